@@ -0,0 +1,336 @@
+// 集群负载测试
+//
+// 在进程内启动若干个集群节点，每个节点一个事件循环线程，与独立部署时一样。
+// 客户端连接按轮询分布到各节点的同一个房间，由其中一个客户端按固定间隔发送剪贴板消息，
+// 统计每条消息从发出到房间内所有连接都收到的耗时和总投递速率，
+// 依次在不同连接数下运行，观察扇出和节点间转发随连接数的变化。
+//
+// 用法: cluster_load [节点数] [每轮消息数] [连接数...]
+// 默认2个节点、每轮200条消息，连接数为100 500 1000 2000。
+// 进程需要能打开两倍于连接数的文件描述符。
+#include "cluster.h"
+#include "server.h"
+#include "server_config.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using bench_clock = std::chrono::steady_clock;
+
+    const unsigned short BASE_PORT = 19100;
+    const char *ROOM_TARGET = "/load";
+    const char *CLUSTER_SECRET = "cluster-load-secret";
+    // 消息体长度，小于一个分片，走控制通道
+    const size_t PAYLOAD_BYTES = 256;
+    // 两条消息的发送间隔
+    const auto SEND_INTERVAL = std::chrono::milliseconds(10);
+    // 同时进行的连接数，避免超过监听队列
+    const size_t CONNECT_BATCH = 100;
+
+    // 一个集群节点
+    struct node
+    {
+        server_config config;
+        net::io_context ioc;
+        session_manager manager;
+        std::unique_ptr<cluster_node> cluster;
+        std::unique_ptr<clipboard_server> server;
+        std::thread thread;
+    };
+
+    // 一轮测试的结果
+    struct round_stats
+    {
+        std::vector<double> completion_ms;
+        size_t deliveries = 0;
+        double seconds = 0;
+        size_t incomplete = 0;
+    };
+
+    // 房间内的一个客户端连接
+    class load_client : public std::enable_shared_from_this<load_client>
+    {
+    public:
+        load_client(net::io_context &ioc, unsigned short port, std::vector<size_t> &received,
+                    std::vector<bench_clock::time_point> &last_arrival)
+            : ws_(ioc), resolver_(ioc), port_(port), received_(received), last_arrival_(last_arrival)
+        {
+        }
+
+        // 连接并开始读取，握手完成或失败后调用done
+        void start(std::function<void(bool)> done)
+        {
+            auto self = shared_from_this();
+            resolver_.async_resolve("127.0.0.1", std::to_string(port_),
+                                    [this, self, done](beast::error_code ec, tcp::resolver::results_type results)
+                                    {
+                                        if (ec)
+                                            return done(false);
+                                        net::async_connect(ws_.next_layer(), results,
+                                                           [this, self, done](beast::error_code ec, const tcp::endpoint &)
+                                                           {
+                                                               if (ec)
+                                                                   return done(false);
+                                                               handshake(done);
+                                                           });
+                                    });
+        }
+
+        // 发送一条剪贴板消息，消息体以编号开头
+        void send(size_t index)
+        {
+            auto message = std::make_shared<std::string>("P2PB/1\nmime: text/plain\ntype: clip\n\n");
+            *message += std::to_string(index) + " ";
+            message->resize(message->size() + PAYLOAD_BYTES - std::to_string(index).size() - 1, 'x');
+            ws_.async_write(net::buffer(*message), [message](beast::error_code, std::size_t) {});
+        }
+
+        void close()
+        {
+            beast::error_code ignored;
+            ws_.next_layer().close(ignored);
+        }
+
+    private:
+        void handshake(std::function<void(bool)> done)
+        {
+            auto self = shared_from_this();
+            ws_.async_handshake("127.0.0.1:" + std::to_string(port_), ROOM_TARGET,
+                                [this, self, done](beast::error_code ec)
+                                {
+                                    done(!ec);
+                                    if (!ec)
+                                        do_read();
+                                });
+        }
+
+        // 记录收到的剪贴板消息，忽略格式通知等其他消息
+        void do_read()
+        {
+            auto self = shared_from_this();
+            ws_.async_read(buffer_,
+                           [this, self](beast::error_code ec, std::size_t)
+                           {
+                               if (ec)
+                                   return;
+                               std::string message = beast::buffers_to_string(buffer_.data());
+                               buffer_.consume(buffer_.size());
+                               size_t body = message.find("\n\n");
+                               if (body != std::string::npos && message.find("\ntype: clip\n") < body)
+                               {
+                                   size_t index = std::strtoull(message.c_str() + body + 2, nullptr, 10);
+                                   if (index < received_.size())
+                                   {
+                                       ++received_[index];
+                                       last_arrival_[index] = bench_clock::now();
+                                   }
+                               }
+                               do_read();
+                           });
+        }
+
+        ws_stream ws_;
+        tcp::resolver resolver_;
+        unsigned short port_;
+        beast::flat_buffer buffer_;
+        std::vector<size_t> &received_;
+        std::vector<bench_clock::time_point> &last_arrival_;
+    };
+
+    // 启动节点，节点之间两两互为对端
+    std::vector<std::unique_ptr<node>> start_cluster(size_t count)
+    {
+        std::vector<std::unique_ptr<node>> nodes;
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto n = std::make_unique<node>();
+            n->config.port = static_cast<unsigned short>(BASE_PORT + i);
+            n->config.node_id = "load-" + std::to_string(i);
+            n->config.cluster_token = CLUSTER_SECRET;
+            n->config.peer_retry_ms = 100;
+            for (size_t j = 0; j < count; ++j)
+            {
+                if (j != i)
+                    n->config.peers.push_back(peer_address{"127.0.0.1", std::to_string(BASE_PORT + j)});
+            }
+            if (count > 1)
+                n->cluster = std::make_unique<cluster_node>(n->ioc, n->config, n->manager);
+            n->server = std::make_unique<clipboard_server>(n->ioc, tcp::endpoint{tcp::v4(), n->config.port},
+                                                           n->manager, n->cluster.get());
+            nodes.push_back(std::move(n));
+        }
+        for (auto &n : nodes)
+        {
+            if (n->cluster)
+                n->cluster->start();
+            node *raw = n.get();
+            n->thread = std::thread([raw]()
+                                    { raw->ioc.run(); });
+        }
+        return nodes;
+    }
+
+    // 在给定连接数下运行一轮
+    round_stats run_round(size_t node_count, size_t connections, size_t messages)
+    {
+        net::io_context ioc;
+        std::vector<size_t> received(messages, 0);
+        std::vector<bench_clock::time_point> last_arrival(messages);
+        std::vector<bench_clock::time_point> sent_at(messages);
+        std::vector<std::shared_ptr<load_client>> clients;
+        round_stats stats;
+
+        // 分批建立连接
+        size_t next = 0;
+        std::atomic<size_t> connected{0};
+        std::atomic<size_t> failed{0};
+        std::function<void()> connect_more = [&]()
+        {
+            size_t in_flight = next - connected - failed;
+            while (next < connections && in_flight < CONNECT_BATCH)
+            {
+                auto port = static_cast<unsigned short>(BASE_PORT + next % node_count);
+                auto client = std::make_shared<load_client>(ioc, port, received, last_arrival);
+                clients.push_back(client);
+                client->start([&](bool ok)
+                              {
+                                  ok ? ++connected : ++failed;
+                                  connect_more();
+                              });
+                ++next;
+                ++in_flight;
+            }
+        };
+        connect_more();
+
+        // 全部连接后等待对端交换房间兴趣，再按间隔发送
+        net::steady_timer timer(ioc);
+        size_t sent = 0;
+        bench_clock::time_point started;
+        std::function<void()> send_next = [&]()
+        {
+            if (sent == messages)
+                return;
+            sent_at[sent] = bench_clock::now();
+            clients.front()->send(sent);
+            ++sent;
+            timer.expires_after(SEND_INTERVAL);
+            timer.async_wait([&](beast::error_code ec)
+                             {
+                                 if (!ec)
+                                     send_next();
+                             });
+        };
+
+        std::thread runner([&]()
+                           { ioc.run(); });
+        auto deadline = bench_clock::now() + std::chrono::seconds(60);
+        while (connected + failed < connections && bench_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        if (failed > 0 || connected < connections)
+        {
+            std::fprintf(stderr, "只建立了 %zu/%zu 个连接\n", connected.load(), connections);
+            connections = connected;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+        started = bench_clock::now();
+        net::post(ioc, send_next);
+
+        // 等待所有消息送达所有连接
+        deadline = bench_clock::now() + SEND_INTERVAL * messages + std::chrono::seconds(30);
+        auto all_delivered = [&]()
+        {
+            return std::all_of(received.begin(), received.end(), [&](size_t n)
+                               { return n >= connections; });
+        };
+        while (bench_clock::now() < deadline)
+        {
+            std::atomic<bool> done{false};
+            net::post(ioc, [&]()
+                      { done = all_delivered(); });
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            if (done)
+                break;
+        }
+
+        net::post(ioc, [&]()
+                  {
+                      stats.seconds = std::chrono::duration<double>(bench_clock::now() - started).count();
+                      for (size_t i = 0; i < messages; ++i)
+                      {
+                          stats.deliveries += received[i];
+                          if (received[i] < connections)
+                              ++stats.incomplete;
+                          else
+                              stats.completion_ms.push_back(
+                                  std::chrono::duration<double, std::milli>(last_arrival[i] - sent_at[i]).count());
+                      }
+                      for (auto &client : clients)
+                          client->close();
+                  });
+        runner.join();
+        std::sort(stats.completion_ms.begin(), stats.completion_ms.end());
+        return stats;
+    }
+
+    double percentile(const std::vector<double> &sorted, double p)
+    {
+        if (sorted.empty())
+            return 0;
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t node_count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2;
+    size_t messages = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200;
+    std::vector<size_t> rounds;
+    for (int i = 3; i < argc; ++i)
+        rounds.push_back(std::strtoul(argv[i], nullptr, 10));
+    if (rounds.empty())
+        rounds = {100, 500, 1000, 2000};
+    if (node_count == 0 || messages == 0)
+    {
+        std::fprintf(stderr, "用法: cluster_load [节点数] [每轮消息数] [连接数...]\n");
+        return 1;
+    }
+
+    // 服务器每次连接和广播都会输出日志，测试期间关闭
+    std::cout.rdbuf(nullptr);
+    auto nodes = start_cluster(node_count);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    std::printf("%zu个节点，每轮%zu条%zu字节的消息，间隔%lld毫秒\n", node_count, messages, PAYLOAD_BYTES,
+                static_cast<long long>(SEND_INTERVAL.count()));
+    std::printf("%8s %10s %10s %10s %14s %8s\n", "连接数", "p50(ms)", "p99(ms)", "max(ms)", "投递/秒", "未送达");
+    bool complete = true;
+    for (size_t connections : rounds)
+    {
+        round_stats stats = run_round(node_count, connections, messages);
+        std::printf("%8zu %10.2f %10.2f %10.2f %14.0f %8zu\n", connections, percentile(stats.completion_ms, 0.5),
+                    percentile(stats.completion_ms, 0.99),
+                    stats.completion_ms.empty() ? 0.0 : stats.completion_ms.back(),
+                    stats.deliveries / stats.seconds, stats.incomplete);
+        std::fflush(stdout);
+        complete = complete && stats.incomplete == 0;
+        // 等服务器清理上一轮的会话
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+
+    for (auto &n : nodes)
+    {
+        n->ioc.stop();
+        n->thread.join();
+    }
+    return complete ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+// 全文搜索延迟测试
+//
+// 向一个房间的索引写入大量由随机词组成的文本条目(默认100万条)，
+// 统计add()在调用线程上的耗时、后台建索引的总耗时，
+// 然后对常见词、少见词、多个词、不存在的词和过短的查询分别重复查询，输出延迟分位数。
+//
+// 用法: search_latency [条目数] [每种查询的次数]
+#include "search_index.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using bench_clock = std::chrono::steady_clock;
+
+    const char *ROOM = "bench";
+    // 词表大小，词频按编号近似齐夫分布
+    const size_t VOCABULARY = 50000;
+    // 每条文本的词数范围
+    const size_t MIN_WORDS = 5;
+    const size_t MAX_WORDS = 40;
+
+    // 生成3到10个小写字母的词
+    std::vector<std::string> make_vocabulary(std::mt19937_64 &rng)
+    {
+        std::uniform_int_distribution<int> length(3, 10);
+        std::uniform_int_distribution<int> letter('a', 'z');
+        std::vector<std::string> words(VOCABULARY);
+        for (auto &word : words)
+        {
+            int n = length(rng);
+            for (int i = 0; i < n; ++i)
+                word += static_cast<char>(letter(rng));
+        }
+        return words;
+    }
+
+    // 在后台线程的队列中排入一个空查询，返回时之前提交的任务都已完成
+    void drain(search_index &index)
+    {
+        std::promise<void> done;
+        index.query(ROOM, "", 1, [&done](std::vector<search_hit>)
+                    { done.set_value(); });
+        done.get_future().wait();
+    }
+
+    // 执行一次查询，返回耗时(毫秒)和结果数
+    std::pair<double, size_t> timed_query(search_index &index, const std::string &query)
+    {
+        std::promise<size_t> result;
+        auto started = bench_clock::now();
+        index.query(ROOM, query, 20, [&result](std::vector<search_hit> hits)
+                    { result.set_value(hits.size()); });
+        size_t count = result.get_future().get();
+        return {std::chrono::duration<double, std::milli>(bench_clock::now() - started).count(), count};
+    }
+
+    double percentile(const std::vector<double> &sorted, double p)
+    {
+        if (sorted.empty())
+            return 0;
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t entries = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    size_t repeats = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200;
+    if (entries == 0 || repeats == 0)
+    {
+        std::fprintf(stderr, "用法: search_latency [条目数] [每种查询的次数]\n");
+        return 1;
+    }
+
+    std::mt19937_64 rng(42);
+    std::vector<std::string> words = make_vocabulary(rng);
+    // 编号越小的词越常见
+    std::vector<double> weights(VOCABULARY);
+    for (size_t i = 0; i < VOCABULARY; ++i)
+        weights[i] = 1.0 / static_cast<double>(i + 1);
+    std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+    std::uniform_int_distribution<size_t> word_count(MIN_WORDS, MAX_WORDS);
+
+    search_index index(entries);
+    double add_ms = 0;
+    size_t bytes = 0;
+    auto started = bench_clock::now();
+    for (size_t i = 0; i < entries; ++i)
+    {
+        auto text = std::make_shared<std::string>();
+        size_t n = word_count(rng);
+        for (size_t w = 0; w < n; ++w)
+        {
+            if (w > 0)
+                *text += ' ';
+            *text += words[pick(rng)];
+        }
+        bytes += text->size();
+        auto before = bench_clock::now();
+        index.add(ROOM, i + 1, std::move(text));
+        add_ms += std::chrono::duration<double, std::milli>(bench_clock::now() - before).count();
+    }
+    drain(index);
+    double build_s = std::chrono::duration<double>(bench_clock::now() - started).count();
+    std::printf("%zu条，共%.1fMB，add()平均%.2f微秒，写入并建完索引%.1f秒\n", entries, bytes / 1e6,
+                add_ms * 1000 / entries, build_s);
+
+    struct query_case
+    {
+        const char *name;
+        std::string query;
+    };
+    std::vector<query_case> cases = {
+        {"常见词", words[0]},
+        {"中等词", words[100]},
+        {"少见词", words[VOCABULARY - 1]},
+        {"两个词", words[1] + " " + words[50]},
+        {"不存在", "qqqzzzqqq"},
+        {"过短", "ab"},
+    };
+
+    std::printf("%-10s %8s %10s %10s %10s\n", "查询", "结果数", "p50(ms)", "p99(ms)", "max(ms)");
+    for (const auto &c : cases)
+    {
+        std::vector<double> latencies;
+        size_t hits = 0;
+        for (size_t i = 0; i < repeats; ++i)
+        {
+            auto result = timed_query(index, c.query);
+            latencies.push_back(result.first);
+            hits = result.second;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        std::printf("%-10s %8zu %10.3f %10.3f %10.3f\n", c.name, hits, percentile(latencies, 0.5),
+                    percentile(latencies, 0.99), latencies.back());
+    }
+    return 0;
+}
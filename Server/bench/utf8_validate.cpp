@@ -0,0 +1,97 @@
+// UTF-8校验吞吐量测试
+//
+// 对纯ASCII、中英混合和以四字节字符为主的文本，分别比较运行时选择的实现
+// 和逐字符的标量实现每秒能校验的字节数，并确认两者对有效和无效数据的结论一致。
+//
+// 用法: utf8_validate [文本字节数] [重复次数]
+#include "utf8_validator.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using bench_clock = std::chrono::steady_clock;
+
+    // 从若干个字符中随机拼出不短于size字节的文本
+    std::string make_text(const std::vector<std::string> &alphabet, size_t size, std::mt19937 &rng)
+    {
+        std::uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+        std::string text;
+        while (text.size() < size)
+            text += alphabet[pick(rng)];
+        return text;
+    }
+
+    // 重复校验，返回每秒校验的字节数(GB/s)
+    double throughput(bool (*validate)(const char *, size_t), const std::string &text, size_t repeats)
+    {
+        size_t valid = 0;
+        auto started = bench_clock::now();
+        for (size_t i = 0; i < repeats; ++i)
+            valid += validate(text.data(), text.size());
+        double seconds = std::chrono::duration<double>(bench_clock::now() - started).count();
+        if (valid != repeats)
+            std::fprintf(stderr, "有效文本被判为无效\n");
+        return static_cast<double>(text.size()) * repeats / seconds / 1e9;
+    }
+
+    bool validate_selected(const char *data, size_t size)
+    {
+        return is_valid_utf8(data, size);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t size = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1024 * 1024;
+    size_t repeats = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200;
+    if (size == 0 || repeats == 0)
+    {
+        std::fprintf(stderr, "用法: utf8_validate [文本字节数] [重复次数]\n");
+        return 1;
+    }
+
+    std::mt19937 rng(7);
+    struct text_case
+    {
+        const char *name;
+        std::string text;
+    };
+    std::vector<text_case> cases = {
+        {"ASCII", make_text({"a", "b", "c", " ", "\n", "0", "Z"}, size, rng)},
+        {"中英混合", make_text({"a", "b", " ", "\xe4\xb8\xad", "\xe6\x96\x87", "\xc3\xa9"}, size, rng)},
+        {"四字节", make_text({"\xf0\x9f\x98\x80", "\xf0\x9f\x93\x8b", "a"}, size, rng)},
+    };
+
+    // 两个实现对无效数据的结论必须一致：截断、过长编码、代理项、超出U+10FFFF和单独的续字节
+    const char *invalid[] = {"\xe4\xb8", "\xc0\xaf", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\x80"};
+    bool consistent = true;
+    for (const auto &c : cases)
+    {
+        for (const char *bad : invalid)
+        {
+            std::string text = c.text;
+            text.insert(text.size() / 2, bad);
+            consistent = consistent && !is_valid_utf8(text) && !is_valid_utf8_scalar(text.data(), text.size());
+        }
+    }
+
+    std::printf("%zu字节，重复%zu次，运行时选择的实现: %s\n", size, repeats, utf8_validator_name());
+    std::printf("%-10s %12s %12s %8s\n", "文本", "选择(GB/s)", "标量(GB/s)", "加速");
+    for (const auto &c : cases)
+    {
+        double selected = throughput(validate_selected, c.text, repeats);
+        double scalar = throughput(is_valid_utf8_scalar, c.text, repeats);
+        std::printf("%-10s %12.2f %12.2f %7.1fx\n", c.name, selected, scalar, selected / scalar);
+    }
+    if (!consistent)
+    {
+        std::fprintf(stderr, "两个实现对无效数据的结论不一致\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,498 @@
+#include "cluster.h"
+#include "message.h"
+#include <chrono>
+#include <iostream>
+
+namespace
+{
+    // 去重窗口大小
+    const size_t SEEN_WINDOW = 4096;
+
+    // 把多条消息打包为一个批量帧：每条消息前加 "<长度>\n"
+    void append_batch_entry(std::string &body, const std::string &message)
+    {
+        body += std::to_string(message.size());
+        body += '\n';
+        body += message;
+    }
+
+    // 拆分批量帧，格式错误时返回false
+    bool split_batch(const std::string &body, std::vector<std::string> &out)
+    {
+        size_t pos = 0;
+        while (pos < body.size())
+        {
+            size_t eol = body.find('\n', pos);
+            if (eol == std::string::npos)
+                return false;
+            size_t len = 0;
+            try
+            {
+                len = std::stoul(body.substr(pos, eol - pos));
+            }
+            catch (const std::exception &)
+            {
+                return false;
+            }
+            if (eol + 1 + len > body.size())
+                return false;
+            out.push_back(body.substr(eol + 1, len));
+            pos = eol + 1 + len;
+        }
+        return true;
+    }
+
+    // 按行拆分房间列表
+    std::vector<std::string> split_lines(const std::string &body)
+    {
+        std::vector<std::string> lines;
+        size_t pos = 0;
+        while (pos < body.size())
+        {
+            size_t eol = body.find('\n', pos);
+            if (eol == std::string::npos)
+                eol = body.size();
+            if (eol > pos)
+                lines.push_back(body.substr(pos, eol - pos));
+            pos = eol + 1;
+        }
+        return lines;
+    }
+}
+
+// 出站链路构造函数
+peer_link::peer_link(net::io_context &ioc, const peer_address &address, const server_config &config,
+                     const std::string &node_id)
+    : ioc_(ioc), address_(address), config_(config), node_id_(node_id),
+      resolver_(ioc), retry_timer_(ioc)
+{
+}
+
+// 开始连接对端
+void peer_link::start()
+{
+    do_connect();
+}
+
+// 解析并连接对端地址
+void peer_link::do_connect()
+{
+    auto self = shared_from_this();
+    resolver_.async_resolve(
+        address_.host, address_.port,
+        [this, self](beast::error_code ec, tcp::resolver::results_type results)
+        {
+            if (ec)
+            {
+                schedule_retry();
+                return;
+            }
+            ws_ = std::make_unique<ws_stream>(ioc_);
+            // 握手请求带上集群共享密钥
+            ws_->set_option(websocket::stream_base::decorator(
+                [this](websocket::request_type &req)
+                { req.set(http::field::authorization, CLUSTER_AUTH_SCHEME + config_.cluster_token); }));
+            net::async_connect(
+                ws_->next_layer(), results,
+                [this, self](beast::error_code ec, const tcp::endpoint &)
+                {
+                    if (ec)
+                    {
+                        schedule_retry();
+                        return;
+                    }
+                    ws_->async_handshake(
+                        address_.host + ":" + address_.port, CLUSTER_TARGET,
+                        [this, self](beast::error_code ec)
+                        {
+                            if (ec)
+                            {
+                                schedule_retry();
+                                return;
+                            }
+                            std::cout << "已连接到对端节点 " << address_.host << ":" << address_.port << "\n";
+                            connected_ = true;
+                            do_read();
+                        });
+                });
+        });
+}
+
+// 连接失败或断开后延迟重连
+void peer_link::schedule_retry()
+{
+    if (connected_)
+        std::cerr << "与对端节点 " << address_.host << ":" << address_.port << " 的连接断开\n";
+
+    // 断开期间对端的兴趣未知，丢弃排队的消息；剪贴板只关心最新值
+    connected_ = false;
+    writing_ = false;
+    queue_.clear();
+    interest_.clear();
+    peer_id_.clear();
+    ws_.reset();
+    ++generation_;
+
+    auto self = shared_from_this();
+    retry_timer_.expires_after(std::chrono::milliseconds(config_.peer_retry_ms));
+    retry_timer_.async_wait(
+        [this, self](beast::error_code ec)
+        {
+            if (!ec)
+                do_connect();
+        });
+}
+
+// 读取对端发回的兴趣更新
+void peer_link::do_read()
+{
+    auto self = shared_from_this();
+    ws_->async_read(read_buffer_,
+                    [this, self](beast::error_code ec, std::size_t)
+                    {
+                        if (ec)
+                        {
+                            schedule_retry();
+                            return;
+                        }
+                        handle_control(beast::buffers_to_string(read_buffer_.data()));
+                        read_buffer_.consume(read_buffer_.size());
+                        do_read();
+                    });
+}
+
+// 处理对端发回的控制消息
+void peer_link::handle_control(const std::string &raw)
+{
+    clip_message msg;
+    if (!clip_message::parse(raw, msg))
+        return;
+
+    std::string type = msg.get("type");
+    if (type == "hello")
+    {
+        peer_id_ = msg.get("node");
+        // 配置错误导致连接到自己时不转发任何消息
+        if (peer_id_ == node_id_)
+            std::cerr << "对端 " << address_.host << ":" << address_.port << " 是本节点自身，忽略\n";
+    }
+    else if (type == "interest" && peer_id_ != node_id_)
+    {
+        std::string op = msg.get("op");
+        if (op == "set")
+            interest_.clear();
+        for (const auto &room : split_lines(msg.body))
+        {
+            if (op == "remove")
+                interest_.erase(room);
+            else
+                interest_.insert(room);
+        }
+    }
+}
+
+// 对端是否有该房间的成员
+bool peer_link::has_interest(const std::string &room) const
+{
+    return connected_ && interest_.count(room) > 0;
+}
+
+// 将消息加入发送队列
+void peer_link::send(std::shared_ptr<const std::string> message)
+{
+    if (!connected_)
+        return;
+    queue_.push_back(std::move(message));
+    if (!writing_)
+        do_flush();
+}
+
+// 将队列中的消息合并写出
+void peer_link::do_flush()
+{
+    if (queue_.empty() || !connected_)
+    {
+        writing_ = false;
+        return;
+    }
+    writing_ = true;
+
+    if (queue_.size() == 1)
+    {
+        // 只有一条消息时直接发送，避免额外的打包开销
+        frame_ = queue_.front();
+        queue_.pop_front();
+    }
+    else
+    {
+        // 合并队列中的消息，直到达到批量上限
+        clip_message batch;
+        batch.set("type", "batch");
+        size_t count = 0;
+        while (!queue_.empty() &&
+               (count == 0 || batch.body.size() + queue_.front()->size() <= config_.peer_batch_bytes))
+        {
+            append_batch_entry(batch.body, *queue_.front());
+            queue_.pop_front();
+            ++count;
+        }
+        batch.set("count", std::to_string(count));
+        frame_ = std::make_shared<const std::string>(batch.serialize());
+    }
+
+    auto self = shared_from_this();
+    uint64_t generation = generation_;
+    ws_->async_write(net::buffer(*frame_),
+                     [this, self, generation](beast::error_code ec, std::size_t)
+                     {
+                         // 链路已重连，忽略旧连接上的写完成
+                         if (generation != generation_)
+                             return;
+                         if (ec)
+                         {
+                             std::cerr << "向对端节点发送失败: " << ec.message() << "\n";
+                             // 关闭连接，等待中的读操作随之失败并触发重连；在此之前不再写入
+                             connected_ = false;
+                             writing_ = false;
+                             beast::error_code ignored;
+                             ws_->next_layer().close(ignored);
+                             return;
+                         }
+                         do_flush();
+                     });
+}
+
+// 入站连接构造函数
+peer_inbound::peer_inbound(std::shared_ptr<ws_stream> ws, cluster_node &owner)
+    : ws_(std::move(ws)), owner_(owner)
+{
+}
+
+// 发送hello和当前兴趣集合，开始读取
+void peer_inbound::start()
+{
+    send(owner_.hello_message());
+    send(owner_.interest_message("set", owner_.manager_.active_rooms()));
+    do_read();
+}
+
+// 发送控制消息给对端
+void peer_inbound::send(std::shared_ptr<const std::string> message)
+{
+    queue_.push_back(std::move(message));
+    if (!writing_)
+        do_write();
+}
+
+void peer_inbound::do_write()
+{
+    if (queue_.empty())
+    {
+        writing_ = false;
+        return;
+    }
+    writing_ = true;
+    auto self = shared_from_this();
+    ws_->async_write(net::buffer(*queue_.front()),
+                     [this, self](beast::error_code ec, std::size_t)
+                     {
+                         if (ec)
+                         {
+                             // 与读取出错相同：关闭连接并注销，之后的消息不再写入断开的流
+                             writing_ = false;
+                             queue_.clear();
+                             beast::error_code ignored;
+                             ws_->next_layer().close(ignored);
+                             owner_.remove_inbound(self);
+                             return;
+                         }
+                         queue_.pop_front();
+                         do_write();
+                     });
+}
+
+void peer_inbound::do_read()
+{
+    auto self = shared_from_this();
+    ws_->async_read(buffer_,
+                    [this, self](beast::error_code ec, std::size_t)
+                    {
+                        if (ec)
+                        {
+                            owner_.remove_inbound(self);
+                            return;
+                        }
+                        owner_.handle_inbound(beast::buffers_to_string(buffer_.data()));
+                        buffer_.consume(buffer_.size());
+                        do_read();
+                    });
+}
+
+// 集群节点构造函数
+cluster_node::cluster_node(net::io_context &ioc, const server_config &config, session_manager &manager)
+    : ioc_(ioc), config_(config), manager_(manager),
+      node_id_(config.node_id.empty() ? "node-" + std::to_string(config.port) : config.node_id)
+{
+    // 序号从启动时间开始，节点重启后不会与对端去重窗口中的旧序号冲突
+    next_id_ = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                         std::chrono::system_clock::now().time_since_epoch())
+                                         .count());
+}
+
+// 连接所有对端并开始监听房间变化
+void cluster_node::start()
+{
+    manager_.set_room_listener([this](const std::string &room, bool active)
+                               { on_room_change(room, active); });
+
+    for (const auto &peer : config_.peers)
+    {
+        auto link = std::make_shared<peer_link>(ioc_, peer, config_, node_id_);
+        links_.push_back(link);
+        link->start();
+    }
+    std::cout << "集群节点 " << node_id_ << " 启动，对端数: " << links_.size() << "\n";
+}
+
+// 转发本地客户端发出的消息
+void cluster_node::relay(const std::string &room, const std::string &message)
+{
+    std::shared_ptr<const std::string> envelope;
+    for (auto &link : links_)
+    {
+        if (!link->has_interest(room))
+            continue;
+        // 只在至少有一个对端需要时才构造信封
+        if (!envelope)
+        {
+            clip_message msg;
+            msg.set("type", "relay");
+            msg.set("origin", node_id_);
+            msg.set("id", std::to_string(next_id_++));
+            msg.set("room", room);
+            msg.body = message;
+            envelope = std::make_shared<const std::string>(msg.serialize());
+        }
+        link->send(envelope);
+    }
+}
+
+// 对端连接的握手请求是否出示了正确的共享密钥
+//
+// 未配置密钥时拒绝所有对端；逐字节比较全部内容，耗时不随匹配的前缀长度变化
+bool cluster_node::authorized(const http::request<http::string_body> &req) const
+{
+    if (config_.cluster_token.empty())
+        return false;
+    std::string expected = CLUSTER_AUTH_SCHEME + config_.cluster_token;
+    beast::string_view presented = req[http::field::authorization];
+    if (presented.size() != expected.size())
+        return false;
+    unsigned char diff = 0;
+    for (size_t i = 0; i < expected.size(); ++i)
+        diff |= static_cast<unsigned char>(presented[i] ^ expected[i]);
+    return diff == 0;
+}
+
+// 接管一个已完成握手的对端入站连接
+void cluster_node::accept_peer(std::shared_ptr<ws_stream> ws)
+{
+    auto peer = std::make_shared<peer_inbound>(std::move(ws), *this);
+    inbound_.insert(peer);
+    peer->start();
+}
+
+// 入站连接断开
+void cluster_node::remove_inbound(const std::shared_ptr<peer_inbound> &peer)
+{
+    inbound_.erase(peer);
+}
+
+// 本地房间成员变化时通知所有入站对端
+void cluster_node::on_room_change(const std::string &room, bool active)
+{
+    auto message = interest_message(active ? "add" : "remove", {room});
+    for (auto &peer : inbound_)
+        peer->send(message);
+}
+
+// 处理入站对端发来的消息
+void cluster_node::handle_inbound(const std::string &raw)
+{
+    clip_message msg;
+    if (!clip_message::parse(raw, msg))
+    {
+        std::cerr << "收到格式错误的集群消息\n";
+        return;
+    }
+
+    std::string type = msg.get("type");
+    if (type == "batch")
+    {
+        std::vector<std::string> entries;
+        if (!split_batch(msg.body, entries))
+        {
+            std::cerr << "收到格式错误的批量帧\n";
+            return;
+        }
+        for (const auto &entry : entries)
+            handle_inbound(entry);
+        return;
+    }
+
+    if (type != "relay")
+        return;
+
+    std::string origin = msg.get("origin");
+    // 丢弃自己发出的消息和重复消息
+    if (origin == node_id_ || !remember(origin, msg.get("id")))
+        return;
+
+    if (!manager_.relayable(msg.body))
+    {
+        std::cerr << "丢弃对端转发的非剪贴板内容或无效UTF-8消息\n";
+        return;
+    }
+
+    // 只投递给本地会话，不再转发给其他节点
+    manager_.broadcast(msg.get("room", "default"), msg.body);
+}
+
+// 记录已收到的消息
+bool cluster_node::remember(const std::string &origin, const std::string &id)
+{
+    std::string key = origin + "#" + id;
+    if (!seen_.insert(key).second)
+        return false;
+    seen_order_.push_back(key);
+    if (seen_order_.size() > SEEN_WINDOW)
+    {
+        seen_.erase(seen_order_.front());
+        seen_order_.pop_front();
+    }
+    return true;
+}
+
+// 构造hello消息
+std::shared_ptr<const std::string> cluster_node::hello_message() const
+{
+    clip_message msg;
+    msg.set("type", "hello");
+    msg.set("node", node_id_);
+    return std::make_shared<const std::string>(msg.serialize());
+}
+
+// 构造兴趣更新消息
+std::shared_ptr<const std::string> cluster_node::interest_message(const std::string &op,
+                                                                  const std::vector<std::string> &rooms) const
+{
+    clip_message msg;
+    msg.set("type", "interest");
+    msg.set("op", op);
+    for (const auto &room : rooms)
+    {
+        msg.body += room;
+        msg.body += '\n';
+    }
+    return std::make_shared<const std::string>(msg.serialize());
+}
@@ -0,0 +1,149 @@
+#ifndef CLIPBOARD_CLUSTER_H
+#define CLIPBOARD_CLUSTER_H
+
+#include "server.h"
+#include "server_config.h"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// 对端节点连接时使用的握手目标，普通客户端的目标是房间名
+#define CLUSTER_TARGET "/_cluster"
+// 对端在握手请求的Authorization头部中以 "Bearer <cluster_token>" 出示共享密钥
+#define CLUSTER_AUTH_SCHEME "Bearer "
+
+class cluster_node;
+
+// 到对端节点的出站链路
+//
+// 每个节点主动连接配置中的所有对端，并只通过出站链路转发本节点客户端发出的消息。
+// 对端通过同一连接反向告知它有成员的房间(interest)，只有对端感兴趣的房间才会被转发。
+// 链路忙时到达的消息在队列中累积，下一次写入时合并为一个批量帧发送。
+class peer_link : public std::enable_shared_from_this<peer_link>
+{
+public:
+    peer_link(net::io_context &ioc, const peer_address &address, const server_config &config,
+              const std::string &node_id);
+
+    // 开始连接对端，断开后自动重连
+    void start();
+    // 将消息加入发送队列，链路空闲时批量发送
+    void send(std::shared_ptr<const std::string> message);
+    // 对端是否有该房间的成员
+    bool has_interest(const std::string &room) const;
+
+private:
+    // 解析并连接对端地址
+    void do_connect();
+    // 连接失败或断开后延迟重连
+    void schedule_retry();
+    // 读取对端发回的兴趣更新
+    void do_read();
+    // 处理对端发回的控制消息
+    void handle_control(const std::string &raw);
+    // 将队列中的消息合并写出
+    void do_flush();
+
+    net::io_context &ioc_;
+    peer_address address_;
+    const server_config &config_;
+    const std::string &node_id_;
+    tcp::resolver resolver_;
+    net::steady_timer retry_timer_;
+    std::unique_ptr<ws_stream> ws_;
+    beast::flat_buffer read_buffer_;
+    // 等待发送的消息
+    std::deque<std::shared_ptr<const std::string>> queue_;
+    // 正在发送的帧，写操作完成前必须保持有效
+    std::shared_ptr<const std::string> frame_;
+    // 连接代数，每次断开后递增，用于忽略旧连接上的回调
+    uint64_t generation_ = 0;
+    bool connected_ = false;
+    bool writing_ = false;
+    // 对端节点标识，由对端的hello消息告知
+    std::string peer_id_;
+    // 对端有成员的房间
+    std::unordered_set<std::string> interest_;
+};
+
+// 来自对端节点的入站连接
+//
+// 接收对端转发的消息并投递给本地会话，同时把本节点的房间兴趣发送给对端。
+class peer_inbound : public std::enable_shared_from_this<peer_inbound>
+{
+public:
+    peer_inbound(std::shared_ptr<ws_stream> ws, cluster_node &owner);
+
+    // 发送hello和当前兴趣集合，开始读取
+    void start();
+    // 发送控制消息给对端
+    void send(std::shared_ptr<const std::string> message);
+
+private:
+    void do_read();
+    void do_write();
+
+    std::shared_ptr<ws_stream> ws_;
+    cluster_node &owner_;
+    beast::flat_buffer buffer_;
+    std::deque<std::shared_ptr<const std::string>> queue_;
+    bool writing_ = false;
+};
+
+// 集群节点，负责节点间的消息中继
+//
+// 防环策略：从对端收到的消息只投递给本地会话，不再转发给其他节点(水平分割)；
+// 此外每条转发消息带有来源节点和序号，重复收到的消息会被丢弃。
+class cluster_node
+{
+public:
+    cluster_node(net::io_context &ioc, const server_config &config, session_manager &manager);
+
+    // 连接所有对端并开始监听房间变化
+    void start();
+    // 转发本地客户端发出的消息给有该房间成员的对端
+    void relay(const std::string &room, const std::string &message);
+    // 对端连接的握手请求是否出示了正确的共享密钥
+    bool authorized(const http::request<http::string_body> &req) const;
+    // 接管一个已完成握手的对端入站连接
+    void accept_peer(std::shared_ptr<ws_stream> ws);
+    // 本节点标识
+    const std::string &node_id() const { return node_id_; }
+
+private:
+    friend class peer_inbound;
+
+    // 本地房间成员变化时通知所有入站对端
+    void on_room_change(const std::string &room, bool active);
+    // 处理入站对端发来的消息
+    void handle_inbound(const std::string &raw);
+    // 记录已收到的消息，重复时返回false
+    bool remember(const std::string &origin, const std::string &id);
+    // 构造hello消息
+    std::shared_ptr<const std::string> hello_message() const;
+    // 构造兴趣更新消息
+    std::shared_ptr<const std::string> interest_message(const std::string &op,
+                                                        const std::vector<std::string> &rooms) const;
+    // 入站连接断开
+    void remove_inbound(const std::shared_ptr<peer_inbound> &peer);
+
+    net::io_context &ioc_;
+    const server_config &config_;
+    session_manager &manager_;
+    std::string node_id_;
+    // 本节点转发消息的递增序号
+    uint64_t next_id_ = 0;
+    // 出站链路
+    std::vector<std::shared_ptr<peer_link>> links_;
+    // 入站连接
+    std::set<std::shared_ptr<peer_inbound>> inbound_;
+    // 最近收到的消息，用于去重
+    std::deque<std::string> seen_order_;
+    std::unordered_set<std::string> seen_;
+};
+
+#endif
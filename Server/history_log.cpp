@@ -0,0 +1,640 @@
+#include "history_log.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_set>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // 记录头魔数 "P2PR"
+    const uint32_t RECORD_MAGIC = 0x52503250;
+    // 检查点魔数 "P2PC"
+    const uint32_t CHECKPOINT_MAGIC = 0x43503250;
+
+    // 每写入这么多条记录更新一次检查点，重启时最多补读这么多条索引尾部(另加轮转间的记录)
+    const size_t CHECKPOINT_RECORDS = 4096;
+    // 向前扫描索引尾部时每次读取的索引项数
+    const size_t TAIL_SCAN_BLOCK = 4096;
+    // 空闲时按时间清理的检查间隔
+    const auto RETENTION_CHECK_INTERVAL = std::chrono::minutes(1);
+
+    // 检查点头部
+    struct checkpoint_header
+    {
+        uint32_t magic;
+        uint32_t count;
+        uint64_t covered_seq;
+    };
+
+    // 检查点中的一个房间，之后紧跟房间名
+    struct checkpoint_entry
+    {
+        uint64_t seq;
+        uint64_t base_seq;
+        uint32_t position;
+        uint32_t room_len;
+    };
+
+    std::string checkpoint_path(const std::string &dir)
+    {
+        return (fs::path(dir) / "rooms.ckpt").string();
+    }
+
+    // 稳定的房间名哈希(FNV-1a)，写入索引文件，不能使用std::hash
+    uint32_t room_hash(const std::string &room)
+    {
+        uint32_t h = 2166136261u;
+        for (unsigned char c : room)
+        {
+            h ^= c;
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    // 记录在段内占用的字节数，按8字节对齐
+    size_t record_size(size_t room_len, size_t payload_len, size_t header_len)
+    {
+        return (header_len + room_len + payload_len + 7) & ~size_t(7);
+    }
+
+    // 段文件名，以起始序号命名并补零以便按名称排序
+    std::string segment_name(uint64_t base_seq)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%020llu", static_cast<unsigned long long>(base_seq));
+        return name;
+    }
+
+    uint64_t now_ms()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                         std::chrono::system_clock::now().time_since_epoch())
+                                         .count());
+    }
+
+    // 读取文件的指定区间，读取不完整时返回false
+    bool pread_all(int fd, void *buf, size_t len, off_t offset)
+    {
+        char *p = static_cast<char *>(buf);
+        while (len > 0)
+        {
+            ssize_t n = ::pread(fd, p, len, offset);
+            if (n <= 0)
+                return false;
+            p += n;
+            len -= static_cast<size_t>(n);
+            offset += n;
+        }
+        return true;
+    }
+
+    void write_all(int fd, const void *buf, size_t len)
+    {
+        const char *p = static_cast<const char *>(buf);
+        while (len > 0)
+        {
+            ssize_t n = ::write(fd, p, len);
+            if (n < 0)
+                throw std::runtime_error(std::string("写入索引失败: ") + std::strerror(errno));
+            p += n;
+            len -= static_cast<size_t>(n);
+        }
+    }
+}
+
+// 打开或创建日志目录并恢复状态
+history_log::history_log(const server_config &config)
+    : config_(config)
+{
+    recover();
+    writer_ = std::thread([this]
+                          { writer_loop(); });
+}
+
+// 刷出剩余消息并停止后台线程
+history_log::~history_log()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_one();
+    if (writer_.joinable())
+        writer_.join();
+    try
+    {
+        close_active();
+        write_checkpoint();
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "关闭历史日志失败: " << e.what() << "\n";
+    }
+}
+
+// 追加一条消息
+uint64_t history_log::append(const std::string &room, std::shared_ptr<const std::string> message)
+{
+    uint64_t seq;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        seq = next_seq_++;
+        pending_.push_back(pending_record{seq, now_ms(), room, std::move(message)});
+    }
+    cv_.notify_one();
+    return seq;
+}
+
+// 扫描目录并恢复序号和各房间最新消息
+void history_log::recover()
+{
+    fs::create_directories(config_.history_dir);
+
+    std::vector<segment> segments;
+    for (const auto &entry : fs::directory_iterator(config_.history_dir))
+    {
+        if (entry.path().extension() != ".log")
+            continue;
+        // 段文件以起始序号命名，其他文件(例如手工放入的notes.log)不属于日志
+        std::string stem = entry.path().stem().string();
+        segment seg;
+        auto parsed = std::from_chars(stem.data(), stem.data() + stem.size(), seg.base_seq);
+        if (parsed.ec != std::errc() || parsed.ptr != stem.data() + stem.size())
+        {
+            std::cerr << "忽略历史目录中不是日志段的文件: " << entry.path().string() << "\n";
+            continue;
+        }
+        seg.log_path = entry.path().string();
+        seg.index_path = (entry.path().parent_path() / (entry.path().stem().string() + ".idx")).string();
+        segments.push_back(seg);
+    }
+    std::sort(segments.begin(), segments.end(),
+              [](const segment &a, const segment &b)
+              { return a.base_seq < b.base_seq; });
+
+    // 每个段只读取最后一个索引项，确定段的有效大小
+    for (auto &seg : segments)
+    {
+        int fd = ::open(seg.index_path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+            throw std::runtime_error("无法打开索引文件: " + seg.index_path);
+        struct stat st;
+        ::fstat(fd, &st);
+        // 丢弃写了一半的索引项
+        seg.entries = static_cast<size_t>(st.st_size) / sizeof(index_entry);
+        if (seg.entries * sizeof(index_entry) != static_cast<size_t>(st.st_size))
+            ::ftruncate(fd, static_cast<off_t>(seg.entries * sizeof(index_entry)));
+        index_entry last;
+        bool has_last = seg.entries > 0 &&
+                        pread_all(fd, &last, sizeof(last), static_cast<off_t>((seg.entries - 1) * sizeof(last)));
+        ::close(fd);
+        if (seg.entries > 0 && !has_last)
+            throw std::runtime_error("读取索引文件失败: " + seg.index_path);
+
+        if (has_last)
+        {
+            int log_fd = ::open(seg.log_path.c_str(), O_RDONLY);
+            record_header header;
+            if (log_fd < 0 || !pread_all(log_fd, &header, sizeof(header), last.position) ||
+                header.magic != RECORD_MAGIC)
+                throw std::runtime_error("日志段损坏: " + seg.log_path);
+            ::close(log_fd);
+            seg.size = last.position + record_size(header.room_len, header.payload_len, sizeof(header));
+            next_seq_ = last.seq + 1;
+            last_written_seq_ = last.seq;
+            seg.last_ms = header.time_ms;
+            has_records_ = true;
+        }
+    }
+
+    // 检查点之后的记录只在最新的索引尾部；没有检查点(旧版本的目录)时扫描全部索引一次
+    uint64_t covered = 0;
+    bool bounded = load_checkpoint(covered);
+    scan_index_tail(segments, bounded, covered);
+
+    // 每个房间读取它的最新记录；所在的段已被清理时房间没有最新内容
+    std::unordered_map<uint64_t, const segment *> by_base;
+    for (const auto &seg : segments)
+        by_base[seg.base_seq] = &seg;
+    for (auto it = room_tails_.begin(); it != room_tails_.end();)
+    {
+        auto seg = by_base.find(it->second.base_seq);
+        int log_fd = seg == by_base.end() ? -1 : ::open(seg->second->log_path.c_str(), O_RDONLY);
+        record_header header;
+        std::string room;
+        std::string payload;
+        bool ok = log_fd >= 0 && pread_all(log_fd, &header, sizeof(header), it->second.position) &&
+                  header.magic == RECORD_MAGIC && header.seq == it->second.seq;
+        if (ok)
+        {
+            room.resize(header.room_len);
+            payload.resize(header.payload_len);
+            off_t offset = it->second.position + sizeof(header);
+            ok = pread_all(log_fd, &room[0], room.size(), offset) &&
+                 pread_all(log_fd, &payload[0], payload.size(), offset + header.room_len) && room == it->first;
+        }
+        if (log_fd >= 0)
+            ::close(log_fd);
+        if (!ok)
+        {
+            it = room_tails_.erase(it);
+            continue;
+        }
+        last_values_.emplace(room, std::make_shared<const std::string>(std::move(payload)));
+        ++it;
+    }
+
+    if (segments.empty())
+    {
+        segment seg;
+        seg.base_seq = next_seq_;
+        seg.log_path = (fs::path(config_.history_dir) / (segment_name(seg.base_seq) + ".log")).string();
+        seg.index_path = (fs::path(config_.history_dir) / (segment_name(seg.base_seq) + ".idx")).string();
+        segments.push_back(seg);
+    }
+
+    closed_.assign(segments.begin(), segments.end() - 1);
+    open_active(segments.back());
+    apply_retention();
+    // 下次启动只需读取之后的索引尾部
+    if (!bounded || covered != last_written_seq_)
+        write_checkpoint();
+
+    std::cout << "历史日志已打开: " << segments.size() << " 个段，恢复 " << last_values_.size()
+              << " 个房间，下一个序号 " << next_seq_ << "\n";
+}
+
+// 读取检查点中各房间最新记录的位置
+//
+// 格式：头部(魔数、房间数、覆盖到的序号)，之后每个房间一项(序号、段起始序号、段内偏移、房间名长度、房间名)
+bool history_log::load_checkpoint(uint64_t &covered)
+{
+    int fd = ::open(checkpoint_path(config_.history_dir).c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    checkpoint_header header;
+    bool ok = pread_all(fd, &header, sizeof(header), 0) && header.magic == CHECKPOINT_MAGIC;
+    off_t offset = sizeof(header);
+    std::unordered_map<std::string, record_location> tails;
+    for (uint32_t i = 0; ok && i < header.count; ++i)
+    {
+        checkpoint_entry entry;
+        ok = pread_all(fd, &entry, sizeof(entry), offset);
+        std::string room(ok ? entry.room_len : 0, '\0');
+        ok = ok && pread_all(fd, &room[0], room.size(), offset + sizeof(entry));
+        if (ok)
+            tails[room] = record_location{entry.seq, entry.base_seq, entry.position};
+        offset += sizeof(entry) + room.size();
+    }
+    ::close(fd);
+    if (!ok)
+    {
+        std::cerr << "历史检查点损坏，扫描全部索引\n";
+        return false;
+    }
+    room_tails_ = std::move(tails);
+    covered = header.covered_seq;
+    return true;
+}
+
+// 从最新的索引项向前扫描到检查点覆盖的序号，每个房间只记录它遇到的第一条(最新的)记录
+void history_log::scan_index_tail(const std::vector<segment> &segments, bool bounded, uint64_t covered)
+{
+    std::unordered_set<uint32_t> seen;
+    std::vector<index_entry> block;
+    for (size_t i = segments.size(); i-- > 0;)
+    {
+        const segment &seg = segments[i];
+        int index_fd = ::open(seg.index_path.c_str(), O_RDONLY);
+        int log_fd = ::open(seg.log_path.c_str(), O_RDONLY);
+        bool reached = false;
+        // 按块从索引末尾向前读
+        for (size_t end = seg.entries; end > 0 && !reached && index_fd >= 0 && log_fd >= 0;)
+        {
+            size_t begin = end > TAIL_SCAN_BLOCK ? end - TAIL_SCAN_BLOCK : 0;
+            block.resize(end - begin);
+            if (!pread_all(index_fd, block.data(), block.size() * sizeof(index_entry),
+                           static_cast<off_t>(begin * sizeof(index_entry))))
+                break;
+            for (auto it = block.rbegin(); it != block.rend(); ++it)
+            {
+                if (bounded && it->seq <= covered)
+                {
+                    reached = true;
+                    break;
+                }
+                if (seen.count(it->room_hash))
+                    continue;
+                record_header header;
+                if (!pread_all(log_fd, &header, sizeof(header), it->position) || header.magic != RECORD_MAGIC)
+                    continue;
+                std::string room(header.room_len, '\0');
+                if (!pread_all(log_fd, &room[0], room.size(), it->position + sizeof(header)))
+                    continue;
+                // 哈希冲突时同一哈希下可能有多个房间，只保留最新的一个
+                seen.insert(it->room_hash);
+                room_tails_[room] = record_location{it->seq, seg.base_seq, it->position};
+            }
+            end = begin;
+        }
+        if (index_fd >= 0)
+            ::close(index_fd);
+        if (log_fd >= 0)
+            ::close(log_fd);
+        if (reached)
+            return;
+    }
+}
+
+// 写入检查点
+//
+// 先写临时文件并刷盘再改名，崩溃时留下的总是完整的旧检查点或新检查点。
+// 只在索引刷盘之后调用，检查点不会指向未落盘的记录
+void history_log::write_checkpoint()
+{
+    if (!has_records_)
+        return;
+
+    // 所在段已被清理的房间不再写入
+    std::unordered_set<uint64_t> live;
+    for (const auto &seg : closed_)
+        live.insert(seg.base_seq);
+    live.insert(active_.base_seq);
+
+    std::string data(sizeof(checkpoint_header), '\0');
+    checkpoint_header header{CHECKPOINT_MAGIC, 0, last_written_seq_};
+    for (const auto &tail : room_tails_)
+    {
+        if (!live.count(tail.second.base_seq))
+            continue;
+        checkpoint_entry entry{tail.second.seq, tail.second.base_seq, tail.second.position,
+                               static_cast<uint32_t>(tail.first.size())};
+        data.append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+        data += tail.first;
+        ++header.count;
+    }
+    std::memcpy(&data[0], &header, sizeof(header));
+
+    std::string path = checkpoint_path(config_.history_dir);
+    std::string temp = path + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::runtime_error("无法写入历史检查点: " + temp);
+    try
+    {
+        write_all(fd, data.data(), data.size());
+    }
+    catch (...)
+    {
+        ::close(fd);
+        throw;
+    }
+    ::fdatasync(fd);
+    ::close(fd);
+    if (::rename(temp.c_str(), path.c_str()) != 0)
+        throw std::runtime_error("无法替换历史检查点: " + path);
+    since_checkpoint_ = 0;
+}
+
+// 按序遍历日志中的全部记录
+void history_log::scan(const record_visitor &visit)
+{
+    std::vector<segment> segments = closed_;
+    segments.push_back(active_);
+    for (const auto &seg : segments)
+    {
+        int index_fd = ::open(seg.index_path.c_str(), O_RDONLY);
+        int log_fd = ::open(seg.log_path.c_str(), O_RDONLY);
+        if (index_fd >= 0 && log_fd >= 0)
+        {
+            index_entry entry;
+            for (off_t pos = 0; pread_all(index_fd, &entry, sizeof(entry), pos); pos += sizeof(entry))
+            {
+                record_header header;
+                if (!pread_all(log_fd, &header, sizeof(header), entry.position) || header.magic != RECORD_MAGIC)
+                    continue;
+                std::string room(header.room_len, '\0');
+                std::string payload(header.payload_len, '\0');
+                off_t offset = entry.position + sizeof(header);
+                if (!pread_all(log_fd, &room[0], room.size(), offset) ||
+                    !pread_all(log_fd, &payload[0], payload.size(), offset + header.room_len))
+                    continue;
+                visit(header.seq, room, std::make_shared<const std::string>(std::move(payload)));
+            }
+        }
+        if (index_fd >= 0)
+            ::close(index_fd);
+        if (log_fd >= 0)
+            ::close(log_fd);
+    }
+}
+
+// 打开(或创建)活动段用于追加
+void history_log::open_active(segment seg)
+{
+    log_fd_ = ::open(seg.log_path.c_str(), O_RDWR | O_CREAT, 0644);
+    index_fd_ = ::open(seg.index_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (log_fd_ < 0 || index_fd_ < 0)
+        throw std::runtime_error("无法打开日志段: " + seg.log_path);
+
+    // 预分配整个段并一次性映射，追加时只需内存拷贝
+    struct stat st;
+    ::fstat(log_fd_, &st);
+    capacity_ = std::max(config_.history_segment_bytes, static_cast<size_t>(st.st_size));
+    if (::ftruncate(log_fd_, static_cast<off_t>(capacity_)) != 0)
+        throw std::runtime_error("无法预分配日志段: " + seg.log_path);
+    void *map = ::mmap(nullptr, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED, log_fd_, 0);
+    if (map == MAP_FAILED)
+        throw std::runtime_error("无法映射日志段: " + seg.log_path);
+    map_ = static_cast<char *>(map);
+
+    active_ = std::move(seg);
+    dirty_from_ = active_.size;
+}
+
+// 关闭活动段
+void history_log::close_active()
+{
+    if (!map_)
+        return;
+    commit();
+    ::munmap(map_, capacity_);
+    map_ = nullptr;
+    // 截断预分配的空间，关闭的段只占用实际大小
+    ::ftruncate(log_fd_, static_cast<off_t>(active_.size));
+    ::close(log_fd_);
+    ::close(index_fd_);
+    log_fd_ = index_fd_ = -1;
+}
+
+// 刷盘：先落盘记录数据，再写索引，保证索引不会指向未落盘的记录
+void history_log::commit()
+{
+    if (active_.size > dirty_from_)
+    {
+        size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        size_t begin = dirty_from_ & ~(page - 1);
+        ::msync(map_ + begin, active_.size - begin, MS_SYNC);
+        dirty_from_ = active_.size;
+    }
+    if (!index_batch_.empty())
+    {
+        write_all(index_fd_, index_batch_.data(), index_batch_.size() * sizeof(index_entry));
+        ::fdatasync(index_fd_);
+        index_batch_.clear();
+    }
+}
+
+// 写入一条记录，空间不足时轮转
+void history_log::write_record(const pending_record &rec)
+{
+    record_header header{};
+    header.magic = RECORD_MAGIC;
+    header.room_len = static_cast<uint32_t>(rec.room.size());
+    header.seq = rec.seq;
+    header.time_ms = rec.time_ms;
+    header.payload_len = static_cast<uint32_t>(rec.message->size());
+    size_t need = record_size(rec.room.size(), rec.message->size(), sizeof(header));
+    if (need > config_.history_segment_bytes)
+    {
+        std::cerr << "历史记录过大，跳过序号 " << rec.seq << "\n";
+        return;
+    }
+
+    // 当前段放不下时轮转到以该记录序号命名的新段
+    if (active_.size + need > capacity_)
+        rotate(rec.seq);
+
+    char *p = map_ + active_.size;
+    std::memcpy(p, &header, sizeof(header));
+    std::memcpy(p + sizeof(header), rec.room.data(), rec.room.size());
+    std::memcpy(p + sizeof(header) + rec.room.size(), rec.message->data(), rec.message->size());
+
+    index_batch_.push_back(index_entry{rec.seq, static_cast<uint32_t>(active_.size), room_hash(rec.room)});
+    room_tails_[rec.room] = record_location{rec.seq, active_.base_seq, static_cast<uint32_t>(active_.size)};
+    active_.size += need;
+    last_written_seq_ = rec.seq;
+    active_.last_ms = rec.time_ms;
+    has_records_ = true;
+    ++since_checkpoint_;
+}
+
+// 轮转到以base_seq命名的新段
+void history_log::rotate(uint64_t base_seq)
+{
+    close_active();
+    closed_.push_back(active_);
+    segment seg;
+    seg.base_seq = base_seq;
+    seg.log_path = (fs::path(config_.history_dir) / (segment_name(base_seq) + ".log")).string();
+    seg.index_path = (fs::path(config_.history_dir) / (segment_name(base_seq) + ".idx")).string();
+    open_active(seg);
+    apply_retention();
+    write_checkpoint();
+}
+
+// 空闲时按时间清理
+//
+// 活动段不会被删除，最后一条记录已超过保留时间时先轮转出去
+void history_log::expire_idle()
+{
+    if (config_.history_retention_hours == 0)
+        return;
+    uint64_t now = now_ms();
+    uint64_t retention_ms = static_cast<uint64_t>(config_.history_retention_hours) * 3600 * 1000;
+    if (active_.size > 0 && now > active_.last_ms && now - active_.last_ms > retention_ms)
+    {
+        uint64_t base_seq;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            base_seq = next_seq_;
+        }
+        rotate(base_seq);
+    }
+    else
+    {
+        apply_retention();
+    }
+}
+
+// 按大小和时间清理旧段
+void history_log::apply_retention()
+{
+    size_t total = active_.size;
+    for (const auto &seg : closed_)
+        total += seg.size;
+
+    // 段的修改时间在关闭截断时会更新，按最后一条记录的时间判断
+    uint64_t now = now_ms();
+    uint64_t retention_ms = static_cast<uint64_t>(config_.history_retention_hours) * 3600 * 1000;
+    while (!closed_.empty())
+    {
+        const segment &oldest = closed_.front();
+        bool too_big = total > config_.history_retention_bytes;
+        bool too_old = config_.history_retention_hours > 0 && now > oldest.last_ms &&
+                        now - oldest.last_ms > retention_ms;
+        if (!too_big && !too_old)
+            break;
+
+        ::unlink(oldest.log_path.c_str());
+        ::unlink(oldest.index_path.c_str());
+        total -= oldest.size;
+        closed_.erase(closed_.begin());
+    }
+}
+
+// 后台写线程
+void history_log::writer_loop()
+{
+    std::vector<pending_record> batch;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            bool woken = cv_.wait_for(lock, RETENTION_CHECK_INTERVAL, [this]
+                                      { return stopping_ || !pending_.empty(); });
+            if (pending_.empty() && stopping_)
+                return;
+            batch.swap(pending_);
+            if (!woken)
+            {
+                lock.unlock();
+                try
+                {
+                    expire_idle();
+                }
+                catch (const std::exception &e)
+                {
+                    std::cerr << "清理历史日志失败: " << e.what() << "\n";
+                }
+                continue;
+            }
+        }
+
+        // 一批消息只刷盘一次
+        try
+        {
+            for (const auto &rec : batch)
+                write_record(rec);
+            commit();
+            if (since_checkpoint_ >= CHECKPOINT_RECORDS)
+                write_checkpoint();
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "写入历史日志失败: " << e.what() << "\n";
+        }
+        batch.clear();
+    }
+}
@@ -0,0 +1,164 @@
+#ifndef CLIPBOARD_HISTORY_LOG_H
+#define CLIPBOARD_HISTORY_LOG_H
+
+#include "server_config.h"
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// 剪贴板历史日志
+//
+// 已接受的消息按顺序追加到内存映射的日志段文件中：
+//   <dir>/<起始序号>.log  记录数据，创建时按段大小预分配并整体mmap
+//   <dir>/<起始序号>.idx  紧凑索引，每条记录16字节(序号、段内偏移、房间哈希)
+//   <dir>/rooms.ckpt      检查点，各房间最新记录的位置
+// 索引在记录写入之后追加，重启时以索引为准，索引之后的残缺记录会被覆盖。
+// 重启时每个段只读取最后一个索引项，各房间的最新内容由检查点加上检查点之后的索引尾部得到，
+// 启动时间与历史总量无关。
+//
+// 后台线程空闲时定期按时间清理：活动段的最后一条记录超过保留时间时先轮转，再删除过期的段，
+// 长时间没有新消息的服务器也会按时清理历史。
+//
+// append()只在内存队列中登记并分配序号，实际写入由后台线程完成：
+// 线程每次取走队列中积累的全部消息，写完后统一刷盘一次(组提交)，
+// 因此广播路径上不会有磁盘I/O。
+class history_log
+{
+public:
+    // 打开或创建日志目录并恢复状态，失败时抛出异常
+    explicit history_log(const server_config &config);
+    // 刷出剩余消息并停止后台线程
+    ~history_log();
+
+    history_log(const history_log &) = delete;
+    history_log &operator=(const history_log &) = delete;
+
+    // 追加一条消息，返回分配的全局序号
+    uint64_t append(const std::string &room, std::shared_ptr<const std::string> message);
+    // 记录遍历回调：序号、房间、消息
+    using record_visitor = std::function<void(uint64_t seq, const std::string &room,
+                                              std::shared_ptr<const std::string> message)>;
+
+    // 按序遍历日志中的全部记录，只能在启动时、追加任何消息之前调用
+    void scan(const record_visitor &visit);
+    // 启动时从日志恢复的各房间最新消息
+    const std::unordered_map<std::string, std::shared_ptr<const std::string>> &recovered_last_values() const
+    {
+        return last_values_;
+    }
+
+private:
+    // 磁盘上的记录头
+    struct record_header
+    {
+        uint32_t magic;
+        uint32_t room_len;
+        uint64_t seq;
+        uint64_t time_ms;
+        uint32_t payload_len;
+        uint32_t reserved;
+    };
+
+    // 索引项
+    struct index_entry
+    {
+        uint64_t seq;
+        uint32_t position;
+        uint32_t room_hash;
+    };
+
+    // 日志段
+    struct segment
+    {
+        uint64_t base_seq = 0;
+        std::string log_path;
+        std::string index_path;
+        // 已写入的字节数
+        size_t size = 0;
+        // 启动时索引中的条目数
+        size_t entries = 0;
+        // 最后一条记录的写入时间，按时间清理以此为准
+        uint64_t last_ms = 0;
+    };
+
+    // 记录在日志中的位置
+    struct record_location
+    {
+        uint64_t seq;
+        uint64_t base_seq;
+        uint32_t position;
+    };
+
+    // 等待写入的消息
+    struct pending_record
+    {
+        uint64_t seq;
+        uint64_t time_ms;
+        std::string room;
+        std::shared_ptr<const std::string> message;
+    };
+
+    // 扫描目录并恢复序号和各房间最新消息
+    void recover();
+    // 读取检查点中各房间最新记录的位置，返回检查点覆盖到的序号
+    bool load_checkpoint(uint64_t &covered);
+    // 从最新的索引项向前扫描到covered(bounded为false时扫描全部)，更新各房间最新记录的位置
+    void scan_index_tail(const std::vector<segment> &segments, bool bounded, uint64_t covered);
+    // 写入检查点，原子替换旧文件
+    void write_checkpoint();
+    // 轮转到以base_seq命名的新段
+    void rotate(uint64_t base_seq);
+    // 空闲时按时间清理，活动段已过期时先轮转
+    void expire_idle();
+    // 打开(或创建)活动段用于追加
+    void open_active(segment seg);
+    // 关闭活动段，截断到实际大小
+    void close_active();
+    // 刷盘已写入的记录并追加对应的索引项
+    void commit();
+    // 写入一条记录，空间不足时轮转
+    void write_record(const pending_record &rec);
+    // 按大小和时间清理旧段
+    void apply_retention();
+    // 后台写线程
+    void writer_loop();
+
+    const server_config &config_;
+
+    // 已关闭的段，从旧到新
+    std::vector<segment> closed_;
+    // 活动段
+    segment active_;
+    int log_fd_ = -1;
+    int index_fd_ = -1;
+    char *map_ = nullptr;
+    size_t capacity_ = 0;
+    // 自上次刷盘以来写入的起始偏移
+    size_t dirty_from_ = 0;
+    // 本批次待写入的索引项
+    std::vector<index_entry> index_batch_;
+
+    std::unordered_map<std::string, std::shared_ptr<const std::string>> last_values_;
+    // 各房间最新记录的位置，只由后台线程维护
+    std::unordered_map<std::string, record_location> room_tails_;
+    // 最后写入的记录序号
+    uint64_t last_written_seq_ = 0;
+    bool has_records_ = false;
+    // 自上次检查点以来写入的记录数
+    size_t since_checkpoint_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<pending_record> pending_;
+    uint64_t next_seq_ = 0;
+    bool stopping_ = false;
+    std::thread writer_;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "latency_stats.h"
+#include "message.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+    // 各段的名称，下标与latency_stats::hop一致
+    const char *const HOP_NAMES[] = {"detect", "upload", "fanout"};
+
+    // 读取微秒时间戳头部，不存在时返回0
+    uint64_t timestamp(const clip_message &msg, const char *key)
+    {
+        return std::strtoull(msg.get(key).c_str(), nullptr, 10);
+    }
+}
+
+// 样本所在的桶
+int latency_histogram::bucket_of(uint64_t micros)
+{
+    if (micros < SUB_BUCKETS)
+        return static_cast<int>(micros);
+    int exponent = 63 - __builtin_clzll(micros);
+    int sub = static_cast<int>((micros >> (exponent - 2)) & (SUB_BUCKETS - 1));
+    return (exponent - 1) * SUB_BUCKETS + sub;
+}
+
+// 桶的上界
+uint64_t latency_histogram::bucket_upper(int bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return static_cast<uint64_t>(bucket);
+    int exponent = bucket / SUB_BUCKETS + 1;
+    uint64_t sub = static_cast<uint64_t>(bucket % SUB_BUCKETS);
+    uint64_t lower = (SUB_BUCKETS + sub) << (exponent - 2);
+    return lower + (uint64_t(1) << (exponent - 2)) - 1;
+}
+
+// 记录一个样本
+void latency_histogram::record(uint64_t micros)
+{
+    ++counts_[bucket_of(micros)];
+    ++count_;
+    if (micros > max_)
+        max_ = micros;
+}
+
+// 第p百分位的近似值
+uint64_t latency_histogram::percentile(double p) const
+{
+    if (count_ == 0)
+        return 0;
+    // 第rank个样本(从1开始)所在的桶
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(count_) + 0.5);
+    if (rank < 1)
+        rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        seen += counts_[i];
+        if (seen >= rank)
+            return bucket_upper(i) < max_ ? bucket_upper(i) : max_;
+    }
+    return max_;
+}
+
+// 清空
+void latency_histogram::clear()
+{
+    std::memset(counts_, 0, sizeof(counts_));
+    count_ = 0;
+    max_ = 0;
+}
+
+// 按消息中的时间戳记录各段延迟
+void latency_stats::record(const clip_message &msg)
+{
+    uint64_t stamps[] = {timestamp(msg, "t-copy"), timestamp(msg, "t-send"),
+                         timestamp(msg, "t-recv"), timestamp(msg, "t-fanout")};
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int i = 0; i < hop_count; ++i)
+    {
+        if (stamps[i] == 0 || stamps[i + 1] == 0)
+            continue;
+        hops_[i].record(stamps[i + 1] > stamps[i] ? stamps[i + 1] - stamps[i] : 0);
+    }
+}
+
+// 生成一行报告并清空统计
+//
+// 例如：detect n=12 p50=1023 p90=2047 p99=3071 max=2890 | upload ...，单位为微秒
+std::string latency_stats::report_and_reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string report;
+    for (int i = 0; i < hop_count; ++i)
+    {
+        latency_histogram &h = hops_[i];
+        if (h.count() == 0)
+            continue;
+        if (!report.empty())
+            report += " | ";
+        report += std::string(HOP_NAMES[i]) + " n=" + std::to_string(h.count()) +
+                  " p50=" + std::to_string(h.percentile(50)) +
+                  " p90=" + std::to_string(h.percentile(90)) +
+                  " p99=" + std::to_string(h.percentile(99)) +
+                  " max=" + std::to_string(h.max());
+        h.clear();
+    }
+    return report;
+}
+
+// 当前时间，Unix纪元以来的微秒数
+uint64_t trace_now_micros()
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+}
+
+// 消息头部中是否带有追踪编号
+bool is_traced(const std::string &raw)
+{
+    if (!clip_message::is_envelope(raw))
+        return false;
+    // 头部在第一个空行处结束
+    size_t headers_end = raw.find("\n\n");
+    size_t trace = raw.find("\ntrace: ");
+    return trace != std::string::npos && trace < headers_end;
+}
@@ -0,0 +1,79 @@
+#ifndef CLIPBOARD_LATENCY_STATS_H
+#define CLIPBOARD_LATENCY_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+struct clip_message;
+
+// 延迟直方图
+//
+// 桶按2的幂划分，每个2的幂再等分为4个子桶，百分位取所在桶的上界，
+// 相对误差不超过25%。记录是常数时间，不保存样本。
+class latency_histogram
+{
+public:
+    // 记录一个样本(微秒)
+    void record(uint64_t micros);
+    // 样本数
+    uint64_t count() const { return count_; }
+    // 最大样本
+    uint64_t max() const { return max_; }
+    // 第p百分位(0-100)的近似值
+    uint64_t percentile(double p) const;
+    // 清空
+    void clear();
+
+private:
+    static const int SUB_BUCKETS = 4;
+    static const int BUCKETS = 64 * SUB_BUCKETS;
+
+    // 样本所在的桶
+    static int bucket_of(uint64_t micros);
+    // 桶的上界
+    static uint64_t bucket_upper(int bucket);
+
+    uint64_t counts_[BUCKETS] = {};
+    uint64_t count_ = 0;
+    uint64_t max_ = 0;
+};
+
+// 剪贴板更新在服务器上可见的各段延迟
+//
+// 发送方客户端在消息中写入trace(追踪编号)、t-copy(检测到复制)和t-send(发出)头部，
+// 服务器在do_read中写入t-recv(收到)，在broadcast中写入t-fanout(交给房间内的会话发送)。
+// 时间戳都是Unix纪元以来的微秒数。这里统计：
+//   detect: t-copy → t-send，发送方检测并读取剪贴板的时间
+//   upload: t-send → t-recv，上传到服务器的时间
+//   fanout: t-recv → t-fanout，服务器处理和转发(含集群节点之间)的时间
+// 跨设备的差值依赖设备之间的时钟同步，时钟偏差导致的负值记为0。
+class latency_stats
+{
+public:
+    // 按消息中的时间戳记录各段延迟，缺少的时间戳对应的段被跳过
+    void record(const clip_message &msg);
+    // 生成一行报告并清空统计，没有样本时返回空字符串
+    std::string report_and_reset();
+
+private:
+    enum hop
+    {
+        hop_detect,
+        hop_upload,
+        hop_fanout,
+        hop_count
+    };
+
+    latency_histogram hops_[hop_count];
+    std::mutex mutex_;
+};
+
+// 当前时间，Unix纪元以来的微秒数
+uint64_t trace_now_micros();
+
+// 消息头部中是否带有追踪编号，只检查头部，不解析整条消息
+bool is_traced(const std::string &raw);
+
+#endif
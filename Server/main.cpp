@@ -1,27 +1,103 @@
 #include "server.h"
+#include "cluster.h"
+#include "history_log.h"
+#include "latency_stats.h"
+#include "search_index.h"
+#include "server_config.h"
+#include "utf8_validator.h"
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
 
 int main(int argc, char *argv[])
 {
     try
     {
-        // 默认端口8080，可通过命令行参数修改
-        unsigned short port = 8080;
-        if (argc >= 2)
-            port = static_cast<unsigned short>(std::atoi(argv[1]));
+        // 用法: clipboard-server [-c 配置文件] [端口]
+        // 默认端口8080，命令行端口优先于配置文件
+        server_config config;
+        // 命令行端口在读取配置文件之后才应用，与参数顺序无关
+        int cli_port = 0;
+        for (int i = 1; i < argc; ++i)
+        {
+            if (std::strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+                config = server_config::load(argv[++i]);
+            else
+                cli_port = std::atoi(argv[i]);
+        }
+        if (cli_port > 0)
+            config.port = static_cast<unsigned short>(cli_port);
 
         // 创建IO上下文
         net::io_context ioc;
         // 创建会话管理器
         session_manager manager;
+        manager.set_lazy_threshold(config.lazy_threshold);
+        manager.set_validate_utf8(config.validate_utf8);
+        manager.set_stream_relay(config.stream_relay);
+        if (config.validate_utf8)
+            std::cout << "转发前检查UTF-8编码 (" << utf8_validator_name() << ")\n";
+
+        // 配置了历史目录时启用持久化历史
+        std::unique_ptr<history_log> history;
+        if (!config.history_dir.empty())
+        {
+            history = std::make_unique<history_log>(config);
+            manager.set_history(history.get());
+        }
+
+        // 启用全文搜索时先用已有历史建立索引
+        std::unique_ptr<search_index> search;
+        if (config.search_max_entries > 0)
+        {
+            search = std::make_unique<search_index>(config.search_max_entries);
+            manager.set_search(search.get());
+            if (history)
+                history->scan([&manager](uint64_t, const std::string &room, std::shared_ptr<const std::string> message)
+                              { manager.index_history(room, std::move(message)); });
+        }
+
+        // 定期输出服务器可见的各段延迟
+        std::unique_ptr<latency_stats> latency;
+        net::steady_timer latency_timer(ioc);
+        std::function<void()> schedule_latency_report;
+        if (config.latency_report_secs > 0)
+        {
+            latency = std::make_unique<latency_stats>();
+            manager.set_latency_stats(latency.get());
+            schedule_latency_report = [&]()
+            {
+                latency_timer.expires_after(std::chrono::seconds(config.latency_report_secs));
+                latency_timer.async_wait([&](beast::error_code ec)
+                                         {
+                                             if (ec)
+                                                 return;
+                                             std::string report = latency->report_and_reset();
+                                             if (!report.empty())
+                                                 std::cout << "剪贴板延迟(微秒) " << report << "\n";
+                                             schedule_latency_report();
+                                         });
+            };
+            schedule_latency_report();
+        }
+
+        // 配置了对端时以集群模式运行
+        std::unique_ptr<cluster_node> cluster;
+        if (!config.peers.empty())
+        {
+            cluster = std::make_unique<cluster_node>(ioc, config, manager);
+            cluster->start();
+        }
 
         // 创建剪贴板服务器，监听指定端口
         clipboard_server server(ioc,
-                                tcp::endpoint{tcp::v4(), port},
-                                manager);
+                                tcp::endpoint{tcp::v4(), config.port},
+                                manager,
+                                cluster.get());
 
-        std::cout << "剪贴板同步服务器启动在端口 " << port << "\n";
+        std::cout << "剪贴板同步服务器启动在端口 " << config.port << "\n";
         // 运行IO上下文事件循环
         ioc.run();
     }
@@ -0,0 +1,74 @@
+#include "message.h"
+#include <cstdint>
+
+// 读取头部字段
+std::string clip_message::get(const std::string &key, const std::string &def) const
+{
+    auto it = headers.find(key);
+    return it == headers.end() ? def : it->second;
+}
+
+// 设置头部字段
+void clip_message::set(const std::string &key, const std::string &value)
+{
+    headers[key] = value;
+}
+
+// 序列化为线上格式
+std::string clip_message::serialize() const
+{
+    std::string out = serialize_envelope_head(headers);
+    out += body;
+    return out;
+}
+
+// 列出消息体中的各种表示
+bool clip_message::parts(std::vector<clip_part> &out) const
+{
+    auto it = headers.find("parts");
+    if (it == headers.end())
+    {
+        out.clear();
+        out.push_back(clip_part{get("mime", "text/plain"), 0, body.size()});
+        return true;
+    }
+    return parse_parts(it->second, body.size(), out);
+}
+
+// 判断原始数据是否带有协议信封
+bool clip_message::is_envelope(const std::string &raw)
+{
+    return ::is_envelope(raw);
+}
+
+// 原始数据是否是PRIMARY选择的内容
+bool clip_message::is_primary(const std::string &raw)
+{
+    if (!is_envelope(raw))
+        return false;
+    // 头部在第一个空行处结束
+    size_t headers_end = raw.find("\n\n");
+    size_t selection = raw.find("\nselection: primary\n");
+    return selection != std::string::npos && selection < headers_end;
+}
+
+// 解析原始数据
+bool clip_message::parse(const std::string &raw, clip_message &out)
+{
+    out.headers.clear();
+    out.body.clear();
+
+    // 旧版客户端直接发送剪贴板文本
+    if (!is_envelope(raw))
+    {
+        out.set("type", "clip");
+        out.body = raw;
+        return true;
+    }
+
+    size_t body_offset = 0;
+    if (!parse_envelope_head(raw, out.headers, body_offset))
+        return false;
+    out.body = raw.substr(body_offset);
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef CLIPBOARD_MESSAGE_H
+#define CLIPBOARD_MESSAGE_H
+
+#include "envelope.h"
+#include <map>
+#include <string>
+#include <vector>
+
+// 多格式消息中一种表示在消息体中的位置
+using clip_part = envelope_part;
+
+// 剪贴板协议消息
+//
+// 线上格式见common/envelope.h，解析和序列化与客户端共用同一份代码。
+// 没有魔数首行的消息视为旧版客户端发送的纯文本剪贴板内容。
+// 没有parts头部时整个消息体是一种表示，类型由mime头部给出。
+//
+// 剪贴板消息的size头部给出消息体长度，服务器在头部到达时据此开始直通转发。
+//
+// selection头部为primary的剪贴板消息是PRIMARY选择的内容，服务器只实时转发给在线的设备，
+// 不分配序号、不写历史、不通告，也不替换房间的最新内容。没有该头部时是系统剪贴板。
+//
+// 客户端端到端加密时消息体是等长的密文，enc、nonce、tag头部由客户端解释，
+// 服务器只按原样转发，不索引也不预览。
+struct clip_message
+{
+    // 头部字段
+    envelope_headers headers;
+    // 消息体（二进制安全）
+    std::string body;
+
+    // 读取头部字段，不存在时返回默认值
+    std::string get(const std::string &key, const std::string &def = "") const;
+    // 设置头部字段
+    void set(const std::string &key, const std::string &value);
+    // 序列化为线上格式
+    std::string serialize() const;
+    // 列出消息体中的各种表示，parts头部格式错误或与消息体长度不符时返回false
+    bool parts(std::vector<clip_part> &out) const;
+
+    // 判断原始数据是否带有协议信封
+    static bool is_envelope(const std::string &raw);
+    // 原始数据是否是PRIMARY选择的内容，只检查头部，不解析整条消息
+    static bool is_primary(const std::string &raw);
+    // 解析原始数据，旧版纯文本消息解析为type=clip的消息
+    static bool parse(const std::string &raw, clip_message &out);
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef CLIPBOARD_PROBES_H
+#define CLIPBOARD_PROBES_H
+
+// USDT静态探针
+//
+// 有systemtap的<sys/sdt.h>时在关键路径上放置提供者为clipboard_server的静态探针，
+// 未被跟踪时每个探针只是一条nop指令，参数留在寄存器中，不产生函数调用；
+// 没有该头文件时探针展开为(void)sizeof(参数)，参数仍做类型检查但不求值，不生成代码。
+// 可以用bpftrace或perf按名称挂载，例如
+//   bpftrace -e 'usdt:/usr/local/bin/clipboard-server:clipboard_server:message { ... }'
+// tools/bpftrace目录下有几个现成的延迟分析脚本。
+//
+// 探针及参数：
+//   accept(fd)                             接受了TCP连接
+//   handshake(session, room, lazy)         WebSocket握手完成，会话加入房间
+//   message(session, bytes)                收齐一条客户端消息
+//   broadcast_start(room, seq, bytes)      开始把消息交给房间内的会话
+//   broadcast_end(room, seq, recipients)   消息已交给所有需要的会话
+//   enqueue(session, bytes)                消息或分片进入会话的发送队列
+//   write_done(session, bytes, error)      会话的一次写操作完成，error为0表示成功
+//   remove(session, room)                  会话离开房间
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define CLIPBOARD_HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef CLIPBOARD_HAVE_PROBES
+#define SERVER_PROBE1(name, a) DTRACE_PROBE1(clipboard_server, name, a)
+#define SERVER_PROBE2(name, a, b) DTRACE_PROBE2(clipboard_server, name, a, b)
+#define SERVER_PROBE3(name, a, b, c) DTRACE_PROBE3(clipboard_server, name, a, b, c)
+#else
+// 参数放在sizeof中只做类型检查，不求值
+#define SERVER_PROBE1(name, a) ((void)sizeof(a))
+#define SERVER_PROBE2(name, a, b) ((void)sizeof(a), (void)sizeof(b))
+#define SERVER_PROBE3(name, a, b, c) ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c))
+#endif
+
+#endif
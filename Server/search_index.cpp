@@ -0,0 +1,387 @@
+#include "search_index.h"
+#include "message.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // ASCII字母转小写，其余字节(包括UTF-8多字节序列)保持不变
+    inline unsigned char fold(unsigned char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c + 32) : c;
+    }
+
+    inline uint32_t trigram_at(const unsigned char *p)
+    {
+        return (uint32_t(fold(p[0])) << 16) | (uint32_t(fold(p[1])) << 8) | fold(p[2]);
+    }
+
+    // 提取去重后的三元组
+    std::vector<uint32_t> trigrams(const std::string &text, size_t limit)
+    {
+        std::vector<uint32_t> out;
+        size_t len = std::min(text.size(), limit);
+        if (len < 3)
+            return out;
+        const auto *p = reinterpret_cast<const unsigned char *>(text.data());
+        out.reserve(len - 2);
+        for (size_t i = 0; i + 2 < len; ++i)
+            out.push_back(trigram_at(p + i));
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+        return out;
+    }
+
+    void put_varint(std::string &out, uint32_t v)
+    {
+        while (v >= 0x80)
+        {
+            out += static_cast<char>((v & 0x7f) | 0x80);
+            v >>= 7;
+        }
+        out += static_cast<char>(v);
+    }
+
+    // 解码倒排表中的全部文档编号
+    std::vector<uint32_t> decode(const std::string &data, uint32_t count)
+    {
+        std::vector<uint32_t> docs;
+        docs.reserve(count);
+        uint32_t doc = 0;
+        size_t pos = 0;
+        while (pos < data.size())
+        {
+            uint32_t delta = 0;
+            int shift = 0;
+            unsigned char c;
+            do
+            {
+                c = static_cast<unsigned char>(data[pos++]);
+                delta |= uint32_t(c & 0x7f) << shift;
+                shift += 7;
+            } while ((c & 0x80) && pos < data.size());
+            doc += delta;
+            docs.push_back(doc);
+        }
+        return docs;
+    }
+
+    std::string fold_string(const std::string &s, size_t limit)
+    {
+        std::string out(s, 0, std::min(s.size(), limit));
+        for (auto &c : out)
+            c = static_cast<char>(fold(static_cast<unsigned char>(c)));
+        return out;
+    }
+
+    // 按空白切分查询词
+    std::vector<std::string> split_terms(const std::string &query)
+    {
+        std::vector<std::string> terms;
+        std::string current;
+        for (char c : query)
+        {
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+            {
+                if (!current.empty())
+                    terms.push_back(fold_string(current, current.size()));
+                current.clear();
+            }
+            else
+            {
+                current += c;
+            }
+        }
+        if (!current.empty())
+            terms.push_back(fold_string(current, current.size()));
+        return terms;
+    }
+
+    // 在文本的前len个字节中从from开始查找已折叠的词，比较时折叠文本，不复制文本
+    size_t find_folded(const std::string &text, size_t len, const std::string &term, size_t from)
+    {
+        const auto *p = reinterpret_cast<const unsigned char *>(text.data());
+        const auto *t = reinterpret_cast<const unsigned char *>(term.data());
+        size_t m = term.size();
+        for (size_t i = from; i + m <= len; ++i)
+        {
+            if (fold(p[i]) != t[0])
+                continue;
+            size_t k = 1;
+            while (k < m && fold(p[i + k]) == t[k])
+                ++k;
+            if (k == m)
+                return i;
+        }
+        return std::string::npos;
+    }
+
+    // 截取[begin, end)并调整到UTF-8字符边界
+    std::string utf8_slice(const std::string &text, size_t begin, size_t end)
+    {
+        end = std::min(end, text.size());
+        while (begin > 0 && begin < end && (static_cast<unsigned char>(text[begin]) & 0xC0) == 0x80)
+            --begin;
+        while (end < text.size() && end > begin && (static_cast<unsigned char>(text[end]) & 0xC0) == 0x80)
+            --end;
+        return text.substr(begin, end - begin);
+    }
+
+    // 查询最多校验的候选条目数，从最新的开始，常见三元组的查询耗时因此有上限
+    const size_t QUERY_VERIFY_LIMIT = 1000;
+    // 预览从第一处匹配之前这么多字节开始，保留一些上下文
+    const size_t PREVIEW_CONTEXT_BYTES = 40;
+    // 文本没有声明格式时(旧版纯文本消息)使用的格式
+    const char *PLAIN_TEXT_MIME = "text/plain;charset=utf-8";
+}
+
+search_index::search_index(size_t max_entries)
+    : max_entries_(max_entries), block_entries_(std::max<size_t>(1, max_entries / 8))
+{
+    worker_ = std::thread([this]
+                          { worker_loop(); });
+}
+
+// 处理完队列中的任务并停止后台线程
+search_index::~search_index()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_one();
+    if (worker_.joinable())
+        worker_.join();
+}
+
+// 在后台线程中执行任务
+void search_index::post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+}
+
+// 后台线程，按提交顺序执行建索引和查询
+void search_index::worker_loop()
+{
+    std::vector<std::function<void()>> batch;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]
+                     { return stopping_ || !tasks_.empty(); });
+            if (tasks_.empty() && stopping_)
+                return;
+            batch.swap(tasks_);
+        }
+        for (auto &task : batch)
+            task();
+        batch.clear();
+    }
+}
+
+// 索引一条剪贴板消息
+void search_index::add(const std::string &room, uint64_t seq, std::shared_ptr<const std::string> message)
+{
+    post([this, room, seq, message]
+         { index_message(room, seq, message); });
+}
+
+// 查询
+void search_index::query(const std::string &room, const std::string &query, size_t limit, hits_callback done)
+{
+    post([this, room, query, limit, done]
+         { done(run_query(room, query, limit)); });
+}
+
+// 按房间序号取回条目的文本
+void search_index::lookup(const std::string &room, uint64_t seq, text_callback done)
+{
+    post([this, room, seq, done]
+         {
+             auto room_it = rooms_.find(room);
+             if (room_it != rooms_.end())
+             {
+                 for (const auto &b : room_it->second.blocks)
+                 {
+                     auto it = b.by_seq.find(seq);
+                     if (it == b.by_seq.end())
+                         continue;
+                     const document &doc = b.docs[it->second - b.first_doc];
+                     done(doc.text, doc.mime);
+                     return;
+                 }
+             }
+             done(nullptr, "");
+         });
+}
+
+// 解析消息并加入房间索引
+void search_index::index_message(const std::string &room, uint64_t seq, const std::shared_ptr<const std::string> &message)
+{
+    // 旧版纯文本消息直接共享原数据；带信封的消息只索引文本表示，优先纯文本
+    std::shared_ptr<const std::string> text = message;
+    std::string mime = PLAIN_TEXT_MIME;
+    if (clip_message::is_envelope(*message))
+    {
+        clip_message msg;
+        std::vector<clip_part> parts;
+        // 端到端加密的内容无法索引
+        if (!clip_message::parse(*message, msg) || msg.get("type") != "clip" || !msg.get("enc").empty() ||
+            !msg.parts(parts))
+            return;
+        const clip_part *chosen = nullptr;
+        for (const auto &part : parts)
+        {
+            if (part.mime.compare(0, 10, "text/plain") == 0)
+            {
+                chosen = &part;
+                break;
+            }
+            if (!chosen && part.mime.compare(0, 5, "text/") == 0)
+                chosen = &part;
+        }
+        if (!chosen)
+            return;
+        mime = chosen->mime;
+        if (parts.size() == 1)
+            text = std::make_shared<const std::string>(std::move(msg.body));
+        else
+            text = std::make_shared<const std::string>(msg.body, chosen->offset, chosen->length);
+    }
+    if (text->empty())
+        return;
+
+    room_index &index = rooms_[room];
+    if (index.blocks.empty() || index.blocks.back().docs.size() >= block_entries_)
+    {
+        index.blocks.emplace_back();
+        index.blocks.back().first_doc = index.next_doc;
+    }
+    block &b = index.blocks.back();
+    uint32_t doc_id = index.next_doc++;
+    for (uint32_t gram : trigrams(*text, SEARCH_MAX_INDEXED_BYTES))
+    {
+        posting_list &list = b.postings[gram];
+        put_varint(list.data, doc_id - list.last_doc);
+        list.last_doc = doc_id;
+        ++list.count;
+    }
+    b.by_seq[seq] = doc_id;
+    b.docs.push_back(document{seq, std::move(text), std::move(mime)});
+    ++index.doc_count;
+
+    // 去掉最旧的块后仍不少于上限时整块丢弃
+    while (index.doc_count - index.blocks.front().docs.size() >= max_entries_)
+    {
+        index.doc_count -= index.blocks.front().docs.size();
+        index.blocks.pop_front();
+    }
+}
+
+// 查询房间索引
+std::vector<search_hit> search_index::run_query(const std::string &room, const std::string &query, size_t limit) const
+{
+    std::vector<search_hit> hits;
+    std::vector<std::string> terms = split_terms(query);
+    if (terms.empty() || limit == 0)
+        return hits;
+
+    auto room_it = rooms_.find(room);
+    if (room_it == rooms_.end())
+        return hits;
+    const room_index &index = room_it->second;
+
+    // 收集所有查询词的三元组；都少于3个字节时无法使用索引，不做线性扫描
+    std::vector<uint32_t> grams;
+    for (const auto &term : terms)
+    {
+        auto t = trigrams(term, term.size());
+        grams.insert(grams.end(), t.begin(), t.end());
+    }
+    if (grams.empty())
+        return hits;
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+
+    // 从最新的块开始，每块内求倒排表交集，再从最新的候选开始校验子串并打分：
+    // 出现次数越多、条目越新得分越高
+    const double total = static_cast<double>(index.next_doc - index.blocks.front().first_doc);
+    size_t verified = 0;
+    for (auto b = index.blocks.rbegin(); b != index.blocks.rend() && verified < QUERY_VERIFY_LIMIT; ++b)
+    {
+        // 从最短的倒排表开始求交集
+        std::vector<const posting_list *> lists;
+        for (uint32_t gram : grams)
+        {
+            auto it = b->postings.find(gram);
+            if (it == b->postings.end())
+                break;
+            lists.push_back(&it->second);
+        }
+        if (lists.size() < grams.size())
+            continue;
+        std::sort(lists.begin(), lists.end(),
+                  [](const posting_list *x, const posting_list *y)
+                  { return x->count < y->count; });
+
+        std::vector<uint32_t> candidates = decode(lists[0]->data, lists[0]->count);
+        for (size_t i = 1; i < lists.size() && !candidates.empty(); ++i)
+        {
+            std::vector<uint32_t> other = decode(lists[i]->data, lists[i]->count);
+            std::vector<uint32_t> merged;
+            std::set_intersection(candidates.begin(), candidates.end(), other.begin(), other.end(),
+                                  std::back_inserter(merged));
+            candidates.swap(merged);
+        }
+
+        for (auto c = candidates.rbegin(); c != candidates.rend() && verified < QUERY_VERIFY_LIMIT; ++c)
+        {
+            ++verified;
+            const document &doc = b->docs[*c - b->first_doc];
+            size_t len = std::min(doc.text->size(), static_cast<size_t>(SEARCH_MAX_INDEXED_BYTES));
+            double score = 0;
+            size_t first_match = std::string::npos;
+            bool all_found = true;
+            for (const auto &term : terms)
+            {
+                size_t n = 0;
+                for (size_t pos = find_folded(*doc.text, len, term, 0); pos != std::string::npos;
+                     pos = find_folded(*doc.text, len, term, pos + term.size()))
+                {
+                    first_match = std::min(first_match, pos);
+                    ++n;
+                }
+                if (n == 0)
+                {
+                    all_found = false;
+                    break;
+                }
+                score += std::log1p(static_cast<double>(n));
+            }
+            if (!all_found)
+                continue;
+            score += static_cast<double>(*c - index.blocks.front().first_doc + 1) / total;
+            size_t begin = first_match > PREVIEW_CONTEXT_BYTES ? first_match - PREVIEW_CONTEXT_BYTES : 0;
+            hits.push_back(search_hit{doc.seq, score, doc.text->size(),
+                                      utf8_slice(*doc.text, begin, begin + SEARCH_PREVIEW_BYTES)});
+        }
+    }
+
+    auto by_score = [](const search_hit &a, const search_hit &b)
+    { return a.score > b.score; };
+    if (hits.size() > limit)
+    {
+        std::partial_sort(hits.begin(), hits.begin() + static_cast<std::ptrdiff_t>(limit), hits.end(), by_score);
+        hits.resize(limit);
+    }
+    else
+    {
+        std::sort(hits.begin(), hits.end(), by_score);
+    }
+    return hits;
+}
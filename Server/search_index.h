@@ -0,0 +1,128 @@
+#ifndef CLIPBOARD_SEARCH_INDEX_H
+#define CLIPBOARD_SEARCH_INDEX_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// 每条文本最多索引的字节数，限制大文本的建索引开销
+#define SEARCH_MAX_INDEXED_BYTES (64 * 1024)
+// 搜索结果中文本预览的最大字节数
+#define SEARCH_PREVIEW_BYTES 200
+
+// 一条搜索结果
+struct search_hit
+{
+    // 条目的房间序号，可以用type=fetch取回完整文本
+    uint64_t seq;
+    // 相关度得分，越大越靠前
+    double score;
+    // 条目文本的总长度
+    size_t size;
+    // 第一处匹配附近的文本，截断在UTF-8字符边界上
+    std::string preview;
+};
+
+// 剪贴板文本的三元组倒排索引
+//
+// 每个房间一份索引。文本按字节切成三元组(ASCII字母不区分大小写)，
+// 每个三元组的倒排表是按文档编号递增排列的变长整数差值编码，
+// 追加新文档只需在表尾写入一个差值。
+// 查询时先求所有三元组倒排表的交集得到候选，再从最新的候选开始校验子串并打分。
+//
+// 房间索引由若干块组成，每块最多max_entries/8条；新条目写入最新的块，
+// 条目数超出上限后整块丢弃最旧的块，不需要重建索引。
+//
+// 建索引和查询都在索引自己的后台线程中完成，add()只在队列中登记，
+// 广播路径上没有解析和建索引的开销，耗时的查询也不会阻塞事件循环。
+class search_index
+{
+public:
+    using hits_callback = std::function<void(std::vector<search_hit> hits)>;
+    // 条目文本和它的格式，条目已不在索引中时text为空
+    using text_callback = std::function<void(std::shared_ptr<const std::string> text, const std::string &mime)>;
+
+    // max_entries为每个房间保留的最大条目数，超出后丢弃最旧的条目
+    explicit search_index(size_t max_entries);
+    // 处理完队列中的任务并停止后台线程
+    ~search_index();
+
+    search_index(const search_index &) = delete;
+    search_index &operator=(const search_index &) = delete;
+
+    // 索引一条剪贴板消息，seq是它的房间序号，非文本消息被忽略
+    void add(const std::string &room, uint64_t seq, std::shared_ptr<const std::string> message);
+    // 查询，在后台线程中以按得分排序的前limit条结果调用done；
+    // 没有至少3个字节的查询词时无法使用索引，结果为空
+    void query(const std::string &room, const std::string &query, size_t limit, hits_callback done);
+    // 按房间序号取回条目的文本，在后台线程中调用done
+    void lookup(const std::string &room, uint64_t seq, text_callback done);
+
+private:
+    // 压缩倒排表
+    struct posting_list
+    {
+        // 变长整数编码的文档编号差值
+        std::string data;
+        // 表中最后一个文档编号
+        uint32_t last_doc = 0;
+        // 文档数
+        uint32_t count = 0;
+    };
+
+    struct document
+    {
+        uint64_t seq;
+        std::shared_ptr<const std::string> text;
+        std::string mime;
+    };
+
+    // 索引块
+    struct block
+    {
+        // 文档编号为 first_doc + 下标
+        uint32_t first_doc = 0;
+        std::vector<document> docs;
+        std::unordered_map<uint32_t, posting_list> postings;
+        // 房间序号到文档编号
+        std::unordered_map<uint64_t, uint32_t> by_seq;
+    };
+
+    // 单个房间的索引，块从旧到新
+    struct room_index
+    {
+        std::deque<block> blocks;
+        uint32_t next_doc = 0;
+        size_t doc_count = 0;
+    };
+
+    // 在后台线程中执行任务
+    void post(std::function<void()> task);
+    // 后台线程
+    void worker_loop();
+    // 解析消息并加入房间索引
+    void index_message(const std::string &room, uint64_t seq, const std::shared_ptr<const std::string> &message);
+    // 查询房间索引
+    std::vector<search_hit> run_query(const std::string &room, const std::string &query, size_t limit) const;
+
+    size_t max_entries_;
+    size_t block_entries_;
+    // 只由后台线程访问
+    std::unordered_map<std::string, room_index> rooms_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<std::function<void()>> tasks_;
+    bool stopping_ = false;
+    std::thread worker_;
+};
+
+#endif
@@ -1,27 +1,183 @@
 #include "server.h"
+#include "cluster.h"
+#include "fingerprint.h"
+#include "history_log.h"
+#include "latency_stats.h"
+#include "message.h"
+#include "probes.h"
+#include "search_index.h"
+#include "session.h"
+#include "utf8_validator.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <set>
+
+namespace
+{
+    // 从握手请求目标中提取房间名，例如 "/team?x=1" -> "team"
+    std::string room_from_target(beast::string_view target)
+    {
+        std::string room(target.data(), target.size());
+        size_t query = room.find('?');
+        if (query != std::string::npos)
+            room.erase(query);
+        while (!room.empty() && room.front() == '/')
+            room.erase(0, 1);
+        return room.empty() ? "default" : room;
+    }
+
+    // 解析握手请求目标中的续传参数，没有since参数时返回false
+    bool resume_from_target(beast::string_view target, resume_point &resume)
+    {
+        size_t query = target.find('?');
+        if (query == beast::string_view::npos)
+            return false;
+
+        bool requested = false;
+        std::string params(target.substr(query + 1));
+        size_t pos = 0;
+        while (pos <= params.size())
+        {
+            size_t end = params.find('&', pos);
+            if (end == std::string::npos)
+                end = params.size();
+            std::string param = params.substr(pos, end - pos);
+            size_t eq = param.find('=');
+            std::string key = param.substr(0, eq);
+            std::string value = eq == std::string::npos ? "" : param.substr(eq + 1);
+            if (key == "since")
+            {
+                requested = true;
+                resume.seq = std::strtoull(value.c_str(), nullptr, 10);
+            }
+            else if (key == "epoch")
+            {
+                resume.epoch = value;
+            }
+            pos = end + 1;
+        }
+        return requested;
+    }
+
+    // 握手请求目标中是否带有值为1的开关参数，例如 lazy=1
+    bool flag_from_target(beast::string_view target, const std::string &name)
+    {
+        size_t query = target.find('?');
+        if (query == beast::string_view::npos)
+            return false;
+        std::string params = "&" + std::string(target.substr(query + 1)) + "&";
+        return params.find("&" + name + "=1&") != std::string::npos;
+    }
+
+    // 按行切分消息体，忽略空行
+    std::vector<std::string> split_lines(const std::string &body)
+    {
+        std::vector<std::string> lines;
+        size_t pos = 0;
+        while (pos < body.size())
+        {
+            size_t end = body.find('\n', pos);
+            if (end == std::string::npos)
+                end = body.size();
+            if (end > pos)
+                lines.push_back(body.substr(pos, end - pos));
+            pos = end + 1;
+        }
+        return lines;
+    }
+
+    // 限制消息最大长度
+    const size_t MAX_MESSAGE_SIZE = 1024 * 1024; // 1MB
+
+    // 每个房间为续传保留的最近消息条数和总字节数
+    const size_t REPLAY_MAX_MESSAGES = 16;
+    const size_t REPLAY_MAX_BYTES = 2 * 1024 * 1024;
+
+    // 通告中文本预览的最大字节数
+    const size_t ANNOUNCE_PREVIEW_BYTES = 64;
+}
+
+// 会话管理器构造函数
+session_manager::session_manager()
+{
+    // 以启动时间作为纪元，客户端据此判断序号是否仍然有效
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    epoch_ = std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+}
 
 // 添加新的WebSocket会话到管理器
-void session_manager::add(std::shared_ptr<websocket::stream<tcp::socket>> ws)
+void session_manager::add(std::shared_ptr<session> s, const resume_point &resume)
 {
-    // 使用锁保护共享数据
-    std::lock_guard<std::mutex> lock(sessions_mutex_);
-    // 插入原始指针以避免循环引用
-    sessions_.insert(ws.get());
-    std::cout << "新设备连接，当前连接数: " << sessions_.size() << "\n";
+    const std::string &room = s->room();
+    bool room_created = false;
+    room_listener listener;
+    {
+        // 使用锁保护共享数据
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        auto &members = rooms_[room];
+        room_created = members.empty();
+        // 插入原始指针以避免循环引用
+        members.insert(s.get());
+        ++session_count_;
+        listener = room_listener_;
+        std::cout << "新设备连接到房间 " << room << "，当前连接数: " << session_count_ << "\n";
+
+        // 告知新设备房间内其他设备可以接收的格式
+        notify_formats(room);
+
+        // 新设备立即收到房间当前的剪贴板内容，续传会话只补发错过的消息
+        if (s->sequenced())
+        {
+            replay(*s, resume);
+        }
+        else
+        {
+            auto last = last_values_.find(room);
+            if (last != last_values_.end())
+                s->deliver(last->second, SESSION_CLIPBOARD_SELECTION);
+        }
+    }
+    // 在锁外通知，避免回调中再次访问管理器时死锁
+    if (room_created && listener)
+        listener(room, true);
 }
 
 // 从管理器中移除WebSocket会话
-void session_manager::remove(websocket::stream<tcp::socket> *ws)
+void session_manager::remove(session *s)
 {
-    // 使用锁保护共享数据
-    std::lock_guard<std::mutex> lock(sessions_mutex_);
-    sessions_.erase(ws);
-    std::cout << "设备断开，当前连接数: " << sessions_.size() << "\n";
+    const std::string room = s->room();
+    bool room_emptied = false;
+    room_listener listener;
+    {
+        // 使用锁保护共享数据
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        auto it = rooms_.find(room);
+        if (it == rooms_.end() || it->second.erase(s) == 0)
+            return;
+        --session_count_;
+        for (auto &relay : relays_)
+            relay.second.recipients.erase(s);
+        if (it->second.empty())
+        {
+            rooms_.erase(it);
+            room_emptied = true;
+        }
+        else
+        {
+            notify_formats(room);
+        }
+        listener = room_listener_;
+        SERVER_PROBE2(remove, s->id(), room.c_str());
+        std::cout << "设备断开，当前连接数: " << session_count_ << "\n";
+    }
+    if (room_emptied && listener)
+        listener(room, false);
 }
 
-// 向所有连接的客户端广播消息
-void session_manager::broadcast(const std::string &message)
+// 向房间内所有连接的客户端广播消息
+void session_manager::broadcast(const std::string &room, const std::string &message)
 {
     // 验证消息有效性
     if (message.empty())
@@ -30,38 +186,548 @@ void session_manager::broadcast(const std::string &message)
         return;
     }
 
-    // 限制消息最大长度
-    const size_t MAX_MESSAGE_SIZE = 1024 * 1024; // 1MB
     if (message.length() > MAX_MESSAGE_SIZE)
     {
         std::cerr << "消息过大，拒绝广播\n";
         return;
     }
 
-    std::cout << "广播剪贴板内容，长度: " << message.length() << "\n";
+    std::cout << "广播剪贴板内容到房间 " << room << "，长度: " << message.length() << "\n";
+
+    // 所有异步写共享同一份数据，直到最后一个写操作完成
+    auto shared = std::make_shared<const std::string>(message);
+
+    // PRIMARY随选择频繁变化，只转发给在线的设备，不进入历史、索引和补发
+    if (clip_message::is_primary(message))
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        fan_out(room, message, std::move(shared), 0, nullptr, SESSION_PRIMARY_SELECTION);
+        return;
+    }
+
+    // 写历史日志只是入队，实际写盘在后台线程完成
+    if (history_)
+        history_->append(room, shared);
 
     // 使用锁保护共享数据
     std::lock_guard<std::mutex> lock(sessions_mutex_);
-    // 遍历所有会话并发送消息
-    for (auto *ws : sessions_)
+    uint64_t room_seq = ++room_logs_[room].seq;
+    // 增量更新全文索引，只是在索引的后台线程中排队
+    if (search_)
+        search_->add(room, room_seq, shared);
+    retain(room, room_seq, shared);
+    fan_out(room, message, std::move(shared), room_seq, nullptr, SESSION_CLIPBOARD_SELECTION);
+}
+
+// 保留房间的消息
+//
+// 分配了序号的消息按序号插入最近的消息，最新的一条总是保留。直通转发的消息在开始时分配序号，
+// 收齐时如果更晚开始的消息已经收齐，它只进入最近的消息，不再成为房间的最新内容
+bool session_manager::retain(const std::string &room, uint64_t seq, const std::shared_ptr<const std::string> &message)
+{
+    room_log &log = room_logs_[room];
+    auto pos = log.recent.end();
+    while (pos != log.recent.begin() && std::prev(pos)->first > seq)
+        --pos;
+    bool latest = pos == log.recent.end();
+    log.recent.emplace(pos, seq, message);
+    log.bytes += message->size();
+    while (log.recent.size() > 1 &&
+           (log.recent.size() > REPLAY_MAX_MESSAGES || log.bytes > REPLAY_MAX_BYTES))
+    {
+        log.bytes -= log.recent.front().second->size();
+        log.recent.pop_front();
+    }
+    if (latest)
+        last_values_[room] = message;
+    return latest;
+}
+
+// 把消息交给房间内skip以外的会话发送
+void session_manager::fan_out(const std::string &room, const std::string &message,
+                              std::shared_ptr<const std::string> shared, uint64_t room_seq,
+                              const std::unordered_set<session *> *skip, const std::string &selection)
+{
+    bool primary = selection == SESSION_PRIMARY_SELECTION;
+    auto it = rooms_.find(room);
+    if (it == rooms_.end())
+        return;
+
+    // 追踪的消息在交给会话时加上分发时间，保留的消息不带，补发时不会被当作实时延迟。
+    // 只解析和重写头部，消息体只复制一次
+    const std::string *outgoing = &message;
+    size_t head_end = is_traced(message) ? message.find("\n\n") : std::string::npos;
+    clip_message head;
+    if (head_end != std::string::npos && clip_message::parse(message.substr(0, head_end + 2), head))
+    {
+        head.set("t-fanout", std::to_string(trace_now_micros()));
+        if (latency_)
+            latency_->record(head);
+        std::string traced = head.serialize();
+        traced.append(message, head_end + 2, std::string::npos);
+        shared = std::make_shared<const std::string>(std::move(traced));
+        outgoing = shared.get();
+    }
+
+    // 遍历房间内所有会话，由各会话按通道优先级异步发送，队列中同一选择尚未发送的旧内容被取代
+    // 带序号的消息和通告只在房间里有需要的会话时生成一次，由这些会话共享
+    SERVER_PROBE3(broadcast_start, room.c_str(), room_seq, outgoing->size());
+    std::shared_ptr<const std::string> stamped;
+    std::shared_ptr<const std::string> announced;
+    size_t recipients = 0;
+    for (auto *s : it->second)
+    {
+        if (skip && skip->count(s))
+            continue;
+        ++recipients;
+        if (!primary && announces_to(*s, outgoing->size()))
+        {
+            if (!announced)
+                announced = announce(*outgoing, room_seq);
+            s->deliver(announced, selection);
+        }
+        else if (!primary && s->sequenced())
+        {
+            if (!stamped)
+                stamped = stamp(*outgoing, room_seq);
+            s->deliver(stamped, selection);
+        }
+        else
+        {
+            s->deliver(shared, selection);
+        }
+    }
+    SERVER_PROBE3(broadcast_end, room.c_str(), room_seq, recipients);
+}
+
+// 给消息加上房间序号
+std::shared_ptr<const std::string> session_manager::stamp(const std::string &message, uint64_t seq) const
+{
+    clip_message msg;
+    if (!clip_message::parse(message, msg))
+    {
+        msg = clip_message();
+        msg.set("type", "clip");
+        msg.body = message;
+    }
+    msg.set("seq", std::to_string(seq));
+    msg.set("epoch", epoch_);
+    return std::make_shared<const std::string>(msg.serialize());
+}
+
+// 向续传会话补发错过的消息
+void session_manager::replay(session &s, const resume_point &resume)
+{
+    const std::string &room = s.room();
+    room_log &log = room_logs_[room];
+
+    // 同一纪元内的序号才有意义
+    bool same_epoch = resume.epoch == epoch_ && resume.seq <= log.seq;
+    if (same_epoch && resume.seq == log.seq)
+        return;
+
+    // 错过的消息都还在内存中时逐条补发
+    if (same_epoch && !log.recent.empty() && log.recent.front().first <= resume.seq + 1)
+    {
+        for (const auto &entry : log.recent)
+        {
+            if (entry.first > resume.seq)
+                s.deliver(announces_to(s, entry.second->size()) ? announce(*entry.second, entry.first)
+                                                         : stamp(*entry.second, entry.first),
+                          SESSION_CLIPBOARD_SELECTION);
+        }
+        return;
+    }
+
+    // 否则只发送房间最新内容
+    auto last = last_values_.find(room);
+    if (last != last_values_.end())
+        s.deliver(announces_to(s, last->second->size()) ? announce(*last->second, log.seq)
+                                                 : stamp(*last->second, log.seq),
+                  SESSION_CLIPBOARD_SELECTION);
+}
+
+// 会话是否只需要收到消息的通告
+bool session_manager::announces_to(const session &s, size_t size) const
+{
+    return s.lazy() && size > lazy_threshold_;
+}
+
+// 生成消息的通告：格式、长度、指纹和文本预览，不含数据
+std::shared_ptr<const std::string> session_manager::announce(const std::string &message, uint64_t seq) const
+{
+    clip_message msg;
+    std::vector<clip_part> parts;
+    if (!clip_message::parse(message, msg) || !msg.parts(parts))
+        return stamp(message, seq);
+
+    clip_message notice;
+    notice.set("type", "announce");
+    notice.set("seq", std::to_string(seq));
+    notice.set("epoch", epoch_);
+    notice.set("size", std::to_string(msg.body.size()));
+    notice.set("fingerprint", payload_fingerprint(msg.body));
+
+    std::string formats;
+    for (const auto &part : parts)
+    {
+        if (!formats.empty())
+            formats += ',';
+        formats += part.mime;
+    }
+    notice.set("formats", formats);
+
+    // 预览取第一种文本表示的开头，截断在UTF-8字符边界上；加密的内容没有预览
+    for (const auto &part : parts)
+    {
+        if (!msg.get("enc").empty())
+            break;
+        if (part.mime.compare(0, 5, "text/") != 0)
+            continue;
+        size_t length = std::min(part.length, ANNOUNCE_PREVIEW_BYTES);
+        while (length > 0 && length < part.length &&
+               (static_cast<unsigned char>(msg.body[part.offset + length]) & 0xC0) == 0x80)
+            --length;
+        notice.body = msg.body.substr(part.offset, length);
+        break;
+    }
+    return std::make_shared<const std::string>(notice.serialize());
+}
+
+// 设置按需获取的阈值
+void session_manager::set_lazy_threshold(size_t threshold)
+{
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    lazy_threshold_ = threshold;
+}
+
+// 设置是否直通转发大消息
+void session_manager::set_stream_relay(bool enabled)
+{
+    stream_relay_ = enabled;
+}
+
+// 开始直通转发房间内的一条消息
+//
+// 只转发给需要整条消息的会话；按需获取的会话等收齐后再收到通告。
+// 转发前必须能确定消息有效，因此检查UTF-8时含未加密纯文本表示的消息不直通转发，
+// 收齐后校验再广播。加上t-fanout和序号后超过消息上限时也不直通转发，接收方会丢弃超限的消息
+uint64_t session_manager::begin_relay(const std::string &room, const clip_message &head, size_t body_size)
+{
+    if (!stream_relay_)
+        return 0;
+    if (validate_utf8_ && head.get("enc").empty() &&
+        head.get("parts", head.get("mime", "text/plain")).find("text/plain") != std::string::npos)
+        return 0;
+
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    auto it = rooms_.find(room);
+    if (it == rooms_.end())
+        return 0;
+
+    clip_message outgoing = head;
+    outgoing.body.clear();
+    if (!outgoing.get("trace").empty())
+        outgoing.set("t-fanout", std::to_string(trace_now_micros()));
+    auto plain = std::make_shared<const std::string>(outgoing.serialize());
+
+    std::unordered_set<session *> recipients;
+    bool sequenced = false;
+    for (auto *s : it->second)
+    {
+        if (s->streamed() && !announces_to(*s, plain->size() + body_size))
+        {
+            recipients.insert(s);
+            sequenced = sequenced || s->sequenced();
+        }
+    }
+    if (recipients.empty())
+        return 0;
+
+    // 续传会话收到的头部带有房间序号
+    uint64_t seq = room_logs_[room].seq + 1;
+    std::shared_ptr<const std::string> stamped;
+    if (sequenced)
+    {
+        outgoing.set("seq", std::to_string(seq));
+        outgoing.set("epoch", epoch_);
+        stamped = std::make_shared<const std::string>(outgoing.serialize());
+    }
+    if (std::max(plain->size(), stamped ? stamped->size() : 0) + body_size > MAX_MESSAGE_SIZE)
+        return 0;
+
+    relay_state &relay = relays_[next_relay_id_];
+    relay.room = room;
+    relay.seq = room_logs_[room].seq = seq;
+    relay.recipients = std::move(recipients);
+    for (auto *s : relay.recipients)
+    {
+        const auto &message = s->sequenced() ? stamped : plain;
+        s->begin_relay(next_relay_id_, message->size() + body_size, SESSION_CLIPBOARD_SELECTION);
+        s->relay(next_relay_id_, message);
+    }
+    return next_relay_id_++;
+}
+
+// 转发消息体的下一段数据
+void session_manager::relay_data(uint64_t relay_id, std::shared_ptr<const std::string> data)
+{
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    auto it = relays_.find(relay_id);
+    if (it == relays_.end())
+        return;
+    for (auto *s : it->second.recipients)
+        s->relay(relay_id, data);
+}
+
+// 消息已收齐
+void session_manager::finish_relay(const std::string &room, uint64_t relay_id, const std::string &message)
+{
+    std::cout << "直通转发剪贴板内容到房间 " << room << "完成，长度: " << message.length() << "\n";
+
+    auto shared = std::make_shared<const std::string>(message);
+    if (history_)
+        history_->append(room, shared);
+
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    auto it = relays_.find(relay_id);
+    if (it == relays_.end())
+        return;
+    relay_state relay = std::move(it->second);
+    relays_.erase(it);
+    if (search_)
+        search_->add(room, relay.seq, shared);
+
+    // 收到直通转发的会话已排队全部分片，其他会话收到整条消息或通告
+    for (auto *s : relay.recipients)
+        s->end_relay(relay_id, true);
+    if (retain(room, relay.seq, shared))
+        fan_out(room, message, std::move(shared), relay.seq, &relay.recipients, SESSION_CLIPBOARD_SELECTION);
+}
+
+// 放弃直通转发
+//
+// 分配的序号不再使用，续传和获取按缺失的序号处理
+void session_manager::abort_relay(uint64_t relay_id)
+{
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    auto it = relays_.find(relay_id);
+    if (it == relays_.end())
+        return;
+    for (auto *s : it->second.recipients)
+        s->end_relay(relay_id, false);
+    relays_.erase(it);
+}
+
+// 设置是否检查纯文本的UTF-8编码
+void session_manager::set_validate_utf8(bool validate)
+{
+    validate_utf8_ = validate;
+}
+
+// 信封消息中未加密的纯文本表示是否是有效的UTF-8
+bool session_manager::text_is_valid(const clip_message &msg) const
+{
+    if (!validate_utf8_ || !msg.get("enc").empty())
+        return true;
+    std::vector<clip_part> parts;
+    if (!msg.parts(parts))
+        return true;
+    for (const auto &part : parts)
+    {
+        if (part.mime.compare(0, 10, "text/plain") == 0 &&
+            !is_valid_utf8(msg.body.data() + part.offset, part.length))
+            return false;
+    }
+    return true;
+}
+
+// 旧版纯文本消息是否是有效的UTF-8
+bool session_manager::text_is_valid(const std::string &text) const
+{
+    return !validate_utf8_ || is_valid_utf8(text);
+}
+
+// 对端转发来的消息是否是本地客户端也能广播的内容
+//
+// 与clipboard_server::handle_message对客户端消息的检查相同，对端不能注入本地客户端发不出的消息
+bool session_manager::relayable(const std::string &message) const
+{
+    if (!clip_message::is_envelope(message))
+        return text_is_valid(message);
+    clip_message msg;
+    return clip_message::parse(message, msg) && msg.get("type") == "clip" && text_is_valid(msg);
+}
+
+// 向会话发送房间中通告过的消息
+//
+// 先在房间最近的消息中查找；已不在内存中时由全文索引的后台线程取回条目的文本，
+// 以单一表示发回，再回到会话的执行器上发送
+void session_manager::fetch(const std::shared_ptr<session> &s, uint64_t seq, const std::string &epoch)
+{
+    std::shared_ptr<const std::string> message;
     {
-        // 异步写入数据到WebSocket
-        ws->async_write(net::buffer(message),
-                        [ws](beast::error_code ec, std::size_t)
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        auto log = room_logs_.find(s->room());
+        // 其他纪元的序号已经失效
+        if (log != room_logs_.end() && epoch == epoch_)
+        {
+            for (const auto &entry : log->second.recent)
+            {
+                if (entry.first == seq)
+                    message = entry.second;
+            }
+        }
+    }
+
+    clip_message reply;
+    if (message && clip_message::parse(*message, reply))
+    {
+        reply.set("type", "fetch-result");
+        reply.set("seq", std::to_string(seq));
+        reply.set("epoch", epoch_);
+        s->deliver(std::make_shared<const std::string>(reply.serialize()));
+        return;
+    }
+
+    if (!search_ || epoch != epoch_)
+    {
+        s->deliver(gone_reply(seq));
+        return;
+    }
+    search_->lookup(s->room(), seq,
+                    [this, s, seq](std::shared_ptr<const std::string> text, const std::string &mime)
+                    {
+                        std::shared_ptr<const std::string> out;
+                        if (!text)
+                        {
+                            out = gone_reply(seq);
+                        }
+                        else
                         {
-                            // 错误处理
-                            if (ec)
-                            {
-                                std::cerr << "发送失败: " << ec.message()
-                                          << " (code: " << ec.value() << ")" << std::endl;
-                            }
-                        });
+                            clip_message found;
+                            found.set("type", "fetch-result");
+                            found.set("seq", std::to_string(seq));
+                            found.set("epoch", epoch_);
+                            found.set("mime", mime);
+                            found.body = *text;
+                            out = std::make_shared<const std::string>(found.serialize());
+                        }
+                        net::post(s->stream().get_executor(), [s, out]()
+                                  { s->deliver(out); });
+                    });
+}
+
+// 条目已不在内存中时的获取结果
+std::shared_ptr<const std::string> session_manager::gone_reply(uint64_t seq) const
+{
+    clip_message reply;
+    reply.set("status", "gone");
+    reply.set("type", "fetch-result");
+    reply.set("seq", std::to_string(seq));
+    reply.set("epoch", epoch_);
+    return std::make_shared<const std::string>(reply.serialize());
+}
+
+// 记录会话可以接收的剪贴板格式
+void session_manager::set_accepts(session *s, std::vector<std::string> formats)
+{
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    s->set_accepts(std::move(formats));
+    notify_formats(s->room());
+}
+
+// 向房间内每个会话通知其他会话可以接收的格式
+void session_manager::notify_formats(const std::string &room)
+{
+    auto it = rooms_.find(room);
+    if (it == rooms_.end())
+        return;
+
+    for (auto *s : it->second)
+    {
+        std::set<std::string> formats;
+        for (auto *other : it->second)
+        {
+            if (other != s)
+                formats.insert(other->accepts().begin(), other->accepts().end());
+        }
+
+        std::string list;
+        for (const auto &format : formats)
+            list += format + "\n";
+        if (list == s->advertised_formats())
+            continue;
+        s->advertised_formats() = list;
+
+        clip_message msg;
+        msg.set("type", "formats");
+        msg.body = list;
+        s->deliver(std::make_shared<const std::string>(msg.serialize()));
     }
 }
 
+// 设置历史日志
+void session_manager::set_history(history_log *history)
+{
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    history_ = history;
+    if (history_)
+        last_values_ = history_->recovered_last_values();
+}
+
+// 设置全文搜索索引
+void session_manager::set_search(search_index *search)
+{
+    search_ = search;
+}
+
+// 设置延迟统计
+void session_manager::set_latency_stats(latency_stats *latency)
+{
+    latency_ = latency;
+}
+
+// 用历史日志中的消息建立全文索引
+void session_manager::index_history(const std::string &room, std::shared_ptr<const std::string> message)
+{
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    uint64_t room_seq = ++room_logs_[room].seq;
+    if (search_)
+        search_->add(room, room_seq, std::move(message));
+}
+
+// 在房间的剪贴板历史中搜索
+void session_manager::search(const std::string &room, const std::string &query, size_t limit,
+                             std::function<void(std::vector<search_hit>)> done)
+{
+    if (!search_)
+        return done({});
+    search_->query(room, query, limit, std::move(done));
+}
+
+// 设置房间状态变化回调
+void session_manager::set_room_listener(room_listener listener)
+{
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    room_listener_ = std::move(listener);
+}
+
+// 获取当前有成员的房间列表
+std::vector<std::string> session_manager::active_rooms()
+{
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    std::vector<std::string> rooms;
+    rooms.reserve(rooms_.size());
+    for (const auto &entry : rooms_)
+        rooms.push_back(entry.first);
+    return rooms;
+}
+
 // 剪贴板服务器构造函数
-clipboard_server::clipboard_server(net::io_context &ioc, tcp::endpoint endpoint, session_manager &manager)
-    : ioc_(ioc), acceptor_(ioc, endpoint), manager_(manager)
+clipboard_server::clipboard_server(net::io_context &ioc, tcp::endpoint endpoint, session_manager &manager,
+                                   cluster_node *cluster)
+    : ioc_(ioc), acceptor_(ioc, endpoint), manager_(manager), cluster_(cluster)
 {
     // 开始接受连接
     do_accept();
@@ -77,8 +743,9 @@ void clipboard_server::do_accept()
             // 如果没有错误，处理新连接
             if (!ec)
             {
+                SERVER_PROBE1(accept, socket.native_handle());
                 // 创建WebSocket流
-                auto ws = std::make_shared<websocket::stream<tcp::socket>>(std::move(socket));
+                auto ws = std::make_shared<ws_stream>(std::move(socket));
                 // 进行WebSocket握手
                 do_handshake(ws);
             }
@@ -88,47 +755,296 @@ void clipboard_server::do_accept()
 }
 
 // 处理WebSocket握手
-void clipboard_server::do_handshake(std::shared_ptr<websocket::stream<tcp::socket>> ws)
+void clipboard_server::do_handshake(std::shared_ptr<ws_stream> ws)
 {
-    // 异步接受WebSocket连接
-    ws->async_accept(
-        [this, ws](beast::error_code ec)
-        {
-            // 如果握手成功
-            if (!ec)
-            {
-                // 添加会话到管理器
-                manager_.add(ws);
-                // 开始读取数据
-                do_read(ws);
-            }
-        });
+    // 先读取HTTP升级请求，以便根据请求目标区分客户端房间和集群对端
+    auto buffer = std::make_shared<beast::flat_buffer>();
+    auto req = std::make_shared<http::request<http::string_body>>();
+
+    http::async_read(ws->next_layer(), *buffer, *req,
+                     [this, ws, buffer, req](beast::error_code ec, std::size_t)
+                     {
+                         if (ec || !websocket::is_upgrade(*req))
+                             return;
+
+                         // 对端连接可以向所有房间投递消息，未出示集群密钥时在升级前断开
+                         if (req->target() == CLUSTER_TARGET && (!cluster_ || !cluster_->authorized(*req)))
+                         {
+                             std::cerr << "拒绝未认证的集群连接\n";
+                             beast::error_code ignored;
+                             ws->next_layer().close(ignored);
+                             return;
+                         }
+
+                         // 异步接受WebSocket连接
+                         ws->async_accept(*req,
+                                          [this, ws, req](beast::error_code ec)
+                                          {
+                                              // 如果握手失败则丢弃连接
+                                              if (ec)
+                                                  return;
+
+                                              // 集群对端节点的入站连接交给集群节点处理
+                                              if (req->target() == CLUSTER_TARGET)
+                                              {
+                                                  cluster_->accept_peer(ws);
+                                                  return;
+                                              }
+
+                                              resume_point resume;
+                                              bool sequenced = resume_from_target(req->target(), resume);
+                                              // 通告以房间序号标识内容，按需获取的会话总是带序号
+                                              bool lazy = flag_from_target(req->target(), "lazy");
+                                              bool streamed = flag_from_target(req->target(), "stream");
+                                              auto s = std::make_shared<session>(ws, room_from_target(req->target()),
+                                                                                 sequenced || lazy, lazy, streamed);
+                                              // 超过上限的消息在读取过程中就被拒绝，不会先缓冲整条消息
+                                              ws->read_message_max(MAX_MESSAGE_SIZE);
+                                              SERVER_PROBE3(handshake, s->id(), s->room().c_str(), lazy);
+                                              // 添加会话到管理器
+                                              manager_.add(s, resume);
+                                              // 开始读取数据
+                                              do_read(s);
+                                          });
+                     });
 }
 
 // 从客户端读取数据
-void clipboard_server::do_read(std::shared_ptr<websocket::stream<tcp::socket>> ws)
+//
+// 未启用直通转发时整条读取消息，启用时分段读取
+void clipboard_server::do_read(std::shared_ptr<session> s)
 {
-    // 创建缓冲区存储接收到的数据
+    if (manager_.stream_relay())
+    {
+        read_some(s, std::make_shared<inbound_message>());
+        return;
+    }
+
     auto buffer = std::make_shared<beast::flat_buffer>();
+    s->stream().async_read(*buffer,
+                           [this, s, buffer](beast::error_code ec, std::size_t)
+                           {
+                               // 如果读取出错(包括消息超过上限)，移除会话
+                               if (ec)
+                               {
+                                   manager_.remove(s.get());
+                                   return;
+                               }
+                               std::string message = beast::buffers_to_string(buffer->data());
+                               SERVER_PROBE2(message, s->id(), message.size());
+                               handle_message(s, std::move(message));
+                               // 继续读取下一个消息
+                               do_read(s);
+                           });
+}
+
+// 读取消息的下一段
+//
+// 每次最多读取SESSION_CHUNK_SIZE字节。直通转发的消息每读到一段就转发给收到直通转发的会话，
+// 不等整条消息收齐；其他消息收齐后再处理
+void clipboard_server::read_some(std::shared_ptr<session> s, std::shared_ptr<inbound_message> in)
+{
+    s->stream().async_read_some(in->buffer, SESSION_CHUNK_SIZE,
+                                [this, s, in](beast::error_code ec, std::size_t bytes)
+                                {
+                                    // 如果读取出错(包括消息超过上限)，移除会话
+                                    if (ec)
+                                    {
+                                        if (in->relay_id)
+                                            manager_.abort_relay(in->relay_id);
+                                        manager_.remove(s.get());
+                                        return;
+                                    }
+
+                                    bool done = s->stream().is_message_done();
+                                    if (in->relay_id)
+                                    {
+                                        // 消息体超过声明的长度时放弃直通转发，收齐后照常广播
+                                        if (in->buffer.size() - in->body_offset > in->body_size)
+                                        {
+                                            manager_.abort_relay(in->relay_id);
+                                            in->relay_id = 0;
+                                        }
+                                        else if (bytes > 0)
+                                        {
+                                            const char *data = static_cast<const char *>(in->buffer.data().data());
+                                            manager_.relay_data(in->relay_id, std::make_shared<const std::string>(
+                                                                                  data + in->buffer.size() - bytes, bytes));
+                                        }
+                                    }
+                                    else if (!done && !in->relay_checked)
+                                    {
+                                        try_relay(s, *in);
+                                    }
+
+                                    if (!done)
+                                    {
+                                        read_some(s, in);
+                                        return;
+                                    }
+
+                                    std::string message = beast::buffers_to_string(in->buffer.data());
+                                    SERVER_PROBE2(message, s->id(), message.size());
+                                    if (in->relay_id && message.size() - in->body_offset == in->body_size)
+                                    {
+                                        // 交给房间保留的消息带有t-recv
+                                        message.replace(0, in->body_offset, in->head);
+                                        manager_.finish_relay(s->room(), in->relay_id, message);
+                                        // 集群之间仍然整条转发
+                                        if (cluster_)
+                                            cluster_->relay(s->room(), message);
+                                    }
+                                    else
+                                    {
+                                        if (in->relay_id)
+                                            manager_.abort_relay(in->relay_id);
+                                        handle_message(s, std::move(message));
+                                    }
+                                    // 继续读取下一个消息
+                                    do_read(s);
+                                });
+}
+
+// 头部到达后尝试开始直通转发
+//
+// 只有头部已经完整、带有size头部且超过一个分片的剪贴板消息才直通转发
+void clipboard_server::try_relay(const std::shared_ptr<session> &s, inbound_message &in)
+{
+    std::string received = beast::buffers_to_string(in.buffer.data());
+    size_t head_end = received.find("\n\n");
+    if (!clip_message::is_envelope(received) || head_end == std::string::npos)
+    {
+        // 头部可能还没有收完
+        in.relay_checked = received.size() >= SESSION_CHUNK_SIZE || !clip_message::is_envelope(received);
+        return;
+    }
+    in.relay_checked = true;
 
-    // 异步读取数据
-    ws->async_read(*buffer,
-                   [this, ws, buffer](beast::error_code ec, std::size_t)
-                   {
-                       // 如果读取成功
-                       if (!ec)
-                       {
-                           // 将缓冲区数据转换为字符串
-                           std::string message = beast::buffers_to_string(buffer->data());
-                           // 广播消息给所有客户端
-                           manager_.broadcast(message);
-                           // 继续读取下一个消息
-                           do_read(ws);
-                       }
-                       else
-                       {
-                           // 如果读取出错，移除会话
-                           manager_.remove(ws.get());
-                       }
-                   });
+    // PRIMARY不分配序号，走普通的广播
+    clip_message head;
+    if (!clip_message::parse(received.substr(0, head_end + 2), head) || head.get("type") != "clip" ||
+        head.get("selection") == SESSION_PRIMARY_SELECTION)
+        return;
+    char *end = nullptr;
+    std::string size = head.get("size");
+    in.body_size = std::strtoull(size.c_str(), &end, 10);
+    in.body_offset = head_end + 2;
+    if (size.empty() || *end != '\0' || in.body_offset + in.body_size <= SESSION_CHUNK_SIZE ||
+        received.size() - in.body_offset > in.body_size)
+        return;
+
+    // 追踪的消息记录服务器开始收到的时间；加上后的整条消息仍不能超过上限
+    if (!head.get("trace").empty())
+        head.set("t-recv", std::to_string(trace_now_micros()));
+    std::string rewritten = head.serialize();
+    if (rewritten.size() + in.body_size > MAX_MESSAGE_SIZE)
+        return;
+    in.relay_id = manager_.begin_relay(s->room(), head, in.body_size);
+    if (!in.relay_id)
+        return;
+    in.head = std::move(rewritten);
+    if (received.size() > in.body_offset)
+        manager_.relay_data(in.relay_id, std::make_shared<const std::string>(received.substr(in.body_offset)));
+}
+
+// 处理一条完整的消息
+void clipboard_server::handle_message(const std::shared_ptr<session> &s, std::string message)
+{
+    // 搜索请求、格式声明和获取请求不广播；只有剪贴板内容会广播，服务器发出的类型
+    // (formats、announce、fetch-result、chunk等)和无法解析的信封直接丢弃
+    if (clip_message::is_envelope(message))
+    {
+        clip_message request;
+        if (!clip_message::parse(message, request))
+        {
+            std::cerr << "丢弃格式错误的消息\n";
+            return;
+        }
+        std::string type = request.get("type");
+        if (type == "search")
+        {
+            handle_search(s, request);
+            return;
+        }
+        if (type == "accept")
+        {
+            manager_.set_accepts(s.get(), split_lines(request.body));
+            return;
+        }
+        if (type == "fetch")
+        {
+            manager_.fetch(s, std::strtoull(request.get("seq").c_str(), nullptr, 10),
+                           request.get("epoch"));
+            return;
+        }
+        if (type != "clip")
+        {
+            std::cerr << "丢弃类型为 " << type << " 的客户端消息\n";
+            return;
+        }
+        if (!manager_.text_is_valid(request))
+        {
+            std::cerr << "丢弃纯文本不是有效UTF-8的消息\n";
+            return;
+        }
+        // 追踪的消息记录服务器收到的时间
+        if (!request.get("trace").empty())
+        {
+            request.set("t-recv", std::to_string(trace_now_micros()));
+            message = request.serialize();
+        }
+    }
+    else if (!manager_.text_is_valid(message))
+    {
+        std::cerr << "丢弃不是有效UTF-8的纯文本消息\n";
+        return;
+    }
+    // 广播消息给房间内所有客户端
+    manager_.broadcast(s->room(), message);
+    // 转发给房间有成员的其他节点
+    if (cluster_)
+        cluster_->relay(s->room(), message);
+}
+
+// 处理客户端的搜索请求
+//
+// 请求：type=search，可选limit，消息体为查询词(至少一个词不短于3个字节)
+// 响应：type=search-result，带epoch头部，消息体为若干条 "<房间序号> <得分> <长度> <预览长度>\n<预览>"，
+// 预览是第一处匹配附近最多200字节的文本，完整内容用type=fetch按序号获取
+//
+// 查询在全文索引的后台线程中执行，结果回到会话的执行器上发送
+void clipboard_server::handle_search(const std::shared_ptr<session> &s, const clip_message &req)
+{
+    size_t limit = 20;
+    try
+    {
+        limit = std::min<size_t>(std::stoul(req.get("limit", "20")), 100);
+    }
+    catch (const std::exception &)
+    {
+    }
+
+    std::string id = req.get("id");
+    std::string epoch = manager_.epoch();
+    manager_.search(s->room(), req.body, limit,
+                    [s, id, epoch](std::vector<search_hit> hits)
+                    {
+                        clip_message response;
+                        response.set("type", "search-result");
+                        if (!id.empty())
+                            response.set("id", id);
+                        response.set("epoch", epoch);
+                        response.set("count", std::to_string(hits.size()));
+                        for (const auto &hit : hits)
+                        {
+                            char score[32];
+                            std::snprintf(score, sizeof(score), "%.3f", hit.score);
+                            response.body += std::to_string(hit.seq) + " " + score + " " + std::to_string(hit.size) +
+                                             " " + std::to_string(hit.preview.size()) + "\n";
+                            response.body += hit.preview;
+                        }
+                        auto out = std::make_shared<const std::string>(response.serialize());
+                        net::post(s->stream().get_executor(), [s, out]()
+                                  { s->deliver(out); });
+                    });
 }
@@ -3,30 +3,190 @@
 
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include <mutex>
 
 // 命名空间简写，提高代码可读性
 namespace net = boost::asio;
 namespace beast = boost::beast;
+namespace http = beast::http;
 using tcp = net::ip::tcp;
 namespace websocket = beast::websocket;
 
+using ws_stream = websocket::stream<tcp::socket>;
+
+class cluster_node;
+class history_log;
+class latency_stats;
+class search_index;
+struct search_hit;
+struct clip_message;
+class session;
+
+// 客户端重连时在握手目标中携带的续传位置，例如 "/team?since=42&epoch=1700000000000"
+struct resume_point
+{
+    // 上次收到的消息所属的服务器纪元
+    std::string epoch;
+    // 上次收到的房间序号
+    uint64_t seq = 0;
+};
+
 // 会话管理器类，负责管理所有WebSocket连接
+//
+// 会话按房间分组，广播只发送给同一房间内的会话。
+// 每个房间的最新消息会被保留，新会话加入时立即收到。
+//
+// 每个房间的消息按顺序编号并保留最近的若干条。请求续传的会话收到的消息带有
+// seq和epoch头部，重连时携带最后收到的位置，只补发错过的消息；
+// 纪元不同(服务器重启)或错过的消息已不在内存中时只发送房间最新内容。
+//
+// 客户端用type=accept消息声明可以接收的格式，管理器把房间内其他会话
+// 可接收格式的并集用type=formats消息通知给每个会话，发送方据此只上传有人使用的表示。
+//
+// 按需获取的会话(握手目标带lazy=1)对超过阈值的消息只收到type=announce通告，
+// 包含序号、格式、长度、指纹和文本预览；本地应用粘贴时客户端发送type=fetch，
+// 管理器从房间最近的消息中找到该序号并以type=fetch-result发回；已不在最近的消息中时
+// 从全文索引取回文本表示，仍找不到时status为gone。
+//
+// 启用直通转发时，带size头部(消息体长度)的大消息在头部到达后就分配房间序号并开始转发给
+// 握手目标带stream=1的会话，之后每收到一段数据就转发一段；收齐后再保留并发送给其他会话。
+// 序号按开始转发的顺序分配，收齐时已有更新的内容完成则不再成为房间的最新内容。
+//
+// 带trace头部的消息在交给会话发送时加上t-fanout时间戳(补发和获取的消息不加)，
+// 接收方据此计算各段延迟；启用延迟统计时同时记录服务器可见的各段。
 class session_manager
 {
 public:
-    // 添加新的WebSocket会话
-    void add(std::shared_ptr<websocket::stream<tcp::socket>> ws);
-    // 移除WebSocket会话
-    void remove(websocket::stream<tcp::socket> *ws);
-    // 向所有连接的客户端广播消息
-    void broadcast(const std::string &message);
+    session_manager();
+
+    // 房间从无成员变为有成员(active=true)或反之时的回调
+    using room_listener = std::function<void(const std::string &room, bool active)>;
+
+    // 添加新的会话到其所属房间，续传会话从resume之后开始补发
+    void add(std::shared_ptr<session> s, const resume_point &resume = resume_point());
+    // 从所属房间移除会话
+    void remove(session *s);
+    // 向房间内所有连接的客户端广播消息，PRIMARY的内容只实时转发
+    void broadcast(const std::string &room, const std::string &message);
+    // 设置房间状态变化回调
+    void set_room_listener(room_listener listener);
+    // 获取当前有成员的房间列表
+    std::vector<std::string> active_rooms();
+    // 设置历史日志，并用日志中恢复的各房间最新消息初始化
+    void set_history(history_log *history);
+    // 设置全文搜索索引
+    void set_search(search_index *search);
+    // 设置延迟统计
+    void set_latency_stats(latency_stats *latency);
+    // 记录会话可以接收的剪贴板格式，并通知房间内其他会话
+    void set_accepts(session *s, std::vector<std::string> formats);
+    // 设置是否检查消息中的纯文本是否是有效的UTF-8，在开始接受连接前调用
+    void set_validate_utf8(bool validate);
+    // 信封消息中未加密的纯文本表示是否是有效的UTF-8，未启用检查时总是true
+    bool text_is_valid(const clip_message &msg) const;
+    // 旧版纯文本消息是否是有效的UTF-8，未启用检查时总是true
+    bool text_is_valid(const std::string &text) const;
+    // 对端转发来的消息是否是本地客户端也能广播的内容：旧版纯文本或type为clip的信封，且通过UTF-8检查
+    bool relayable(const std::string &message) const;
+    // 设置按需获取的阈值，不超过该长度的消息仍整条发送
+    void set_lazy_threshold(size_t threshold);
+    // 设置是否直通转发大消息，在开始接受连接前调用
+    void set_stream_relay(bool enabled);
+    // 是否直通转发大消息
+    bool stream_relay() const { return stream_relay_; }
+    // 开始直通转发房间内的一条消息，head是消息的头部(消息体为空)，body_size是消息体的总长度。
+    // 返回转发编号；无法直通转发时返回0，调用方收齐后照常广播
+    uint64_t begin_relay(const std::string &room, const clip_message &head, size_t body_size);
+    // 转发消息体的下一段数据
+    void relay_data(uint64_t relay_id, std::shared_ptr<const std::string> data);
+    // 消息已收齐，保留并发送给没有收到直通转发的会话
+    void finish_relay(const std::string &room, uint64_t relay_id, const std::string &message);
+    // 发送方断开或消息与声明的长度不符，放弃直通转发
+    void abort_relay(uint64_t relay_id);
+    // 向会话发送房间中通告过的消息，已不在最近的消息中时从全文索引取回文本
+    void fetch(const std::shared_ptr<session> &s, uint64_t seq, const std::string &epoch);
+    // 用历史日志中的一条消息建立全文索引并为它分配房间序号，在开始接受连接前按日志顺序调用
+    void index_history(const std::string &room, std::shared_ptr<const std::string> message);
+    // 在房间的剪贴板历史中搜索，done在全文索引的后台线程中调用，未启用搜索时立即以空结果调用
+    void search(const std::string &room, const std::string &query, size_t limit,
+                std::function<void(std::vector<search_hit>)> done);
+    // 本次运行的纪元
+    const std::string &epoch() const { return epoch_; }
 
 private:
-    // 存储所有活跃的WebSocket会话
-    std::unordered_set<websocket::stream<tcp::socket> *> sessions_;
+    // 房间最近的消息，用于断线续传
+    struct room_log
+    {
+        // 房间最后一条消息的序号
+        uint64_t seq = 0;
+        // 最近的消息(序号、原始消息)，从旧到新
+        std::deque<std::pair<uint64_t, std::shared_ptr<const std::string>>> recent;
+        // recent中消息的总字节数
+        size_t bytes = 0;
+    };
+
+    // 进行中的直通转发
+    struct relay_state
+    {
+        std::string room;
+        // 开始转发时分配的房间序号
+        uint64_t seq = 0;
+        // 收到直通转发的会话
+        std::unordered_set<session *> recipients;
+    };
+
+    // 给消息加上房间序号，供续传会话使用
+    std::shared_ptr<const std::string> stamp(const std::string &message, uint64_t seq) const;
+    // 生成消息的通告，供按需获取的会话使用
+    std::shared_ptr<const std::string> announce(const std::string &message, uint64_t seq) const;
+    // 会话是否只需要收到消息的通告
+    bool announces_to(const session &s, size_t size) const;
+    // 保留房间的消息，返回它是否是房间的最新内容，调用方持有锁
+    bool retain(const std::string &room, uint64_t seq, const std::shared_ptr<const std::string> &message);
+    // 条目已不在内存中时的获取结果
+    std::shared_ptr<const std::string> gone_reply(uint64_t seq) const;
+    // 把消息交给房间内skip以外的会话发送，调用方持有锁；PRIMARY的消息原样发送
+    void fan_out(const std::string &room, const std::string &message, std::shared_ptr<const std::string> shared,
+                 uint64_t seq, const std::unordered_set<session *> *skip, const std::string &selection);
+    // 向续传会话补发错过的消息，调用方持有锁
+    void replay(session &s, const resume_point &resume);
+    // 向房间内每个会话通知其他会话可以接收的格式(有变化时)，调用方持有锁
+    void notify_formats(const std::string &room);
+
+    // 按房间存储所有活跃的WebSocket会话
+    std::unordered_map<std::string, std::unordered_set<session *>> rooms_;
+    // 每个房间的最新消息
+    std::unordered_map<std::string, std::shared_ptr<const std::string>> last_values_;
+    // 每个房间的序号和最近消息
+    std::unordered_map<std::string, room_log> room_logs_;
+    // 本次运行的序号纪元，房间序号在重启后从头计数
+    std::string epoch_;
+    // 当前连接总数
+    size_t session_count_ = 0;
+    // 历史日志，未启用时为空
+    history_log *history_ = nullptr;
+    // 全文搜索索引，未启用时为空
+    search_index *search_ = nullptr;
+    // 延迟统计，未启用时为空
+    latency_stats *latency_ = nullptr;
+    // 按需获取的阈值
+    size_t lazy_threshold_ = 4096;
+    // 是否检查纯文本的UTF-8编码
+    bool validate_utf8_ = false;
+    // 是否直通转发大消息
+    bool stream_relay_ = false;
+    // 进行中的直通转发，按转发编号索引
+    std::unordered_map<uint64_t, relay_state> relays_;
+    uint64_t next_relay_id_ = 1;
+    // 房间状态变化回调
+    room_listener room_listener_;
     // 互斥锁，保证线程安全
     std::mutex sessions_mutex_;
 };
@@ -36,15 +196,39 @@ class clipboard_server
 {
 public:
     // 构造函数，初始化服务器并开始接受连接
-    clipboard_server(net::io_context &ioc, tcp::endpoint endpoint, session_manager &manager);
+    // cluster为空时以单节点模式运行
+    clipboard_server(net::io_context &ioc, tcp::endpoint endpoint, session_manager &manager,
+                     cluster_node *cluster = nullptr);
 
 private:
+    // 正在接收的消息
+    struct inbound_message
+    {
+        beast::flat_buffer buffer;
+        // 直通转发编号，0表示收齐后再广播
+        uint64_t relay_id = 0;
+        // 已经尝试过直通转发
+        bool relay_checked = false;
+        // 直通转发时交给房间保留的头部(含t-recv)和消息体在缓冲区中的起点
+        std::string head;
+        size_t body_offset = 0;
+        size_t body_size = 0;
+    };
+
     // 异步接受新连接
     void do_accept();
     // 处理WebSocket握手
-    void do_handshake(std::shared_ptr<websocket::stream<tcp::socket>> ws);
+    void do_handshake(std::shared_ptr<ws_stream> ws);
     // 从客户端读取数据
-    void do_read(std::shared_ptr<websocket::stream<tcp::socket>> ws);
+    void do_read(std::shared_ptr<session> s);
+    // 读取消息的下一段
+    void read_some(std::shared_ptr<session> s, std::shared_ptr<inbound_message> in);
+    // 头部到达后尝试开始直通转发
+    void try_relay(const std::shared_ptr<session> &s, inbound_message &in);
+    // 处理一条完整的消息
+    void handle_message(const std::shared_ptr<session> &s, std::string message);
+    // 处理客户端的搜索请求，结果只发回给该客户端
+    void handle_search(const std::shared_ptr<session> &s, const clip_message &req);
 
     // 引用IO上下文，用于异步操作
     net::io_context &ioc_;
@@ -52,6 +236,8 @@ private:
     tcp::acceptor acceptor_;
     // 引用会话管理器
     session_manager &manager_;
+    // 集群节点，单节点模式下为空
+    cluster_node *cluster_;
 };
 
 #endif
@@ -0,0 +1,93 @@
+#include "server_config.h"
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+    // 去除首尾空白
+    std::string trim(const std::string &s)
+    {
+        const char *ws = " \t\r\n";
+        size_t begin = s.find_first_not_of(ws);
+        if (begin == std::string::npos)
+            return "";
+        size_t end = s.find_last_not_of(ws);
+        return s.substr(begin, end - begin + 1);
+    }
+
+    // 解析 host:port 形式的对端地址
+    peer_address parse_peer(const std::string &value)
+    {
+        size_t colon = value.rfind(':');
+        if (colon == std::string::npos || colon == 0 || colon + 1 == value.size())
+            throw std::runtime_error("无效的对端地址: " + value);
+        return peer_address{value.substr(0, colon), value.substr(colon + 1)};
+    }
+}
+
+// 从文件加载配置
+server_config server_config::load(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in)
+        throw std::runtime_error("无法打开配置文件: " + path);
+
+    server_config config;
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line))
+    {
+        ++line_no;
+        line = trim(line);
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        size_t eq = line.find('=');
+        if (eq == std::string::npos)
+            throw std::runtime_error("配置第" + std::to_string(line_no) + "行格式错误");
+
+        std::string key = trim(line.substr(0, eq));
+        std::string value = trim(line.substr(eq + 1));
+
+        if (key == "port")
+            config.port = static_cast<unsigned short>(std::stoul(value));
+        else if (key == "node_id")
+            config.node_id = value;
+        else if (key == "peer")
+            config.peers.push_back(parse_peer(value));
+        else if (key == "peer_batch_bytes")
+            config.peer_batch_bytes = std::stoul(value);
+        else if (key == "cluster_token")
+            config.cluster_token = value;
+        else if (key == "peer_retry_ms")
+            config.peer_retry_ms = static_cast<unsigned>(std::stoul(value));
+        else if (key == "history_dir")
+            config.history_dir = value;
+        else if (key == "history_segment_bytes")
+            config.history_segment_bytes = std::stoul(value);
+        else if (key == "history_retention_bytes")
+            config.history_retention_bytes = std::stoul(value);
+        else if (key == "history_retention_hours")
+            config.history_retention_hours = static_cast<unsigned>(std::stoul(value));
+        else if (key == "search_max_entries")
+            config.search_max_entries = std::stoul(value);
+        else if (key == "lazy_threshold")
+            config.lazy_threshold = std::stoul(value);
+        else if (key == "validate_utf8")
+            config.validate_utf8 = value == "1" || value == "true";
+        else if (key == "stream_relay")
+            config.stream_relay = value == "1" || value == "true";
+        else if (key == "latency_report_secs")
+            config.latency_report_secs = static_cast<unsigned>(std::stoul(value));
+        else
+            throw std::runtime_error("未知配置项: " + key);
+    }
+
+    // 对端连接可以向所有房间注入消息，必须用共享密钥认证
+    if (!config.peers.empty() && config.cluster_token.empty())
+        throw std::runtime_error("配置了peer时必须设置cluster_token");
+    // 单条消息最大1MB，且索引中的段内偏移为32位
+    if (config.history_segment_bytes < (2u << 20) || config.history_segment_bytes > (1u << 30))
+        throw std::runtime_error("history_segment_bytes 必须在2MB到1GB之间");
+    return config;
+}
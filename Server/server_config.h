@@ -0,0 +1,66 @@
+#ifndef CLIPBOARD_SERVER_CONFIG_H
+#define CLIPBOARD_SERVER_CONFIG_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// 集群中对端节点的地址
+struct peer_address
+{
+    std::string host;
+    std::string port;
+};
+
+// 服务器配置
+//
+// 配置文件为简单的 key = value 格式，#开头的行为注释，例如：
+//   port = 8080
+//   node_id = node-a
+//   peer = 127.0.0.1:8081
+//   peer = 127.0.0.1:8082
+//   cluster_token = <所有节点相同的随机字符串>
+struct server_config
+{
+    // 监听端口
+    unsigned short port = 8080;
+    // 本节点在集群中的唯一标识，为空时使用端口号生成
+    std::string node_id;
+    // 静态对端节点列表
+    std::vector<peer_address> peers;
+    // 每个对端链路单次批量发送的最大字节数
+    std::size_t peer_batch_bytes = 256 * 1024;
+    // 对端链路断开后重连间隔(毫秒)
+    unsigned peer_retry_ms = 1000;
+    // 集群共享密钥，对端连接时在握手请求中出示；为空时不接受对端连接
+    std::string cluster_token;
+
+    // 剪贴板历史日志目录，为空时不保存历史
+    std::string history_dir;
+    // 单个日志段的大小上限
+    std::size_t history_segment_bytes = 64 * 1024 * 1024;
+    // 历史日志总大小上限，超出后删除最旧的段
+    std::size_t history_retention_bytes = 1024 * 1024 * 1024;
+    // 历史保留时间(小时)，0表示不按时间清理
+    unsigned history_retention_hours = 24 * 7;
+
+    // 全文搜索每个房间保留的最大条目数，0表示不启用搜索
+    std::size_t search_max_entries = 0;
+
+    // 按需获取的会话只收到超过该长度的消息的通告，较小的消息仍然整条发送
+    std::size_t lazy_threshold = 4096;
+
+    // 转发前检查纯文本表示是否是有效的UTF-8，无效的消息被丢弃；加密的内容不检查
+    bool validate_utf8 = false;
+
+    // 大消息边接收边转发给握手目标带stream=1的会话，不等整条消息收齐；检查UTF-8时含未加密纯文本的消息不直通转发
+    bool stream_relay = false;
+
+    // 输出各段延迟统计的间隔(秒)，0表示不统计
+    unsigned latency_report_secs = 0;
+
+    // 从文件加载配置，文件无法读取或格式错误时抛出异常
+    static server_config load(const std::string &path);
+};
+
+#endif
@@ -0,0 +1,224 @@
+#include "session.h"
+#include "message.h"
+#include "probes.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <iostream>
+
+namespace
+{
+    // 下一个会话编号
+    std::atomic<uint64_t> next_session_id{1};
+}
+
+// 会话构造函数
+session::session(std::shared_ptr<ws_stream> ws, std::string room, bool sequenced, bool lazy, bool streamed)
+    : ws_(std::move(ws)), id_(next_session_id++), room_(std::move(room)), sequenced_(sequenced), lazy_(lazy), streamed_(streamed)
+{
+}
+
+// 把消息加入发送队列
+void session::deliver(std::shared_ptr<const std::string> message, const std::string &selection)
+{
+    // 连接已出错，等待读操作移除会话
+    if (failed_)
+        return;
+
+    if (!selection.empty())
+        supersede(selection);
+
+    SERVER_PROBE2(enqueue, id_, message->size());
+    if (message->size() > SESSION_CHUNK_SIZE)
+        bulk_.push_back(bulk_item{std::move(message), next_stream_id_++, 0, selection});
+    else
+        control_.push_back(control_item{std::move(message), selection});
+
+    if (!writing_)
+        do_write();
+}
+
+// 开始直通转发一条消息
+void session::begin_relay(uint64_t relay_id, size_t total, const std::string &selection)
+{
+    if (failed_)
+        return;
+    relays_[relay_id] = relay_stream{next_stream_id_++, total, 0, false, selection};
+}
+
+// 直通转发消息的下一段数据
+void session::relay(uint64_t relay_id, std::shared_ptr<const std::string> data)
+{
+    auto it = relays_.find(relay_id);
+    // 已被取代或连接已出错
+    if (it == relays_.end() || data->empty())
+        return;
+
+    relay_stream &stream = it->second;
+    clip_message header;
+    header.set("type", "chunk");
+    header.set("stream", std::to_string(stream.stream_id));
+    header.set("offset", std::to_string(stream.offset));
+    header.set("total", std::to_string(stream.total));
+    stream.offset += data->size();
+    SERVER_PROBE2(enqueue, id_, data->size());
+    relay_queue_.push_back(relay_chunk{relay_id, header.serialize(), std::move(data)});
+
+    if (!writing_)
+        do_write();
+}
+
+// 结束直通转发
+void session::end_relay(uint64_t relay_id, bool complete)
+{
+    auto it = relays_.find(relay_id);
+    if (it == relays_.end())
+        return;
+
+    if (!complete)
+    {
+        drop_relay(it);
+        return;
+    }
+    // 分片已全部排队，不再受同一选择的取代影响
+    std::string selection = std::move(it->second.selection);
+    relays_.erase(it);
+    if (!selection.empty())
+        supersede(selection);
+}
+
+// 放弃直通转发的流
+void session::drop_relay(std::map<uint64_t, relay_stream>::iterator it)
+{
+    uint64_t relay_id = it->first;
+    if (it->second.started)
+    {
+        clip_message abort;
+        abort.set("type", "chunk");
+        abort.set("stream", std::to_string(it->second.stream_id));
+        abort.set("abort", "1");
+        control_.push_back(control_item{std::make_shared<const std::string>(abort.serialize()), ""});
+    }
+    relays_.erase(it);
+    relay_queue_.erase(std::remove_if(relay_queue_.begin(), relay_queue_.end(),
+                                      [relay_id](const relay_chunk &chunk)
+                                      { return chunk.relay_id == relay_id; }),
+                       relay_queue_.end());
+
+    if (!writing_)
+        do_write();
+}
+
+// 移除队列中同一选择尚未开始发送的内容
+//
+// 已经发出部分分片的大数据消息继续发完，客户端不会留下无法完成的流；
+// 直通转发的消息可能还要很久才能收齐，直接放弃
+void session::supersede(const std::string &selection)
+{
+    control_.erase(std::remove_if(control_.begin(), control_.end(),
+                                  [&](const control_item &item)
+                                  { return item.selection == selection; }),
+                   control_.end());
+    bulk_.erase(std::remove_if(bulk_.begin(), bulk_.end(),
+                               [&](const bulk_item &item)
+                               { return item.offset == 0 && item.selection == selection; }),
+                bulk_.end());
+    for (auto it = relays_.begin(); it != relays_.end();)
+    {
+        auto current = it++;
+        if (current->second.selection == selection)
+            drop_relay(current);
+    }
+}
+
+// 选择下一条要发送的数据并开始写
+void session::do_write()
+{
+    auto self = shared_from_this();
+
+    // 控制通道优先
+    if (!control_.empty())
+    {
+        writing_ = true;
+        writing_payload_ = std::move(control_.front().payload);
+        control_.pop_front();
+        ws_->async_write(net::buffer(*writing_payload_),
+                         [this, self](beast::error_code ec, std::size_t bytes)
+                         { on_write(ec, bytes); });
+        return;
+    }
+
+    // 直通转发的分片引用接收到的数据，不额外拷贝
+    if (!relay_queue_.empty())
+    {
+        writing_ = true;
+        relay_chunk &chunk = relay_queue_.front();
+        auto stream = relays_.find(chunk.relay_id);
+        if (stream != relays_.end())
+            stream->second.started = true;
+        chunk_header_ = std::move(chunk.header);
+        writing_payload_ = std::move(chunk.data);
+        relay_queue_.pop_front();
+        std::array<net::const_buffer, 2> buffers = {
+            net::buffer(chunk_header_),
+            net::buffer(*writing_payload_)};
+        ws_->async_write(buffers,
+                         [this, self](beast::error_code ec, std::size_t bytes)
+                         { on_write(ec, bytes); });
+        return;
+    }
+
+    if (bulk_.empty())
+    {
+        writing_ = false;
+        return;
+    }
+
+    // 发送大数据通道队首消息的下一个分片
+    writing_ = true;
+    bulk_item &item = bulk_.front();
+    size_t total = item.payload->size();
+    size_t length = std::min<size_t>(SESSION_CHUNK_SIZE, total - item.offset);
+
+    clip_message header;
+    header.set("type", "chunk");
+    header.set("stream", std::to_string(item.stream_id));
+    header.set("offset", std::to_string(item.offset));
+    header.set("total", std::to_string(total));
+    chunk_header_ = header.serialize();
+
+    // 分片数据直接引用原消息，不额外拷贝
+    writing_payload_ = item.payload;
+    std::array<net::const_buffer, 2> buffers = {
+        net::buffer(chunk_header_),
+        net::buffer(item.payload->data() + item.offset, length)};
+
+    item.offset += length;
+    if (item.offset == total)
+        bulk_.pop_front();
+
+    ws_->async_write(buffers,
+                     [this, self](beast::error_code ec, std::size_t bytes)
+                     { on_write(ec, bytes); });
+}
+
+// 写完成回调
+void session::on_write(beast::error_code ec, std::size_t bytes)
+{
+    SERVER_PROBE3(write_done, id_, bytes, ec.value());
+    writing_payload_.reset();
+    if (ec)
+    {
+        // 连接已断开，读操作会同时失败并移除会话
+        std::cerr << "发送失败: " << ec.message()
+                  << " (code: " << ec.value() << ")" << std::endl;
+        failed_ = true;
+        control_.clear();
+        relay_queue_.clear();
+        relays_.clear();
+        bulk_.clear();
+        writing_ = false;
+        return;
+    }
+    do_write();
+}
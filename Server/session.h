@@ -0,0 +1,139 @@
+#ifndef CLIPBOARD_SESSION_H
+#define CLIPBOARD_SESSION_H
+
+#include "server.h"
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// 大于该长度的消息进入大数据通道并分片发送
+#define SESSION_CHUNK_SIZE (16 * 1024)
+
+// 剪贴板内容所属的选择：显式复制的系统剪贴板和选中即复制的PRIMARY
+#define SESSION_CLIPBOARD_SELECTION "clipboard"
+#define SESSION_PRIMARY_SELECTION "primary"
+
+// 单个客户端会话
+//
+// 每个会话有三条发送通道：
+//   - 控制通道：小消息，整条发送；
+//   - 直通通道：服务器边接收边转发的大消息，每收到一段就作为一个type=chunk分片发出；
+//   - 大数据通道：大消息按SESSION_CHUNK_SIZE切成type=chunk的分片消息。
+// 每次写完成后按上面的顺序选择通道，因此小消息最多等待一个分片的发送时间，
+// 不会排在慢速客户端的整个大消息之后。
+// WebSocket协议不允许不同消息的数据帧交错，所以分片在应用层完成，
+// 每个分片都是一条完整的WebSocket消息，由客户端按stream重组。
+//
+// 剪贴板以最后一次写入为准：同一选择的新内容到达时，队列中尚未开始发送的旧内容被取代，
+// 慢速客户端每个选择最多排队一条内容，恢复后只下载最新的值。已经开始发送的直通转发被取代时
+// 发送带abort头部的分片，客户端丢弃未完成的流。
+class session : public std::enable_shared_from_this<session>
+{
+public:
+    // sequenced为true时客户端请求了断线续传，收到的消息都带有房间序号；
+    // lazy为true时大消息只发送通告，客户端需要时再获取；
+    // streamed为true时客户端可以接收直通转发的消息
+    session(std::shared_ptr<ws_stream> ws, std::string room, bool sequenced = false, bool lazy = false,
+            bool streamed = false);
+
+    // 把消息加入发送队列；selection不为空时消息是该选择的剪贴板内容，
+    // 取代队列中同一选择尚未开始发送的内容
+    void deliver(std::shared_ptr<const std::string> message, const std::string &selection = "");
+
+    // 开始直通转发一条消息，total是发给本会话的消息总长度
+    void begin_relay(uint64_t relay_id, size_t total, const std::string &selection);
+    // 直通转发消息的下一段数据
+    void relay(uint64_t relay_id, std::shared_ptr<const std::string> data);
+    // 结束直通转发；complete为true时消息已全部排队并取代同一选择的旧内容，否则放弃这条流
+    void end_relay(uint64_t relay_id, bool complete);
+
+    ws_stream &stream() { return *ws_; }
+    // 进程内唯一的会话编号，用于日志和跟踪探针
+    uint64_t id() const { return id_; }
+    const std::string &room() const { return room_; }
+    bool sequenced() const { return sequenced_; }
+    bool lazy() const { return lazy_; }
+    bool streamed() const { return streamed_; }
+
+    // 客户端声明可以接收的剪贴板格式
+    void set_accepts(std::vector<std::string> formats) { accepts_ = std::move(formats); }
+    const std::vector<std::string> &accepts() const { return accepts_; }
+    // 上次通知给客户端的房间格式列表
+    std::string &advertised_formats() { return advertised_formats_; }
+
+private:
+    // 控制通道中的消息
+    struct control_item
+    {
+        std::shared_ptr<const std::string> payload;
+        std::string selection;
+    };
+
+    // 正在分片发送的大消息
+    struct bulk_item
+    {
+        std::shared_ptr<const std::string> payload;
+        uint64_t stream_id;
+        size_t offset;
+        std::string selection;
+    };
+
+    // 直通转发给本会话的消息
+    struct relay_stream
+    {
+        uint64_t stream_id;
+        size_t total;
+        // 已排队的字节数
+        size_t offset;
+        // 已经有分片写出
+        bool started;
+        std::string selection;
+    };
+
+    // 直通通道中的分片
+    struct relay_chunk
+    {
+        uint64_t relay_id;
+        std::string header;
+        std::shared_ptr<const std::string> data;
+    };
+
+    // 移除队列中同一选择尚未开始发送的内容
+    void supersede(const std::string &selection);
+    // 放弃直通转发的流，已有分片写出时通知客户端
+    void drop_relay(std::map<uint64_t, relay_stream>::iterator it);
+
+    // 选择下一条要发送的数据并开始写
+    void do_write();
+    // 写完成回调
+    void on_write(beast::error_code ec, std::size_t bytes);
+
+    std::shared_ptr<ws_stream> ws_;
+    uint64_t id_;
+    std::string room_;
+    bool sequenced_;
+    bool lazy_;
+    bool streamed_;
+    std::vector<std::string> accepts_;
+    std::string advertised_formats_;
+    // 控制通道
+    std::deque<control_item> control_;
+    // 直通通道和进行中的直通转发，按转发编号索引
+    std::deque<relay_chunk> relay_queue_;
+    std::map<uint64_t, relay_stream> relays_;
+    // 大数据通道
+    std::deque<bulk_item> bulk_;
+    // 正在写出的数据，写操作完成前必须保持有效
+    std::shared_ptr<const std::string> writing_payload_;
+    std::string chunk_header_;
+    bool writing_ = false;
+    // 写操作出错后不再接受新消息
+    bool failed_ = false;
+    // 本会话分片流的递增编号
+    uint64_t next_stream_id_ = 0;
+};
+
+#endif
@@ -0,0 +1,118 @@
+// 历史日志恢复的测试
+//
+// 在临时目录中写入日志，模拟写索引时崩溃后重新打开，检查：
+//   - 写了一半的索引项被丢弃，检查点之后的记录从索引尾部恢复，下一个序号和各房间最新内容
+//     以索引中最后一条完整的记录为准；索引之后的残缺记录被新记录覆盖
+//   - 历史目录中不是日志段的 *.log 文件被忽略，不影响恢复
+//
+// 用法: history_log_test，全部通过时退出码为0
+#include "history_log.h"
+#include "test_support.h"
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+
+namespace
+{
+    namespace fs = std::filesystem;
+
+    // 测试结束时删除的临时目录
+    struct temp_dir
+    {
+        fs::path path;
+
+        temp_dir()
+        {
+            std::string pattern = (fs::temp_directory_path() / "history_log_test.XXXXXX").string();
+            path = ::mkdtemp(&pattern[0]);
+        }
+
+        ~temp_dir()
+        {
+            std::error_code ec;
+            fs::remove_all(path, ec);
+        }
+    };
+
+    std::shared_ptr<const std::string> text(const std::string &data)
+    {
+        return std::make_shared<const std::string>(data);
+    }
+
+    // 房间的最新内容，没有时为空字符串
+    std::string last_value(const history_log &log, const std::string &room)
+    {
+        auto it = log.recovered_last_values().find(room);
+        return it == log.recovered_last_values().end() ? "" : *it->second;
+    }
+
+    // 目录中唯一的索引文件
+    fs::path index_file(const fs::path &dir)
+    {
+        fs::path found;
+        for (const auto &entry : fs::directory_iterator(dir))
+        {
+            if (entry.path().extension() == ".idx")
+            {
+                CHECK(found.empty());
+                found = entry.path();
+            }
+        }
+        return found;
+    }
+
+    // 写入两批记录，第二批之后回到第一批的检查点并截掉最后一个索引项的一半，相当于写索引时崩溃
+    void test_recover_truncated_index()
+    {
+        temp_dir dir;
+        server_config config;
+        config.history_dir = dir.path.string();
+        fs::path checkpoint = dir.path / "rooms.ckpt";
+        fs::path saved = dir.path / "saved.ckpt";
+
+        uint64_t b1 = 0;
+        {
+            history_log log(config);
+            log.append("a", text("a1"));
+            b1 = log.append("b", text("b1"));
+        }
+        fs::copy_file(checkpoint, saved);
+
+        uint64_t a2 = 0;
+        uint64_t a3 = 0;
+        {
+            history_log log(config);
+            CHECK(last_value(log, "a") == "a1");
+            a2 = log.append("a", text("a2"));
+            a3 = log.append("a", text("a3"));
+        }
+        CHECK(a2 == b1 + 1 && a3 == a2 + 1);
+        fs::copy_file(saved, checkpoint, fs::copy_options::overwrite_existing);
+        fs::remove(saved);
+        fs::path index = index_file(dir.path);
+        fs::resize_file(index, fs::file_size(index) - 8);
+        std::ofstream(dir.path / "notes.log") << "not a segment";
+
+        {
+            history_log log(config);
+            CHECK(last_value(log, "a") == "a2");
+            CHECK(last_value(log, "b") == "b1");
+            CHECK(log.append("b", text("b2")) == a3);
+        }
+
+        history_log log(config);
+        CHECK(last_value(log, "a") == "a2");
+        CHECK(last_value(log, "b") == "b2");
+        std::vector<std::string> records;
+        log.scan([&](uint64_t, const std::string &room, std::shared_ptr<const std::string> message)
+                 { records.push_back(room + ":" + *message); });
+        CHECK(records == (std::vector<std::string>{"a:a1", "b:b1", "a:a2", "b:b2"}));
+    }
+}
+
+int main()
+{
+    return test_support::run_tests({
+        {"recover_truncated_index", test_recover_truncated_index},
+    });
+}
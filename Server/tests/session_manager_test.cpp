@@ -0,0 +1,196 @@
+// 会话管理器广播和补发的测试
+//
+// 会话使用本机的一对WebSocket连接，测试在事件循环运行之前广播，
+// 第一条消息在广播时就开始写，之后的消息仍在会话的队列中。检查：
+//   - 同一选择的新内容取代队列中尚未发送的旧内容，其他选择的内容不受影响
+//   - 续传会话在同一纪元内只补发错过的消息，已是最新时不补发
+//   - 纪元不同或错过的消息已不在内存中时只发送房间最新内容
+//
+// 用法: session_manager_test，全部通过时退出码为0
+#include "session.h"
+#include "test_support.h"
+
+namespace
+{
+    using test_support::frame;
+    using test_support::make_data;
+    using test_support::read_frames;
+
+    // 带selection头部的剪贴板消息
+    std::string clip(const std::string &body, const std::string &selection = SESSION_CLIPBOARD_SELECTION)
+    {
+        clip_message msg;
+        msg.set("type", "clip");
+        msg.set("selection", selection);
+        msg.body = body;
+        return msg.serialize();
+    }
+
+    // 消息体，大消息的分片按顺序拼接
+    std::vector<std::string> bodies(const std::vector<frame> &frames)
+    {
+        std::vector<std::string> out;
+        std::string pending;
+        for (const auto &f : frames)
+        {
+            if (f.type() != "chunk")
+            {
+                out.push_back(f.msg.body);
+                continue;
+            }
+            pending += f.msg.body;
+            if (pending.size() == std::stoul(f.msg.get("total", "0")))
+            {
+                clip_message whole;
+                clip_message::parse(pending, whole);
+                out.push_back(whole.body);
+                pending.clear();
+            }
+        }
+        return out;
+    }
+
+    // 管理器和加入房间的一个会话的客户端
+    struct fixture
+    {
+        net::io_context ioc;
+        session_manager manager;
+        test_support::ws_pair pair;
+        std::shared_ptr<session> s;
+
+        fixture()
+            : pair(test_support::connect_pair(ioc))
+        {
+        }
+
+        ~fixture()
+        {
+            if (s)
+                manager.remove(s.get());
+        }
+
+        // 会话加入房间，续传会话从resume之后开始补发
+        void join(bool sequenced = false, const resume_point &resume = resume_point())
+        {
+            s = std::make_shared<session>(pair.server, "test", sequenced, false, false);
+            manager.add(s, resume);
+        }
+
+        // 房间内没有会话时广播序号为1到count的消息，消息体为 "m<序号>"
+        void fill(int count)
+        {
+            for (int i = 1; i <= count; ++i)
+                manager.broadcast("test", clip("m" + std::to_string(i)));
+        }
+    };
+
+    resume_point resume_at(const std::string &epoch, uint64_t seq)
+    {
+        resume_point resume;
+        resume.epoch = epoch;
+        resume.seq = seq;
+        return resume;
+    }
+
+    // 补发消息的房间序号
+    std::vector<std::string> seqs(const std::vector<frame> &frames)
+    {
+        std::vector<std::string> out;
+        for (const auto &f : frames)
+            out.push_back(f.msg.get("seq"));
+        return out;
+    }
+
+    // 慢速设备只收到正在发送的和最新的CLIPBOARD内容，PRIMARY单独保留
+    void test_supersede_queued_update()
+    {
+        fixture f;
+        f.join();
+        f.manager.broadcast("test", clip("v1"));
+        f.manager.broadcast("test", clip("v2"));
+        f.manager.broadcast("test", clip("selected", SESSION_PRIMARY_SELECTION));
+        f.manager.broadcast("test", clip("v3"));
+
+        auto frames = read_frames(f.ioc, *f.pair.client, 4, std::chrono::milliseconds(500));
+        CHECK(bodies(frames) == (std::vector<std::string>{"v1", "selected", "v3"}));
+    }
+
+    // 大消息同样只保留最新的一条，已经开始发送的继续发完
+    void test_supersede_queued_bulk()
+    {
+        fixture f;
+        f.join();
+        std::string first = make_data(3 * SESSION_CHUNK_SIZE, 1);
+        std::string stale = make_data(3 * SESSION_CHUNK_SIZE, 2);
+        std::string latest = make_data(3 * SESSION_CHUNK_SIZE, 3);
+        f.manager.broadcast("test", clip(first));
+        f.manager.broadcast("test", clip(stale));
+        f.manager.broadcast("test", clip(latest));
+
+        auto frames = read_frames(f.ioc, *f.pair.client, 9, std::chrono::milliseconds(500));
+        CHECK(frames.size() == 8);
+        CHECK(bodies(frames) == (std::vector<std::string>{first, latest}));
+    }
+
+    // 同一纪元内只补发错过的消息，带有序号和纪元。补发的消息同样按选择取代，
+    // 错过两条时第一条在补发时开始写，两条都会发出
+    void test_resume_replays_missed()
+    {
+        fixture f;
+        f.fill(5);
+        f.join(true, resume_at(f.manager.epoch(), 3));
+
+        auto frames = read_frames(f.ioc, *f.pair.client, 3, std::chrono::milliseconds(500));
+        CHECK(seqs(frames) == (std::vector<std::string>{"4", "5"}));
+        CHECK(bodies(frames) == (std::vector<std::string>{"m4", "m5"}));
+        for (const auto &frame : frames)
+            CHECK(frame.msg.get("epoch") == f.manager.epoch());
+    }
+
+    // 已收到最新的消息时不补发
+    void test_resume_up_to_date()
+    {
+        fixture f;
+        f.fill(5);
+        f.join(true, resume_at(f.manager.epoch(), 5));
+
+        auto frames = read_frames(f.ioc, *f.pair.client, 1, std::chrono::milliseconds(300));
+        CHECK(frames.empty());
+    }
+
+    // 纪元不同(服务器重启过)时只发送房间最新内容
+    void test_resume_epoch_mismatch()
+    {
+        fixture f;
+        f.fill(5);
+        f.join(true, resume_at("1", 3));
+
+        auto frames = read_frames(f.ioc, *f.pair.client, 2, std::chrono::milliseconds(500));
+        CHECK(seqs(frames) == (std::vector<std::string>{"5"}));
+        CHECK(bodies(frames) == (std::vector<std::string>{"m5"}));
+    }
+
+    // 错过的消息已不在内存中时只发送房间最新内容
+    void test_resume_too_old()
+    {
+        fixture f;
+        f.fill(20);
+        f.join(true, resume_at(f.manager.epoch(), 1));
+
+        auto frames = read_frames(f.ioc, *f.pair.client, 2, std::chrono::milliseconds(500));
+        CHECK(seqs(frames) == (std::vector<std::string>{"20"}));
+        CHECK(bodies(frames) == (std::vector<std::string>{"m20"}));
+    }
+}
+
+int main()
+{
+    return test_support::run_tests({
+        {"supersede_queued_update", test_supersede_queued_update},
+        {"supersede_queued_bulk", test_supersede_queued_bulk},
+        {"resume_replays_missed", test_resume_replays_missed},
+        {"resume_up_to_date", test_resume_up_to_date},
+        {"resume_epoch_mismatch", test_resume_epoch_mismatch},
+        {"resume_too_old", test_resume_too_old},
+    });
+}
@@ -0,0 +1,198 @@
+// 会话发送通道的测试
+//
+// 会话直接使用本机的一对WebSocket连接，测试在事件循环运行之前把消息放入队列，
+// 第一条消息在入队时就开始写，之后的顺序完全由通道优先级决定。检查：
+//   - 控制通道的小消息插在大数据分片之间发出
+//   - 直通转发的分片插在大数据分片之间发出
+//   - 同一选择尚未开始发送的大消息被更新的内容取代，已开始发送的继续发完
+//   - 放弃已开始的直通转发时发出带abort的分片，队列中剩余的分片不再发送；
+//     尚未开始的直通转发被取代时直接丢弃
+//
+// 用法: session_test，全部通过时退出码为0
+#include "session.h"
+#include "test_support.h"
+#include <map>
+
+namespace
+{
+    using test_support::frame;
+    using test_support::make_data;
+    using test_support::read_frames;
+
+    // 大数据通道和直通转发分片的流编号、偏移和数据
+    struct chunk
+    {
+        std::string stream;
+        size_t offset;
+        size_t total;
+        std::string data;
+    };
+
+    bool as_chunk(const frame &f, chunk &out)
+    {
+        if (f.type() != "chunk")
+            return false;
+        out.stream = f.msg.get("stream");
+        out.offset = std::stoul(f.msg.get("offset", "0"));
+        out.total = std::stoul(f.msg.get("total", "0"));
+        out.data = f.msg.body;
+        return true;
+    }
+
+    // 按流编号拼接收到的分片，只保留收齐的流
+    std::map<std::string, std::string> assemble(const std::vector<frame> &frames)
+    {
+        std::map<std::string, std::string> streams;
+        std::map<std::string, size_t> totals;
+        for (const auto &f : frames)
+        {
+            chunk c;
+            if (!as_chunk(f, c))
+                continue;
+            CHECK(streams[c.stream].size() == c.offset);
+            streams[c.stream] += c.data;
+            totals[c.stream] = c.total;
+        }
+        for (auto it = streams.begin(); it != streams.end();)
+            it = it->second.size() == totals[it->first] ? std::next(it) : streams.erase(it);
+        return streams;
+    }
+
+    // 只读的会话和它的客户端
+    struct fixture
+    {
+        net::io_context ioc;
+        test_support::ws_pair pair;
+        std::shared_ptr<session> s;
+
+        fixture()
+            : pair(test_support::connect_pair(ioc))
+        {
+            s = std::make_shared<session>(pair.server, "test", false, false, true);
+        }
+
+        std::shared_ptr<const std::string> message(std::string data)
+        {
+            return std::make_shared<const std::string>(std::move(data));
+        }
+    };
+
+    // 大消息的第一个分片已经开始写，之后的控制消息先于剩余分片发出
+    void test_control_overtakes_bulk()
+    {
+        fixture f;
+        std::string bulk = make_data(5 * SESSION_CHUNK_SIZE);
+        f.s->deliver(f.message(bulk));
+        f.s->deliver(f.message("control"));
+
+        auto frames = read_frames(f.ioc, *f.pair.client, 6);
+        CHECK(frames.size() == 6);
+        if (frames.size() != 6)
+            return;
+        CHECK(frames[0].type() == "chunk");
+        CHECK(frames[1].raw == "control");
+        auto streams = assemble(frames);
+        CHECK(streams.size() == 1 && streams.begin()->second == bulk);
+    }
+
+    // 直通转发的分片先于大数据通道的剩余分片发出
+    void test_relay_overtakes_bulk()
+    {
+        fixture f;
+        std::string bulk = make_data(3 * SESSION_CHUNK_SIZE);
+        f.s->deliver(f.message(bulk));
+        f.s->begin_relay(1, 10, SESSION_CLIPBOARD_SELECTION);
+        f.s->relay(1, f.message("relay-"));
+        f.s->relay(1, f.message("data"));
+        f.s->end_relay(1, true);
+
+        auto frames = read_frames(f.ioc, *f.pair.client, 5);
+        CHECK(frames.size() == 5);
+        if (frames.size() != 5)
+            return;
+        chunk first, second, third;
+        CHECK(as_chunk(frames[0], first) && first.offset == 0 && first.total == bulk.size());
+        CHECK(as_chunk(frames[1], second) && second.stream != first.stream && second.data == "relay-");
+        CHECK(as_chunk(frames[2], third) && third.stream == second.stream && third.data == "data");
+        auto streams = assemble(frames);
+        CHECK(streams.size() == 2);
+        CHECK(streams[first.stream] == bulk);
+        CHECK(streams[second.stream] == "relay-data");
+    }
+
+    // 同一选择的新内容取代尚未开始发送的大消息；已经开始发送的大消息继续发完
+    void test_superseded_bulk_dropped()
+    {
+        fixture f;
+        std::string first = make_data(2 * SESSION_CHUNK_SIZE, 1);
+        std::string stale = make_data(2 * SESSION_CHUNK_SIZE, 2);
+        std::string latest = make_data(2 * SESSION_CHUNK_SIZE, 3);
+        f.s->deliver(f.message(first), SESSION_CLIPBOARD_SELECTION);
+        f.s->deliver(f.message(stale), SESSION_CLIPBOARD_SELECTION);
+        f.s->deliver(f.message(latest), SESSION_CLIPBOARD_SELECTION);
+
+        auto frames = read_frames(f.ioc, *f.pair.client, 5, std::chrono::milliseconds(500));
+        CHECK(frames.size() == 4);
+        auto streams = assemble(frames);
+        CHECK(streams.size() == 2);
+        std::vector<std::string> contents;
+        for (const auto &stream : streams)
+            contents.push_back(stream.second);
+        CHECK(contents == (std::vector<std::string>{first, latest}));
+    }
+
+    // 发送方中途断开：已发出的分片之后是同一流的abort分片，排队的分片被丢弃
+    void test_relay_abort()
+    {
+        fixture f;
+        f.s->begin_relay(1, 100, SESSION_CLIPBOARD_SELECTION);
+        f.s->relay(1, f.message("partial-"));
+        f.s->relay(1, f.message("queued"));
+        f.s->end_relay(1, false);
+        f.s->deliver(f.message("after"));
+
+        auto frames = read_frames(f.ioc, *f.pair.client, 4, std::chrono::milliseconds(500));
+        CHECK(frames.size() == 3);
+        if (frames.size() != 3)
+            return;
+        chunk data, abort;
+        CHECK(as_chunk(frames[0], data) && data.data == "partial-");
+        CHECK(as_chunk(frames[1], abort) && abort.stream == data.stream);
+        CHECK(frames[1].msg.get("abort") == "1");
+        CHECK(frames[2].raw == "after");
+    }
+
+    // 新内容取代同一选择的直通转发：已开始的发出abort分片，未开始的不发出任何分片
+    void test_relay_superseded()
+    {
+        fixture f;
+        f.s->begin_relay(1, 100, SESSION_CLIPBOARD_SELECTION);
+        f.s->relay(1, f.message("started"));
+        f.s->begin_relay(2, 100, SESSION_PRIMARY_SELECTION);
+        f.s->relay(2, f.message("waiting"));
+        f.s->deliver(f.message("clipboard"), SESSION_CLIPBOARD_SELECTION);
+        f.s->deliver(f.message("primary"), SESSION_PRIMARY_SELECTION);
+
+        auto frames = read_frames(f.ioc, *f.pair.client, 5, std::chrono::milliseconds(500));
+        CHECK(frames.size() == 4);
+        if (frames.size() != 4)
+            return;
+        chunk started;
+        CHECK(as_chunk(frames[0], started) && started.data == "started");
+        CHECK(frames[1].type() == "chunk" && frames[1].msg.get("stream") == started.stream &&
+              frames[1].msg.get("abort") == "1");
+        CHECK(frames[2].raw == "clipboard");
+        CHECK(frames[3].raw == "primary");
+    }
+}
+
+int main()
+{
+    return test_support::run_tests({
+        {"control_overtakes_bulk", test_control_overtakes_bulk},
+        {"relay_overtakes_bulk", test_relay_overtakes_bulk},
+        {"superseded_bulk_dropped", test_superseded_bulk_dropped},
+        {"relay_abort", test_relay_abort},
+        {"relay_superseded", test_relay_superseded},
+    });
+}
@@ -0,0 +1,124 @@
+#ifndef CLIPBOARD_TEST_SUPPORT_H
+#define CLIPBOARD_TEST_SUPPORT_H
+
+// 服务器测试共用的检查宏、本机WebSocket连接和消息读取
+
+#include "message.h"
+#include "server.h"
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// 失败的检查数，main按它决定退出码
+inline int test_failures = 0;
+
+// 条件不成立时输出位置并记为失败，继续执行后面的检查
+#define CHECK(condition)                                                             \
+    do                                                                               \
+    {                                                                                \
+        if (!(condition))                                                            \
+        {                                                                            \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": 检查失败: " #condition "\n"; \
+            ++test_failures;                                                         \
+        }                                                                            \
+    } while (0)
+
+namespace test_support
+{
+    // 本机上一对已完成握手的WebSocket连接：server端交给会话，client端由测试读取
+    struct ws_pair
+    {
+        std::shared_ptr<ws_stream> server;
+        std::unique_ptr<ws_stream> client;
+    };
+
+    // 建立一对连接，target是客户端握手的请求目标
+    inline ws_pair connect_pair(net::io_context &ioc, const std::string &target = "/test")
+    {
+        tcp::acceptor acceptor(ioc, tcp::endpoint(net::ip::address_v4::loopback(), 0));
+        ws_pair pair{std::make_shared<ws_stream>(ioc), std::make_unique<ws_stream>(ioc)};
+        pair.client->next_layer().connect(acceptor.local_endpoint());
+        acceptor.accept(pair.server->next_layer());
+        pair.client->read_message_max(64 * 1024 * 1024);
+
+        pair.server->async_accept([](beast::error_code ec)
+                                  { CHECK(!ec); });
+        pair.client->async_handshake("127.0.0.1", target, [](beast::error_code ec)
+                                     { CHECK(!ec); });
+        ioc.restart();
+        ioc.run();
+        return pair;
+    }
+
+    // 客户端收到的一个WebSocket消息
+    struct frame
+    {
+        clip_message msg;
+        std::string raw;
+
+        std::string type() const { return msg.get("type"); }
+    };
+
+    // 运行事件循环，直到客户端收到count个消息或超时，返回收到的消息
+    inline std::vector<frame> read_frames(net::io_context &ioc, ws_stream &client, size_t count,
+                                          std::chrono::milliseconds timeout = std::chrono::seconds(5))
+    {
+        std::vector<frame> frames;
+        beast::flat_buffer buffer;
+        std::function<void()> next;
+        next = [&]()
+        {
+            if (frames.size() == count)
+                return;
+            client.async_read(buffer, [&](beast::error_code ec, std::size_t)
+                              {
+                                  if (ec)
+                                      return;
+                                  frame f;
+                                  f.raw = beast::buffers_to_string(buffer.data());
+                                  buffer.consume(buffer.size());
+                                  clip_message::parse(f.raw, f.msg);
+                                  frames.push_back(std::move(f));
+                                  next();
+                              });
+        };
+        next();
+        ioc.restart();
+        ioc.run_for(timeout);
+        // 超时时取消未完成的读
+        if (frames.size() < count)
+        {
+            client.next_layer().cancel();
+            ioc.restart();
+            ioc.poll();
+        }
+        return frames;
+    }
+
+    // 由可打印字符组成的数据，每个位置的字符不同周期重复，错位或丢段都会被发现
+    inline std::string make_data(size_t size, char seed = 0)
+    {
+        std::string data(size, ' ');
+        for (size_t i = 0; i < size; ++i)
+            data[i] = static_cast<char>('!' + (i * 7 + i / 4093 + seed) % 94);
+        return data;
+    }
+
+    // 依次运行各项测试并输出结果，返回main的退出码
+    inline int run_tests(const std::vector<std::pair<const char *, void (*)()>> &tests)
+    {
+        for (const auto &test : tests)
+        {
+            int before = test_failures;
+            test.second();
+            std::cout << (test_failures == before ? "通过 " : "失败 ") << test.first << std::endl;
+        }
+        return test_failures == 0 ? 0 : 1;
+    }
+}
+
+#endif
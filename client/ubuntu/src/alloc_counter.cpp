@@ -0,0 +1,47 @@
+#include "alloc_counter.h"
+
+#ifdef P2PBOARD_ALLOC_COUNTER
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> allocation_count{0};
+std::atomic<uint64_t> allocation_bytes{0};
+
+} // namespace
+
+// 数组和nothrow版本默认转发到这里，按对齐分配的内存不计入
+void* operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+AllocationStats allocation_stats() {
+    AllocationStats stats;
+    stats.count = allocation_count.load(std::memory_order_relaxed);
+    stats.bytes = allocation_bytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+#else
+
+AllocationStats allocation_stats() {
+    return AllocationStats();
+}
+
+#endif
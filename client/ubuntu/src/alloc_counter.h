@@ -0,0 +1,31 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstdint>
+
+/**
+ * @file alloc_counter.h
+ * @brief 调试构建中的堆分配计数
+ *
+ * 定义P2PBOARD_ALLOC_COUNTER时替换全局operator new，统计进程内的分配次数和字节数，
+ * 用于确认剪贴板内容从读取到发送的路径上没有多余的复制。未定义时统计始终为零。
+ */
+
+/**
+ * @struct AllocationStats
+ * @brief 累计的堆分配
+ */
+struct AllocationStats {
+    // 分配次数
+    uint64_t count = 0;
+
+    // 分配的字节数
+    uint64_t bytes = 0;
+};
+
+/**
+ * @brief 进程启动以来的堆分配，两次调用的差即为期间的分配
+ */
+AllocationStats allocation_stats();
+
+#endif // ALLOC_COUNTER_H
@@ -0,0 +1,135 @@
+#ifndef CLIPBOARD_BACKEND_H
+#define CLIPBOARD_BACKEND_H
+
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "protocol.h"
+
+/**
+ * @class ClipboardBackend
+ * @brief 剪贴板后端接口
+ *
+ * 后端负责与具体的剪贴板实现交互：读取本地应用复制的内容，
+ * 取得选择所有权并向本地应用提供数据。CLIPBOARD和PRIMARY是两个独立的选择，
+ * 分别读取和设置，按需获取只用于CLIPBOARD。
+ * 去抖、去重和按需获取的等待由ClipboardManager统一处理。
+ *
+ * 除initialize外，所有方法都在io_context线程上调用，事件也在该线程上报告。
+ */
+class ClipboardBackend
+{
+public:
+    /**
+     * @brief 后端事件的接收者
+     */
+    class Listener
+    {
+    public:
+        virtual ~Listener() = default;
+
+        /**
+         * @brief 本地应用复制或选中了新内容
+         *
+         * 只包含纯文本和需要读取的格式，我们自己设置的内容不会报告。
+         * 未启用PRIMARY跟踪时只报告CLIPBOARD。
+         *
+         * @param selection 变化的选择
+         * @param item 读到的条目
+         */
+        virtual void on_local_change(ClipboardSelection selection, ClipboardItem item) = 0;
+
+        /**
+         * @brief 本地应用请求了按通告持有、尚未取回的数据
+         *
+         * 接收者取得数据后调用provide，期间到达的请求由后端保存。
+         */
+        virtual void on_data_requested() = 0;
+
+        /**
+         * @brief 我们持有的CLIPBOARD被其他应用取得
+         */
+        virtual void on_ownership_lost() = 0;
+    };
+
+    virtual ~ClipboardBackend() = default;
+
+    /**
+     * @brief 后端名称，用于日志
+     */
+    virtual const char *name() const = 0;
+
+    /**
+     * @brief 连接显示服务器等初始化
+     *
+     * @throws std::runtime_error 初始化失败时抛出
+     */
+    virtual void initialize() = 0;
+
+    /**
+     * @brief 开始监控剪贴板，事件报告给listener
+     *
+     * @param io_context 客户端事件循环
+     * @param listener 事件接收者，生命周期必须长于监控
+     */
+    virtual void start(boost::asio::io_context &io_context, Listener &listener) = 0;
+
+    /**
+     * @brief 停止监控，拒绝等待中的请求
+     */
+    virtual void stop() = 0;
+
+    /**
+     * @brief 同步读取当前CLIPBOARD的纯文本
+     */
+    virtual std::string read_text() = 0;
+
+    /**
+     * @brief 取得选择所有权并提供条目
+     *
+     * @param selection 要设置的选择，另一个选择不受影响
+     * @param item 要提供的条目，所有请求共享同一份数据
+     */
+    virtual void offer(ClipboardSelection selection, std::shared_ptr<const ClipboardItem> item) = 0;
+
+    /**
+     * @brief 取得CLIPBOARD所有权并声明格式，数据在本地应用请求时通过provide提供
+     *
+     * @param formats 声明的MIME类型
+     */
+    virtual void offer_lazy(const std::vector<std::string> &formats) = 0;
+
+    /**
+     * @brief 提供按需获取的数据并回复等待中的请求
+     *
+     * @param item 获取到的条目，为空表示获取失败，等待中的请求被拒绝，下次请求重新获取
+     */
+    virtual void provide(std::shared_ptr<const ClipboardItem> item) = 0;
+
+    /**
+     * @brief 设置除纯文本外需要读取的格式
+     */
+    void set_wanted_formats(std::set<std::string> formats) { wanted_formats_ = std::move(formats); }
+
+    /**
+     * @brief 设置是否读取并报告PRIMARY的变化，在start之前调用
+     */
+    void set_track_primary(bool track) { track_primary_ = track; }
+
+protected:
+    // 事件接收者，监控期间有效
+    Listener *listener_ = nullptr;
+
+    // 除纯文本外需要读取的格式
+    std::set<std::string> wanted_formats_;
+
+    // 是否读取并报告PRIMARY的变化
+    bool track_primary_ = false;
+};
+
+#endif // CLIPBOARD_BACKEND_H
@@ -0,0 +1,113 @@
+#include "clipboard_data.h"
+#include "config.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// 密封的memfd和它当前的映射
+struct ClipboardData::File {
+    int fd;
+    size_t size;
+
+    // 有视图存活时的映射，最后一个视图释放时解除映射
+    std::weak_ptr<const void> mapping;
+
+    File(int fd, size_t size) : fd(fd), size(size) {}
+    ~File() { close(fd); }
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+};
+
+namespace {
+    // 把数据写入新的memfd并密封，失败返回-1
+    int write_sealed_memfd(const char* data, size_t size) {
+        int fd = memfd_create("p2pboard-clipboard", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (fd < 0) {
+            return -1;
+        }
+        size_t written = 0;
+        while (written < size) {
+            ssize_t n = write(fd, data + written, size - written);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                close(fd);
+                return -1;
+            }
+            written += static_cast<size_t>(n);
+        }
+        // 没有可写的映射，F_SEAL_WRITE一定成功
+        if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+}
+
+// 复制一段数据
+ClipboardData ClipboardData::copy_of(const char* data, size_t size) {
+    ClipboardData result;
+    if (size >= MEMFD_SPILL_THRESHOLD) {
+        int fd = write_sealed_memfd(data, size);
+        if (fd >= 0) {
+            result.file_ = std::make_shared<File>(fd, size);
+            return result;
+        }
+        std::cerr << "创建memfd失败，剪贴板数据保存在内存中: " << std::strerror(errno) << std::endl;
+    }
+    result.bytes_.assign(data, size);
+    return result;
+}
+
+// 数据长度
+size_t ClipboardData::size() const {
+    return file_ ? file_->size : bytes_.size();
+}
+
+// 保存数据的memfd
+int ClipboardData::fd() const {
+    return file_ ? file_->fd : -1;
+}
+
+// 只读视图
+ClipboardView ClipboardData::view() const {
+    if (!file_) {
+        return ClipboardView(bytes_.data(), bytes_.size(), nullptr);
+    }
+
+    std::shared_ptr<const void> mapping = file_->mapping.lock();
+    if (!mapping) {
+        void* addr = mmap(nullptr, file_->size, PROT_READ, MAP_SHARED, file_->fd, 0);
+        if (addr == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "映射剪贴板数据失败");
+        }
+        size_t size = file_->size;
+        mapping = std::shared_ptr<const void>(addr, [size](const void* p) {
+            munmap(const_cast<void*>(p), size);
+        });
+        file_->mapping = mapping;
+    }
+    return ClipboardView(static_cast<const char*>(mapping.get()), file_->size, mapping);
+}
+
+// 达到阈值的内联数据移入memfd
+bool ClipboardData::spill() {
+    if (file_ || bytes_.size() < MEMFD_SPILL_THRESHOLD) {
+        return file_ != nullptr;
+    }
+    int fd = write_sealed_memfd(bytes_.data(), bytes_.size());
+    if (fd < 0) {
+        std::cerr << "创建memfd失败，剪贴板数据保存在内存中: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    file_ = std::make_shared<File>(fd, bytes_.size());
+    // 交换释放字符串的缓冲区，clear只会保留容量
+    std::string().swap(bytes_);
+    return true;
+}
@@ -0,0 +1,114 @@
+#ifndef CLIPBOARD_DATA_H
+#define CLIPBOARD_DATA_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/**
+ * @file clipboard_data.h
+ * @brief 剪贴板表示的数据存储
+ *
+ * 小于MEMFD_SPILL_THRESHOLD的数据保存在堆上的字符串中。更大的数据写入memfd_create创建的匿名文件并密封，
+ * 之后不能再修改或改变长度；读取时才映射进进程，所有视图释放后解除映射，
+ * 平时不计入进程的常驻内存，内存紧张时内核可以把这些页换出。
+ * 复制数据只增加memfd的引用，不复制内容。系统不支持memfd时数据保持内联。
+ */
+
+/**
+ * @class ClipboardView
+ * @brief 剪贴板数据的只读视图
+ *
+ * 视图存活期间数据保持映射，异步写出时把视图和写操作一起持有。
+ */
+class ClipboardView {
+public:
+    ClipboardView() = default;
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    /**
+     * @brief 复制为字符串
+     */
+    std::string str() const { return std::string(data_, size_); }
+
+private:
+    friend class ClipboardData;
+
+    ClipboardView(const char* data, size_t size, std::shared_ptr<const void> mapping)
+        : data_(data), size_(size), mapping_(std::move(mapping)) {}
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+
+    // memfd的映射，内联数据为空
+    std::shared_ptr<const void> mapping_;
+};
+
+/**
+ * @class ClipboardData
+ * @brief 一种表示的数据，小数据内联，大数据保存在密封的memfd中
+ */
+class ClipboardData {
+public:
+    ClipboardData() = default;
+    ClipboardData(std::string bytes) : bytes_(std::move(bytes)) {}
+    ClipboardData(const char* bytes) : bytes_(bytes) {}
+
+    /**
+     * @brief 复制一段数据，达到阈值时直接写入memfd，不经过堆上的字符串
+     */
+    static ClipboardData copy_of(const char* data, size_t size);
+
+    size_t size() const;
+    bool empty() const { return size() == 0; }
+
+    /**
+     * @brief 数据是否保存在memfd中
+     */
+    bool spilled() const { return file_ != nullptr; }
+
+    /**
+     * @brief 保存数据的memfd，内联数据返回-1
+     *
+     * 文件已密封为只读，调用方可以直接把它拼接(splice)到管道或套接字。
+     */
+    int fd() const;
+
+    /**
+     * @brief 只读视图，memfd中的数据在此时映射
+     *
+     * @throws std::system_error 映射失败
+     */
+    ClipboardView view() const;
+
+    /**
+     * @brief 复制为字符串
+     */
+    std::string str() const { return view().str(); }
+
+    /**
+     * @brief 可修改的内联数据，数据已保存在memfd中时返回nullptr
+     */
+    std::string* inline_bytes() { return file_ ? nullptr : &bytes_; }
+
+    /**
+     * @brief 达到阈值的内联数据移入memfd，释放堆上的字符串
+     *
+     * @return 数据保存在memfd中返回true
+     */
+    bool spill();
+
+private:
+    // 密封的memfd和它当前的映射
+    struct File;
+
+    // 内联数据
+    std::string bytes_;
+
+    // 溢出后的数据，复制的ClipboardData共享同一个文件
+    std::shared_ptr<File> file_;
+};
+
+#endif // CLIPBOARD_DATA_H
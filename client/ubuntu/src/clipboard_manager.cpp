@@ -1,23 +1,104 @@
 #include "clipboard_manager.h"
 #include "config.h"
+#include "fingerprint.h"
+#include "probes.h"
+#include "text_encoding.h"
+#include "wayland_clipboard_backend.h"
+#include "x11_clipboard_backend.h"
 #include <iostream>
-#include <thread>
 #include <chrono>
 #include <cstring>
+#include <algorithm>
+
+namespace
+{
+    // 除纯文本外能够读取和提供的格式
+    const char *const SUPPORTED_EXTRA_FORMATS[] = {
+        "text/html",
+        "text/uri-list",
+        "image/png"};
+
+    // 持续变化时最多推迟的去抖窗口数，避免长时间拖动选择时一直不发送
+    const int DEBOUNCE_MAX_WINDOWS = 4;
+
+    // 内容指纹，覆盖每种表示的类型和数据，用于判断内容是否真的变化
+    uint64_t content_fingerprint(const ClipboardItem &item)
+    {
+        uint64_t hash = FINGERPRINT_BASIS;
+        auto mix = [&hash](const char *bytes, size_t size)
+        {
+            hash = fingerprint_update(hash, bytes, size);
+            // 分隔类型和数据，避免不同的切分得到相同的指纹
+            hash *= FINGERPRINT_PRIME;
+        };
+        for (const auto &part : item)
+        {
+            mix(part.mime.data(), part.mime.size());
+            ClipboardView data = part.data.view();
+            mix(data.data(), data.size());
+        }
+        return hash;
+    }
+
+    // 条目中所有表示的数据总长度
+    size_t content_size(const ClipboardItem &item)
+    {
+        size_t size = 0;
+        for (const auto &part : item)
+        {
+            size += part.data.size();
+        }
+        return size;
+    }
+
+    // 把纯文本表示规范为线上格式：有效的UTF-8，LF换行
+    void normalize_text(ClipboardItem &item)
+    {
+        for (auto &part : item)
+        {
+            std::string *text = part.data.inline_bytes();
+            if (part.mime != TEXT_MIME_TYPE || !text)
+            {
+                continue;
+            }
+            if (!is_valid_utf8(*text))
+            {
+                std::cerr << "剪贴板文本不是有效的UTF-8，无效字节已替换" << std::endl;
+                *text = repair_utf8(*text);
+            }
+            crlf_to_lf(*text);
+        }
+    }
+
+    // 大的表示移入memfd，快照长期持有时不占用堆
+    void spill_large_parts(ClipboardItem &item)
+    {
+        for (auto &part : item)
+        {
+            part.data.spill();
+        }
+    }
+}
 
 // 构造函数
 ClipboardManager::ClipboardManager()
 {
     // 初始化剪贴板访问
     initialized_ = false;
-    current_content_ = "";
     last_check_time_ = std::chrono::steady_clock::now();
 }
 
+// 使用指定后端构造
+ClipboardManager::ClipboardManager(std::unique_ptr<ClipboardBackend> backend)
+    : ClipboardManager()
+{
+    backend_ = std::move(backend);
+}
+
 // 析构函数
 ClipboardManager::~ClipboardManager()
 {
-    // 如有必要清理资源
+    stop_monitoring();
 }
 
 // 初始化剪贴板管理器
@@ -25,39 +106,40 @@ bool ClipboardManager::initialize()
 {
     try
     {
-        // 检查我们是否在X11或Wayland上运行
-        const char *display_env = std::getenv("WAYLAND_DISPLAY");
-        const char *x11_display_env = std::getenv("DISPLAY");
-
-        if (display_env && strlen(display_env) > 0)
-        {
-            // 在Wayland上运行
-            std::cout << "在Wayland上运行。使用Wayland剪贴板API。" << std::endl;
-            use_wayland_ = true;
-        }
-        else if (x11_display_env && strlen(x11_display_env) > 0)
-        {
-            // 在X11上运行
-            std::cout << "在X11上运行。使用X11剪贴板API。" << std::endl;
-            use_wayland_ = false;
-        }
-        else
+        if (!backend_)
         {
-            // 回退到X11
-            std::cout << "未检测到显示环境。默认使用X11剪贴板API。" << std::endl;
-            use_wayland_ = false;
-        }
+            // 检查我们是否在X11或Wayland上运行
+            const char *display_env = std::getenv("WAYLAND_DISPLAY");
+            const char *x11_display_env = std::getenv("DISPLAY");
 
-        // 初始化适当的剪贴板后端
-        if (use_wayland_)
-        {
-            initialize_wayland_clipboard();
+            if (display_env && strlen(display_env) > 0)
+            {
+                // 在Wayland上运行
+                std::cout << "在Wayland上运行。使用Wayland剪贴板API。" << std::endl;
+                backend_ = std::make_unique<WaylandClipboardBackend>();
+            }
+            else if (x11_display_env && strlen(x11_display_env) > 0)
+            {
+                // 在X11上运行
+                std::cout << "在X11上运行。使用X11剪贴板API。" << std::endl;
+                backend_ = std::make_unique<X11ClipboardBackend>();
+            }
+            else
+            {
+                // 回退到X11
+                std::cout << "未检测到显示环境。默认使用X11剪贴板API。" << std::endl;
+                backend_ = std::make_unique<X11ClipboardBackend>();
+            }
         }
         else
         {
-            initialize_x11_clipboard();
+            std::cout << "使用" << backend_->name() << "剪贴板后端" << std::endl;
         }
 
+        // 初始化剪贴板后端
+        backend_->initialize();
+        backend_->set_wanted_formats(wanted_formats_);
+
         // 成功
         initialized_ = true;
         return true;
@@ -80,21 +162,12 @@ std::string ClipboardManager::get_clipboard_content()
 
     try
     {
-        std::string current_content = "";
-
-        if (use_wayland_)
-        {
-            current_content = get_wayland_clipboard_content();
-        }
-        else
-        {
-            current_content = get_x11_clipboard_content();
-        }
+        std::string current_content = backend_->read_text();
 
-        // 检查内容自上次检查以来是否发生变化
-        if (current_content != current_content_)
+        // 检查内容是否与最近的快照不同
+        const ClipboardPart *text = clipboard_.current_item ? find_part(*clipboard_.current_item, TEXT_MIME_TYPE) : nullptr;
+        if (!text || text->data.str() != current_content)
         {
-            current_content_ = current_content;
             last_check_time_ = std::chrono::steady_clock::now();
         }
 
@@ -109,307 +182,343 @@ std::string ClipboardManager::get_clipboard_content()
 
 // 设置剪贴板内容
 void ClipboardManager::set_clipboard_content(const std::string &content)
+{
+    set_clipboard_item(ClipboardItem{ClipboardPart{TEXT_MIME_TYPE, content}});
+}
+
+// 设置多种格式的剪贴板内容，条目被复制一次
+bool ClipboardManager::set_clipboard_item(const ClipboardItem &item, ClipboardSelection selection)
+{
+    auto copy = std::make_shared<ClipboardItem>(item);
+    spill_large_parts(*copy);
+    return set_clipboard_item(std::shared_ptr<const ClipboardItem>(std::move(copy)), selection);
+}
+
+// 设置多种格式的剪贴板内容
+bool ClipboardManager::set_clipboard_item(std::shared_ptr<const ClipboardItem> item, ClipboardSelection selection)
 {
     if (!initialized_)
     {
         std::cerr << "剪贴板管理器未初始化。无法设置剪贴板内容。" << std::endl;
-        return;
+        return false;
+    }
+    if (!item || item->empty() || (selection == ClipboardSelection::Primary && !primary_sync_))
+    {
+        return false;
     }
 
     try
     {
-        if (use_wayland_)
+        // 与该选择最近报告或写入的内容相同(例如服务器回传的我们自己的复制)时不再写入，
+        // 以免从本地应用手中抢走选择
+        SelectionState &current = state(selection);
+        uint64_t fingerprint = content_fingerprint(*item);
+        size_t size = content_size(*item);
+        if (size == current.reported_size && fingerprint == current.reported_fingerprint)
         {
-            set_wayland_clipboard_content(content);
+            return false;
         }
-        else
+
+        // 后端拒绝按通告持有CLIPBOARD时等待中的请求
+        if (selection == ClipboardSelection::Clipboard)
         {
-            set_x11_clipboard_content(content);
+            cancel_lazy_fetch();
         }
+        backend_->offer(selection, item);
 
-        // 更新本地副本
-        current_content_ = content;
+        // 后端和本地副本共享同一快照，写入的内容不再作为本地变化报告
+        current.current_item = std::move(item);
         last_check_time_ = std::chrono::steady_clock::now();
+        current.reported_fingerprint = fingerprint;
+        current.reported_size = size;
+        return true;
     }
     catch (const std::exception &e)
     {
         std::cerr << "设置剪贴板内容时出错: " << e.what() << std::endl;
+        return false;
     }
 }
 
-// 初始化Wayland剪贴板
-void ClipboardManager::initialize_wayland_clipboard()
+// 按通告设置剪贴板
+void ClipboardManager::set_lazy_clipboard(const std::vector<std::string> &formats, std::function<void()> fetch)
 {
-    // 创建到Wayland合成器的连接
-    wayland_display_ = wl_display_connect(nullptr);
-    if (!wayland_display_)
+    if (!initialized_ || !io_context_)
     {
-        throw std::runtime_error("连接Wayland显示失败");
+        std::cerr << "剪贴板监控未启动。无法按通告设置剪贴板。" << std::endl;
+        return;
     }
-
-    // 获取注册表
-    registry_ = wl_display_get_registry(wayland_display_);
-    if (!registry_)
+    if (formats.empty())
     {
-        throw std::runtime_error("获取Wayland注册表失败");
+        return;
     }
 
-    // 注册全局对象
-    wl_registry_add_listener(registry_, &registry_listener_, this);
-
-    // 获取剪贴板管理器
-    wl_display_roundtrip(wayland_display_);
-
-    // 检查剪贴板管理器是否可用
-    if (!clipboard_manager_)
+    try
     {
-        throw std::runtime_error("Wayland剪贴板管理器不可用");
+        cancel_lazy_fetch();
+        lazy_fetch_ = std::move(fetch);
+        backend_->offer_lazy(formats);
+
+        // 内容在取回之前未知；远端的内容取代了上次报告的本地复制，再次复制相同内容时仍要报告
+        clipboard_.current_item.reset();
+        clipboard_.reported_fingerprint = 0;
+        clipboard_.reported_size = 0;
+        last_check_time_ = std::chrono::steady_clock::now();
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "按通告设置剪贴板时出错: " << e.what() << std::endl;
     }
-
-    // 注册剪贴板事件
-    // wl_data_device_manager_add_listener(clipboard_manager_, &data_device_listener_, this);
-    wl_display_roundtrip(wayland_display_);
-
-    std::cout << "Wayland剪贴板管理器初始化成功" << std::endl;
-}
-
-// 获取Wayland剪贴板内容
-std::string ClipboardManager::get_wayland_clipboard_content()
-{
-    // 这是一个简化的实现
-    // 在实际应用中，您需要处理完整的Wayland协议
-
-    // 目前，我们将使用一个虚拟实现
-    // 在实践中，您需要实现完整的Wayland剪贴板协议
-    // 这涉及创建数据设备、处理选择等
-
-    // 返回测试字符串
-    return "来自Wayland的测试剪贴板内容";
-}
-
-// 设置Wayland剪贴板内容
-void ClipboardManager::set_wayland_clipboard_content(const std::string &content)
-{
-    // 这是一个简化的实现
-    // 在实际应用中，您需要实现完整的Wayland协议
-
-    // 目前，我们只打印一条消息
-    std::cout << "设置Wayland剪贴板内容: " << content << std::endl;
 }
 
-// 初始化X11剪贴板
-void ClipboardManager::initialize_x11_clipboard()
+// 提供按需获取到的数据
+void ClipboardManager::resolve_lazy_clipboard(std::shared_ptr<const ClipboardItem> item)
 {
-    // 连接到X11服务器
-    x11_display_ = XOpenDisplay(nullptr);
-    if (!x11_display_)
+    // 已被新的内容取代或已超时
+    if (!lazy_fetching_)
     {
-        throw std::runtime_error("连接X11显示失败");
+        return;
+    }
+    lazy_fetching_ = false;
+    if (lazy_timer_)
+    {
+        lazy_timer_->cancel();
     }
 
-    // 获取原子
-    atom_selection_ = XInternAtom(x11_display_, "PRIMARY", False);
-    atom_clipboard_ = XInternAtom(x11_display_, "CLIPBOARD", False);
-    atom_utf8_string_ = XInternAtom(x11_display_, "UTF8_STRING", False);
-
-    // 检查X11是否可用
-    if (atom_selection_ == 0 || atom_clipboard_ == 0 || atom_utf8_string_ == 0)
+    // 获取失败时后端拒绝等待中的请求，下次请求重新获取
+    if (!item || item->empty())
     {
-        throw std::runtime_error("X11原子不可用");
+        backend_->provide(nullptr);
+        return;
     }
 
-    std::cout << "X11剪贴板管理器初始化成功" << std::endl;
+    // 取回的内容不再作为本地变化报告
+    lazy_fetch_ = nullptr;
+    clipboard_.reported_fingerprint = content_fingerprint(*item);
+    clipboard_.reported_size = content_size(*item);
+    clipboard_.current_item = item;
+    backend_->provide(std::move(item));
 }
 
-// 获取X11剪贴板内容
-std::string ClipboardManager::get_x11_clipboard_content()
+// 本地应用请求按通告持有的数据
+void ClipboardManager::on_data_requested()
 {
-    try
+    if (lazy_fetching_)
     {
-        // 尝试PRIMARY和CLIPBOARD选择
-        std::string content = get_x11_clipboard_content_for_atom(atom_selection_);
-
-        if (content.empty())
-        {
-            content = get_x11_clipboard_content_for_atom(atom_clipboard_);
-        }
-
-        return content;
+        return;
     }
-    catch (const std::exception &e)
+    if (!lazy_fetch_ || !lazy_timer_)
     {
-        std::cerr << "读取X11剪贴板时出错: " << e.what() << std::endl;
-        return "";
+        backend_->provide(nullptr);
+        return;
     }
+    lazy_fetching_ = true;
+
+    lazy_timer_->expires_after(std::chrono::milliseconds(LAZY_FETCH_TIMEOUT_MS));
+    lazy_timer_->async_wait([this](const boost::system::error_code &ec)
+                            {
+                                // 定时器可能在取消前已经到期，以到期时间确认确实超时
+                                if (!ec && lazy_fetching_ &&
+                                    lazy_timer_->expiry() <= std::chrono::steady_clock::now())
+                                {
+                                    std::cerr << "按需获取剪贴板内容超时" << std::endl;
+                                    resolve_lazy_clipboard(nullptr);
+                                }
+                            });
+    lazy_fetch_();
 }
 
-// 设置X11剪贴板内容
-void ClipboardManager::set_x11_clipboard_content(const std::string &content)
+// 我们持有的选择被其他应用取得
+void ClipboardManager::on_ownership_lost()
 {
-    try
+    cancel_lazy_fetch();
+}
+
+// 结束按需获取的等待
+void ClipboardManager::cancel_lazy_fetch()
+{
+    lazy_fetch_ = nullptr;
+    lazy_fetching_ = false;
+    if (lazy_timer_)
     {
-        // 设置PRIMARY和CLIPBOARD选择
-        set_x11_clipboard_content_for_atom(atom_selection_, content);
-        set_x11_clipboard_content_for_atom(atom_clipboard_, content);
+        lazy_timer_->cancel();
     }
-    catch (const std::exception &e)
+}
+
+// 本地应用复制或选中了新内容
+void ClipboardManager::on_local_change(ClipboardSelection selection, ClipboardItem item)
+{
+    // 未启用同步时后端不读取PRIMARY，启动前已开始的读取仍可能报告
+    if (selection == ClipboardSelection::Primary && !primary_sync_)
     {
-        std::cerr << "设置X11剪贴板时出错: " << e.what() << std::endl;
+        return;
     }
+    update_content(selection, std::move(item));
 }
 
-// 获取特定X11原子的剪贴板内容
-std::string ClipboardManager::get_x11_clipboard_content_for_atom(Atom atom)
+// 选择对应的状态
+ClipboardManager::SelectionState &ClipboardManager::state(ClipboardSelection selection)
 {
-    // 获取拥有选择的窗口
-    Window window = XGetSelectionOwner(x11_display_, atom);
+    return selection == ClipboardSelection::Primary ? primary_ : clipboard_;
+}
 
-    if (window == 0)
+// 设置PRIMARY选择的同步策略
+void ClipboardManager::set_primary_sync(bool enabled, std::chrono::milliseconds min_interval)
+{
+    primary_sync_ = enabled;
+    primary_interval_ = min_interval;
+    if (backend_)
     {
-        return ""; // 没有所有者，所以没有数据
+        backend_->set_track_primary(enabled);
     }
+}
 
-    // 请求数据
-    XSetSelectionOwner(x11_display_, atom, window, CurrentTime);
-
-    // 等待数据可用
-    XEvent event;
-    bool got_data = false;
-
-    while (!got_data)
+// 设置除纯文本外需要读取的格式
+void ClipboardManager::set_wanted_formats(const std::vector<std::string> &formats)
+{
+    wanted_formats_.clear();
+    for (const auto &format : formats)
     {
-        XNextEvent(x11_display_, &event);
-
-        switch (event.type)
-        {
-        case SelectionNotify:
+        for (const char *supported : SUPPORTED_EXTRA_FORMATS)
         {
-            // 检查选择是否成功
-            if (event.xselection.property != None)
+            if (format == supported)
             {
-                // 获取数据
-                Atom actual_type;
-                int actual_format;
-                unsigned long nitems;
-                unsigned long bytes_after;
-                unsigned char *data;
-
-                XGetWindowProperty(x11_display_, window, event.xselection.property,
-                                   0, 0, 0, XA_STRING, &actual_type, &actual_format,
-                                   &nitems, &bytes_after, &data);
-
-                if (actual_type == atom_utf8_string_ && data)
-                {
-                    std::string result((char *)data, nitems);
-                    XFree(data);
-                    got_data = true;
-                    return result;
-                }
+                wanted_formats_.insert(format);
             }
-            break;
-        }
-        case SelectionRequest:
-        {
-            // 处理选择请求
-            XEvent reply;
-            memset(&reply, 0, sizeof(reply));
-            reply.type = SelectionNotify;
-            reply.xselection.requestor = event.xselectionrequest.requestor;
-            reply.xselection.selection = event.xselectionrequest.selection;
-            reply.xselection.target = event.xselectionrequest.target;
-            reply.xselection.property = event.xselectionrequest.property;
-            reply.xselection.time = event.xselectionrequest.time;
-
-            // 发送回数据
-            XSendEvent(x11_display_, event.xselectionrequest.requestor, False, 0, &reply);
-            break;
-        }
         }
     }
-
-    return "";
+    if (backend_)
+    {
+        backend_->set_wanted_formats(wanted_formats_);
+    }
 }
 
-// 为特定X11原子设置剪贴板内容
-void ClipboardManager::set_x11_clipboard_content_for_atom(Atom atom, const std::string &content)
+// 本客户端能够读取和提供的格式
+std::vector<std::string> ClipboardManager::supported_formats()
 {
-    // 创建一个窗口来保存选择
-    Window window = XCreateSimpleWindow(x11_display_, RootWindow(x11_display_, 0),
-                                        0, 0, 1, 1, 0, 0, 0);
-
-    // 设置选择所有者
-    XSetSelectionOwner(x11_display_, atom, window, CurrentTime);
-
-    // 等待选择被设置
-    XFlush(x11_display_);
-
-    // 保持窗口存活直到选择被处理
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-
-    // 清理
-    XDestroyWindow(x11_display_, window);
-    XFlush(x11_display_);
+    std::vector<std::string> formats = {TEXT_MIME_TYPE};
+    formats.insert(formats.end(), std::begin(SUPPORTED_EXTRA_FORMATS), std::end(SUPPORTED_EXTRA_FORMATS));
+    return formats;
 }
 
-// Wayland注册表监听器回调
-static void registry_handle_global(void *data, struct wl_registry *registry,
-                                   uint32_t name, const char *interface, uint32_t version)
+// 开始事件驱动的剪贴板监控
+void ClipboardManager::start_monitoring(boost::asio::io_context &io_context, ChangeCallback on_change)
 {
-    auto *manager = static_cast<ClipboardManager *>(data);
-    if (strcmp(interface, "wl_data_device_manager") == 0)
+    if (!initialized_)
     {
-        manager->clipboard_manager_ = static_cast<wl_data_device_manager *>(wl_registry_bind(registry, name,
-                                                                                             &wl_data_device_manager_interface, version));
+        std::cerr << "剪贴板管理器未初始化。无法开始监控。" << std::endl;
+        return;
     }
-}
 
-// Wayland数据设备监听器回调
-static void data_device_handle_data_offer(void *data, struct wl_data_device *wl_data_device, struct wl_data_offer *id)
-{
-    // 处理数据提供
-    std::cout << "收到Wayland数据提供" << std::endl;
+    on_change_ = std::move(on_change);
+    io_context_ = &io_context;
+    clipboard_.debounce_timer = std::make_unique<boost::asio::steady_timer>(io_context);
+    primary_.debounce_timer = std::make_unique<boost::asio::steady_timer>(io_context);
+    lazy_timer_ = std::make_unique<boost::asio::steady_timer>(io_context);
+    backend_->set_track_primary(primary_sync_);
+    backend_->start(io_context, *this);
 }
 
-static void data_device_handle_enter(void *data, struct wl_data_device *wl_data_device, uint32_t serial, struct wl_surface *surface, wl_fixed_t x, wl_fixed_t y, struct wl_data_offer *id)
+// 停止剪贴板监控
+void ClipboardManager::stop_monitoring()
 {
-    // 处理进入事件
-    std::cout << "收到Wayland进入事件" << std::endl;
+    // 后端拒绝等待中的请求，丢弃正在进行的读取
+    if (backend_)
+    {
+        backend_->stop();
+    }
+    for (SelectionState *current : {&clipboard_, &primary_})
+    {
+        if (current->debounce_timer)
+        {
+            current->debounce_timer->cancel();
+            current->debounce_timer.reset();
+        }
+        current->change_pending = false;
+    }
+    cancel_lazy_fetch();
+    lazy_timer_.reset();
+    io_context_ = nullptr;
+    on_change_ = nullptr;
 }
 
-static void data_device_handle_leave(void *data, struct wl_data_device *wl_data_device)
+// 记录选择的新条目并通知回调
+void ClipboardManager::update_content(ClipboardSelection selection, ClipboardItem item)
 {
-    // 处理离开事件
-    std::cout << "收到Wayland离开事件" << std::endl;
-}
+    if (item.empty())
+    {
+        return;
+    }
 
-static void data_device_handle_motion(void *data, struct wl_data_device *wl_data_device, uint32_t time, wl_fixed_t x, wl_fixed_t y)
-{
-    // 处理移动事件
-    std::cout << "收到Wayland移动事件" << std::endl;
+    // 读到的内容规范为线上格式后成为不可变的快照，之后只共享不复制
+    normalize_text(item);
+    spill_large_parts(item);
+    SelectionState &current = state(selection);
+    current.current_item = std::make_shared<const ClipboardItem>(std::move(item));
+    auto now = std::chrono::steady_clock::now();
+    last_check_time_ = now;
+
+    if (!on_change_)
+    {
+        return;
+    }
+    // PRIMARY两次报告之间至少间隔primary_interval_
+    auto earliest = selection == ClipboardSelection::Primary ? current.last_report + primary_interval_ : now;
+    if ((debounce_window_.count() == 0 && earliest <= now) || !current.debounce_timer)
+    {
+        report_change(selection);
+        return;
+    }
+
+    // 每次变化重新计时，一串连续变化只报告最后的值；
+    // 但从第一次变化起最多推迟DEBOUNCE_MAX_WINDOWS个窗口
+    if (!current.change_pending)
+    {
+        current.change_pending = true;
+        current.pending_since = now;
+    }
+    auto deadline = std::min(now + debounce_window_, current.pending_since + debounce_window_ * DEBOUNCE_MAX_WINDOWS);
+    current.debounce_timer->expires_at(std::max(deadline, earliest));
+    current.debounce_timer->async_wait([this, selection](const boost::system::error_code &ec)
+                                       {
+                                           if (!ec)
+                                           {
+                                               report_change(selection);
+                                           }
+                                       });
 }
 
-static void data_device_handle_drop(void *data, struct wl_data_device *wl_data_device)
+// 设置去抖窗口
+void ClipboardManager::set_debounce_window(std::chrono::milliseconds window)
 {
-    // 处理放置事件
-    std::cout << "收到Wayland放置事件" << std::endl;
+    debounce_window_ = window;
 }
 
-static void data_device_handle_selection(void *data, struct wl_data_device *wl_data_device, struct wl_data_offer *id)
+// 内容指纹与该选择上次报告的不同时通知回调
+void ClipboardManager::report_change(ClipboardSelection selection)
 {
-    // 处理剪贴板选择
-    std::cout << "收到Wayland剪贴板选择" << std::endl;
-}
+    SelectionState &current = state(selection);
+    current.change_pending = false;
+    // 去抖期间被按通告持有的选择取代
+    if (!current.current_item)
+    {
+        return;
+    }
+
+    // 先比较长度，长度相同时再比较指纹；回传的内容与规范后的快照相同，不会再写入
+    uint64_t fingerprint = content_fingerprint(*current.current_item);
+    size_t size = content_size(*current.current_item);
+    if (size == current.reported_size && fingerprint == current.reported_fingerprint)
+    {
+        return;
+    }
+    current.reported_fingerprint = fingerprint;
+    current.reported_size = size;
+    current.last_report = std::chrono::steady_clock::now();
 
-// Wayland接口实现
-const struct wl_registry_listener ClipboardManager::registry_listener_ = {
-    registry_handle_global,
-    nullptr // handle_global_remove
-};
-
-const struct wl_data_device_listener ClipboardManager::data_device_listener_ = {
-    data_device_handle_data_offer,
-    data_device_handle_enter,
-    data_device_handle_leave,
-    data_device_handle_motion,
-    data_device_handle_drop,
-    data_device_handle_selection};
+    CLIENT_PROBE1(detect, size);
+    if (on_change_)
+    {
+        on_change_(selection, current.current_item);
+    }
+}
@@ -4,47 +4,55 @@
 #include <string>
 #include <atomic>
 #include <chrono>
+#include <functional>
+#include <memory>
+#include <set>
+#include <vector>
 
-// X11 headers
-#ifdef __linux__
-#include <X11/Xlib.h>
-#include <X11/Xatom.h>
-#endif
+#include <boost/asio.hpp>
 
-// Wayland headers
-#ifdef __linux__
-#include <wayland-client.h>
-#include <wayland-client-protocol.h>
-#endif
+#include "clipboard_backend.h"
+#include "protocol.h"
 
 /**
  * @class ClipboardManager
  * @brief 管理Linux系统剪贴板访问
  *
- * 此类提供跨平台接口用于访问和修改系统剪贴板，
- * 支持X11和Wayland显示服务器。
- * 它处理与剪贴板API交互的底层细节，
- * 同时为应用程序的其他部分提供简单接口。
+ * 此类为应用程序的其他部分提供访问和修改剪贴板的简单接口，
+ * 与具体剪贴板实现交互的细节由ClipboardBackend处理：
+ * 支持X11和Wayland显示服务器，也可以使用不依赖显示服务器的内存后端。
+ * 变化去抖、内容去重和按需获取的等待在这里统一处理，与后端无关。
+ * CLIPBOARD和PRIMARY各自保存快照并分别检测变化；PRIMARY默认不同步。
  */
-class ClipboardManager
+class ClipboardManager : private ClipboardBackend::Listener
 {
 public:
     /**
      * @brief 构造函数
-     * 使用默认设置初始化剪贴板管理器
+     * 初始化时根据当前显示环境选择X11或Wayland后端
      */
     ClipboardManager();
 
+    /**
+     * @brief 使用指定后端构造
+     *
+     * @param backend 剪贴板后端，例如MemoryClipboardBackend
+     */
+    explicit ClipboardManager(std::unique_ptr<ClipboardBackend> backend);
+
     /**
      * @brief 析构函数
      * 清理剪贴板管理器使用的资源
      */
-    ~ClipboardManager();
+    ~ClipboardManager() override;
+
+    ClipboardManager(const ClipboardManager &) = delete;
+    ClipboardManager &operator=(const ClipboardManager &) = delete;
 
     /**
      * @brief 初始化剪贴板管理器
      *
-     * 此方法根据当前显示环境设置适当的后端(X11或Wayland)。
+     * 没有指定后端时根据当前显示环境选择适当的后端(X11或Wayland)，然后初始化后端。
      * 应在使用任何其他方法之前调用此方法。
      *
      * @return 初始化成功返回true，否则返回false
@@ -54,8 +62,8 @@ public:
     /**
      * @brief 获取当前剪贴板内容
      *
-     * 此方法从系统剪贴板检索当前文本。
-     * 它检查PRIMARY和CLIPBOARD选择，并返回找到的第一个非空内容。
+     * 此方法从系统剪贴板检索当前文本，不含其他格式。
+     * 只读取CLIPBOARD选择，选中的文本(PRIMARY)不算作剪贴板内容。
      *
      * @return 当前剪贴板内容作为字符串返回
      */
@@ -64,66 +72,200 @@ public:
     /**
      * @brief 设置剪贴板内容
      *
-     * 此方法将指定文本设置为新的剪贴板内容。
-     * 它更新PRIMARY和CLIPBOARD选择，以确保与不同应用程序的兼容性。
+     * 此方法将指定文本设置为新的剪贴板内容，只更新CLIPBOARD选择。
      *
      * @param content 要设置到剪贴板中的文本
      */
     void set_clipboard_content(const std::string &content);
 
-public:
-    // X11相关成员变量
-    Display *x11_display_ = nullptr;
-    Atom atom_selection_;
-    Atom atom_clipboard_;
-    Atom atom_utf8_string_;
+    /**
+     * @brief 设置多种格式的剪贴板内容
+     *
+     * 条目中的每种表示都以其MIME类型提供给本地应用，
+     * 纯文本表示同时以各种常见的文本目标提供。
+     *
+     * @param item 要设置到剪贴板中的条目，由后端共享，不复制
+     * @param selection 要设置的选择；未启用PRIMARY同步时PRIMARY的内容被忽略
+     * @return 确实写入了剪贴板返回true，内容与该选择最近报告或写入的相同(例如回传)时返回false
+     */
+    bool set_clipboard_item(std::shared_ptr<const ClipboardItem> item,
+                            ClipboardSelection selection = ClipboardSelection::Clipboard);
 
-    // Wayland相关成员变量
-    struct wl_display *wayland_display_ = nullptr;
-    struct wl_registry *registry_ = nullptr;
-    struct wl_data_device_manager *clipboard_manager_ = nullptr;
+    /**
+     * @brief 设置多种格式的剪贴板内容，条目被复制一次，大的表示移入memfd
+     */
+    bool set_clipboard_item(const ClipboardItem &item,
+                            ClipboardSelection selection = ClipboardSelection::Clipboard);
 
-    // 标志位指示是否使用Wayland
-    bool use_wayland_ = false;
+    /**
+     * @brief 按通告设置CLIPBOARD，数据在本地应用请求时才获取
+     *
+     * 立即取得选择所有权并声明通告的格式。本地应用第一次请求数据时调用fetch，
+     * 调用方取得数据后调用resolve_lazy_clipboard，期间到达的请求都等待这一次获取；
+     * 超过LAZY_FETCH_TIMEOUT_MS仍未取得时拒绝等待中的请求，下次请求重新获取。
+     * 需要先调用start_monitoring。
+     *
+     * @param formats 通告的MIME类型
+     * @param fetch 获取数据的回调
+     */
+    void set_lazy_clipboard(const std::vector<std::string> &formats, std::function<void()> fetch);
 
-    // 标志位指示管理器是否已初始化
-    std::atomic<bool> initialized_ = false;
+    /**
+     * @brief 提供按需获取到的数据
+     *
+     * 回复等待中的请求，之后的请求直接使用这份数据。
+     *
+     * @param item 获取到的条目，为空指针或空条目表示获取失败
+     */
+    void resolve_lazy_clipboard(std::shared_ptr<const ClipboardItem> item);
 
-    // 当前剪贴板内容
-    std::string current_content_;
+    /**
+     * @brief 设置除纯文本外需要读取的格式
+     *
+     * 通常是服务器通告的房间内其他客户端接受的格式，
+     * 与本客户端支持的格式取交集。纯文本总是读取。
+     *
+     * @param formats MIME类型列表
+     */
+    void set_wanted_formats(const std::vector<std::string> &formats);
 
-    // 上次检查剪贴板的时间
-    std::chrono::steady_clock::time_point last_check_time_;
+    /**
+     * @brief 本客户端能够读取和提供的格式
+     */
+    static std::vector<std::string> supported_formats();
 
-    // Wayland注册表监听器
-    static const struct wl_registry_listener registry_listener_;
+    /**
+     * @brief 设置PRIMARY选择的同步策略
+     *
+     * PRIMARY在每次选中文本时变化，默认不同步，也不读取。启用后与CLIPBOARD分别去抖和去重，
+     * 并且两次报告之间至少间隔min_interval，期间的变化只报告最后一次。需要在start_monitoring之前调用。
+     *
+     * @param enabled 是否同步PRIMARY
+     * @param min_interval PRIMARY两次报告的最小间隔，0表示只去抖
+     */
+    void set_primary_sync(bool enabled, std::chrono::milliseconds min_interval);
 
-    // Wayland数据设备监听器
-    static const struct wl_data_device_listener data_device_listener_;
+    /**
+     * @brief 剪贴板变化回调类型，参数为变化的选择和它新的快照
+     *
+     * 快照创建后不再修改，可以直接作为发送消息的消息体，不必复制。
+     */
+    using ChangeCallback = std::function<void(ClipboardSelection, std::shared_ptr<const ClipboardItem>)>;
 
-    // 初始化Wayland剪贴板
-    void initialize_wayland_clipboard();
+    /**
+     * @brief 开始事件驱动的剪贴板监控
+     *
+     * X11下通过XFixes订阅CLIPBOARD(以及启用同步时的PRIMARY)的所有者变化，
+     * Wayland下通过数据设备的selection事件接收新的选择，
+     * 并把显示连接的文件描述符交给io_context监视，不再阻塞等待或定时轮询。
+     * 向本地应用提供数据也依赖此事件循环。
+     * 剪贴板内容发生变化时在io_context线程上调用回调。
+     *
+     * @param io_context 客户端事件循环
+     * @param on_change 剪贴板变化回调
+     */
+    void start_monitoring(boost::asio::io_context &io_context, ChangeCallback on_change);
+
+    /**
+     * @brief 停止剪贴板监控
+     */
+    void stop_monitoring();
+
+    /**
+     * @brief 设置变化去抖窗口
+     *
+     * 窗口内的连续变化(例如拖动选择文本)合并为一次，只报告最后的内容。
+     * 内容指纹与上次报告的相同时不会报告。为0时每次变化立即报告。
+     *
+     * @param window 去抖窗口
+     */
+    void set_debounce_window(std::chrono::milliseconds window);
+
+    /**
+     * @brief 剪贴板内容最近一次变化的时间
+     *
+     * 在变化回调中调用时是所报告内容被检测到的时间，用于延迟追踪。
+     */
+    std::chrono::steady_clock::time_point last_change_time() const { return last_check_time_; }
+
+private:
+    // 一个选择的快照和变化检测状态
+    struct SelectionState
+    {
+        // 当前快照，按通告持有且尚未取回时为空
+        std::shared_ptr<const ClipboardItem> current_item;
+
+        // 上次报告(或从远端写入)的内容指纹和长度
+        uint64_t reported_fingerprint = 0;
+        size_t reported_size = 0;
 
-    // 获取Wayland剪贴板内容
-    std::string get_wayland_clipboard_content();
+        // 是否有尚未报告的变化，以及这串变化开始的时间
+        bool change_pending = false;
+        std::chrono::steady_clock::time_point pending_since;
 
-    // 设置Wayland剪贴板内容
-    void set_wayland_clipboard_content(const std::string &content);
+        // 上次报告的时间，用于限制报告频率
+        std::chrono::steady_clock::time_point last_report;
 
-    // 初始化X11剪贴板
-    void initialize_x11_clipboard();
+        // 去抖定时器
+        std::unique_ptr<boost::asio::steady_timer> debounce_timer;
+    };
+
+    // 选择对应的状态
+    SelectionState &state(ClipboardSelection selection);
+
+    // 后端报告本地应用复制或选中了新内容
+    void on_local_change(ClipboardSelection selection, ClipboardItem item) override;
+
+    // 后端报告本地应用请求按通告持有的数据，开始按需获取(如果尚未开始)
+    void on_data_requested() override;
+
+    // 后端报告我们持有的选择被其他应用取得，放弃按通告持有的选择
+    void on_ownership_lost() override;
+
+    // 结束按需获取的等待
+    void cancel_lazy_fetch();
+
+    // 记录选择的新条目，去抖后通知回调
+    void update_content(ClipboardSelection selection, ClipboardItem item);
+
+    // 选择的内容确实变化时通知回调
+    void report_change(ClipboardSelection selection);
+
+    // 剪贴板后端
+    std::unique_ptr<ClipboardBackend> backend_;
+
+    // 客户端事件循环，监控期间有效
+    boost::asio::io_context *io_context_ = nullptr;
+
+    // 标志位指示管理器是否已初始化
+    std::atomic<bool> initialized_ = false;
+
+    // CLIPBOARD和PRIMARY的状态
+    SelectionState clipboard_;
+    SelectionState primary_;
+
+    // 是否同步PRIMARY，以及两次报告的最小间隔
+    bool primary_sync_ = false;
+    std::chrono::milliseconds primary_interval_{0};
+
+    // 除纯文本外需要读取的格式
+    std::set<std::string> wanted_formats_;
+
+    // 上次检查剪贴板的时间
+    std::chrono::steady_clock::time_point last_check_time_;
 
-    // 获取X11剪贴板内容
-    std::string get_x11_clipboard_content();
+    // 剪贴板变化回调
+    ChangeCallback on_change_;
 
-    // 设置X11剪贴板内容
-    void set_x11_clipboard_content(const std::string &content);
+    // 变化去抖窗口
+    std::chrono::milliseconds debounce_window_{0};
 
-    // 获取特定X11原子的剪贴板内容
-    std::string get_x11_clipboard_content_for_atom(Atom atom);
+    // 按通告持有选择时获取数据的回调，数据取回后清空
+    std::function<void()> lazy_fetch_;
 
-    // 为特定X11原子设置剪贴板内容
-    void set_x11_clipboard_content_for_atom(Atom atom, const std::string &content);
+    // 是否正在等待按需获取的数据，以及等待超时定时器
+    bool lazy_fetching_ = false;
+    std::unique_ptr<boost::asio::steady_timer> lazy_timer_;
 };
 
 #endif // CLIPBOARD_MANAGER_H
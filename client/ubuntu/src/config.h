@@ -6,11 +6,47 @@
 #define SERVER_PORT "8080"
 #define SERVER_PROTOCOL "ws://"
 
+// 房间名，同一房间的设备互相同步；加密时作为附加认证数据
+#define SERVER_ROOM "default"
+
 // 连接超时时间(秒)
 #define CONNECTION_TIMEOUT 30
 
-// 剪贴板同步间隔(毫秒)
-#define CLIPBOARD_SYNC_INTERVAL 1000
+// 重连退避的初始延迟和最大延迟(毫秒)，实际延迟在[0, 当前上限]内随机
+#define RECONNECT_INITIAL_DELAY_MS 500
+#define RECONNECT_MAX_DELAY_MS 30000
+
+// 剪贴板变化去抖窗口(毫秒)，窗口内的连续变化只发送最后一次，0表示不去抖
+#define CLIPBOARD_DEBOUNCE_MS 150
+
+// 同步PRIMARY选择(选中即复制)，默认关闭，只同步显式复制的CLIPBOARD
+#define PRIMARY_SYNC_ENABLED 0
+
+// PRIMARY两次发送的最小间隔(毫秒)，拖选文字时的连续变化只发送最后一次
+#define PRIMARY_MIN_INTERVAL_MS 1000
+
+// 按需获取模式：服务器对大内容只发送通告，本地应用粘贴时才下载。
+// 默认关闭：启用后每次粘贴大内容都要等待一次到服务器的往返
+#define LAZY_FETCH_ENABLED 0
+
+// 按需获取等待服务器响应的超时(毫秒)，超时后拒绝本次粘贴
+#define LAZY_FETCH_TIMEOUT_MS 5000
+
+// 保存配对密钥的环境变量，设置后剪贴板内容端到端加密，同一组的设备必须使用相同的密钥
+#define PAIRING_SECRET_ENV "P2PBOARD_PAIRING_SECRET"
+
+// 拉伸配对密钥的PBKDF2迭代次数
+#define PAIRING_KDF_ITERATIONS 200000
+
+// 延迟追踪：发出的剪贴板消息带追踪编号和时间戳，收到的按段统计延迟。
+// 默认关闭：带trace头部的消息在服务器广播时要重新序列化以加上t-fanout
+#define LATENCY_TRACE_ENABLED 0
+
+// 输出延迟统计的间隔(秒)
+#define LATENCY_REPORT_INTERVAL_S 60
+
+// 达到此大小(字节)的剪贴板数据保存在密封的memfd中，不占用进程堆
+#define MEMFD_SPILL_THRESHOLD (64 * 1024)
 
 // 最大消息大小(字节)
 #define MAX_MESSAGE_SIZE 1024 * 1024  // 1MB
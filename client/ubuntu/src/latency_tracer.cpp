@@ -0,0 +1,140 @@
+#include "latency_tracer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+    // 各段的名称，下标与LatencyTracer::Hop一致
+    const char* const HOP_NAMES[] = {"detect", "upload", "fanout", "download", "apply", "total"};
+
+    // 读取微秒时间戳头部，不存在时返回0
+    uint64_t timestamp(const ProtocolMessage& message, const char* key) {
+        return std::strtoull(message.get(key).c_str(), nullptr, 10);
+    }
+}
+
+LatencyTracer::LatencyTracer() : random_(std::random_device{}()) {
+}
+
+// 为发出的消息写入追踪头部
+void LatencyTracer::stamp_outgoing(ProtocolMessage& message, std::chrono::steady_clock::time_point copied) {
+    char trace[17];
+    std::snprintf(trace, sizeof(trace), "%016llx", static_cast<unsigned long long>(random_()));
+
+    // 单调时钟的时间点换算为墙上时间，与其他设备和服务器的时间戳可比
+    uint64_t now = now_micros();
+    auto elapsed = std::chrono::steady_clock::now() - copied;
+    uint64_t since = static_cast<uint64_t>(
+        std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+
+    message.set("trace", trace);
+    message.set("t-copy", std::to_string(since < now ? now - since : now));
+    message.set("t-send", std::to_string(now));
+}
+
+// 收到的消息已写入本地剪贴板
+void LatencyTracer::record_applied(const ProtocolMessage& message) {
+    if (message.get("trace").empty()) {
+        return;
+    }
+
+    uint64_t applied = now_micros();
+    uint64_t stamps[] = {timestamp(message, "t-copy"), timestamp(message, "t-send"),
+                         timestamp(message, "t-recv"), timestamp(message, "t-fanout"),
+                         timestamp(message, "t-arrive"), applied};
+
+    // 相邻时间戳之间是一段，最后一段是从复制到写入的总时间
+    for (int hop = DETECT; hop < TOTAL; ++hop) {
+        if (stamps[hop] == 0 || stamps[hop + 1] == 0) {
+            continue;
+        }
+        hops_[hop].record(stamps[hop + 1] > stamps[hop] ? stamps[hop + 1] - stamps[hop] : 0);
+    }
+    if (stamps[DETECT] != 0) {
+        hops_[TOTAL].record(applied > stamps[DETECT] ? applied - stamps[DETECT] : 0);
+    }
+}
+
+// 生成一行报告并清空统计
+std::string LatencyTracer::report_and_reset() {
+    std::string report;
+    for (int hop = 0; hop < HOP_COUNT; ++hop) {
+        Histogram& h = hops_[hop];
+        if (h.count() == 0) {
+            continue;
+        }
+        if (!report.empty()) {
+            report += " | ";
+        }
+        report += std::string(HOP_NAMES[hop]) + " n=" + std::to_string(h.count()) +
+                  " p50=" + std::to_string(h.percentile(50)) +
+                  " p90=" + std::to_string(h.percentile(90)) +
+                  " p99=" + std::to_string(h.percentile(99)) +
+                  " max=" + std::to_string(h.max());
+        h.clear();
+    }
+    return report;
+}
+
+// 当前时间，Unix纪元以来的微秒数
+uint64_t LatencyTracer::now_micros() {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+}
+
+// 样本所在的桶：小于4的值各占一个桶，之后每个2的幂分为4个子桶
+int LatencyTracer::Histogram::bucket_of(uint64_t micros) {
+    if (micros < SUB_BUCKETS) {
+        return static_cast<int>(micros);
+    }
+    int exponent = 63 - __builtin_clzll(micros);
+    int sub = static_cast<int>((micros >> (exponent - 2)) & (SUB_BUCKETS - 1));
+    return (exponent - 1) * SUB_BUCKETS + sub;
+}
+
+// 桶的上界
+uint64_t LatencyTracer::Histogram::bucket_upper(int bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return static_cast<uint64_t>(bucket);
+    }
+    int exponent = bucket / SUB_BUCKETS + 1;
+    uint64_t sub = static_cast<uint64_t>(bucket % SUB_BUCKETS);
+    uint64_t lower = (SUB_BUCKETS + sub) << (exponent - 2);
+    return lower + (uint64_t(1) << (exponent - 2)) - 1;
+}
+
+// 记录一个样本
+void LatencyTracer::Histogram::record(uint64_t micros) {
+    ++counts_[bucket_of(micros)];
+    ++count_;
+    if (micros > max_) {
+        max_ = micros;
+    }
+}
+
+// 第p百分位的近似值，取所在桶的上界
+uint64_t LatencyTracer::Histogram::percentile(double p) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(count_) + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return std::min(bucket_upper(i), max_);
+        }
+    }
+    return max_;
+}
+
+// 清空
+void LatencyTracer::Histogram::clear() {
+    std::memset(counts_, 0, sizeof(counts_));
+    count_ = 0;
+    max_ = 0;
+}
@@ -0,0 +1,98 @@
+#ifndef LATENCY_TRACER_H
+#define LATENCY_TRACER_H
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+
+#include "protocol.h"
+
+/**
+ * @class LatencyTracer
+ * @brief 剪贴板更新从复制到粘贴的逐段延迟追踪
+ *
+ * 发送方为每条剪贴板消息生成追踪编号并写入时间戳头部，经过的每一跳各自追加一个：
+ *   trace: <64位随机数，十六进制>
+ *   t-copy: 发送方检测到本地复制
+ *   t-send: 发送方把消息交给WebSocket客户端(离线时在队列中等待的时间计入上传)
+ *   t-recv: 服务器收到
+ *   t-fanout: 服务器交给房间内的会话发送
+ *   t-arrive: 接收方收齐消息(只在本地添加，不经过网络)
+ * 时间戳都是Unix纪元以来的微秒数。接收方写入本地剪贴板后按这些时间戳统计各段：
+ * detect、upload、fanout、download、apply以及从复制到可粘贴的total。
+ *
+ * 跨设备的差值依赖设备之间的时钟同步(例如NTP)，时钟偏差导致的负值记为0；
+ * detect和apply在同一台设备上计算，不受影响。
+ *
+ * 每段的统计是对数直方图：每个2的幂再等分为4个子桶，百分位的相对误差不超过25%。
+ * 所有方法都必须在io_context线程上调用。
+ */
+class LatencyTracer {
+public:
+    LatencyTracer();
+
+    /**
+     * @brief 为发出的消息写入追踪编号、t-copy和t-send
+     *
+     * @param message 要发送的消息，加密之后调用，追踪头部不参与加密认证
+     * @param copied 检测到本地复制的时间
+     */
+    void stamp_outgoing(ProtocolMessage& message, std::chrono::steady_clock::time_point copied);
+
+    /**
+     * @brief 收到的消息已写入本地剪贴板，记录各段延迟
+     *
+     * 没有追踪编号的消息被忽略，缺少的时间戳对应的段被跳过。
+     *
+     * @param message 收到的消息
+     */
+    void record_applied(const ProtocolMessage& message);
+
+    /**
+     * @brief 生成一行报告并清空统计
+     *
+     * 例如：total n=12 p50=3071 p90=6143 p99=8191 max=7420 | ...，单位为微秒
+     *
+     * @return 报告，没有样本时为空字符串
+     */
+    std::string report_and_reset();
+
+    /**
+     * @brief 当前时间，Unix纪元以来的微秒数
+     */
+    static uint64_t now_micros();
+
+private:
+    // 一段延迟的对数直方图
+    class Histogram {
+    public:
+        void record(uint64_t micros);
+        uint64_t count() const { return count_; }
+        uint64_t max() const { return max_; }
+        uint64_t percentile(double p) const;
+        void clear();
+
+    private:
+        static const int SUB_BUCKETS = 4;
+        static const int BUCKETS = 64 * SUB_BUCKETS;
+
+        static int bucket_of(uint64_t micros);
+        static uint64_t bucket_upper(int bucket);
+
+        uint64_t counts_[BUCKETS] = {};
+        uint64_t count_ = 0;
+        uint64_t max_ = 0;
+    };
+
+    // 统计的各段，顺序与报告一致
+    enum Hop { DETECT, UPLOAD, FANOUT, DOWNLOAD, APPLY, TOTAL, HOP_COUNT };
+
+    // 各段的直方图
+    Histogram hops_[HOP_COUNT];
+
+    // 生成追踪编号
+    std::mt19937_64 random_;
+};
+
+#endif // LATENCY_TRACER_H
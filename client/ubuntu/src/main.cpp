@@ -1,31 +1,34 @@
+#include <csignal>
+#include <cstdlib>
+#include <functional>
 #include <iostream>
 #include <memory>
-#include <thread>
-#include <chrono>
+
+#include <malloc.h>
+
+#include <boost/asio.hpp>
 
 // 包含我们的头文件
+#include "alloc_counter.h"
 #include "websocket_client.h"
 #include "clipboard_manager.h"
+#include "latency_tracer.h"
+#include "payload_cipher.h"
+#include "probes.h"
 #include "config.h"
 
-// 全局标志位用于控制应用程序循环
-volatile bool running = true;
+int main() {
+    std::cout << "启动P2PBoard Ubuntu客户端..." << std::endl;
 
-// 信号处理器用于优雅关闭
-void signal_handler(int sig) {
-    std::cout << "\n收到信号 " << sig << "。正在关闭..." << std::endl;
-    running = false;
-}
+    // 读取方提前关闭管道时写入返回EPIPE，而不是终止进程
+    std::signal(SIGPIPE, SIG_IGN);
 
-int main() {
-    // 设置信号处理器用于优雅关闭
-    #ifdef _POSIX_C_SOURCE
-        #include <signal.h>
-        signal(SIGINT, signal_handler);
-        signal(SIGTERM, signal_handler);
-    #endif
+    // 大缓冲区固定用mmap分配，释放后立即归还系统；否则glibc会动态调高阈值，
+    // 读取或接收大内容的临时缓冲区释放后仍留在堆中，数据移入memfd也不能降低常驻内存
+    mallopt(M_MMAP_THRESHOLD, MEMFD_SPILL_THRESHOLD);
 
-    std::cout << "启动P2PBoard Ubuntu客户端..." << std::endl;
+    // 客户端事件循环，剪贴板监控和WebSocket连接共用这一个线程
+    boost::asio::io_context io_context;
 
     // 初始化剪贴板管理器
     ClipboardManager clipboard_manager;
@@ -34,51 +37,192 @@ int main() {
         return 1;
     }
 
+    // 配置了配对密钥时端到端加密剪贴板内容，服务器只转发密文
+    std::unique_ptr<PayloadCipher> cipher;
+    const char* pairing_secret = std::getenv(PAIRING_SECRET_ENV);
+    if (pairing_secret && *pairing_secret) {
+        try {
+            cipher = std::make_unique<PayloadCipher>(pairing_secret, SERVER_ROOM);
+            std::cout << "已启用端到端加密 (" << cipher->algorithm() << ")" << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "初始化端到端加密失败: " << e.what() << "。退出。" << std::endl;
+            return 1;
+        }
+    }
+
     // 初始化WebSocket客户端
-    WebSocketClient websocket_client;
-    std::string server_url = std::string(SERVER_PROTOCOL) + SERVER_HOST + ":" + SERVER_PORT;
+    WebSocketClient websocket_client(io_context);
+    websocket_client.set_cipher(cipher.get());
+    std::string server_url = std::string(SERVER_PROTOCOL) + SERVER_HOST + ":" + SERVER_PORT + "/" + SERVER_ROOM;
 
     std::cout << "连接到服务器 " << server_url << std::endl;
 
+    // 连接在事件循环中建立，失败或断开后自动重连
     if (!websocket_client.connect(server_url)) {
-        std::cerr << "连接服务器失败。退出。" << std::endl;
+        std::cerr << "无效的服务器地址。退出。" << std::endl;
         return 1;
     }
 
-    // 启动剪贴板监控线程
-    std::thread clipboard_thread([&]() {
-        while (running) {
-            // 获取当前剪贴板内容
-            std::string clipboard_content = clipboard_manager.get_clipboard_content();
-
-            // 如果有新的内容则发送到服务器
-            if (!clipboard_content.empty()) {
-                websocket_client.send_message(clipboard_content);
+    // 从复制到粘贴的逐段延迟，定期输出
+    LatencyTracer tracer;
+    boost::asio::steady_timer report_timer(io_context);
+    std::function<void()> schedule_report = [&]() {
+        report_timer.expires_after(std::chrono::seconds(LATENCY_REPORT_INTERVAL_S));
+        report_timer.async_wait([&](const boost::system::error_code& ec) {
+            if (ec) {
+                return;
+            }
+            std::string report = tracer.report_and_reset();
+            if (!report.empty()) {
+                std::cout << "剪贴板延迟(微秒) " << report << std::endl;
             }
+            schedule_report();
+        });
+    };
+    if (LATENCY_TRACE_ENABLED) {
+        schedule_report();
+    }
 
-            // 等待同步间隔
-            std::this_thread::sleep_for(std::chrono::milliseconds(CLIPBOARD_SYNC_INTERVAL));
+    // 最近一次发送的内容指纹，用于识别服务器通告的是我们自己的复制
+    std::string sent_fingerprint;
+    // 最近一次按通告持有的内容，本地应用粘贴时按序号向服务器获取
+    std::string announced_seq;
+
+    // 其他设备的剪贴板更新写入本地剪贴板；与本地内容相同的回传会被忽略。
+    // 服务器通告房间内其他设备接受的格式，只读取这些格式以免传输无人使用的数据
+    websocket_client.set_message_handler([&](ProtocolMessage& message) {
+        std::string type = message.get("type");
+        if (type == "announce") {
+            if (message.get("fingerprint") == sent_fingerprint) {
+                return;
+            }
+            std::vector<std::string> formats;
+            std::string list = message.get("formats");
+            size_t pos = 0;
+            while (pos < list.size()) {
+                size_t end = list.find(',', pos);
+                if (end == std::string::npos) {
+                    end = list.size();
+                }
+                formats.push_back(list.substr(pos, end - pos));
+                pos = end + 1;
+            }
+            announced_seq = message.get("seq");
+            std::string epoch = message.get("epoch");
+            std::string seq = announced_seq;
+            clipboard_manager.set_lazy_clipboard(formats, [&websocket_client, seq, epoch]() {
+                ProtocolMessage request;
+                request.set("type", "fetch");
+                request.set("seq", seq);
+                request.set("epoch", epoch);
+                websocket_client.send_message(request.serialize(), "fetch");
+            });
+        } else if (type == "fetch-result") {
+            if (message.get("seq") != announced_seq) {
+                return;
+            }
+            auto item = std::make_shared<ClipboardItem>();
+            if (message.get("status") == "gone" || !message.take_item(*item)) {
+                std::cerr << "服务器已没有通告的剪贴板内容" << std::endl;
+                item.reset();
+            }
+            clipboard_manager.resolve_lazy_clipboard(std::move(item));
+        } else if (type == "clip") {
+            // 后端和管理器共用同一份快照，消息体移入快照
+            auto item = std::make_shared<ClipboardItem>();
+            size_t size = message.body.size();
+            if (message.take_item(*item)) {
+                // 回传的我们自己的复制没有写入，不计入延迟；未启用PRIMARY同步时忽略PRIMARY
+                ClipboardSelection selection = selection_from_name(message.get("selection"));
+                if (clipboard_manager.set_clipboard_item(item, selection)) {
+                    CLIENT_PROBE2(apply, size, message.get("trace").c_str());
+                    if (LATENCY_TRACE_ENABLED) {
+                        tracer.record_applied(message);
+                    }
+                }
+            } else {
+                std::cerr << "收到格式错误的剪贴板消息" << std::endl;
+            }
+        } else if (type == "formats") {
+            std::vector<std::string> formats;
+            size_t pos = 0;
+            while (pos < message.body.size()) {
+                size_t end = message.body.find('\n', pos);
+                if (end == std::string::npos) {
+                    end = message.body.size();
+                }
+                if (end > pos) {
+                    formats.push_back(message.body.substr(pos, end - pos));
+                }
+                pos = end + 1;
+            }
+            clipboard_manager.set_wanted_formats(formats);
+        }
+    });
+    websocket_client.set_accepted_formats(ClipboardManager::supported_formats());
+    websocket_client.set_lazy(LAZY_FETCH_ENABLED);
+
+    // 信号处理用于优雅关闭
+    boost::asio::signal_set signals(io_context, SIGINT, SIGTERM);
+    signals.async_wait([&](const boost::system::error_code& ec, int sig) {
+        if (!ec) {
+            std::cout << "\n收到信号 " << sig << "。正在关闭..." << std::endl;
+            // 停止监控并发送关闭帧，剩余操作完成后事件循环自然退出
+            clipboard_manager.stop_monitoring();
+            websocket_client.disconnect();
+            report_timer.cancel();
         }
     });
 
-    // 主循环 - 保持连接活跃
-    while (running) {
-        // 检查来自服务器的传入消息
-        websocket_client.process_messages();
-
-        // 小延迟以防止忙等待
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    }
+    // 剪贴板内容真正变化时发送到服务器，连续变化合并为一次
+    clipboard_manager.set_debounce_window(std::chrono::milliseconds(CLIPBOARD_DEBOUNCE_MS));
+    // PRIMARY按选择频繁变化，单独限速，服务器只实时转发不保留历史
+    clipboard_manager.set_primary_sync(PRIMARY_SYNC_ENABLED, std::chrono::milliseconds(PRIMARY_MIN_INTERVAL_MS));
+    clipboard_manager.start_monitoring(io_context, [&](ClipboardSelection selection,
+                                                       std::shared_ptr<const ClipboardItem> item) {
+#ifdef P2PBOARD_ALLOC_COUNTER
+        AllocationStats before = allocation_stats();
+#endif
+        ProtocolMessage message;
+        message.set("type", "clip");
+        if (selection != ClipboardSelection::Clipboard) {
+            message.set("selection", selection_name(selection));
+        }
+        // 加密时复制一次明文后原地加密，指纹按服务器看到的密文计算
+        if (cipher) {
+            message.set_item(*item);
+            if (!cipher->seal(message)) {
+                std::cerr << "加密剪贴板内容失败，未发送" << std::endl;
+                return;
+            }
+        }
+        if (LATENCY_TRACE_ENABLED) {
+            tracer.stamp_outgoing(message, clipboard_manager.last_change_time());
+        }
+        // 明文直接引用剪贴板快照发送，不复制
+        WireMessage wire = cipher ? message.take_wire() : message.encode_item(item);
+        // 通告只针对CLIPBOARD
+        if (selection == ClipboardSelection::Clipboard) {
+            sent_fingerprint = wire.body_fingerprint();
+        }
+#ifdef P2PBOARD_ALLOC_COUNTER
+        AllocationStats after = allocation_stats();
+        std::cout << "发送剪贴板 " << wire.size() << " 字节，分配 " << (after.count - before.count)
+                  << " 次共 " << (after.bytes - before.bytes) << " 字节" << std::endl;
+#endif
+        CLIENT_PROBE2(send, wire.size(), message.get("trace").c_str());
+        // 离线时每个选择只保留最新的一条，PRIMARY不会替换待发的CLIPBOARD
+        websocket_client.send_message(std::move(wire), selection_name(selection));
+    });
 
-    // 清理资源
-    std::cout << "正在关闭客户端..." << std::endl;
-    websocket_client.disconnect();
+    // 运行事件循环直到关闭
+    io_context.run();
 
-    // 等待剪贴板线程结束
-    if (clipboard_thread.joinable()) {
-        clipboard_thread.join();
+    std::string report = tracer.report_and_reset();
+    if (!report.empty()) {
+        std::cout << "剪贴板延迟(微秒) " << report << std::endl;
     }
 
     std::cout << "客户端关闭完成。" << std::endl;
     return 0;
-}
\ No newline at end of file
+}
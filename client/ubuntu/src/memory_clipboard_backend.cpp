@@ -0,0 +1,169 @@
+#include "memory_clipboard_backend.h"
+
+// 开始监控剪贴板
+void MemoryClipboardBackend::start(boost::asio::io_context &, Listener &listener)
+{
+    listener_ = &listener;
+
+    // 与真实后端一样，启动时报告本地应用持有的内容
+    if (content_ && !owned_)
+    {
+        report_local_change(ClipboardSelection::Clipboard, *content_);
+    }
+}
+
+// 停止监控
+void MemoryClipboardBackend::stop()
+{
+    finish_pastes();
+    listener_ = nullptr;
+}
+
+// 获取当前剪贴板文本
+std::string MemoryClipboardBackend::read_text()
+{
+    const ClipboardPart *text = content_ ? find_part(*content_, TEXT_MIME_TYPE) : nullptr;
+    return text ? text->data.str() : "";
+}
+
+// 写入远端内容
+void MemoryClipboardBackend::offer(ClipboardSelection selection, std::shared_ptr<const ClipboardItem> item)
+{
+    if (selection == ClipboardSelection::Primary)
+    {
+        primary_ = std::move(item);
+        record(EventKind::Offered, primary_, selection);
+        return;
+    }
+    lazy_formats_.clear();
+    finish_pastes();
+    content_ = std::move(item);
+    owned_ = true;
+    record(EventKind::Offered, content_);
+}
+
+// 按通告声明格式
+void MemoryClipboardBackend::offer_lazy(const std::vector<std::string> &formats)
+{
+    finish_pastes();
+    content_.reset();
+    lazy_formats_ = formats;
+    owned_ = true;
+    record(EventKind::Announced, nullptr);
+}
+
+// 提供按需获取的数据
+void MemoryClipboardBackend::provide(std::shared_ptr<const ClipboardItem> item)
+{
+    if (item)
+    {
+        content_ = std::move(item);
+        lazy_formats_.clear();
+        record(EventKind::Offered, content_);
+    }
+    finish_pastes();
+}
+
+// 模拟本地应用复制
+void MemoryClipboardBackend::copy(ClipboardItem item)
+{
+    bool was_owned = owned_;
+    lazy_formats_.clear();
+    finish_pastes();
+    content_ = std::make_shared<const ClipboardItem>(std::move(item));
+    owned_ = false;
+    record(EventKind::Copied, content_);
+
+    if (was_owned && listener_)
+    {
+        listener_->on_ownership_lost();
+    }
+    report_local_change(ClipboardSelection::Clipboard, *content_);
+}
+
+// 模拟本地应用选中文本
+void MemoryClipboardBackend::select(ClipboardItem item)
+{
+    primary_ = std::make_shared<const ClipboardItem>(std::move(item));
+    record(EventKind::Copied, primary_, ClipboardSelection::Primary);
+    if (track_primary_)
+    {
+        report_local_change(ClipboardSelection::Primary, *primary_);
+    }
+}
+
+// 把本地应用持有的内容报告给客户端
+void MemoryClipboardBackend::report_local_change(ClipboardSelection selection, const ClipboardItem &content)
+{
+    if (!listener_)
+    {
+        return;
+    }
+
+    // 与真实后端一样，只读取纯文本和需要的格式
+    ClipboardItem wanted;
+    for (const auto &part : content)
+    {
+        if (part.mime == TEXT_MIME_TYPE || wanted_formats_.count(part.mime))
+        {
+            wanted.push_back(part);
+        }
+    }
+    if (!wanted.empty())
+    {
+        listener_->on_local_change(selection, std::move(wanted));
+    }
+}
+
+// 模拟本地应用粘贴
+void MemoryClipboardBackend::paste(PasteCallback done)
+{
+    if (!content_ && !lazy_formats_.empty() && listener_)
+    {
+        pending_pastes_.push_back(std::move(done));
+        listener_->on_data_requested();
+        return;
+    }
+    record(EventKind::Pasted, content_);
+    done(content_);
+}
+
+// 当前声明的格式
+std::vector<std::string> MemoryClipboardBackend::formats() const
+{
+    if (!content_)
+    {
+        return lazy_formats_;
+    }
+    std::vector<std::string> formats;
+    for (const auto &part : *content_)
+    {
+        formats.push_back(part.mime);
+    }
+    return formats;
+}
+
+// 记录事件并通知观察者
+void MemoryClipboardBackend::record(EventKind kind, std::shared_ptr<const ClipboardItem> item,
+                                    ClipboardSelection selection)
+{
+    events_.push_back(Event{kind, std::chrono::steady_clock::now(), std::move(item), selection});
+    if (observer_)
+    {
+        observer_(events_.back());
+    }
+}
+
+// 以当前内容完成等待中的粘贴
+void MemoryClipboardBackend::finish_pastes()
+{
+    std::vector<PasteCallback> pastes;
+    pastes.swap(pending_pastes_);
+    for (auto &done : pastes)
+    {
+        // 按通告持有但数据未取回时粘贴失败
+        auto item = lazy_formats_.empty() ? content_ : nullptr;
+        record(EventKind::Pasted, item);
+        done(item);
+    }
+}
@@ -0,0 +1,159 @@
+#ifndef MEMORY_CLIPBOARD_BACKEND_H
+#define MEMORY_CLIPBOARD_BACKEND_H
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "clipboard_backend.h"
+
+/**
+ * @class MemoryClipboardBackend
+ * @brief 不依赖显示服务器的内存剪贴板
+ *
+ * 由测试或模拟程序驱动：copy()模拟本地应用复制，select()模拟选中文本(PRIMARY)，paste()模拟本地应用粘贴。
+ * 每次复制、写入和粘贴都记录一个带时间戳的事件，用于在没有显示服务器的环境中
+ * 测量客户端 → 服务器 → 客户端的延迟和吞吐。后端之间没有共享状态，
+ * 同一进程中可以为多个ClipboardManager各创建一个实例，模拟多个客户端。
+ *
+ * 所有方法都必须在io_context线程上调用。
+ */
+class MemoryClipboardBackend : public ClipboardBackend
+{
+public:
+    /**
+     * @brief 记录的事件类型
+     */
+    enum class EventKind
+    {
+        // 本地应用复制(或选中)了内容
+        Copied,
+        // 客户端写入了远端内容，包括按需获取的数据取回
+        Offered,
+        // 客户端按通告声明了格式，数据尚未取回
+        Announced,
+        // 本地应用的粘贴完成，失败时条目为空
+        Pasted
+    };
+
+    /**
+     * @brief 带时间戳的事件
+     */
+    struct Event
+    {
+        EventKind kind;
+        std::chrono::steady_clock::time_point time;
+        std::shared_ptr<const ClipboardItem> item;
+        ClipboardSelection selection = ClipboardSelection::Clipboard;
+    };
+
+    /**
+     * @brief 粘贴回调类型，参数为粘贴到的条目，失败时为空
+     */
+    using PasteCallback = std::function<void(std::shared_ptr<const ClipboardItem>)>;
+
+    /**
+     * @brief 事件观察者类型，每个事件记录后立即调用
+     */
+    using Observer = std::function<void(const Event &)>;
+
+    const char *name() const override { return "memory"; }
+    void initialize() override {}
+    void start(boost::asio::io_context &io_context, Listener &listener) override;
+    void stop() override;
+    std::string read_text() override;
+    void offer(ClipboardSelection selection, std::shared_ptr<const ClipboardItem> item) override;
+    void offer_lazy(const std::vector<std::string> &formats) override;
+    void provide(std::shared_ptr<const ClipboardItem> item) override;
+
+    /**
+     * @brief 模拟本地应用复制
+     *
+     * 本地应用取得选择，条目中的纯文本和需要读取的格式报告给客户端。
+     *
+     * @param item 复制的条目
+     */
+    void copy(ClipboardItem item);
+
+    /**
+     * @brief 模拟本地应用选中文本
+     *
+     * 本地应用取得PRIMARY；客户端跟踪PRIMARY时报告给客户端。
+     *
+     * @param item 选中的条目
+     */
+    void select(ClipboardItem item);
+
+    /**
+     * @brief 模拟本地应用粘贴
+     *
+     * 客户端按通告持有选择时，等数据取回(或超时)后才调用done。
+     *
+     * @param done 粘贴完成回调
+     */
+    void paste(PasteCallback done);
+
+    /**
+     * @brief 当前剪贴板条目，按通告持有且尚未取回时为空
+     */
+    std::shared_ptr<const ClipboardItem> content() const { return content_; }
+
+    /**
+     * @brief 当前PRIMARY条目
+     */
+    std::shared_ptr<const ClipboardItem> primary() const { return primary_; }
+
+    /**
+     * @brief 当前声明的格式
+     */
+    std::vector<std::string> formats() const;
+
+    /**
+     * @brief 已记录的事件
+     */
+    const std::vector<Event> &events() const { return events_; }
+
+    /**
+     * @brief 清空已记录的事件，长时间运行的压测应定期调用
+     */
+    void clear_events() { events_.clear(); }
+
+    /**
+     * @brief 设置事件观察者
+     */
+    void set_observer(Observer observer) { observer_ = std::move(observer); }
+
+private:
+    // 记录事件并通知观察者
+    void record(EventKind kind, std::shared_ptr<const ClipboardItem> item,
+                ClipboardSelection selection = ClipboardSelection::Clipboard);
+
+    // 把本地应用持有的内容报告给客户端
+    void report_local_change(ClipboardSelection selection, const ClipboardItem &content);
+
+    // 以当前内容完成等待中的粘贴，没有内容时粘贴失败
+    void finish_pastes();
+
+    // 当前剪贴板条目
+    std::shared_ptr<const ClipboardItem> content_;
+
+    // 当前PRIMARY条目
+    std::shared_ptr<const ClipboardItem> primary_;
+
+    // 选择是否由客户端持有
+    bool owned_ = false;
+
+    // 按通告持有选择时声明的格式，数据取回后清空
+    std::vector<std::string> lazy_formats_;
+
+    // 等待按需获取的粘贴
+    std::vector<PasteCallback> pending_pastes_;
+
+    // 已记录的事件和观察者
+    std::vector<Event> events_;
+    Observer observer_;
+};
+
+#endif // MEMORY_CLIPBOARD_BACKEND_H
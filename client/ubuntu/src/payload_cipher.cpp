@@ -0,0 +1,241 @@
+#include "payload_cipher.h"
+#include "config.h"
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+#include <openssl/crypto.h>
+#include <openssl/kdf.h>
+#include <openssl/rand.h>
+
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#endif
+
+namespace {
+    // 随机数和认证标签长度，随机数为4字节发送方编号和8字节大端计数器
+    const int NONCE_SIZE = 12;
+    const int SENDER_SIZE = 4;
+    const int TAG_SIZE = 16;
+
+    // 组密钥拉伸时使用的固定盐，同一组的设备必须相同
+    const char PAIRING_SALT[] = "P2PBoard pairing v1";
+
+    // enc头部中的算法名称，下标与PayloadCipher::Algorithm一致
+    const char* const ALGORITHM_NAMES[] = {"aes-256-gcm", "chacha20-poly1305"};
+
+    const EVP_CIPHER* algorithm_cipher(int algorithm) {
+        return algorithm == 0 ? EVP_aes_256_gcm() : EVP_chacha20_poly1305();
+    }
+
+    // 字节与十六进制互转
+    std::string to_hex(const unsigned char* data, size_t size) {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(size * 2);
+        for (size_t i = 0; i < size; ++i) {
+            hex += digits[data[i] >> 4];
+            hex += digits[data[i] & 0x0f];
+        }
+        return hex;
+    }
+
+    bool from_hex(const std::string& hex, unsigned char* out, size_t size) {
+        if (hex.size() != size * 2) {
+            return false;
+        }
+        auto value = [](char c) -> int {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        };
+        for (size_t i = 0; i < size; ++i) {
+            int high = value(hex[2 * i]);
+            int low = value(hex[2 * i + 1]);
+            if (high < 0 || low < 0) {
+                return false;
+            }
+            out[i] = static_cast<unsigned char>(high << 4 | low);
+        }
+        return true;
+    }
+}
+
+// 从配对密钥导出组密钥
+PayloadCipher::PayloadCipher(const std::string& pairing_secret, const std::string& room)
+    : preferred_(has_aes_instructions() ? AES_256_GCM : CHACHA20_POLY1305), room_(room) {
+    if (RAND_bytes(sender_, sizeof(sender_)) != 1) {
+        throw std::runtime_error("生成发送方编号失败");
+    }
+
+    // 配对密钥可能是便于记忆的短语，先拉伸为组密钥
+    unsigned char group_key[32];
+    if (PKCS5_PBKDF2_HMAC(pairing_secret.data(), static_cast<int>(pairing_secret.size()),
+                          reinterpret_cast<const unsigned char*>(PAIRING_SALT), sizeof(PAIRING_SALT) - 1,
+                          PAIRING_KDF_ITERATIONS, EVP_sha256(), sizeof(group_key), group_key) != 1) {
+        throw std::runtime_error("拉伸配对密钥失败");
+    }
+
+    // 每种算法使用独立的密钥
+    for (int algorithm = 0; algorithm < ALGORITHM_COUNT; ++algorithm) {
+        std::string info = std::string("p2pboard payload key ") + ALGORITHM_NAMES[algorithm];
+        size_t key_size = sizeof(keys_[algorithm]);
+        EVP_PKEY_CTX* kdf = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+        bool derived = kdf &&
+                       EVP_PKEY_derive_init(kdf) == 1 &&
+                       EVP_PKEY_CTX_set_hkdf_md(kdf, EVP_sha256()) == 1 &&
+                       EVP_PKEY_CTX_set1_hkdf_key(kdf, group_key, sizeof(group_key)) == 1 &&
+                       EVP_PKEY_CTX_add1_hkdf_info(kdf, reinterpret_cast<const unsigned char*>(info.data()),
+                                                   static_cast<int>(info.size())) == 1 &&
+                       EVP_PKEY_derive(kdf, keys_[algorithm], &key_size) == 1;
+        EVP_PKEY_CTX_free(kdf);
+        if (!derived) {
+            OPENSSL_cleanse(group_key, sizeof(group_key));
+            throw std::runtime_error("导出加密密钥失败");
+        }
+
+        // 密钥只设置一次，之后每条消息只更换随机数
+        decrypt_[algorithm].reset(EVP_CIPHER_CTX_new());
+        if (!decrypt_[algorithm] ||
+            EVP_DecryptInit_ex(decrypt_[algorithm].get(), algorithm_cipher(algorithm), nullptr, nullptr, nullptr) != 1 ||
+            EVP_CIPHER_CTX_ctrl(decrypt_[algorithm].get(), EVP_CTRL_AEAD_SET_IVLEN, NONCE_SIZE, nullptr) != 1 ||
+            EVP_DecryptInit_ex(decrypt_[algorithm].get(), nullptr, nullptr, keys_[algorithm], nullptr) != 1) {
+            OPENSSL_cleanse(group_key, sizeof(group_key));
+            throw std::runtime_error("初始化解密上下文失败");
+        }
+    }
+    OPENSSL_cleanse(group_key, sizeof(group_key));
+
+    encrypt_.reset(EVP_CIPHER_CTX_new());
+    if (!encrypt_ ||
+        EVP_EncryptInit_ex(encrypt_.get(), algorithm_cipher(preferred_), nullptr, nullptr, nullptr) != 1 ||
+        EVP_CIPHER_CTX_ctrl(encrypt_.get(), EVP_CTRL_AEAD_SET_IVLEN, NONCE_SIZE, nullptr) != 1 ||
+        EVP_EncryptInit_ex(encrypt_.get(), nullptr, nullptr, keys_[preferred_], nullptr) != 1) {
+        throw std::runtime_error("初始化加密上下文失败");
+    }
+}
+
+// 析构函数
+PayloadCipher::~PayloadCipher() {
+    OPENSSL_cleanse(keys_, sizeof(keys_));
+}
+
+// 原地加密消息体
+bool PayloadCipher::seal(ProtocolMessage& message) {
+    if (message.body.size() > static_cast<size_t>(INT_MAX)) {
+        return false;
+    }
+
+    // 计数器每条消息递增，同一密钥下随机数不会重复
+    unsigned char nonce[NONCE_SIZE];
+    std::memcpy(nonce, sender_, SENDER_SIZE);
+    uint64_t counter = ++counter_;
+    for (int i = NONCE_SIZE - 1; i >= SENDER_SIZE; --i) {
+        nonce[i] = static_cast<unsigned char>(counter);
+        counter >>= 8;
+    }
+
+    std::string aad = associated_data(message);
+    unsigned char* data = reinterpret_cast<unsigned char*>(&message.body[0]);
+    int size = static_cast<int>(message.body.size());
+    int written = 0;
+    unsigned char tag[TAG_SIZE];
+    EVP_CIPHER_CTX* ctx = encrypt_.get();
+    if (EVP_EncryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) != 1 ||
+        EVP_EncryptUpdate(ctx, nullptr, &written, reinterpret_cast<const unsigned char*>(aad.data()),
+                          static_cast<int>(aad.size())) != 1 ||
+        EVP_EncryptUpdate(ctx, data, &written, data, size) != 1 ||
+        EVP_EncryptFinal_ex(ctx, data + written, &written) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, TAG_SIZE, tag) != 1) {
+        // 消息体已被部分覆盖，不能再发送
+        message.body.clear();
+        return false;
+    }
+
+    message.set("enc", ALGORITHM_NAMES[preferred_]);
+    message.set("nonce", to_hex(nonce, sizeof(nonce)));
+    message.set("tag", to_hex(tag, sizeof(tag)));
+    return true;
+}
+
+// 验证并原地解密消息体
+bool PayloadCipher::open(ProtocolMessage& message) {
+    std::string enc = message.get("enc");
+    int algorithm = 0;
+    while (algorithm < ALGORITHM_COUNT && enc != ALGORITHM_NAMES[algorithm]) {
+        ++algorithm;
+    }
+
+    std::string type = message.get("type");
+    unsigned char nonce[NONCE_SIZE];
+    unsigned char tag[TAG_SIZE];
+    if (algorithm == ALGORITHM_COUNT || (type != "clip" && type != "fetch-result") ||
+        message.body.size() > static_cast<size_t>(INT_MAX) ||
+        !from_hex(message.get("nonce"), nonce, sizeof(nonce)) ||
+        !from_hex(message.get("tag"), tag, sizeof(tag))) {
+        message.body.clear();
+        return false;
+    }
+
+    std::string aad = associated_data(message);
+    unsigned char* data = reinterpret_cast<unsigned char*>(&message.body[0]);
+    int size = static_cast<int>(message.body.size());
+    int written = 0;
+    EVP_CIPHER_CTX* ctx = decrypt_[algorithm].get();
+    // 认证标签在Final中校验，失败时已解密的数据必须丢弃
+    if (EVP_DecryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) != 1 ||
+        EVP_DecryptUpdate(ctx, nullptr, &written, reinterpret_cast<const unsigned char*>(aad.data()),
+                          static_cast<int>(aad.size())) != 1 ||
+        EVP_DecryptUpdate(ctx, data, &written, data, size) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, TAG_SIZE, tag) != 1 ||
+        EVP_DecryptFinal_ex(ctx, data + written, &written) != 1) {
+        message.body.clear();
+        return false;
+    }
+
+    // 认证通过后再检查重放，伪造的消息不能推进计数器
+    uint64_t counter = 0;
+    for (int i = SENDER_SIZE; i < NONCE_SIZE; ++i) {
+        counter = counter << 8 | nonce[i];
+    }
+    uint64_t& accepted = accepted_[to_hex(nonce, SENDER_SIZE) + " " +
+                                   selection_name(selection_from_name(message.get("selection")))];
+    if (counter <= accepted) {
+        message.body.clear();
+        return false;
+    }
+    accepted = counter;
+
+    message.headers.erase("enc");
+    message.headers.erase("nonce");
+    message.headers.erase("tag");
+    return true;
+}
+
+// 附加认证数据：房间、消息类型、选择和格式描述
+//
+// 获取结果是之前通告的clip，按clip认证
+std::string PayloadCipher::associated_data(const ProtocolMessage& message) const {
+    std::string parts = message.get("parts");
+    std::string aad = "room:" + room_ + "\ntype:clip\nselection:" +
+                      selection_name(selection_from_name(message.get("selection"))) + "\n";
+    aad += parts.empty() ? "mime:" + message.get("mime") : "parts:" + parts;
+    return aad;
+}
+
+// 发送时使用的算法名称
+const char* PayloadCipher::algorithm() const {
+    return ALGORITHM_NAMES[preferred_];
+}
+
+// 当前CPU是否有AES指令，OpenSSL在有AES指令时自动使用硬件实现
+bool PayloadCipher::has_aes_instructions() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_cpu_supports("aes");
+#elif defined(__aarch64__)
+    return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+#else
+    return false;
+#endif
+}
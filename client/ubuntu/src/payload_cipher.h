@@ -0,0 +1,117 @@
+#ifndef PAYLOAD_CIPHER_H
+#define PAYLOAD_CIPHER_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <openssl/evp.h>
+
+#include "protocol.h"
+
+/**
+ * @class PayloadCipher
+ * @brief 剪贴板内容的端到端加密
+ *
+ * 使用同一配对密钥的设备共享组密钥：配对密钥经PBKDF2-HMAC-SHA256拉伸为组密钥，
+ * 再用HKDF为每种算法导出独立的密钥。发送时按CPU能力选择算法，有AES指令时用
+ * AES-256-GCM，否则用ChaCha20-Poly1305；接收时按enc头部选择，两种都能解密。
+ *
+ * 只加密消息体，原地进行，密文与明文等长，随机数和认证标签放在头部：
+ *   enc: aes-256-gcm
+ *   nonce: <12字节，十六进制>
+ *   tag: <16字节，十六进制>
+ * mime或parts头部保持明文，服务器仍能按长度切分表示和生成通告，但看不到内容。
+ * 附加认证数据包括房间、消息类型(clip)、选择和格式描述，服务器无法把内容转到其他房间、
+ * 把CLIPBOARD改成PRIMARY(或反之)或替换格式描述。
+ *
+ * 随机数由发送方编号(每次启动随机生成的4字节)和8字节递增计数器组成，不会重复。
+ * 接收方记录每个发送方每个选择已接受的最大计数器，重放的旧密文和重复的随机数被拒绝。
+ *
+ * 每种算法的加解密上下文只在构造时设置一次密钥，之后每条消息只更换随机数。
+ */
+class PayloadCipher {
+public:
+    /**
+     * @brief 从配对密钥导出组密钥
+     *
+     * @param pairing_secret 配对密钥，同一组的设备必须相同
+     * @param room 所在的房间，作为附加认证数据，其他房间的密文无法解密
+     * @throws std::runtime_error 密钥导出或生成发送方编号失败时抛出
+     */
+    PayloadCipher(const std::string& pairing_secret, const std::string& room);
+
+    /**
+     * @brief 析构函数，清除内存中的密钥
+     */
+    ~PayloadCipher();
+
+    PayloadCipher(const PayloadCipher&) = delete;
+    PayloadCipher& operator=(const PayloadCipher&) = delete;
+
+    /**
+     * @brief 原地加密消息体并写入enc、nonce和tag头部
+     *
+     * @param message 要加密的消息，mime或parts头部必须已经设置
+     * @return 加密成功返回true
+     */
+    bool seal(ProtocolMessage& message);
+
+    /**
+     * @brief 验证并原地解密消息体，移除加密头部
+     *
+     * 只接受type为clip或fetch-result的消息(获取结果是之前通告的clip)。
+     *
+     * @param message 带enc头部的消息，失败时消息体被清空
+     * @return 认证通过且不是重放的消息返回true
+     */
+    bool open(ProtocolMessage& message);
+
+    /**
+     * @brief 发送时使用的算法名称
+     */
+    const char* algorithm() const;
+
+private:
+    enum Algorithm {
+        AES_256_GCM,
+        CHACHA20_POLY1305,
+        ALGORITHM_COUNT
+    };
+
+    struct ContextDeleter {
+        void operator()(EVP_CIPHER_CTX* ctx) const { EVP_CIPHER_CTX_free(ctx); }
+    };
+    using Context = std::unique_ptr<EVP_CIPHER_CTX, ContextDeleter>;
+
+    // 当前CPU是否有AES指令
+    static bool has_aes_instructions();
+
+    // 附加认证数据
+    std::string associated_data(const ProtocolMessage& message) const;
+
+    // 发送时使用的算法
+    Algorithm preferred_;
+
+    // 每种算法的密钥
+    unsigned char keys_[ALGORITHM_COUNT][32];
+
+    // 加密上下文(发送算法)和每种算法的解密上下文，已设置密钥
+    Context encrypt_;
+    Context decrypt_[ALGORITHM_COUNT];
+
+    // 所在的房间
+    std::string room_;
+
+    // 本次启动的发送方编号，随机数的前4字节
+    unsigned char sender_[4];
+
+    // 最后一条发出消息的计数器，随机数的后8字节
+    uint64_t counter_ = 0;
+
+    // 每个发送方每个选择已接受的最大计数器，键为发送方编号(十六进制)和选择名
+    std::map<std::string, uint64_t> accepted_;
+};
+
+#endif // PAYLOAD_CIPHER_H
@@ -0,0 +1,36 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/**
+ * @file probes.h
+ * @brief USDT静态跟踪探针
+ *
+ * 有systemtap的<sys/sdt.h>时在剪贴板同步的关键路径上放置提供者为p2pboard_client的静态探针，
+ * 未被跟踪时每个探针只是一条nop指令；没有该头文件时探针展开为(void)sizeof(参数)，参数仍做类型检查但不求值。
+ * trace参数是消息的追踪编号，没有追踪时为空字符串，可以与服务器和其他设备的探针对应起来。
+ *
+ * 探针及参数：
+ *   - detect(bytes)              检测到本地剪贴板变化(去抖之后)
+ *   - send(bytes, trace)         剪贴板消息交给WebSocket客户端发送
+ *   - write_done(bytes, error)   一次WebSocket写操作完成，error为0表示成功
+ *   - receive(bytes, trace)      收齐服务器发来的一条消息
+ *   - apply(bytes, trace)        收到的内容写入了本地剪贴板
+ */
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define P2PBOARD_HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef P2PBOARD_HAVE_PROBES
+#define CLIENT_PROBE1(name, a) DTRACE_PROBE1(p2pboard_client, name, a)
+#define CLIENT_PROBE2(name, a, b) DTRACE_PROBE2(p2pboard_client, name, a, b)
+#else
+// 参数放在sizeof中只做类型检查，不求值
+#define CLIENT_PROBE1(name, a) ((void)sizeof(a))
+#define CLIENT_PROBE2(name, a, b) ((void)sizeof(a), (void)sizeof(b))
+#endif
+
+#endif // PROBES_H
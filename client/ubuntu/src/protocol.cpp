@@ -0,0 +1,259 @@
+#include "protocol.h"
+#include "config.h"
+#include "fingerprint.h"
+#include <cstdint>
+#include <iostream>
+
+namespace {
+    // 按条目设置mime或parts头部
+    void describe_item(ProtocolMessage& message, const ClipboardItem& item) {
+        message.headers.erase("mime");
+        message.headers.erase("parts");
+        // 服务器在头部到达时就知道消息体长度，可以边接收边转发
+        size_t size = 0;
+        for (const auto& part : item) {
+            size += part.data.size();
+        }
+        message.set("size", std::to_string(size));
+        if (item.size() == 1) {
+            message.set("mime", item.front().mime);
+            return;
+        }
+
+        std::string parts;
+        for (const auto& part : item) {
+            append_part_spec(parts, part.mime, part.data.size());
+        }
+        message.set("parts", parts);
+    }
+}
+
+// 线上格式的总长度
+size_t WireMessage::size() const {
+    if (!item) {
+        return head.size() + body.size();
+    }
+    size_t total = head.size();
+    for (const auto& part : *item) {
+        total += part.data.size();
+    }
+    return total;
+}
+
+// 消息体的指纹
+std::string WireMessage::body_fingerprint() const {
+    if (!item) {
+        return payload_fingerprint(body);
+    }
+    uint64_t hash = FINGERPRINT_BASIS;
+    for (const auto& part : *item) {
+        ClipboardView data = part.data.view();
+        hash = fingerprint_update(hash, data.data(), data.size());
+    }
+    return fingerprint_hex(hash);
+}
+
+// 读取头部字段
+std::string ProtocolMessage::get(const std::string& key, const std::string& def) const {
+    auto it = headers.find(key);
+    return it == headers.end() ? def : it->second;
+}
+
+// 设置头部字段
+void ProtocolMessage::set(const std::string& key, const std::string& value) {
+    headers[key] = value;
+}
+
+// 序列化为线上格式
+std::string ProtocolMessage::serialize() const {
+    std::string out = serialize_envelope_head(headers);
+    out += body;
+    return out;
+}
+
+// 以剪贴板快照为消息体生成待发送的消息
+WireMessage ProtocolMessage::encode_item(std::shared_ptr<const ClipboardItem> item) {
+    describe_item(*this, *item);
+    body.clear();
+    return WireMessage{serialize_envelope_head(headers), std::string(), std::move(item)};
+}
+
+// 生成待发送的消息，消息体移入结果
+WireMessage ProtocolMessage::take_wire() {
+    WireMessage wire{serialize_envelope_head(headers), std::move(body), nullptr};
+    body.clear();
+    return wire;
+}
+
+// 选择在selection头部中的名称
+const char* selection_name(ClipboardSelection selection) {
+    return selection == ClipboardSelection::Primary ? PRIMARY_SELECTION_NAME : CLIPBOARD_SELECTION_NAME;
+}
+
+// 按selection头部取得选择
+ClipboardSelection selection_from_name(const std::string& name) {
+    return name == PRIMARY_SELECTION_NAME ? ClipboardSelection::Primary : ClipboardSelection::Clipboard;
+}
+
+// 查找条目中指定类型的表示
+const ClipboardPart* find_part(const ClipboardItem& item, const std::string& mime) {
+    for (const auto& part : item) {
+        if (part.mime == mime) {
+            return &part;
+        }
+    }
+    return nullptr;
+}
+
+// 把剪贴板条目写入消息体
+void ProtocolMessage::set_item(const ClipboardItem& item) {
+    describe_item(*this, item);
+    body.clear();
+
+    if (item.size() == 1) {
+        ClipboardView data = item.front().data.view();
+        body.assign(data.data(), data.size());
+        return;
+    }
+
+    size_t total = 0;
+    for (const auto& part : item) {
+        total += part.data.size();
+    }
+    body.reserve(total);
+    for (const auto& part : item) {
+        ClipboardView data = part.data.view();
+        body.append(data.data(), data.size());
+    }
+}
+
+// 从消息体取出剪贴板条目
+bool ProtocolMessage::take_item(ClipboardItem& item) {
+    item.clear();
+    auto it = headers.find("parts");
+    if (it == headers.end()) {
+        ClipboardData data(std::move(body));
+        body.clear();
+        data.spill();
+        item.push_back(ClipboardPart{get("mime", TEXT_MIME_TYPE), std::move(data)});
+        return true;
+    }
+
+    std::vector<envelope_part> parts;
+    if (!parse_parts(it->second, body.size(), parts)) {
+        return false;
+    }
+    for (auto& part : parts) {
+        item.push_back(ClipboardPart{std::move(part.mime),
+                                     ClipboardData::copy_of(body.data() + part.offset, part.length)});
+    }
+    body.clear();
+    return true;
+}
+
+// 判断原始数据是否带有协议信封
+bool ProtocolMessage::is_envelope(std::string_view raw) {
+    return ::is_envelope(raw);
+}
+
+// 只解析头部
+bool ProtocolMessage::parse_head(std::string_view raw, ProtocolMessage& out, std::string_view& body) {
+    out.headers.clear();
+
+    // 纯文本消息
+    if (!is_envelope(raw)) {
+        out.set("type", "clip");
+        body = raw;
+        return true;
+    }
+
+    size_t body_offset = 0;
+    if (!parse_envelope_head(raw, out.headers, body_offset)) {
+        return false;
+    }
+    body = raw.substr(body_offset);
+    return true;
+}
+
+// 解析原始数据
+bool ProtocolMessage::parse(std::string_view raw, ProtocolMessage& out) {
+    std::string_view body;
+    if (!parse_head(raw, out, body)) {
+        out.body.clear();
+        return false;
+    }
+    out.body.assign(body.data(), body.size());
+    return true;
+}
+
+// 接收一个分片
+bool ChunkAssembler::feed(const ProtocolMessage& chunk, std::string_view data, ProtocolMessage& complete) {
+    const std::string stream = chunk.get("stream");
+    // 服务器放弃了直通转发的流
+    if (!chunk.get("abort").empty()) {
+        streams_.erase(stream);
+        return false;
+    }
+    size_t offset = 0;
+    size_t total = 0;
+    try {
+        offset = std::stoul(chunk.get("offset", "0"));
+        total = std::stoul(chunk.get("total", "0"));
+    } catch (const std::exception&) {
+        std::cerr << "分片头部格式错误" << std::endl;
+        return false;
+    }
+
+    if (total > MAX_MESSAGE_SIZE) {
+        std::cerr << "分片消息过大 (" << total << " 字节)" << std::endl;
+        streams_.erase(stream);
+        return false;
+    }
+
+    Stream& current = streams_[stream];
+    // 分片按顺序到达，偏移不连续说明丢失了前面的分片
+    if (offset != current.received) {
+        std::cerr << "分片偏移不连续，丢弃流 " << stream << std::endl;
+        streams_.erase(stream);
+        return false;
+    }
+    current.received += data.size();
+
+    if (current.parsed) {
+        current.message.body.append(data.data(), data.size());
+    } else {
+        // 头部通常在第一个分片内，直接从分片数据解析；跨越分片时先暂存
+        std::string_view raw = data;
+        if (!current.head.empty()) {
+            current.head.append(data.data(), data.size());
+            raw = current.head;
+        }
+        std::string_view body;
+        if (!ProtocolMessage::parse_head(raw, current.message, body)) {
+            if (raw.find("\n\n") != std::string_view::npos || current.received >= total) {
+                std::cerr << "分片消息头部格式错误，丢弃流 " << stream << std::endl;
+                streams_.erase(stream);
+                return false;
+            }
+            if (current.head.empty()) {
+                current.head.assign(data.data(), data.size());
+            }
+            return false;
+        }
+        current.parsed = true;
+        size_t head_size = raw.size() - body.size();
+        if (total > head_size) {
+            current.message.body.reserve(total - head_size);
+        }
+        current.message.body.assign(body.data(), body.size());
+        current.head = std::string();
+    }
+
+    if (current.received < total) {
+        return false;
+    }
+
+    complete = std::move(current.message);
+    streams_.erase(stream);
+    return true;
+}
@@ -0,0 +1,235 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "clipboard_data.h"
+#include "envelope.h"
+
+// 纯文本表示的MIME类型
+#define TEXT_MIME_TYPE "text/plain;charset=utf-8"
+
+// 剪贴板消息selection头部的取值，没有该头部的消息属于CLIPBOARD
+#define CLIPBOARD_SELECTION_NAME "clipboard"
+#define PRIMARY_SELECTION_NAME "primary"
+
+/**
+ * @brief 剪贴板内容所属的选择
+ *
+ * CLIPBOARD是显式复制的内容；PRIMARY在每次选中文本时变化，用于中键粘贴。两者分别同步。
+ */
+enum class ClipboardSelection {
+    Clipboard,
+    Primary
+};
+
+/**
+ * @brief 选择在selection头部中的名称
+ */
+const char* selection_name(ClipboardSelection selection);
+
+/**
+ * @brief 按selection头部取得选择，空值和未知的名称视为CLIPBOARD
+ */
+ClipboardSelection selection_from_name(const std::string& name);
+
+/**
+ * @struct ClipboardPart
+ * @brief 剪贴板条目的一种表示
+ */
+struct ClipboardPart {
+    // MIME类型，例如text/plain;charset=utf-8、text/html、image/png
+    std::string mime;
+
+    // 数据，大数据保存在memfd中
+    ClipboardData data;
+};
+
+/**
+ * @brief 剪贴板条目，同一内容的多种表示，纯文本表示(如果有)在最前
+ */
+using ClipboardItem = std::vector<ClipboardPart>;
+
+/**
+ * @brief 查找条目中指定类型的表示
+ *
+ * @return 找到的表示，没有时返回nullptr
+ */
+const ClipboardPart* find_part(const ClipboardItem& item, const std::string& mime);
+
+/**
+ * @struct WireMessage
+ * @brief 待发送的线上格式消息
+ *
+ * 由序列化的头部和消息体组成，发送时作为一个WebSocket消息分散写出，不拼接复制。
+ * 明文剪贴板内容的消息体直接引用剪贴板快照中各表示的数据，快照和数据的视图在发送完成前保持存活；
+ * 其他消息(包括加密后的内容)的消息体保存在body中。创建后不再修改。
+ */
+struct WireMessage {
+    // 魔数首行和头部，以空行结束
+    std::string head;
+
+    // 消息体，item不为空时不使用
+    std::string body;
+
+    // 消息体引用的剪贴板快照，各表示的数据按顺序拼接即为消息体
+    std::shared_ptr<const ClipboardItem> item;
+
+    /**
+     * @brief 线上格式的总长度
+     */
+    size_t size() const;
+
+    /**
+     * @brief 消息体的指纹，与对拼接后的消息体调用payload_fingerprint相同
+     */
+    std::string body_fingerprint() const;
+};
+
+/**
+ * @struct ProtocolMessage
+ * @brief P2PBoard服务器协议消息
+ *
+ * 线上格式类似HTTP头部：魔数首行、若干 "key: value" 行、一个空行，
+ * 然后是二进制安全的消息体。没有魔数首行的消息视为纯文本剪贴板内容。
+ * 解析和序列化与服务器共用common/envelope.cpp。
+ *
+ * 多种表示放在一条消息中时，parts头部按顺序列出每种表示的类型和长度，
+ * 例如 "text/plain;charset=utf-8 12,text/html 40"，消息体是各表示数据的拼接。
+ */
+struct ProtocolMessage {
+    // 头部字段
+    envelope_headers headers;
+
+    // 消息体
+    std::string body;
+
+    /**
+     * @brief 读取头部字段
+     *
+     * @param key 字段名
+     * @param def 字段不存在时的默认值
+     * @return 字段值
+     */
+    std::string get(const std::string& key, const std::string& def = "") const;
+
+    /**
+     * @brief 设置头部字段
+     */
+    void set(const std::string& key, const std::string& value);
+
+    /**
+     * @brief 序列化为线上格式
+     */
+    std::string serialize() const;
+
+    /**
+     * @brief 把剪贴板条目写入消息体
+     *
+     * 只有一种表示时使用mime头部，否则使用parts头部；size头部给出消息体长度。
+     */
+    void set_item(const ClipboardItem& item);
+
+    /**
+     * @brief 以剪贴板快照为消息体生成待发送的消息
+     *
+     * 按set_item的规则设置mime或parts头部，消息体引用快照中的数据，不复制。
+     *
+     * @param item 剪贴板快照
+     * @return 待发送的消息
+     */
+    WireMessage encode_item(std::shared_ptr<const ClipboardItem> item);
+
+    /**
+     * @brief 生成待发送的消息，消息体移入结果，不复制
+     *
+     * 调用后消息体为空。
+     */
+    WireMessage take_wire();
+
+    /**
+     * @brief 从消息体取出剪贴板条目
+     *
+     * 只有一种表示时消息体移入条目，不复制；多种表示时各表示的数据复制到各自的存储。
+     * 达到MEMFD_SPILL_THRESHOLD的表示保存在memfd中。调用后消息体为空。
+     * @param item 输出的剪贴板条目
+     * @return parts头部格式正确返回true
+     */
+    bool take_item(ClipboardItem& item);
+
+    /**
+     * @brief 判断原始数据是否带有协议信封
+     */
+    static bool is_envelope(std::string_view raw);
+
+    /**
+     * @brief 只解析头部，消息体不复制
+     *
+     * 纯文本消息解析为type=clip的消息，整条数据都是消息体。
+     *
+     * @param raw 原始数据
+     * @param out 解析出的头部，消息体不变
+     * @param body 输出消息体在raw中的位置
+     * @return 头部完整且格式正确返回true
+     */
+    static bool parse_head(std::string_view raw, ProtocolMessage& out, std::string_view& body);
+
+    /**
+     * @brief 解析原始数据
+     *
+     * 纯文本消息解析为type=clip的消息。
+     *
+     * @param raw 原始数据
+     * @param out 解析结果
+     * @return 格式正确返回true
+     */
+    static bool parse(std::string_view raw, ProtocolMessage& out);
+};
+
+/**
+ * @class ChunkAssembler
+ * @brief 重组服务器分片发送的大消息
+ *
+ * 服务器把大消息切成type=chunk的分片，分片之间可能穿插其他小消息。
+ * 每个分片带有stream、offset和total字段，按stream累积直到收齐。
+ * 服务器边接收边转发的流在发送方断开或内容被取代时以带abort字段的分片结束，已收到的部分被丢弃。
+ *
+ * 被分片的消息的头部解析后，各分片的数据直接追加到消息体，不再拼接整条原始消息。
+ */
+class ChunkAssembler {
+public:
+    /**
+     * @brief 接收一个分片
+     *
+     * @param chunk 分片消息的头部
+     * @param data 分片的数据
+     * @param complete 收齐时输出解析好的完整消息
+     * @return 收齐返回true
+     */
+    bool feed(const ProtocolMessage& chunk, std::string_view data, ProtocolMessage& complete);
+
+private:
+    // 正在重组的消息
+    struct Stream {
+        // 已收到的字节数
+        size_t received = 0;
+
+        // 头部跨越分片时暂存已收到的数据，头部解析后清空
+        std::string head;
+
+        // 头部已经解析，之后的数据直接追加到消息体
+        bool parsed = false;
+
+        // 重组中的消息
+        ProtocolMessage message;
+    };
+
+    // 正在重组的消息，按stream编号索引
+    std::map<std::string, Stream> streams_;
+};
+
+#endif // PROTOCOL_H
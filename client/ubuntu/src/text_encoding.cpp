@@ -0,0 +1,51 @@
+#include "text_encoding.h"
+#include <cstring>
+
+// 把无效的UTF-8字节替换为U+FFFD
+std::string repair_utf8(const std::string& text) {
+    std::string repaired;
+    repaired.reserve(text.size());
+    size_t i = 0;
+    while (i < text.size()) {
+        size_t length = utf8_sequence_length(text.data(), i, text.size());
+        if (length == 0) {
+            repaired += "\xEF\xBF\xBD";
+            ++i;
+        } else {
+            repaired.append(text, i, length);
+            i += length;
+        }
+    }
+    return repaired;
+}
+
+// 原地把CRLF换行转换为LF
+bool crlf_to_lf(std::string& text) {
+    size_t first = text.find("\r\n");
+    if (first == std::string::npos) {
+        return false;
+    }
+
+    // 用memchr找下一个CR，中间的数据整段前移
+    char* data = &text[0];
+    size_t size = text.size();
+    size_t in = first;
+    size_t out = first;
+    while (in < size) {
+        const void* cr = std::memchr(data + in, '\r', size - in);
+        size_t next = cr ? static_cast<size_t>(static_cast<const char*>(cr) - data) : size;
+        std::memmove(data + out, data + in, next - in);
+        out += next - in;
+        in = next;
+        if (in == size) {
+            break;
+        }
+        // CRLF中的CR丢弃，LF在下一段中复制；单独的CR保留
+        if (in + 1 == size || data[in + 1] != '\n') {
+            data[out++] = '\r';
+        }
+        ++in;
+    }
+    text.resize(out);
+    return true;
+}
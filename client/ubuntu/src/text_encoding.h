@@ -0,0 +1,35 @@
+#ifndef TEXT_ENCODING_H
+#define TEXT_ENCODING_H
+
+#include "utf8_validator.h"
+#include <string>
+
+/**
+ * @file text_encoding.h
+ * @brief 剪贴板文本的UTF-8校验和换行符转换
+ *
+ * 线上的纯文本表示(TEXT_MIME_TYPE)是UTF-8，换行符统一为LF。
+ * 客户端读取本地剪贴板时校验一次并把CRLF转换为LF。
+ *
+ * UTF-8校验(is_valid_utf8、utf8_validator_name)与服务器共用common/utf8_validator.h中的实现。
+ */
+
+/**
+ * @brief 把无效的UTF-8字节替换为U+FFFD
+ *
+ * 只在is_valid_utf8返回false时调用，逐字节处理，有效的字符保持不变。
+ *
+ * @param text 文本
+ * @return 有效的UTF-8文本
+ */
+std::string repair_utf8(const std::string& text);
+
+/**
+ * @brief 原地把CRLF换行转换为LF，单独的CR保持不变
+ *
+ * @param text 文本
+ * @return 有转换时返回true
+ */
+bool crlf_to_lf(std::string& text);
+
+#endif // TEXT_ENCODING_H
@@ -0,0 +1,865 @@
+#include "wayland_clipboard_backend.h"
+#include "config.h"
+#include "wlr-data-control-unstable-v1-client-protocol.h"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    // 读取选择时按优先级尝试的文本MIME类型
+    const char *const WAYLAND_TEXT_MIME_TYPES[] = {
+        "text/plain;charset=utf-8",
+        "UTF8_STRING",
+        "text/plain",
+        "TEXT",
+        "STRING"};
+
+    // 我们的数据源额外声明的类型，用来识别并跳过自己设置的选择
+    const char *const WAYLAND_SOURCE_MARKER = "application/x-p2pboard-source";
+
+    // 每次从管道读取的块大小
+    const size_t WAYLAND_READ_CHUNK = 64 * 1024;
+
+    // 把memfd中的数据从offset起拼接到管道，管道满时等待可写后继续
+    void splice_send(std::shared_ptr<boost::asio::posix::stream_descriptor> pipe,
+                     std::shared_ptr<const ClipboardItem> item, const ClipboardPart *part, loff_t offset)
+    {
+        while (static_cast<size_t>(offset) < part->data.size())
+        {
+            ssize_t n = splice(part->data.fd(), &offset, pipe->native_handle(), nullptr,
+                               part->data.size() - static_cast<size_t>(offset), SPLICE_F_NONBLOCK);
+            if (n > 0 || (n < 0 && errno == EINTR))
+            {
+                continue;
+            }
+            if (n < 0 && errno == EAGAIN)
+            {
+                pipe->async_wait(boost::asio::posix::stream_descriptor::wait_write,
+                                 [pipe, item, part, offset](const boost::system::error_code &ec)
+                                 {
+                                     if (!ec)
+                                     {
+                                         splice_send(pipe, item, part, offset);
+                                     }
+                                 });
+                return;
+            }
+            std::cerr << "发送Wayland选择数据失败: " << (n < 0 ? std::strerror(errno) : "数据提前结束") << std::endl;
+            return;
+        }
+    }
+}
+
+// 析构函数
+WaylandClipboardBackend::~WaylandClipboardBackend()
+{
+    stop();
+
+    if (display_)
+    {
+        if (selection_offer_)
+        {
+            destroy_offer(selection_offer_);
+        }
+        if (primary_offer_)
+        {
+            destroy_offer(primary_offer_);
+        }
+        if (data_source_)
+        {
+            handle_source_cancelled(data_source_);
+        }
+        if (primary_source_)
+        {
+            handle_source_cancelled(primary_source_);
+        }
+        if (data_control_device_)
+        {
+            zwlr_data_control_device_v1_destroy(data_control_device_);
+        }
+        if (data_control_manager_)
+        {
+            zwlr_data_control_manager_v1_destroy(data_control_manager_);
+        }
+        if (data_device_)
+        {
+            wl_data_device_destroy(data_device_);
+        }
+        if (seat_)
+        {
+            wl_seat_destroy(seat_);
+        }
+        if (registry_)
+        {
+            wl_registry_destroy(registry_);
+        }
+        wl_display_disconnect(display_);
+    }
+}
+
+// 连接Wayland合成器
+void WaylandClipboardBackend::initialize()
+{
+    // 创建到Wayland合成器的连接
+    display_ = wl_display_connect(nullptr);
+    if (!display_)
+    {
+        throw std::runtime_error("连接Wayland显示失败");
+    }
+
+    // 获取注册表
+    registry_ = wl_display_get_registry(display_);
+    if (!registry_)
+    {
+        throw std::runtime_error("获取Wayland注册表失败");
+    }
+
+    // 注册全局对象
+    wl_registry_add_listener(registry_, &registry_listener_, this);
+
+    // 获取座位和剪贴板管理器
+    wl_display_roundtrip(display_);
+
+    if (!seat_)
+    {
+        throw std::runtime_error("Wayland座位不可用");
+    }
+
+    if (data_control_manager_)
+    {
+        // wlr数据控制协议不依赖键盘焦点，后台运行也能收到选择变化
+        data_control_device_ = zwlr_data_control_manager_v1_get_data_device(data_control_manager_, seat_);
+        zwlr_data_control_device_v1_add_listener(data_control_device_, &control_device_listener_, this);
+        std::cout << "使用wlr数据控制协议访问剪贴板" << std::endl;
+    }
+    else if (data_device_manager_)
+    {
+        // 核心协议只在本客户端拥有键盘焦点时发送selection事件，设置选择也需要输入事件的serial
+        data_device_ = wl_data_device_manager_get_data_device(data_device_manager_, seat_);
+        wl_data_device_add_listener(data_device_, &data_device_listener_, this);
+        std::cout << "合成器不支持wlr数据控制协议，使用核心数据设备，仅在获得焦点时能同步剪贴板" << std::endl;
+    }
+    else
+    {
+        throw std::runtime_error("Wayland剪贴板管理器不可用");
+    }
+
+    // 接收初始选择，数据在开始监控后读取
+    wl_display_roundtrip(display_);
+
+    std::cout << "Wayland剪贴板管理器初始化成功" << std::endl;
+}
+
+// 开始监控剪贴板
+void WaylandClipboardBackend::start(boost::asio::io_context &io_context, Listener &listener)
+{
+    io_context_ = &io_context;
+    listener_ = &listener;
+
+    // 由事件循环监视Wayland显示连接
+    watcher_ = std::make_unique<boost::asio::posix::stream_descriptor>(io_context, wl_display_get_fd(display_));
+
+    // 读取初始化时收到的选择
+    if (selection_offer_)
+    {
+        receive_offer(ClipboardSelection::Clipboard, selection_offer_);
+    }
+    if (primary_offer_ && track_primary_)
+    {
+        receive_offer(ClipboardSelection::Primary, primary_offer_);
+    }
+    dispatch_events();
+}
+
+// 停止监控
+void WaylandClipboardBackend::stop()
+{
+    if (watcher_)
+    {
+        watcher_->cancel();
+        // 显示连接的文件描述符由libwayland关闭
+        watcher_->release();
+        watcher_.reset();
+    }
+    refuse_lazy_sends();
+    // 丢弃正在进行的选择读取
+    ++receive_generation_;
+    ++primary_generation_;
+    io_context_ = nullptr;
+    listener_ = nullptr;
+}
+
+// 获取当前剪贴板文本
+std::string WaylandClipboardBackend::read_text()
+{
+    // 选择变化由事件循环异步读取，这里返回我们提供的或最近一次读到的内容
+    if (data_source_)
+    {
+        const ClipboardPart *text = outgoing_ ? find_part(*outgoing_, TEXT_MIME_TYPE) : nullptr;
+        return text ? text->data.str() : "";
+    }
+    return received_text_;
+}
+
+// 取得选择并提供条目
+void WaylandClipboardBackend::offer(ClipboardSelection selection, std::shared_ptr<const ClipboardItem> item)
+{
+    std::vector<std::string> formats;
+    for (const auto &part : *item)
+    {
+        formats.push_back(part.mime);
+    }
+
+    if (selection == ClipboardSelection::Primary)
+    {
+        if (!supports_primary())
+        {
+            return;
+        }
+        primary_outgoing_ = std::move(item);
+        set_source(selection, formats);
+        return;
+    }
+
+    refuse_lazy_sends();
+    lazy_formats_.clear();
+    outgoing_ = std::move(item);
+    set_source(selection, formats);
+}
+
+// 取得选择并声明格式
+void WaylandClipboardBackend::offer_lazy(const std::vector<std::string> &formats)
+{
+    refuse_lazy_sends();
+    outgoing_.reset();
+    lazy_formats_ = formats;
+    set_source(ClipboardSelection::Clipboard, formats);
+}
+
+// 提供按需获取的数据
+void WaylandClipboardBackend::provide(std::shared_ptr<const ClipboardItem> item)
+{
+    if (item)
+    {
+        outgoing_ = std::move(item);
+        lazy_formats_.clear();
+    }
+
+    // 回复等待中的请求，没有数据时直接关闭管道
+    std::vector<std::pair<std::string, int32_t>> sends;
+    sends.swap(lazy_sends_);
+    for (const auto &send : sends)
+    {
+        serve_send(outgoing_, send.first, send.second);
+    }
+}
+
+// 合成器是否支持设置PRIMARY
+bool WaylandClipboardBackend::supports_primary() const
+{
+    return data_control_device_ && zwlr_data_control_device_v1_get_version(data_control_device_) >=
+                                       ZWLR_DATA_CONTROL_DEVICE_V1_SET_PRIMARY_SELECTION_SINCE_VERSION;
+}
+
+// 选择读取的代数
+uint64_t &WaylandClipboardBackend::receive_generation(ClipboardSelection selection)
+{
+    return selection == ClipboardSelection::Primary ? primary_generation_ : receive_generation_;
+}
+
+// 创建声明指定格式的数据源并设为选择
+void WaylandClipboardBackend::set_source(ClipboardSelection selection, const std::vector<std::string> &formats)
+{
+    // 纯文本以各种常见的文本类型提供，其他表示以各自的MIME类型提供
+    std::vector<std::string> mime_types;
+    for (const auto &format : formats)
+    {
+        if (format == TEXT_MIME_TYPE)
+        {
+            mime_types.insert(mime_types.end(), std::begin(WAYLAND_TEXT_MIME_TYPES), std::end(WAYLAND_TEXT_MIME_TYPES));
+        }
+        else
+        {
+            mime_types.push_back(format);
+        }
+    }
+
+    // 新数据源被设置后，合成器会取消旧数据源
+    if (data_control_device_)
+    {
+        auto *source = zwlr_data_control_manager_v1_create_data_source(data_control_manager_);
+        zwlr_data_control_source_v1_add_listener(source, &control_source_listener_, this);
+        for (const auto &mime_type : mime_types)
+        {
+            zwlr_data_control_source_v1_offer(source, mime_type.c_str());
+        }
+        zwlr_data_control_source_v1_offer(source, WAYLAND_SOURCE_MARKER);
+        if (selection == ClipboardSelection::Primary)
+        {
+            zwlr_data_control_device_v1_set_primary_selection(data_control_device_, source);
+            primary_source_ = source;
+        }
+        else
+        {
+            zwlr_data_control_device_v1_set_selection(data_control_device_, source);
+            data_source_ = source;
+        }
+    }
+    else if (data_device_ && selection == ClipboardSelection::Clipboard)
+    {
+        auto *source = wl_data_device_manager_create_data_source(data_device_manager_);
+        wl_data_source_add_listener(source, &data_source_listener_, this);
+        for (const auto &mime_type : mime_types)
+        {
+            wl_data_source_offer(source, mime_type.c_str());
+        }
+        wl_data_source_offer(source, WAYLAND_SOURCE_MARKER);
+        // 没有输入事件的serial，合成器可能拒绝此请求
+        wl_data_device_set_selection(data_device_, source, 0);
+        data_source_ = source;
+    }
+
+    wl_display_flush(display_);
+}
+
+// 等待Wayland显示连接可读并分发事件
+void WaylandClipboardBackend::dispatch_events()
+{
+    // 先分发队列中已有的事件，直到可以安全地准备读取
+    while (wl_display_prepare_read(display_) != 0)
+    {
+        wl_display_dispatch_pending(display_);
+    }
+    wl_display_flush(display_);
+
+    watcher_->async_wait(boost::asio::posix::stream_descriptor::wait_read,
+                         [this](const boost::system::error_code &ec)
+                         {
+                             if (ec)
+                             {
+                                 wl_display_cancel_read(display_);
+                                 return;
+                             }
+                             if (wl_display_read_events(display_) < 0)
+                             {
+                                 std::cerr << "Wayland连接已断开" << std::endl;
+                                 return;
+                             }
+                             wl_display_dispatch_pending(display_);
+                             if (watcher_)
+                             {
+                                 dispatch_events();
+                             }
+                         });
+}
+
+// 新的数据提供
+void WaylandClipboardBackend::handle_new_offer(void *offer)
+{
+    offer_mime_types_[offer];
+}
+
+// 数据提供声明了一种MIME类型
+void WaylandClipboardBackend::handle_offer_mime(void *offer, const char *mime_type)
+{
+    offer_mime_types_[offer].emplace_back(mime_type);
+}
+
+// 选择变化
+void WaylandClipboardBackend::handle_selection(void *offer)
+{
+    // 上一个选择的数据提供在新选择到达后必须销毁
+    if (selection_offer_ && selection_offer_ != offer)
+    {
+        destroy_offer(selection_offer_);
+    }
+    selection_offer_ = offer;
+    ++receive_generation_;
+
+    // 开始监控前收到的选择由start读取
+    if (offer && io_context_)
+    {
+        receive_offer(ClipboardSelection::Clipboard, offer);
+    }
+}
+
+// PRIMARY变化
+void WaylandClipboardBackend::handle_primary_selection(void *offer)
+{
+    if (primary_offer_ && primary_offer_ != offer)
+    {
+        destroy_offer(primary_offer_);
+    }
+    primary_offer_ = offer;
+    ++primary_generation_;
+
+    if (offer && io_context_ && track_primary_)
+    {
+        receive_offer(ClipboardSelection::Primary, offer);
+    }
+}
+
+// 请求数据提供依次发送文本和需要的其他格式
+void WaylandClipboardBackend::receive_offer(ClipboardSelection selection, void *offer)
+{
+    const std::vector<std::string> &mime_types = offer_mime_types_[offer];
+    auto offered = [&mime_types](const std::string &mime_type)
+    {
+        return std::find(mime_types.begin(), mime_types.end(), mime_type) != mime_types.end();
+    };
+    if (offered(WAYLAND_SOURCE_MARKER))
+    {
+        // 我们自己设置的选择
+        return;
+    }
+
+    auto fetch = std::make_shared<Fetch>();
+    for (const char *mime_type : WAYLAND_TEXT_MIME_TYPES)
+    {
+        if (offered(mime_type))
+        {
+            fetch->pending.emplace_back(mime_type, TEXT_MIME_TYPE);
+            break;
+        }
+    }
+    for (const auto &format : wanted_formats_)
+    {
+        if (offered(format))
+        {
+            fetch->pending.emplace_back(format, format);
+        }
+    }
+    if (fetch->pending.empty())
+    {
+        return;
+    }
+
+    fetch_next_part(selection, offer, fetch, receive_generation(selection));
+}
+
+// 读取下一种格式，全部完成后报告读到的条目
+void WaylandClipboardBackend::fetch_next_part(ClipboardSelection selection, void *offer, std::shared_ptr<Fetch> fetch,
+                                              uint64_t generation)
+{
+    if (fetch->pending.empty())
+    {
+        if (fetch->item.empty())
+        {
+            return;
+        }
+        if (selection == ClipboardSelection::Clipboard)
+        {
+            const ClipboardPart *text = find_part(fetch->item, TEXT_MIME_TYPE);
+            received_text_ = text ? text->data.str() : "";
+        }
+        if (listener_)
+        {
+            listener_->on_local_change(selection, std::move(fetch->item));
+        }
+        return;
+    }
+    std::pair<std::string, std::string> next = std::move(fetch->pending.front());
+    fetch->pending.erase(fetch->pending.begin());
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) != 0)
+    {
+        std::cerr << "创建管道失败: " << strerror(errno) << std::endl;
+        return;
+    }
+
+    if (data_control_device_)
+    {
+        zwlr_data_control_offer_v1_receive(static_cast<zwlr_data_control_offer_v1 *>(offer), next.first.c_str(), fds[1]);
+    }
+    else
+    {
+        wl_data_offer_receive(static_cast<wl_data_offer *>(offer), next.first.c_str(), fds[1]);
+    }
+    // libwayland在编组请求时已复制写端，关闭我们的副本才能在对方写完后读到EOF
+    wl_display_flush(display_);
+    close(fds[1]);
+
+    auto pipe = std::make_shared<boost::asio::posix::stream_descriptor>(*io_context_, fds[0]);
+    std::string mime = std::move(next.second);
+    read_pipe(pipe, std::make_shared<std::string>(), selection, generation,
+              [this, selection, offer, fetch, generation, mime](std::string &data)
+              {
+                  if (fetch->bytes + data.size() > MAX_MESSAGE_SIZE)
+                  {
+                      std::cerr << "剪贴板内容超过最大消息大小，已忽略格式 " << mime << std::endl;
+                  }
+                  else if (!data.empty())
+                  {
+                      fetch->bytes += data.size();
+                      fetch->item.push_back(ClipboardPart{mime, std::move(data)});
+                  }
+                  fetch_next_part(selection, offer, fetch, generation);
+              });
+}
+
+// 通过管道异步读取选择数据，数据直接读入结果缓冲区
+void WaylandClipboardBackend::read_pipe(std::shared_ptr<boost::asio::posix::stream_descriptor> pipe,
+                                        std::shared_ptr<std::string> buffer, ClipboardSelection selection,
+                                        uint64_t generation, std::function<void(std::string &)> done)
+{
+    size_t offset = buffer->size();
+    buffer->resize(offset + WAYLAND_READ_CHUNK);
+    pipe->async_read_some(boost::asio::buffer(&(*buffer)[offset], WAYLAND_READ_CHUNK),
+                          [this, pipe, buffer, selection, generation, offset, done](const boost::system::error_code &ec, size_t bytes)
+                          {
+                              buffer->resize(offset + bytes);
+                              if (ec == boost::asio::error::operation_aborted || generation != receive_generation(selection))
+                              {
+                                  // 已被新的选择取代
+                                  return;
+                              }
+                              if (ec == boost::asio::error::eof)
+                              {
+                                  done(*buffer);
+                                  return;
+                              }
+                              if (ec)
+                              {
+                                  std::cerr << "读取Wayland选择数据失败: " << ec.message() << std::endl;
+                                  buffer->clear();
+                                  done(*buffer);
+                                  return;
+                              }
+                              if (buffer->size() > MAX_MESSAGE_SIZE)
+                              {
+                                  std::cerr << "Wayland选择数据超过最大消息大小，已忽略" << std::endl;
+                                  buffer->clear();
+                                  done(*buffer);
+                                  return;
+                              }
+                              read_pipe(pipe, buffer, selection, generation, done);
+                          });
+}
+
+// 其他客户端请求读取我们提供的数据
+void WaylandClipboardBackend::handle_send(void *source, const char *mime_type, int32_t fd)
+{
+    if (source == primary_source_ && source && io_context_)
+    {
+        serve_send(primary_outgoing_, mime_type, fd);
+        return;
+    }
+    if (source != data_source_ || !io_context_)
+    {
+        close(fd);
+        return;
+    }
+
+    // 按通告持有选择时，等数据取回后再写入
+    if (!outgoing_ && !lazy_formats_.empty())
+    {
+        lazy_sends_.emplace_back(mime_type, fd);
+        if (listener_)
+        {
+            listener_->on_data_requested();
+        }
+        return;
+    }
+    serve_send(outgoing_, mime_type, fd);
+}
+
+// 把我们提供的某种格式写入管道，没有该格式时直接关闭
+void WaylandClipboardBackend::serve_send(std::shared_ptr<const ClipboardItem> item, const std::string &mime_type,
+                                         int32_t fd)
+{
+    if (!item || !io_context_)
+    {
+        close(fd);
+        return;
+    }
+
+    // 各种文本类型都提供纯文本表示
+    std::string mime = mime_type;
+    for (const char *text_type : WAYLAND_TEXT_MIME_TYPES)
+    {
+        if (mime == text_type)
+        {
+            mime = TEXT_MIME_TYPE;
+            break;
+        }
+    }
+    const ClipboardPart *part = find_part(*item, mime);
+    if (!part)
+    {
+        close(fd);
+        return;
+    }
+
+    // 各个读取方共享同一份内容，写入时不复制；memfd中的数据直接拼接到管道，不映射进进程
+    auto pipe = std::make_shared<boost::asio::posix::stream_descriptor>(*io_context_, fd);
+    if (part->data.spilled())
+    {
+        pipe->non_blocking(true);
+        splice_send(pipe, item, part, 0);
+        return;
+    }
+    ClipboardView data = part->data.view();
+    boost::asio::async_write(*pipe, boost::asio::buffer(data.data(), data.size()),
+                             [pipe, item](const boost::system::error_code &ec, size_t)
+                             {
+                                 if (ec && ec != boost::asio::error::operation_aborted)
+                                 {
+                                     std::cerr << "发送Wayland选择数据失败: " << ec.message() << std::endl;
+                                 }
+                             });
+}
+
+// 拒绝所有等待按需获取的读取请求
+void WaylandClipboardBackend::refuse_lazy_sends()
+{
+    for (const auto &send : lazy_sends_)
+    {
+        close(send.second);
+    }
+    lazy_sends_.clear();
+}
+
+// 数据源被取消或不再需要
+void WaylandClipboardBackend::handle_source_cancelled(void *source)
+{
+    if (data_control_manager_)
+    {
+        zwlr_data_control_source_v1_destroy(static_cast<zwlr_data_control_source_v1 *>(source));
+    }
+    else
+    {
+        wl_data_source_destroy(static_cast<wl_data_source *>(source));
+    }
+    if (source == data_source_)
+    {
+        data_source_ = nullptr;
+        outgoing_.reset();
+        lazy_formats_.clear();
+        refuse_lazy_sends();
+        if (listener_)
+        {
+            listener_->on_ownership_lost();
+        }
+    }
+    else if (source == primary_source_)
+    {
+        primary_source_ = nullptr;
+        primary_outgoing_.reset();
+    }
+}
+
+// 数据控制设备失效
+void WaylandClipboardBackend::handle_device_finished()
+{
+    // 座位已被移除，设备不再有效
+    std::cerr << "Wayland数据控制设备已失效" << std::endl;
+    zwlr_data_control_device_v1_destroy(data_control_device_);
+    data_control_device_ = nullptr;
+}
+
+// 销毁数据提供
+void WaylandClipboardBackend::destroy_offer(void *offer)
+{
+    if (data_control_manager_)
+    {
+        zwlr_data_control_offer_v1_destroy(static_cast<zwlr_data_control_offer_v1 *>(offer));
+    }
+    else
+    {
+        wl_data_offer_destroy(static_cast<wl_data_offer *>(offer));
+    }
+    offer_mime_types_.erase(offer);
+    if (offer == selection_offer_)
+    {
+        selection_offer_ = nullptr;
+    }
+    if (offer == primary_offer_)
+    {
+        primary_offer_ = nullptr;
+    }
+}
+
+// Wayland注册表监听器回调
+void WaylandClipboardBackend::registry_handle_global(void *data, struct wl_registry *registry,
+                                                     uint32_t name, const char *interface, uint32_t version)
+{
+    auto *backend = static_cast<WaylandClipboardBackend *>(data);
+    if (strcmp(interface, "wl_seat") == 0 && !backend->seat_)
+    {
+        // 只使用第一个座位
+        backend->seat_ = static_cast<wl_seat *>(wl_registry_bind(registry, name, &wl_seat_interface, 1));
+    }
+    else if (strcmp(interface, "wl_data_device_manager") == 0)
+    {
+        backend->data_device_manager_ = static_cast<wl_data_device_manager *>(wl_registry_bind(registry, name,
+                                                                                               &wl_data_device_manager_interface, std::min(version, 3u)));
+    }
+    else if (strcmp(interface, "zwlr_data_control_manager_v1") == 0)
+    {
+        backend->data_control_manager_ = static_cast<zwlr_data_control_manager_v1 *>(wl_registry_bind(registry, name,
+                                                                                                       &zwlr_data_control_manager_v1_interface, std::min(version, 2u)));
+    }
+}
+
+// Wayland数据设备监听器回调
+void WaylandClipboardBackend::data_device_handle_data_offer(void *data, struct wl_data_device *, struct wl_data_offer *id)
+{
+    static_cast<WaylandClipboardBackend *>(data)->handle_new_offer(id);
+    wl_data_offer_add_listener(id, &data_offer_listener_, data);
+}
+
+void WaylandClipboardBackend::data_device_handle_enter(void *data, struct wl_data_device *, uint32_t, struct wl_surface *,
+                                                       wl_fixed_t, wl_fixed_t, struct wl_data_offer *id)
+{
+    // 不支持拖放，直接销毁拖放的数据提供
+    if (id)
+    {
+        static_cast<WaylandClipboardBackend *>(data)->destroy_offer(id);
+    }
+}
+
+static void data_device_handle_leave(void *, struct wl_data_device *)
+{
+}
+
+static void data_device_handle_motion(void *, struct wl_data_device *, uint32_t, wl_fixed_t, wl_fixed_t)
+{
+}
+
+static void data_device_handle_drop(void *, struct wl_data_device *)
+{
+}
+
+void WaylandClipboardBackend::data_device_handle_selection(void *data, struct wl_data_device *, struct wl_data_offer *id)
+{
+    // 处理剪贴板选择
+    static_cast<WaylandClipboardBackend *>(data)->handle_selection(id);
+}
+
+// Wayland数据提供监听器回调
+void WaylandClipboardBackend::data_offer_handle_offer(void *data, struct wl_data_offer *offer, const char *mime_type)
+{
+    static_cast<WaylandClipboardBackend *>(data)->handle_offer_mime(offer, mime_type);
+}
+
+static void data_offer_handle_source_actions(void *, struct wl_data_offer *, uint32_t)
+{
+}
+
+static void data_offer_handle_action(void *, struct wl_data_offer *, uint32_t)
+{
+}
+
+// Wayland数据源监听器回调
+static void data_source_handle_target(void *, struct wl_data_source *, const char *)
+{
+}
+
+void WaylandClipboardBackend::data_source_handle_send(void *data, struct wl_data_source *source, const char *mime_type, int32_t fd)
+{
+    static_cast<WaylandClipboardBackend *>(data)->handle_send(source, mime_type, fd);
+}
+
+void WaylandClipboardBackend::data_source_handle_cancelled(void *data, struct wl_data_source *source)
+{
+    static_cast<WaylandClipboardBackend *>(data)->handle_source_cancelled(source);
+}
+
+static void data_source_handle_dnd_drop_performed(void *, struct wl_data_source *)
+{
+}
+
+static void data_source_handle_dnd_finished(void *, struct wl_data_source *)
+{
+}
+
+static void data_source_handle_action(void *, struct wl_data_source *, uint32_t)
+{
+}
+
+// wlr数据控制协议监听器回调
+void WaylandClipboardBackend::control_device_handle_data_offer(void *data, struct zwlr_data_control_device_v1 *,
+                                                               struct zwlr_data_control_offer_v1 *id)
+{
+    static_cast<WaylandClipboardBackend *>(data)->handle_new_offer(id);
+    zwlr_data_control_offer_v1_add_listener(id, &control_offer_listener_, data);
+}
+
+void WaylandClipboardBackend::control_device_handle_selection(void *data, struct zwlr_data_control_device_v1 *,
+                                                              struct zwlr_data_control_offer_v1 *id)
+{
+    static_cast<WaylandClipboardBackend *>(data)->handle_selection(id);
+}
+
+void WaylandClipboardBackend::control_device_handle_finished(void *data, struct zwlr_data_control_device_v1 *)
+{
+    static_cast<WaylandClipboardBackend *>(data)->handle_device_finished();
+}
+
+void WaylandClipboardBackend::control_device_handle_primary_selection(void *data, struct zwlr_data_control_device_v1 *,
+                                                                      struct zwlr_data_control_offer_v1 *id)
+{
+    static_cast<WaylandClipboardBackend *>(data)->handle_primary_selection(id);
+}
+
+void WaylandClipboardBackend::control_offer_handle_offer(void *data, struct zwlr_data_control_offer_v1 *offer, const char *mime_type)
+{
+    static_cast<WaylandClipboardBackend *>(data)->handle_offer_mime(offer, mime_type);
+}
+
+void WaylandClipboardBackend::control_source_handle_send(void *data, struct zwlr_data_control_source_v1 *source,
+                                                         const char *mime_type, int32_t fd)
+{
+    static_cast<WaylandClipboardBackend *>(data)->handle_send(source, mime_type, fd);
+}
+
+void WaylandClipboardBackend::control_source_handle_cancelled(void *data, struct zwlr_data_control_source_v1 *source)
+{
+    static_cast<WaylandClipboardBackend *>(data)->handle_source_cancelled(source);
+}
+
+// Wayland接口实现
+const struct wl_registry_listener WaylandClipboardBackend::registry_listener_ = {
+    registry_handle_global,
+    nullptr // handle_global_remove
+};
+
+const struct wl_data_device_listener WaylandClipboardBackend::data_device_listener_ = {
+    data_device_handle_data_offer,
+    data_device_handle_enter,
+    data_device_handle_leave,
+    data_device_handle_motion,
+    data_device_handle_drop,
+    data_device_handle_selection};
+
+const struct wl_data_offer_listener WaylandClipboardBackend::data_offer_listener_ = {
+    data_offer_handle_offer,
+    data_offer_handle_source_actions,
+    data_offer_handle_action};
+
+const struct wl_data_source_listener WaylandClipboardBackend::data_source_listener_ = {
+    data_source_handle_target,
+    data_source_handle_send,
+    data_source_handle_cancelled,
+    data_source_handle_dnd_drop_performed,
+    data_source_handle_dnd_finished,
+    data_source_handle_action};
+
+const struct zwlr_data_control_device_v1_listener WaylandClipboardBackend::control_device_listener_ = {
+    control_device_handle_data_offer,
+    control_device_handle_selection,
+    control_device_handle_finished,
+    control_device_handle_primary_selection};
+
+const struct zwlr_data_control_offer_v1_listener WaylandClipboardBackend::control_offer_listener_ = {
+    control_offer_handle_offer};
+
+const struct zwlr_data_control_source_v1_listener WaylandClipboardBackend::control_source_listener_ = {
+    control_source_handle_send,
+    control_source_handle_cancelled};
@@ -0,0 +1,202 @@
+#ifndef WAYLAND_CLIPBOARD_BACKEND_H
+#define WAYLAND_CLIPBOARD_BACKEND_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <wayland-client.h>
+#include <wayland-client-protocol.h>
+
+#include "clipboard_backend.h"
+
+// wlr数据控制协议对象，定义在wayland-scanner生成的头文件中
+struct zwlr_data_control_manager_v1;
+struct zwlr_data_control_device_v1;
+struct zwlr_data_control_offer_v1;
+struct zwlr_data_control_source_v1;
+struct zwlr_data_control_device_v1_listener;
+struct zwlr_data_control_source_v1_listener;
+struct zwlr_data_control_offer_v1_listener;
+
+/**
+ * @class WaylandClipboardBackend
+ * @brief Wayland剪贴板后端
+ *
+ * 合成器支持wlr数据控制协议时优先使用，后台运行也能收到选择变化；
+ * 否则使用核心数据设备，只在获得键盘焦点时能同步剪贴板。
+ * 选择数据通过管道在事件循环中异步读写。
+ * PRIMARY只能通过wlr数据控制协议(版本2)读写，启用跟踪时与CLIPBOARD分别读取和设置。
+ */
+class WaylandClipboardBackend : public ClipboardBackend
+{
+public:
+    WaylandClipboardBackend() = default;
+    ~WaylandClipboardBackend() override;
+
+    WaylandClipboardBackend(const WaylandClipboardBackend &) = delete;
+    WaylandClipboardBackend &operator=(const WaylandClipboardBackend &) = delete;
+
+    const char *name() const override { return "Wayland"; }
+    void initialize() override;
+    void start(boost::asio::io_context &io_context, Listener &listener) override;
+    void stop() override;
+    std::string read_text() override;
+    void offer(ClipboardSelection selection, std::shared_ptr<const ClipboardItem> item) override;
+    void offer_lazy(const std::vector<std::string> &formats) override;
+    void provide(std::shared_ptr<const ClipboardItem> item) override;
+
+private:
+    // 从数据提供依次读取各种格式，每项为(请求的MIME类型, 记录的MIME类型)
+    struct Fetch
+    {
+        std::vector<std::pair<std::string, std::string>> pending;
+        ClipboardItem item;
+        size_t bytes = 0;
+    };
+
+    // 创建声明指定格式的数据源并设为选择
+    void set_source(ClipboardSelection selection, const std::vector<std::string> &formats);
+
+    // 合成器是否支持设置PRIMARY
+    bool supports_primary() const;
+
+    // 选择读取的代数
+    uint64_t &receive_generation(ClipboardSelection selection);
+
+    // 等待Wayland显示连接可读并分发事件
+    void dispatch_events();
+
+    // 新的数据提供，随后会收到它声明的MIME类型
+    void handle_new_offer(void *offer);
+
+    // 数据提供声明了一种MIME类型
+    void handle_offer_mime(void *offer, const char *mime_type);
+
+    // CLIPBOARD变化，offer为空表示选择被清空
+    void handle_selection(void *offer);
+
+    // PRIMARY变化，offer为空表示选择被清空
+    void handle_primary_selection(void *offer);
+
+    // 请求数据提供通过管道发送文本和需要的其他格式
+    void receive_offer(ClipboardSelection selection, void *offer);
+
+    // 读取下一种格式，全部完成后报告读到的条目
+    void fetch_next_part(ClipboardSelection selection, void *offer, std::shared_ptr<Fetch> fetch,
+                         uint64_t generation);
+
+    // 通过管道异步读取选择数据，读完后调用done，失败时数据为空
+    void read_pipe(std::shared_ptr<boost::asio::posix::stream_descriptor> pipe,
+                   std::shared_ptr<std::string> buffer, ClipboardSelection selection, uint64_t generation,
+                   std::function<void(std::string &)> done);
+
+    // 其他客户端请求读取我们提供的某种格式，按通告持有选择时先获取数据
+    void handle_send(void *source, const char *mime_type, int32_t fd);
+
+    // 把条目中的某种格式写入管道
+    void serve_send(std::shared_ptr<const ClipboardItem> item, const std::string &mime_type, int32_t fd);
+
+    // 拒绝所有等待按需获取的读取请求
+    void refuse_lazy_sends();
+
+    // 数据源被新的选择替换或不再需要，销毁数据源
+    void handle_source_cancelled(void *source);
+
+    // 数据控制设备失效
+    void handle_device_finished();
+
+    // 销毁数据提供
+    void destroy_offer(void *offer);
+
+    // Wayland监听器回调，data为后端对象
+    static void registry_handle_global(void *data, struct wl_registry *registry,
+                                       uint32_t name, const char *interface, uint32_t version);
+    static void data_device_handle_data_offer(void *data, struct wl_data_device *, struct wl_data_offer *id);
+    static void data_device_handle_enter(void *data, struct wl_data_device *, uint32_t, struct wl_surface *,
+                                         wl_fixed_t, wl_fixed_t, struct wl_data_offer *id);
+    static void data_device_handle_selection(void *data, struct wl_data_device *, struct wl_data_offer *id);
+    static void data_offer_handle_offer(void *data, struct wl_data_offer *offer, const char *mime_type);
+    static void data_source_handle_send(void *data, struct wl_data_source *source, const char *mime_type, int32_t fd);
+    static void data_source_handle_cancelled(void *data, struct wl_data_source *source);
+    static void control_device_handle_data_offer(void *data, struct zwlr_data_control_device_v1 *,
+                                                 struct zwlr_data_control_offer_v1 *id);
+    static void control_device_handle_selection(void *data, struct zwlr_data_control_device_v1 *,
+                                                struct zwlr_data_control_offer_v1 *id);
+    static void control_device_handle_finished(void *data, struct zwlr_data_control_device_v1 *device);
+    static void control_device_handle_primary_selection(void *data, struct zwlr_data_control_device_v1 *,
+                                                        struct zwlr_data_control_offer_v1 *id);
+    static void control_offer_handle_offer(void *data, struct zwlr_data_control_offer_v1 *offer, const char *mime_type);
+    static void control_source_handle_send(void *data, struct zwlr_data_control_source_v1 *source,
+                                           const char *mime_type, int32_t fd);
+    static void control_source_handle_cancelled(void *data, struct zwlr_data_control_source_v1 *source);
+
+    struct wl_display *display_ = nullptr;
+    struct wl_registry *registry_ = nullptr;
+    struct wl_data_device_manager *data_device_manager_ = nullptr;
+    struct wl_seat *seat_ = nullptr;
+    struct wl_data_device *data_device_ = nullptr;
+
+    // wlr数据控制协议，可用时优先使用，后台客户端也能收到选择变化
+    struct zwlr_data_control_manager_v1 *data_control_manager_ = nullptr;
+    struct zwlr_data_control_device_v1 *data_control_device_ = nullptr;
+
+    // 当前选择对应的数据提供(wl_data_offer或zwlr_data_control_offer_v1)
+    void *selection_offer_ = nullptr;
+
+    // 当前PRIMARY对应的数据提供
+    void *primary_offer_ = nullptr;
+
+    // 每个数据提供声明的MIME类型
+    std::map<void *, std::vector<std::string>> offer_mime_types_;
+
+    // 我们设置剪贴板时创建的数据源
+    void *data_source_ = nullptr;
+
+    // 数据源提供的内容，所有读取请求共享同一份数据
+    std::shared_ptr<const ClipboardItem> outgoing_;
+
+    // 我们设置PRIMARY时创建的数据源和它提供的内容
+    void *primary_source_ = nullptr;
+    std::shared_ptr<const ClipboardItem> primary_outgoing_;
+
+    // 按通告持有选择时声明的格式，数据取回后清空
+    std::vector<std::string> lazy_formats_;
+
+    // 等待按需获取的读取请求(MIME类型, 文件描述符)
+    std::vector<std::pair<std::string, int32_t>> lazy_sends_;
+
+    // 最近一次从其他客户端读到的纯文本
+    std::string received_text_;
+
+    // 监视Wayland显示连接
+    std::unique_ptr<boost::asio::posix::stream_descriptor> watcher_;
+
+    // CLIPBOARD和PRIMARY读取的代数，新选择到达后丢弃旧的读取结果
+    uint64_t receive_generation_ = 0;
+    uint64_t primary_generation_ = 0;
+
+    // 客户端事件循环，监控期间有效
+    boost::asio::io_context *io_context_ = nullptr;
+
+    // Wayland注册表监听器
+    static const struct wl_registry_listener registry_listener_;
+
+    // Wayland数据设备监听器
+    static const struct wl_data_device_listener data_device_listener_;
+
+    // Wayland数据提供和数据源监听器
+    static const struct wl_data_offer_listener data_offer_listener_;
+    static const struct wl_data_source_listener data_source_listener_;
+
+    // wlr数据控制协议监听器
+    static const struct zwlr_data_control_device_v1_listener control_device_listener_;
+    static const struct zwlr_data_control_offer_v1_listener control_offer_listener_;
+    static const struct zwlr_data_control_source_v1_listener control_source_listener_;
+};
+
+#endif // WAYLAND_CLIPBOARD_BACKEND_H
@@ -1,211 +1,439 @@
 #include "websocket_client.h"
 #include "config.h"
-#include <iostream>
-#include <thread>
+#include "latency_tracer.h"
+#include "payload_cipher.h"
+#include "probes.h"
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
+#include <iostream>
 
-// 构造函数
-WebSocketClient::WebSocketClient() {
-    // 初始化上下文和解析器
-    context_ = std::make_unique<boost::asio::io_context>();
-    resolver_ = std::make_unique<boost::asio::ip::tcp::resolver>(*context_);
-
-    // 初始化流
-    ws_ = std::make_unique<boost::beast::websocket::stream<boost::asio::ip::tcp::socket>>(*context_);
+namespace websocket = boost::beast::websocket;
+
+namespace {
+    // 消息的头部和消息体各段，按顺序组成一个WebSocket消息；
+    // 各表示的视图保存在views中，写入完成前保持映射
+    std::vector<boost::asio::const_buffer> wire_buffers(const WireMessage& message,
+                                                        std::vector<ClipboardView>& views) {
+        std::vector<boost::asio::const_buffer> buffers;
+        buffers.push_back(boost::asio::buffer(message.head));
+        if (message.item) {
+            for (const auto& part : *message.item) {
+                if (!part.data.empty()) {
+                    views.push_back(part.data.view());
+                    buffers.push_back(boost::asio::buffer(views.back().data(), views.back().size()));
+                }
+            }
+        } else if (!message.body.empty()) {
+            buffers.push_back(boost::asio::buffer(message.body));
+        }
+        return buffers;
+    }
+}
 
-    // 初始化连接状态
-    connected_ = false;
-    stopped_ = false;
+// 构造函数
+WebSocketClient::WebSocketClient(boost::asio::io_context& io_context)
+    : io_context_(io_context), resolver_(io_context), reconnect_timer_(io_context),
+      random_(std::random_device{}()) {
 }
 
 // 析构函数
 WebSocketClient::~WebSocketClient() {
-    if (connected_) {
-        disconnect();
+    if (ws_) {
+        // 事件循环可能已经停止，直接关闭底层连接
+        boost::beast::get_lowest_layer(*ws_).close();
     }
 }
 
 // 连接到服务器
 bool WebSocketClient::connect(const std::string& server_url) {
-    try {
-        // 解析服务器URL
-        std::size_t protocol_end = server_url.find("://");
-        std::size_t host_start = protocol_end + 3;
-        std::size_t port_start = server_url.find(":", host_start);
-        std::size_t host_end = server_url.find("/", host_start);
-
-        if (protocol_end == std::string::npos || host_start >= server_url.size()) {
-            std::cerr << "无效的服务器URL格式: " << server_url << std::endl;
-            return false;
-        }
+    // 解析服务器URL: ws://host[:port][/target]
+    std::size_t protocol_end = server_url.find("://");
+    if (protocol_end == std::string::npos || protocol_end + 3 >= server_url.size()) {
+        std::cerr << "无效的服务器URL格式: " << server_url << std::endl;
+        return false;
+    }
 
-        std::string protocol = server_url.substr(0, protocol_end);
-        std::string host = server_url.substr(host_start, (port_start != std::string::npos ? port_start : host_end) - host_start);
-        std::string port = (port_start != std::string::npos && host_end != std::string::npos) ?
-                            server_url.substr(port_start + 1, host_end - port_start - 1) : "80";
+    std::size_t host_start = protocol_end + 3;
+    std::size_t host_end = server_url.find('/', host_start);
+    std::string authority = server_url.substr(host_start, host_end == std::string::npos ? std::string::npos : host_end - host_start);
+    std::size_t port_start = authority.find(':');
 
-        // 解析主机
-        auto const results = resolver_->resolve(host, port);
+    host_ = authority.substr(0, port_start);
+    port_ = port_start != std::string::npos ? authority.substr(port_start + 1) : "80";
+    target_ = host_end != std::string::npos ? server_url.substr(host_end) : "/";
+    if (host_.empty() || port_.empty()) {
+        std::cerr << "无效的服务器URL格式: " << server_url << std::endl;
+        return false;
+    }
 
-        // 创建套接字
-        boost::asio::ip::tcp::socket socket(*context_);
+    closing_ = false;
+    reconnect_attempt_ = 0;
+    start_connect();
+    return true;
+}
 
-        // 连接到服务器
-        boost::asio::connect(socket, results->begin(), results->end());
+// 创建新的流并开始解析服务器地址
+void WebSocketClient::start_connect() {
+    ++generation_;
+    ws_ = std::make_unique<websocket_stream>(io_context_);
+    read_buffer_.clear();
+    writing_ = false;
+    connected_ = false;
+    // 上一个连接中未收齐的分片不会再到达
+    chunk_assembler_ = ChunkAssembler();
+
+    // 解析主机
+    uint64_t generation = generation_;
+    resolver_.async_resolve(host_, port_,
+        [this, generation](const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::results_type results) {
+            if (generation == generation_) {
+                on_resolve(ec, std::move(results));
+            }
+        });
+}
 
-        // 设置WebSocket流
-        ws_->initiate(std::move(socket));
+// 主机名解析完成
+void WebSocketClient::on_resolve(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::results_type results) {
+    if (ec) {
+        fail(ec, "解析服务器地址失败");
+        return;
+    }
 
-        // 执行WebSocket握手
-        boost::beast::websocket::request_type req;
-        req.set(boost::beast::http::field::host, host);
-        req.set(boost::beast::http::field::user_agent, "P2PBoard-Client/1.0");
-        req.set(boost::beast::http::field::connection, "Upgrade");
-        req.set(boost::beast::http::field::upgrade, "websocket");
+    // 连接到服务器
+    auto& tcp = boost::beast::get_lowest_layer(*ws_);
+    tcp.expires_after(std::chrono::seconds(CONNECTION_TIMEOUT));
+    uint64_t generation = generation_;
+    tcp.async_connect(results, [this, generation](const boost::system::error_code& ec, const boost::asio::ip::tcp::endpoint&) {
+        if (generation == generation_) {
+            on_connect(ec);
+        }
+    });
+}
 
-        // 执行握手
-        boost::beast::error_code ec;
-        ws_->handshake(req, ec);
+// TCP连接完成
+void WebSocketClient::on_connect(const boost::system::error_code& ec) {
+    if (ec) {
+        fail(ec, "连接服务器失败");
+        return;
+    }
 
-        if (ec) {
-            std::cerr << "WebSocket握手失败: " << ec.message() << std::endl;
-            return false;
+    // 握手和关闭由WebSocket自身的超时控制
+    auto& tcp = boost::beast::get_lowest_layer(*ws_);
+    tcp.expires_never();
+    tcp.socket().set_option(boost::asio::ip::tcp::no_delay(true));
+    ws_->set_option(websocket::stream_base::timeout::suggested(boost::beast::role_type::client));
+    // 剪贴板内容不保证是合法的UTF-8，按二进制帧发送
+    ws_->binary(true);
+    ws_->set_option(websocket::stream_base::decorator([](websocket::request_type& req) {
+        req.set(boost::beast::http::field::user_agent, "P2PBoard-Client/1.0");
+    }));
+
+    // 执行WebSocket握手，目标路径选择房间，查询参数携带续传位置
+    std::string host = host_ + ":" + port_;
+    std::string target = target_ + (target_.find('?') == std::string::npos ? "?" : "&") +
+                         "since=" + std::to_string(last_seq_);
+    if (!epoch_.empty()) {
+        target += "&epoch=" + epoch_;
+    }
+    if (lazy_) {
+        target += "&lazy=1";
+    }
+    // 可以接收服务器边接收边转发的大消息
+    target += "&stream=1";
+    uint64_t generation = generation_;
+    ws_->async_handshake(host, target, [this, generation](const boost::system::error_code& ec) {
+        if (generation == generation_) {
+            on_handshake(ec);
         }
+    });
+}
 
-        // 成功连接
-        connected_ = true;
-        std::cout << "成功连接到服务器 " << server_url << std::endl;
+// WebSocket握手完成
+void WebSocketClient::on_handshake(const boost::system::error_code& ec) {
+    if (ec) {
+        fail(ec, "WebSocket握手失败");
+        return;
+    }
 
-        // 在单独的线程中启动读取消息
-        start_reading_thread();
+    // 成功连接
+    connected_ = true;
+    reconnect_attempt_ = 0;
+    std::cout << "成功连接到服务器 " << host_ << ":" << port_ << target_ << std::endl;
 
-        return true;
+    // 离线期间的最新内容排在队首发出
+    for (auto it = offline_.rbegin(); it != offline_.rend(); ++it) {
+        write_queue_.push_front(OutgoingMessage{it->first, std::move(it->second)});
+    }
+    offline_.clear();
 
-    } catch (const std::exception& e) {
-        std::cerr << "连接过程中发生异常: " << e.what() << std::endl;
-        return false;
+    // 服务器按连接记录可接收的格式，每次连接都要最先声明
+    if (accept_message_) {
+        write_queue_.push_front(OutgoingMessage{"", accept_message_});
     }
+
+    do_read();
+    do_write();
 }
 
 // 从服务器断开连接
 void WebSocketClient::disconnect() {
-    if (!connected_) {
+    if (closing_) {
         return;
     }
+    closing_ = true;
+    reconnect_timer_.cancel();
+    write_queue_.clear();
+    offline_.clear();
 
-    try {
-        // 关闭WebSocket连接
-        boost::beast::error_code ec;
-        ws_->close(boost::beast::websocket::close_reason::normal, ec);
+    if (!ws_) {
+        return;
+    }
+    if (!connected_) {
+        // 仍在连接中，取消所有操作
+        ++generation_;
+        resolver_.cancel();
+        boost::beast::get_lowest_layer(*ws_).close();
+        return;
+    }
 
-        if (ec) {
+    // 发送关闭帧，挂起的读取操作会在服务器回应后结束
+    ws_->async_close(websocket::close_reason(websocket::close_code::normal), [this](const boost::system::error_code& ec) {
+        if (ec && ec != boost::asio::error::operation_aborted) {
             std::cerr << "关闭WebSocket连接时出错: " << ec.message() << std::endl;
         }
-
-        // 停止读取线程
-        stopped_ = true;
-        if (reading_thread_.joinable()) {
-            reading_thread_.join();
-        }
-
         connected_ = false;
         std::cout << "已从服务器断开连接。" << std::endl;
-
-    } catch (const std::exception& e) {
-        std::cerr << "断开连接过程中发生异常: " << e.what() << std::endl;
-    }
+    });
 }
 
 // 发送消息到服务器
-void WebSocketClient::send_message(const std::string& message) {
+void WebSocketClient::send_message(const std::string& message, const std::string& selection) {
+    send_message(WireMessage{message, std::string(), nullptr}, selection);
+}
+
+// 发送线上格式的消息到服务器
+void WebSocketClient::send_message(WireMessage message, const std::string& selection) {
+    if (closing_) {
+        std::cerr << "无法发送消息: 客户端正在关闭" << std::endl;
+        return;
+    }
+
+    // 检查消息大小
+    size_t size = message.size();
+    if (size > MAX_MESSAGE_SIZE) {
+        std::cerr << "消息过大 (" << size << " 字节)。最大允许值: " << MAX_MESSAGE_SIZE << std::endl;
+        return;
+    }
+
+    auto payload = std::make_shared<const WireMessage>(std::move(message));
     if (!connected_) {
-        std::cerr << "无法发送消息: 未连接到服务器" << std::endl;
+        // 离线时只保留每个选择的最新内容
+        offline_[selection] = std::move(payload);
         return;
     }
 
-    try {
-        // 检查消息大小
-        if (message.length() > MAX_MESSAGE_SIZE) {
-            std::cerr << "消息过大 (" << message.length() << " 字节)。最大允许值: " << MAX_MESSAGE_SIZE << std::endl;
-            return;
+    write_queue_.push_back(OutgoingMessage{selection, std::move(payload)});
+    do_write();
+}
+
+// 发出队列中的下一条消息
+void WebSocketClient::do_write() {
+    if (writing_ || !connected_ || write_queue_.empty()) {
+        return;
+    }
+
+    writing_ = true;
+    // 队首消息、它引用的剪贴板快照和数据的映射在写入完成前保持存活
+    auto payload = write_queue_.front().payload;
+    auto views = std::make_shared<std::vector<ClipboardView>>();
+    uint64_t generation = generation_;
+    auto buffers = wire_buffers(*payload, *views);
+    ws_->async_write(buffers, [this, payload, views, generation](const boost::system::error_code& ec, std::size_t bytes) {
+        if (generation == generation_) {
+            on_write(ec, bytes);
         }
+    });
+}
 
-        // 发送消息
-        boost::beast::error_code ec;
-        boost::beast::flat_buffer buffer;
-        boost::beast::ostream(buffer) << message;
+// 写入完成
+void WebSocketClient::on_write(const boost::system::error_code& ec, std::size_t bytes) {
+    CLIENT_PROBE2(write_done, bytes, ec.value());
+    writing_ = false;
+    if (ec) {
+        fail(ec, "发送消息时出错");
+        return;
+    }
 
-        ws_->write(buffer.data(), ec);
+    if (!write_queue_.empty()) {
+        write_queue_.pop_front();
+    }
+    do_write();
+}
 
-        if (ec) {
-            std::cerr << "发送消息时出错: " << ec.message() << std::endl;
-            connected_ = false;  // 出错时标记为断开连接
+// 挂起下一个读取操作
+void WebSocketClient::do_read() {
+    uint64_t generation = generation_;
+    ws_->async_read(read_buffer_, [this, generation](const boost::system::error_code& ec, std::size_t bytes) {
+        if (generation == generation_) {
+            on_read(ec, bytes);
         }
+    });
+}
 
-    } catch (const std::exception& e) {
-        std::cerr << "发送消息时发生异常: " << e.what() << std::endl;
-        connected_ = false;  // 出错时标记为断开连接
+// 读取完成
+void WebSocketClient::on_read(const boost::system::error_code& ec, std::size_t) {
+    if (ec) {
+        fail(ec, "读取消息时出错");
+        return;
     }
+
+    // flat_buffer的数据是连续的，直接在缓冲区上解析，处理完再清空
+    auto data = read_buffer_.cdata();
+    handle_received_message(std::string_view(static_cast<const char*>(data.data()), data.size()));
+    read_buffer_.consume(read_buffer_.size());
+
+    do_read();
 }
 
-// 处理传入消息
-void WebSocketClient::process_messages() {
-    if (!connected_) {
+// 连接失败或断开
+void WebSocketClient::fail(const boost::system::error_code& ec, const char* what) {
+    connected_ = false;
+
+    // 主动断开时读写操作以错误结束属于正常情况
+    if (closing_) {
+        write_queue_.clear();
         return;
     }
 
-    try {
-        // 读取任何可用消息
-        boost::beast::error_code ec;
-        boost::beast::flat_buffer buffer;
+    if (ec == websocket::error::closed) {
+        std::cerr << "服务器关闭了连接" << std::endl;
+    } else {
+        std::cerr << what << ": " << ec.message() << std::endl;
+    }
+
+    // 未确认发出的消息折叠回离线队列，每个选择只保留最新的一条
+    for (auto& pending : write_queue_) {
+        // 格式声明在重连握手后重新发送
+        if (pending.payload != accept_message_) {
+            offline_[pending.selection] = std::move(pending.payload);
+        }
+    }
+    write_queue_.clear();
 
-        // 读取消息
-        ws_->read(buffer, ec);
+    // 使旧连接上仍未完成的操作的回调失效
+    ++generation_;
+    boost::beast::get_lowest_layer(*ws_).close();
+    schedule_reconnect();
+}
 
-        if (ec) {
-            if (ec != boost::beast::websocket::error::closed) {
-                std::cerr << "读取消息时出错: " << ec.message() << std::endl;
-            }
-            connected_ = false;  // 出错时标记为断开连接
-            return;
+// 按指数退避安排下一次重连
+void WebSocketClient::schedule_reconnect() {
+    // 上限按失败次数翻倍，实际延迟在[0, 上限]内均匀随机，
+    // 避免大量设备在同一次网络中断后同时重连
+    unsigned shift = std::min(reconnect_attempt_, 16u);
+    long long ceiling = std::min<long long>(static_cast<long long>(RECONNECT_INITIAL_DELAY_MS) << shift,
+                                            RECONNECT_MAX_DELAY_MS);
+    std::uniform_int_distribution<long long> jitter(0, ceiling);
+    auto delay = std::chrono::milliseconds(jitter(random_));
+    ++reconnect_attempt_;
+
+    std::cerr << delay.count() << " 毫秒后重新连接" << std::endl;
+    reconnect_timer_.expires_after(delay);
+    reconnect_timer_.async_wait([this](const boost::system::error_code& ec) {
+        if (!ec && !closing_) {
+            start_connect();
         }
+    });
+}
 
-        // 提取消息内容
-        std::string message = boost::beast::buffers_to_string(buffer.data());
+// 设置消息回调
+void WebSocketClient::set_message_handler(MessageCallback on_message) {
+    on_message_ = std::move(on_message);
+}
+
+// 请求按需获取模式
+void WebSocketClient::set_lazy(bool lazy) {
+    lazy_ = lazy;
+}
 
-        // 处理接收到的消息
-        handle_received_message(message);
+// 设置端到端加密
+void WebSocketClient::set_cipher(PayloadCipher* cipher) {
+    cipher_ = cipher;
+}
 
-    } catch (const std::exception& e) {
-        std::cerr << "处理消息时发生异常: " << e.what() << std::endl;
-        connected_ = false;  // 出错时标记为断开连接
+// 声明本客户端可以接收的剪贴板格式
+void WebSocketClient::set_accepted_formats(const std::vector<std::string>& formats) {
+    ProtocolMessage message;
+    message.set("type", "accept");
+    for (const auto& format : formats) {
+        message.body += format + "\n";
+    }
+    accept_message_ = std::make_shared<const WireMessage>(message.take_wire());
+
+    if (connected_) {
+        write_queue_.push_back(OutgoingMessage{"", accept_message_});
+        do_write();
     }
 }
 
-// 启动读取线程
-void WebSocketClient::start_reading_thread() {
-    stopped_ = false;
-    reading_thread_ = std::thread([this]() {
-        while (!stopped_) {
-            // 检查传入消息
-            process_messages();
+// 处理接收到的消息
+void WebSocketClient::handle_received_message(std::string_view frame) {
+    ProtocolMessage parsed;
+    std::string_view body;
+    if (!ProtocolMessage::parse_head(frame, parsed, body)) {
+        std::cerr << "收到格式错误的消息" << std::endl;
+        return;
+    }
 
-            // 小延迟以防止忙等待
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    // 大消息被服务器分片发送，收齐后再按完整消息处理
+    if (parsed.get("type") == "chunk") {
+        ProtocolMessage complete;
+        if (chunk_assembler_.feed(parsed, body, complete)) {
+            size_t size = std::strtoull(parsed.get("total", "0").c_str(), nullptr, 10);
+            dispatch_message(complete, size);
         }
-    });
+        return;
+    }
+
+    parsed.body.assign(body.data(), body.size());
+    dispatch_message(parsed, frame.size());
 }
 
-// 处理接收到的消息
-void WebSocketClient::handle_received_message(const std::string& message) {
-    // 简单实现：仅打印消息
-    std::cout << "从服务器接收到: " << message << std::endl;
-
-    // 在实际实现中，您应该:
-    // 1. 验证消息格式
-    // 2. 如果是剪贴板更新则更新本地剪贴板
-    // 3. 根据消息内容触发适当的操作
-
-    // 目前假设所有消息都是剪贴板内容
-    // 这将由剪贴板管理器处理
-}
\ No newline at end of file
+// 处理一条完整的消息
+void WebSocketClient::dispatch_message(ProtocolMessage& parsed, size_t size) {
+    // 追踪的消息记录收齐的时间，分片消息以最后一片为准
+    std::string trace = parsed.get("trace");
+    if (!trace.empty()) {
+        parsed.set("t-arrive", std::to_string(LatencyTracer::now_micros()));
+    }
+    CLIENT_PROBE2(receive, size, trace.c_str());
+
+    // 记录续传位置；获取结果中的序号是之前通告的，不代表房间进度
+    std::string seq = parsed.get("seq");
+    if (!seq.empty() && parsed.get("type") != "fetch-result") {
+        last_seq_ = std::strtoull(seq.c_str(), nullptr, 10);
+        epoch_ = parsed.get("epoch");
+    }
+
+    // 加密的内容先原地解密；配置了加密时不接受明文内容，以免服务器或未配对的设备注入
+    std::string type = parsed.get("type");
+    bool carries_content = type == "clip" || (type == "fetch-result" && parsed.get("status") != "gone");
+    if (!parsed.get("enc").empty()) {
+        if (!cipher_ || !cipher_->open(parsed)) {
+            std::cerr << "无法解密收到的剪贴板内容(配对密钥或房间不同，或是重放的旧消息)" << std::endl;
+            return;
+        }
+    } else if (cipher_ && carries_content) {
+        std::cerr << "忽略未加密的剪贴板内容" << std::endl;
+        return;
+    }
+
+    // 剪贴板更新和格式通告交给回调处理
+    if (on_message_) {
+        on_message_(parsed);
+        return;
+    }
+
+    std::cout << "从服务器接收到: " << parsed.body << std::endl;
+}
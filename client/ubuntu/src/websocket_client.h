@@ -1,18 +1,26 @@
 #ifndef WEBSOCKET_CLIENT_H
 #define WEBSOCKET_CLIENT_H
 
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
 #include <memory>
+#include <random>
 #include <string>
-#include <thread>
-#include <atomic>
+#include <string_view>
+#include <vector>
 
 // Boost库
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
 #include <boost/beast/websocket.hpp>
 
+#include "protocol.h"
+
 // 前向声明
 class ClipboardManager;
+class PayloadCipher;
 
 /**
  * @class WebSocketClient
@@ -25,14 +33,31 @@ class ClipboardManager;
  *
  * 客户端连接到服务器，在剪贴板内容变化时发送内容，
  * 并从其他客户端接收剪贴板更新。
+ *
+ * 所有操作都是异步的，运行在调用方提供的io_context上：
+ * 始终挂起一个读取操作，消息到达后立即处理；
+ * 发送的消息进入队列，由单个写操作依次发出。
+ * 除构造和析构外，所有方法都必须在io_context线程上调用。
+ *
+ * 连接失败或断开后按带随机抖动的指数退避自动重连。
+ * 离线期间每个选择只保留最新的一条待发送内容，重连后发出。
+ * 重连握手携带最后收到的房间序号，服务器只补发错过的消息。
  */
 class WebSocketClient {
 public:
+    /**
+     * @brief 消息回调类型，参数为收到的完整消息(剪贴板更新、格式通告等)
+     *
+     * 回调可以用ProtocolMessage::take_item把消息体移入剪贴板条目。
+     */
+    using MessageCallback = std::function<void(ProtocolMessage&)>;
+
     /**
      * @brief 构造函数
-     * 使用默认设置初始化WebSocket客户端
+     *
+     * @param io_context 客户端事件循环
      */
-    WebSocketClient();
+    explicit WebSocketClient(boost::asio::io_context& io_context);
 
     /**
      * @brief 析构函数
@@ -41,67 +66,199 @@ public:
     ~WebSocketClient();
 
     /**
-     * @brief 连接到服务器
+     * @brief 开始连接到服务器
      *
-     * @param server_url 服务器URL，格式为ws://host:port
-     * @return 连接成功返回true，否则返回false
+     * 解析、连接和握手都在事件循环中异步完成，
+     * 握手成功后开始接收消息，连接失败或断开时自动重连。
+     *
+     * @param server_url 服务器URL，格式为ws://host[:port][/room]
+     * @return URL格式正确返回true，否则返回false
      */
     bool connect(const std::string& server_url);
 
     /**
      * @brief 从服务器断开连接
+     *
+     * 发送关闭帧并停止重连，队列中尚未发出的消息被丢弃。
      */
     void disconnect();
 
     /**
      * @brief 发送消息到服务器
      *
+     * 消息进入发送队列后立即返回。未连接时只保留每个选择最新的一条，
+     * 连接建立后发出。
+     *
      * @param message 要发送的消息（通常是剪贴板内容）
+     * @param selection 消息所属的选择，离线时同一选择的旧消息被替换
      */
-    void send_message(const std::string& message);
+    void send_message(const std::string& message, const std::string& selection = "clipboard");
 
     /**
-     * @brief 处理来自服务器的传入消息
+     * @brief 发送线上格式的消息到服务器
+     *
+     * 头部和消息体作为一个WebSocket消息分散写出，引用的剪贴板快照不被复制。
+     * 其余行为与发送字符串消息相同。
      *
-     * 此方法应定期调用以检查新消息。
-     * 它读取任何可用消息并调用handle_received_message。
+     * @param message 要发送的消息
+     * @param selection 消息所属的选择
      */
-    void process_messages();
+    void send_message(WireMessage message, const std::string& selection = "clipboard");
+
+    /**
+     * @brief 设置消息回调
+     *
+     * 分片消息重组完成后才会调用。
+     */
+    void set_message_handler(MessageCallback on_message);
+
+    /**
+     * @brief 声明本客户端可以接收的剪贴板格式
+     *
+     * 每次连接建立后最先发送，服务器据此向房间内其他客户端
+     * 通告需要读取的格式。
+     *
+     * @param formats MIME类型列表
+     */
+    void set_accepted_formats(const std::vector<std::string>& formats);
+
+    /**
+     * @brief 请求按需获取模式
+     *
+     * 服务器对较大的剪贴板内容只发送type=announce通告，
+     * 需要数据时发送type=fetch获取。下次建立连接时生效。
+     */
+    void set_lazy(bool lazy);
+
+    /**
+     * @brief 设置端到端加密
+     *
+     * 设置后收到的加密内容先解密再交给回调，无法解密的内容和明文剪贴板内容被丢弃。
+     * 发送的内容由调用方加密。
+     *
+     * @param cipher 加密器，为空时不解密；生命周期必须长于客户端
+     */
+    void set_cipher(PayloadCipher* cipher);
 
 private:
+    using websocket_stream = boost::beast::websocket::stream<boost::beast::tcp_stream>;
+
+    // 待发送的消息
+    struct OutgoingMessage {
+        std::string selection;
+        std::shared_ptr<const WireMessage> payload;
+    };
+
+    // 创建新的流并开始解析服务器地址
+    void start_connect();
+
+    // 按指数退避安排下一次重连
+    void schedule_reconnect();
+
+    // 主机名解析完成
+    void on_resolve(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::results_type results);
+
+    // TCP连接完成
+    void on_connect(const boost::system::error_code& ec);
+
+    // WebSocket握手完成
+    void on_handshake(const boost::system::error_code& ec);
+
+    // 挂起下一个读取操作
+    void do_read();
+
+    // 读取完成
+    void on_read(const boost::system::error_code& ec, std::size_t bytes);
+
+    // 发出队列中的下一条消息
+    void do_write();
+
+    // 写入完成
+    void on_write(const boost::system::error_code& ec, std::size_t bytes);
+
+    // 连接失败或断开，安排重连
+    void fail(const boost::system::error_code& ec, const char* what);
+
     /**
-     * @brief 启动读取线程
+     * @brief 处理来自服务器的一个WebSocket消息
+     *
+     * 直接从读缓冲区解析头部，消息体只复制一次：普通消息复制到消息体，
+     * 分片的数据追加到重组中的消息体。
      *
-     * 此方法启动后台线程，持续检查来自服务器的传入消息。
+     * @param frame 读缓冲区中的消息
      */
-    void start_reading_thread();
+    void handle_received_message(std::string_view frame);
 
     /**
-     * @brief 处理来自服务器的消息
+     * @brief 处理一条完整的消息
      *
-     * 此方法处理从服务器接收的消息。在此实现中，
-     * 它只是打印消息，但在实际应用中它会根据消息内容
-     * 更新本地剪贴板或触发其他操作。
+     * 记录续传位置，解密加密的内容，把消息交给回调，没有回调时只打印。
      *
-     * @param message 接收的消息
+     * @param message 完整的消息
+     * @param size 消息在线上的长度
      */
-    void handle_received_message(const std::string& message);
+    void dispatch_message(ProtocolMessage& message, size_t size);
 
-    // Boost ASIO上下文用于I/O操作
-    std::unique_ptr<boost::asio::io_context> context_;
+    // 客户端事件循环
+    boost::asio::io_context& io_context_;
 
     // DNS查找解析器
-    std::unique_ptr<boost::asio::ip::tcp::resolver> resolver_;
+    boost::asio::ip::tcp::resolver resolver_;
 
-    // WebSocket流
-    std::unique_ptr<boost::beast::websocket::stream<boost::asio::ip::tcp::socket>> ws_;
+    // WebSocket流，每次连接重新创建
+    std::unique_ptr<websocket_stream> ws_;
+
+    // 服务器地址
+    std::string host_;
+    std::string port_;
+    std::string target_;
+
+    // 读取缓冲区，在多次读取之间复用
+    boost::beast::flat_buffer read_buffer_;
+
+    // 等待发送的消息
+    std::deque<OutgoingMessage> write_queue_;
+
+    // 离线期间每个选择最新的待发送内容
+    std::map<std::string, std::shared_ptr<const WireMessage>> offline_;
+
+    // 连接代数，旧连接上迟到的回调被忽略
+    uint64_t generation_ = 0;
+
+    // 重连定时器和连续失败次数
+    boost::asio::steady_timer reconnect_timer_;
+    unsigned reconnect_attempt_ = 0;
+
+    // 退避抖动的随机数
+    std::minstd_rand random_;
+
+    // 最后收到的房间序号和服务器纪元，重连时用于续传
+    uint64_t last_seq_ = 0;
+    std::string epoch_;
+
+    // 是否有写操作正在进行
+    bool writing_ = false;
 
     // 连接状态
-    std::atomic<bool> connected_;
-    std::atomic<bool> stopped_;
+    bool connected_ = false;
+
+    // 是否正在主动断开
+    bool closing_ = false;
+
+    // 是否请求按需获取模式
+    bool lazy_ = false;
+
+    // 端到端加密，未配置时为空
+    PayloadCipher* cipher_ = nullptr;
+
+    // 消息回调
+    MessageCallback on_message_;
+
+    // 格式声明消息，为空时不发送
+    std::shared_ptr<const WireMessage> accept_message_;
 
-    // 读取线程
-    std::thread reading_thread_;
+    // 服务器分片发送的大消息重组器
+    ChunkAssembler chunk_assembler_;
 };
 
-#endif // WEBSOCKET_CLIENT_H
\ No newline at end of file
+#endif // WEBSOCKET_CLIENT_H
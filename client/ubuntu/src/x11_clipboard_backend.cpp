@@ -0,0 +1,750 @@
+#include "x11_clipboard_backend.h"
+#include "config.h"
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <stdexcept>
+#include <poll.h>
+
+// X11错误处理器，只记录错误
+static int x11_error_handler(Display *display, XErrorEvent *error)
+{
+    char text[256];
+    XGetErrorText(display, error->error_code, text, sizeof(text));
+    std::cerr << "X11错误: " << text << std::endl;
+    return 0;
+}
+
+// 析构函数
+X11ClipboardBackend::~X11ClipboardBackend()
+{
+    stop();
+
+    if (display_)
+    {
+        if (window_)
+        {
+            XDestroyWindow(display_, window_);
+        }
+        XCloseDisplay(display_);
+    }
+}
+
+// 连接X服务器
+void X11ClipboardBackend::initialize()
+{
+    // 连接到X11服务器
+    display_ = XOpenDisplay(nullptr);
+    if (!display_)
+    {
+        throw std::runtime_error("连接X11显示失败");
+    }
+
+    // 获取原子
+    atom_primary_ = XInternAtom(display_, "PRIMARY", False);
+    atom_clipboard_ = XInternAtom(display_, "CLIPBOARD", False);
+    atom_utf8_string_ = XInternAtom(display_, "UTF8_STRING", False);
+    atom_incr_ = XInternAtom(display_, "INCR", False);
+    atom_targets_ = XInternAtom(display_, "TARGETS", False);
+    atom_text_ = XInternAtom(display_, "TEXT", False);
+    atom_text_plain_utf8_ = XInternAtom(display_, "text/plain;charset=utf-8", False);
+
+    // 检查X11是否可用
+    if (atom_primary_ == 0 || atom_clipboard_ == 0 || atom_utf8_string_ == 0)
+    {
+        throw std::runtime_error("X11原子不可用");
+    }
+
+    // 检查XFixes扩展，用于接收选择所有者变化事件
+    int xfixes_error_base = 0;
+    if (!XFixesQueryExtension(display_, &xfixes_event_base_, &xfixes_error_base))
+    {
+        throw std::runtime_error("X服务器不支持XFixes扩展");
+    }
+
+    // 请求方窗口可能在传输过程中销毁，不能让默认错误处理器退出进程
+    XSetErrorHandler(x11_error_handler);
+
+    // 超过单个请求能携带的属性数据时使用INCR分段发送；
+    // 请求长度以4字节为单位，扣除ChangeProperty请求头
+    max_property_bytes_ = static_cast<size_t>(XMaxRequestSize(display_)) * 4 - 100;
+
+    // 创建不映射的隐藏窗口，作为选择转换的目标
+    window_ = XCreateSimpleWindow(display_, DefaultRootWindow(display_),
+                                  0, 0, 1, 1, 0, 0, 0);
+    // INCR传输通过属性变化事件推进
+    XSelectInput(display_, window_, PropertyChangeMask);
+
+    std::cout << "X11剪贴板管理器初始化成功" << std::endl;
+}
+
+// 开始监控剪贴板
+void X11ClipboardBackend::start(boost::asio::io_context &io_context, Listener &listener)
+{
+    listener_ = &listener;
+
+    // 订阅CLIPBOARD的所有者变化，跟踪PRIMARY时也订阅PRIMARY；启动时读取一次当前内容
+    XFixesSelectSelectionInput(display_, window_, atom_clipboard_, XFixesSetSelectionOwnerNotifyMask);
+    start_fetch(atom_clipboard_, CurrentTime);
+    if (track_primary_)
+    {
+        XFixesSelectSelectionInput(display_, window_, atom_primary_, XFixesSetSelectionOwnerNotifyMask);
+        start_fetch(atom_primary_, CurrentTime);
+    }
+
+    // 由事件循环监视X连接，而不是阻塞在XNextEvent上
+    watcher_ = std::make_unique<boost::asio::posix::stream_descriptor>(io_context, ConnectionNumber(display_));
+    process_events();
+    wait_events();
+}
+
+// 停止监控
+void X11ClipboardBackend::stop()
+{
+    if (watcher_)
+    {
+        watcher_->cancel();
+        // X连接的文件描述符由Xlib关闭
+        watcher_->release();
+        watcher_.reset();
+    }
+    refuse_lazy_requests();
+    listener_ = nullptr;
+}
+
+// 获取当前剪贴板文本
+std::string X11ClipboardBackend::read_text()
+{
+    // 选中的文本(PRIMARY)不算作剪贴板内容
+    return read_selection_text(atom_clipboard_);
+}
+
+// 取得选择所有权并提供条目
+void X11ClipboardBackend::offer(ClipboardSelection selection, std::shared_ptr<const ClipboardItem> item)
+{
+    Atom atom = selection_atom(selection);
+    if (atom == atom_clipboard_)
+    {
+        refuse_lazy_requests();
+        lazy_formats_.clear();
+    }
+
+    // 数据在转换请求到达时才写到请求方的属性上
+    outgoing_[atom] = std::move(item);
+    take_ownership(atom);
+    XFlush(display_);
+}
+
+// 取得CLIPBOARD所有权并声明格式
+void X11ClipboardBackend::offer_lazy(const std::vector<std::string> &formats)
+{
+    refuse_lazy_requests();
+    outgoing_.erase(atom_clipboard_);
+    lazy_formats_ = formats;
+    take_ownership(atom_clipboard_);
+    XFlush(display_);
+}
+
+// 选择对应的原子
+Atom X11ClipboardBackend::selection_atom(ClipboardSelection selection) const
+{
+    return selection == ClipboardSelection::Primary ? atom_primary_ : atom_clipboard_;
+}
+
+// 提供按需获取的数据
+void X11ClipboardBackend::provide(std::shared_ptr<const ClipboardItem> item)
+{
+    if (item)
+    {
+        outgoing_[atom_clipboard_] = std::move(item);
+        lazy_formats_.clear();
+    }
+
+    // 回复等待中的请求，没有数据时全部拒绝
+    std::vector<XSelectionRequestEvent> requests;
+    requests.swap(lazy_requests_);
+    for (const auto &request : requests)
+    {
+        answer_selection_request(request);
+    }
+    XFlush(display_);
+}
+
+// 获取特定选择的文本
+//
+// 同步版本，供未启用事件监控时使用。以选择原子本身作为目标属性请求转换，
+// 最多等待一秒，只取走本窗口的SelectionNotify事件，不影响事件队列中的其他事件。
+std::string X11ClipboardBackend::read_selection_text(Atom selection)
+{
+    // 没有所有者，所以没有数据
+    Window owner = XGetSelectionOwner(display_, selection);
+    if (owner == None)
+    {
+        return "";
+    }
+    // 我们自己持有选择时，转换请求要等事件循环处理，直接返回提供的内容
+    if (owner == window_)
+    {
+        auto held = outgoing_.find(selection);
+        const ClipboardPart *text = held != outgoing_.end() ? find_part(*held->second, TEXT_MIME_TYPE) : nullptr;
+        return text ? text->data.str() : "";
+    }
+
+    // 请求所有者把选择转换为UTF8_STRING并写到我们窗口的属性上
+    XConvertSelection(display_, selection, atom_utf8_string_, selection, window_, CurrentTime);
+    XFlush(display_);
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    XEvent event;
+    for (;;)
+    {
+        if (XCheckTypedWindowEvent(display_, window_, SelectionNotify, &event) &&
+            event.xselection.selection == selection)
+        {
+            std::string content;
+            Atom type = None;
+            if (event.xselection.property == None ||
+                !read_property(event.xselection.property, content, type) || type == atom_incr_)
+            {
+                // 转换失败；同步读取不支持INCR大数据传输
+                return "";
+            }
+            return content;
+        }
+
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0)
+        {
+            return "";
+        }
+        struct pollfd pfd = {ConnectionNumber(display_), POLLIN, 0};
+        poll(&pfd, 1, static_cast<int>(remaining.count()));
+    }
+}
+
+// 读取并删除我们窗口上的属性，数据追加到content末尾
+bool X11ClipboardBackend::read_property(Atom property, std::string &content, Atom &type)
+{
+    int format = 0;
+    unsigned long nitems = 0;
+    unsigned long bytes_after = 0;
+    unsigned char *data = nullptr;
+
+    // 长度以32位为单位，一次读取全部数据
+    if (XGetWindowProperty(display_, window_, property, 0, LONG_MAX / 4, True,
+                           AnyPropertyType, &type, &format, &nitems, &bytes_after, &data) != Success)
+    {
+        return false;
+    }
+
+    if (data)
+    {
+        // format为32时Xlib按long存储每一项
+        size_t unit = format == 32 ? sizeof(long) : static_cast<size_t>(format / 8);
+        content.append(reinterpret_cast<char *>(data), nitems * unit);
+        XFree(data);
+    }
+    return true;
+}
+
+// 等待X连接可读
+void X11ClipboardBackend::wait_events()
+{
+    // 先把缓冲的请求发出去，否则可能永远等不到回复
+    XFlush(display_);
+    watcher_->async_wait(boost::asio::posix::stream_descriptor::wait_read,
+                         [this](const boost::system::error_code &ec)
+                         {
+                             if (ec)
+                             {
+                                 return;
+                             }
+                             process_events();
+                             wait_events();
+                         });
+}
+
+// 处理X连接上所有待处理的事件
+void X11ClipboardBackend::process_events()
+{
+    // XPending会读取套接字中已到达的数据，队列中的事件全部处理完后才重新等待
+    while (XPending(display_) > 0)
+    {
+        XEvent event;
+        XNextEvent(display_, &event);
+
+        if (event.type == xfixes_event_base_ + XFixesSelectionNotify)
+        {
+            auto *notify = reinterpret_cast<XFixesSelectionNotifyEvent *>(&event);
+            // 忽略自己持有的选择、被清空的选择和不跟踪的PRIMARY
+            if (notify->owner == window_ || notify->owner == None ||
+                (notify->selection == atom_primary_ && !track_primary_))
+            {
+                continue;
+            }
+            start_fetch(notify->selection, notify->selection_timestamp);
+        }
+        else if (event.type == SelectionNotify)
+        {
+            handle_selection_notify(event.xselection);
+        }
+        else if (event.type == PropertyNotify)
+        {
+            if (event.xproperty.window == window_)
+            {
+                handle_property_notify(event.xproperty);
+            }
+            else
+            {
+                continue_incr_send(event.xproperty);
+            }
+        }
+        else if (event.type == SelectionRequest)
+        {
+            handle_selection_request(event.xselectionrequest);
+        }
+        else if (event.type == SelectionClear)
+        {
+            handle_selection_clear(event.xselectionclear);
+        }
+        else if (event.type == DestroyNotify)
+        {
+            // 请求方窗口销毁，放弃向它进行的INCR发送
+            Window window = event.xdestroywindow.window;
+            for (auto it = outgoing_transfers_.begin(); it != outgoing_transfers_.end();)
+            {
+                it = it->first.first == window ? outgoing_transfers_.erase(it) : std::next(it);
+            }
+        }
+    }
+}
+
+// 处理选择转换结果
+void X11ClipboardBackend::handle_selection_notify(const XSelectionEvent &event)
+{
+    auto it = fetches_.find(event.selection);
+    if (it == fetches_.end() || event.target != it->second.current)
+    {
+        return;
+    }
+    Fetch &fetch = it->second;
+
+    if (event.target == atom_targets_)
+    {
+        // 所有者不支持TARGETS时targets为空
+        std::vector<Atom> targets;
+        std::string data;
+        Atom type = None;
+        if (event.property != None && read_property(event.property, data, type) && type == XA_ATOM)
+        {
+            for (size_t offset = 0; offset + sizeof(long) <= data.size(); offset += sizeof(long))
+            {
+                long atom = 0;
+                memcpy(&atom, data.data() + offset, sizeof(long));
+                targets.push_back(static_cast<Atom>(atom));
+            }
+        }
+        fetch.pending = choose_targets(targets);
+        fetch_next_target(event.selection);
+        return;
+    }
+
+    if (event.property == None)
+    {
+        // 所有者不支持UTF8_STRING时退回到STRING
+        if (event.target == atom_utf8_string_)
+        {
+            fetch.current = XA_STRING;
+            XConvertSelection(display_, event.selection, XA_STRING, event.selection,
+                              window_, fetch.time);
+            return;
+        }
+        fetch_next_target(event.selection);
+        return;
+    }
+
+    std::string content;
+    Atom type = None;
+    if (!read_property(event.property, content, type))
+    {
+        fetch_next_target(event.selection);
+        return;
+    }
+
+    if (type == atom_incr_)
+    {
+        // 删除属性(已在读取时完成)即表示开始INCR传输，后续数据通过PropertyNotify到达。
+        // 属性值是总长度的下限，按它预留空间，各段直接追加到同一个缓冲区
+        std::string &buffer = incr_transfers_[event.property];
+        buffer.clear();
+        long total = 0;
+        if (content.size() >= sizeof(long))
+        {
+            memcpy(&total, content.data(), sizeof(long));
+        }
+        if (total > 0)
+        {
+            buffer.reserve(std::min(static_cast<size_t>(total), MAX_MESSAGE_SIZE - fetch.bytes));
+        }
+        return;
+    }
+
+    add_part(fetch, event.target, std::move(content));
+    fetch_next_target(event.selection);
+}
+
+// 开始读取选择的各种格式
+void X11ClipboardBackend::start_fetch(Atom selection, Time time)
+{
+    // 新的所有者取代进行中的读取
+    incr_transfers_.erase(selection);
+    fetches_[selection] = Fetch{time, atom_targets_, {}, {}, 0, false};
+    XConvertSelection(display_, selection, atom_targets_, selection, window_, time);
+}
+
+// 根据所有者支持的目标选出要转换的目标
+std::vector<Atom> X11ClipboardBackend::choose_targets(const std::vector<Atom> &targets)
+{
+    std::vector<Atom> chosen;
+    if (targets.empty())
+    {
+        // 不支持TARGETS的旧客户端，只尝试文本
+        chosen.push_back(atom_utf8_string_);
+        return chosen;
+    }
+
+    auto offered = [&targets](Atom atom)
+    {
+        return std::find(targets.begin(), targets.end(), atom) != targets.end();
+    };
+    for (Atom text : {atom_utf8_string_, atom_text_plain_utf8_, static_cast<Atom>(XA_STRING)})
+    {
+        if (offered(text))
+        {
+            chosen.push_back(text);
+            break;
+        }
+    }
+    for (const auto &format : wanted_formats_)
+    {
+        Atom atom = XInternAtom(display_, format.c_str(), False);
+        if (offered(atom))
+        {
+            chosen.push_back(atom);
+        }
+    }
+    return chosen;
+}
+
+// 转换下一个目标，全部完成后报告读到的条目
+void X11ClipboardBackend::fetch_next_target(Atom selection)
+{
+    auto it = fetches_.find(selection);
+    if (it == fetches_.end())
+    {
+        return;
+    }
+
+    Fetch &fetch = it->second;
+    fetch.overflow = false;
+    if (fetch.pending.empty())
+    {
+        ClipboardItem item = std::move(fetch.item);
+        fetches_.erase(it);
+        if (listener_ && !item.empty())
+        {
+            listener_->on_local_change(selection == atom_primary_ ? ClipboardSelection::Primary
+                                                                  : ClipboardSelection::Clipboard,
+                                       std::move(item));
+        }
+        return;
+    }
+
+    fetch.current = fetch.pending.front();
+    fetch.pending.erase(fetch.pending.begin());
+    XConvertSelection(display_, selection, fetch.current, selection, window_, fetch.time);
+}
+
+// 记录转换得到的一种表示
+void X11ClipboardBackend::add_part(Fetch &fetch, Atom target, std::string data)
+{
+    if (data.empty())
+    {
+        return;
+    }
+    std::string mime = target_mime(target);
+    if (fetch.bytes + data.size() > MAX_MESSAGE_SIZE)
+    {
+        std::cerr << "剪贴板内容超过最大消息大小，已忽略格式 " << mime << std::endl;
+        return;
+    }
+    fetch.bytes += data.size();
+    fetch.item.push_back(ClipboardPart{std::move(mime), std::move(data)});
+}
+
+// 目标原子对应的MIME类型
+std::string X11ClipboardBackend::target_mime(Atom target)
+{
+    // 严格来说STRING应为Latin-1，这里与UTF8_STRING同样看待
+    if (target == atom_utf8_string_ || target == atom_text_plain_utf8_ || target == XA_STRING)
+    {
+        return TEXT_MIME_TYPE;
+    }
+
+    char *name = XGetAtomName(display_, target);
+    if (!name)
+    {
+        return "";
+    }
+    std::string mime = name;
+    XFree(name);
+    return mime;
+}
+
+// 处理INCR传输中的属性变化
+void X11ClipboardBackend::handle_property_notify(const XPropertyEvent &event)
+{
+    auto it = incr_transfers_.find(event.atom);
+    auto fetch = fetches_.find(event.atom);
+    if (event.state != PropertyNewValue || it == incr_transfers_.end() || fetch == fetches_.end())
+    {
+        return;
+    }
+
+    // 直接追加到已收到的数据后面，不经过临时缓冲区
+    size_t received = it->second.size();
+    Atom type = None;
+    if (!read_property(event.atom, it->second, type))
+    {
+        incr_transfers_.erase(it);
+        fetch_next_target(event.atom);
+        return;
+    }
+
+    // 长度为0的块表示传输结束
+    if (it->second.size() == received)
+    {
+        std::string content = std::move(it->second);
+        incr_transfers_.erase(it);
+        if (!fetch->second.overflow)
+        {
+            add_part(fetch->second, fetch->second.current, std::move(content));
+        }
+        fetch_next_target(event.atom);
+        return;
+    }
+
+    // 超过上限后仍要读完并丢弃剩余的块，所有者才能结束传输
+    if (fetch->second.overflow || fetch->second.bytes + it->second.size() > MAX_MESSAGE_SIZE)
+    {
+        if (!fetch->second.overflow)
+        {
+            std::cerr << "剪贴板内容超过最大消息大小，放弃读取该格式" << std::endl;
+            fetch->second.overflow = true;
+        }
+        it->second.clear();
+    }
+}
+
+// 取得选择的所有权
+//
+// 只取得选择所有权，数据在SelectionRequest到达时由事件循环提供
+void X11ClipboardBackend::take_ownership(Atom selection)
+{
+    XSetSelectionOwner(display_, selection, window_, CurrentTime);
+    if (XGetSelectionOwner(display_, selection) == window_)
+    {
+        owned_selections_.insert(selection);
+    }
+    else
+    {
+        std::cerr << "获取X11选择所有权失败" << std::endl;
+    }
+}
+
+// 响应其他客户端的选择转换请求
+void X11ClipboardBackend::handle_selection_request(const XSelectionRequestEvent &request)
+{
+    // 按通告持有CLIPBOARD时，除TARGETS外的请求等数据取回后再回复
+    if (request.selection == atom_clipboard_ && !outgoing_.count(atom_clipboard_) && !lazy_formats_.empty() &&
+        request.target != atom_targets_ && request.owner == window_ && owned_selections_.count(request.selection))
+    {
+        lazy_requests_.push_back(request);
+        if (listener_)
+        {
+            listener_->on_data_requested();
+        }
+        return;
+    }
+    answer_selection_request(request);
+}
+
+// 按我们提供的内容回复选择转换请求，没有可提供的数据时拒绝
+void X11ClipboardBackend::answer_selection_request(const XSelectionRequestEvent &request)
+{
+    // 旧客户端可能不指定属性，此时使用目标原子作为属性
+    Atom property = request.property == None ? request.target : request.property;
+    bool served = request.owner == window_ &&
+                  owned_selections_.count(request.selection) &&
+                  serve_target(request.selection, request.requestor, property, request.target);
+    send_selection_notify(request, served ? property : None);
+}
+
+// 通知请求方转换结果，property为None表示拒绝
+void X11ClipboardBackend::send_selection_notify(const XSelectionRequestEvent &request, Atom property)
+{
+    XEvent reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.type = SelectionNotify;
+    reply.xselection.requestor = request.requestor;
+    reply.xselection.selection = request.selection;
+    reply.xselection.target = request.target;
+    reply.xselection.property = property;
+    reply.xselection.time = request.time;
+    XSendEvent(display_, request.requestor, False, NoEventMask, &reply);
+}
+
+// 拒绝所有等待按需获取的请求
+void X11ClipboardBackend::refuse_lazy_requests()
+{
+    if (lazy_requests_.empty())
+    {
+        return;
+    }
+
+    // 等待期间没有数据，回复时全部拒绝
+    std::vector<XSelectionRequestEvent> requests;
+    requests.swap(lazy_requests_);
+    for (const auto &request : requests)
+    {
+        send_selection_notify(request, None);
+    }
+    XFlush(display_);
+}
+
+// 把我们为选择提供的内容按请求的目标写到请求方的属性上
+bool X11ClipboardBackend::serve_target(Atom selection, Window requestor, Atom property, Atom target)
+{
+    auto held = outgoing_.find(selection);
+    std::shared_ptr<const ClipboardItem> item = held != outgoing_.end() ? held->second : nullptr;
+    if (target == atom_targets_)
+    {
+        // 按通告持有CLIPBOARD时声明通告的格式
+        std::vector<std::string> formats;
+        if (item)
+        {
+            for (const auto &part : *item)
+            {
+                formats.push_back(part.mime);
+            }
+        }
+        else if (selection == atom_clipboard_)
+        {
+            formats = lazy_formats_;
+        }
+
+        // 纯文本以各种常见的文本目标提供，其他表示以MIME类型作为目标
+        std::vector<Atom> targets = {atom_targets_};
+        for (const auto &format : formats)
+        {
+            if (format == TEXT_MIME_TYPE)
+            {
+                targets.insert(targets.end(), {atom_utf8_string_, atom_text_plain_utf8_, atom_text_, XA_STRING});
+            }
+            else
+            {
+                targets.push_back(XInternAtom(display_, format.c_str(), False));
+            }
+        }
+        XChangeProperty(display_, requestor, property, XA_ATOM, 32, PropModeReplace,
+                        reinterpret_cast<unsigned char *>(targets.data()), static_cast<int>(targets.size()));
+        return true;
+    }
+
+    if (!item)
+    {
+        return false;
+    }
+
+    Atom type = target;
+    std::string mime = TEXT_MIME_TYPE;
+    if (target == atom_text_)
+    {
+        type = atom_utf8_string_;
+    }
+    else if (target != atom_utf8_string_ && target != atom_text_plain_utf8_ && target != XA_STRING)
+    {
+        // 严格来说STRING应为Latin-1，这里直接提供原始字节；其他目标按MIME类型查找表示
+        mime = target_mime(target);
+    }
+
+    const ClipboardPart *part = find_part(*item, mime);
+    if (!part)
+    {
+        return false;
+    }
+
+    ClipboardView payload = part->data.view();
+    if (payload.size() > max_property_bytes_)
+    {
+        // INCR：先写入总长度，请求方每删除一次属性我们写入下一段
+        XSelectInput(display_, requestor, PropertyChangeMask | StructureNotifyMask);
+        long size = static_cast<long>(payload.size());
+        XChangeProperty(display_, requestor, property, atom_incr_, 32, PropModeReplace,
+                        reinterpret_cast<unsigned char *>(&size), 1);
+        outgoing_transfers_[{requestor, property}] = OutgoingTransfer{type, item, payload, 0};
+        return true;
+    }
+
+    XChangeProperty(display_, requestor, property, type, 8, PropModeReplace,
+                    reinterpret_cast<const unsigned char *>(payload.data()), static_cast<int>(payload.size()));
+    return true;
+}
+
+// 请求方删除属性后写入INCR传输的下一段
+void X11ClipboardBackend::continue_incr_send(const XPropertyEvent &event)
+{
+    auto it = outgoing_transfers_.find({event.window, event.atom});
+    if (event.state != PropertyDelete || it == outgoing_transfers_.end())
+    {
+        return;
+    }
+
+    OutgoingTransfer &transfer = it->second;
+    size_t chunk = std::min(max_property_bytes_, transfer.payload.size() - transfer.offset);
+    XChangeProperty(display_, event.window, event.atom, transfer.type, 8, PropModeReplace,
+                    reinterpret_cast<const unsigned char *>(transfer.payload.data() + transfer.offset),
+                    static_cast<int>(chunk));
+    transfer.offset += chunk;
+
+    // 写入长度为0的段表示传输结束，同一窗口没有其他传输时停止监听它
+    if (chunk == 0)
+    {
+        outgoing_transfers_.erase(it);
+        auto next = outgoing_transfers_.lower_bound({event.window, 0});
+        if (next == outgoing_transfers_.end() || next->first.first != event.window)
+        {
+            XSelectInput(display_, event.window, NoEventMask);
+        }
+    }
+}
+
+// 其他客户端取得了选择
+void X11ClipboardBackend::handle_selection_clear(const XSelectionClearEvent &event)
+{
+    owned_selections_.erase(event.selection);
+    // 进行中的INCR传输各自持有数据
+    outgoing_.erase(event.selection);
+    if (event.selection == atom_clipboard_)
+    {
+        lazy_formats_.clear();
+        refuse_lazy_requests();
+        if (listener_)
+        {
+            listener_->on_ownership_lost();
+        }
+    }
+}
@@ -0,0 +1,172 @@
+#ifndef X11_CLIPBOARD_BACKEND_H
+#define X11_CLIPBOARD_BACKEND_H
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/Xfixes.h>
+
+#include "clipboard_backend.h"
+
+/**
+ * @class X11ClipboardBackend
+ * @brief X11剪贴板后端
+ *
+ * 通过XFixes订阅PRIMARY和CLIPBOARD的所有者变化，先转换TARGETS再依次转换需要的目标，
+ * 支持INCR增量传输。PRIMARY只在启用跟踪时读取；两个选择分别设置，各自持有提供的数据，
+ * 转换请求到达时才写到请求方的属性上，较大的数据用INCR分段发送。
+ */
+class X11ClipboardBackend : public ClipboardBackend
+{
+public:
+    X11ClipboardBackend() = default;
+    ~X11ClipboardBackend() override;
+
+    X11ClipboardBackend(const X11ClipboardBackend &) = delete;
+    X11ClipboardBackend &operator=(const X11ClipboardBackend &) = delete;
+
+    const char *name() const override { return "X11"; }
+    void initialize() override;
+    void start(boost::asio::io_context &io_context, Listener &listener) override;
+    void stop() override;
+    std::string read_text() override;
+    void offer(ClipboardSelection selection, std::shared_ptr<const ClipboardItem> item) override;
+    void offer_lazy(const std::vector<std::string> &formats) override;
+    void provide(std::shared_ptr<const ClipboardItem> item) override;
+
+private:
+    // 从其他客户端读取一个选择的各种格式：先转换TARGETS，再依次转换需要的目标
+    struct Fetch
+    {
+        Time time;
+        // 正在转换的目标
+        Atom current;
+        // 尚未转换的目标
+        std::vector<Atom> pending;
+        // 已读到的表示
+        ClipboardItem item;
+        size_t bytes;
+        // 当前目标的INCR数据超过上限，读完后丢弃
+        bool overflow;
+    };
+
+    // 向其他客户端进行的INCR发送
+    struct OutgoingTransfer
+    {
+        Atom type;
+        // 持有条目和数据的视图，传输期间数据保持映射
+        std::shared_ptr<const ClipboardItem> item;
+        ClipboardView payload;
+        size_t offset;
+    };
+
+    // 同步读取特定选择的文本
+    std::string read_selection_text(Atom selection);
+
+    // 选择对应的原子
+    Atom selection_atom(ClipboardSelection selection) const;
+
+    // 取得选择的所有权
+    void take_ownership(Atom selection);
+
+    // 响应其他客户端的选择转换请求，按通告持有选择时先获取数据
+    void handle_selection_request(const XSelectionRequestEvent &request);
+
+    // 按我们提供的内容回复选择转换请求
+    void answer_selection_request(const XSelectionRequestEvent &request);
+
+    // 通知请求方转换结果，property为None表示拒绝
+    void send_selection_notify(const XSelectionRequestEvent &request, Atom property);
+
+    // 拒绝所有等待按需获取的请求
+    void refuse_lazy_requests();
+
+    // 把我们为选择提供的内容按请求的目标写到请求方的属性上，不支持的目标返回false
+    bool serve_target(Atom selection, Window requestor, Atom property, Atom target);
+
+    // 请求方删除属性后写入INCR传输的下一段
+    void continue_incr_send(const XPropertyEvent &event);
+
+    // 其他客户端取得了选择
+    void handle_selection_clear(const XSelectionClearEvent &event);
+
+    // 读取并删除我们窗口上的属性，数据追加到content末尾
+    bool read_property(Atom property, std::string &content, Atom &type);
+
+    // 开始读取选择的各种格式
+    void start_fetch(Atom selection, Time time);
+
+    // 根据所有者支持的目标选出要转换的目标，纯文本在最前
+    std::vector<Atom> choose_targets(const std::vector<Atom> &targets);
+
+    // 转换下一个目标，全部完成后报告读到的条目
+    void fetch_next_target(Atom selection);
+
+    // 记录转换得到的一种表示
+    void add_part(Fetch &fetch, Atom target, std::string data);
+
+    // 目标原子对应的MIME类型
+    std::string target_mime(Atom target);
+
+    // 等待X连接可读
+    void wait_events();
+
+    // 处理X连接上所有待处理的事件
+    void process_events();
+
+    // 处理选择转换结果
+    void handle_selection_notify(const XSelectionEvent &event);
+
+    // 处理INCR传输中的属性变化
+    void handle_property_notify(const XPropertyEvent &event);
+
+    Display *display_ = nullptr;
+    Atom atom_primary_ = None;
+    Atom atom_clipboard_ = None;
+    Atom atom_utf8_string_ = None;
+    Atom atom_incr_ = None;
+    Atom atom_targets_ = None;
+    Atom atom_text_ = None;
+    Atom atom_text_plain_utf8_ = None;
+
+    // 用于接收选择数据的隐藏窗口
+    Window window_ = 0;
+
+    // XFixes事件基值
+    int xfixes_event_base_ = 0;
+
+    // 监视X连接文件描述符
+    std::unique_ptr<boost::asio::posix::stream_descriptor> watcher_;
+
+    // 正在进行INCR增量传输的选择，值为已收到的数据
+    std::map<Atom, std::string> incr_transfers_;
+
+    // 正在进行的读取，按选择索引
+    std::map<Atom, Fetch> fetches_;
+
+    // 我们持有选择时提供的内容，按选择索引，所有转换请求共享同一份数据
+    std::map<Atom, std::shared_ptr<const ClipboardItem>> outgoing_;
+
+    // 按通告持有CLIPBOARD时声明的格式，数据取回后清空
+    std::vector<std::string> lazy_formats_;
+
+    // 等待按需获取的转换请求
+    std::vector<XSelectionRequestEvent> lazy_requests_;
+
+    // 我们当前持有的选择
+    std::set<Atom> owned_selections_;
+
+    // 正在进行的INCR发送，按(请求方窗口, 属性)索引
+    std::map<std::pair<Window, Atom>, OutgoingTransfer> outgoing_transfers_;
+
+    // 单次ChangeProperty能携带的最大字节数，超过时使用INCR
+    size_t max_property_bytes_ = 0;
+};
+
+#endif // X11_CLIPBOARD_BACKEND_H
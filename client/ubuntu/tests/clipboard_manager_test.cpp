@@ -0,0 +1,226 @@
+// ClipboardManager的无头测试
+//
+// 通过MemoryClipboardBackend驱动ClipboardManager，不需要显示服务器，检查：
+//   - 去抖：窗口内的连续复制只报告最后一次
+//   - 去重：与上次报告或写入的内容相同的变化不报告，回传的内容不重复写入
+//   - 按需获取：粘贴时只获取一次，超过LAZY_FETCH_TIMEOUT_MS未取回时粘贴失败，下次粘贴重新获取；
+//     远端通告取代本地复制后，再次复制之前的内容仍然报告
+//   - PRIMARY：未启用时不报告；启用后两次报告之间至少间隔设定的时间，期间只报告最后一次
+//
+// 用法: clipboard_manager_test，全部通过时退出码为0
+#include "clipboard_manager.h"
+#include "config.h"
+#include "memory_clipboard_backend.h"
+#include "test_support.h"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+    using test_support::test_clock;
+    using std::chrono::milliseconds;
+
+    ClipboardItem text_item(const std::string& text) {
+        return ClipboardItem{ClipboardPart{TEXT_MIME_TYPE, ClipboardData(text)}};
+    }
+
+    std::string text_of(const std::shared_ptr<const ClipboardItem>& item) {
+        const ClipboardPart* part = item ? find_part(*item, TEXT_MIME_TYPE) : nullptr;
+        return part ? part->data.str() : "";
+    }
+
+    // 一次报告
+    struct Report {
+        ClipboardSelection selection;
+        std::string text;
+        test_clock::time_point time;
+    };
+
+    // 由内存后端驱动的管理器，记录每次报告
+    struct Fixture {
+        boost::asio::io_context io;
+        MemoryClipboardBackend* backend = nullptr;
+        std::unique_ptr<ClipboardManager> manager;
+        std::vector<Report> reports;
+
+        Fixture(milliseconds debounce, bool primary_sync, milliseconds primary_interval) {
+            auto memory = std::make_unique<MemoryClipboardBackend>();
+            backend = memory.get();
+            manager = std::make_unique<ClipboardManager>(std::move(memory));
+            manager->initialize();
+            manager->set_debounce_window(debounce);
+            manager->set_primary_sync(primary_sync, primary_interval);
+            manager->start_monitoring(io, [this](ClipboardSelection selection,
+                                                 std::shared_ptr<const ClipboardItem> item) {
+                reports.push_back(Report{selection, text_of(item), test_clock::now()});
+            });
+        }
+
+        ~Fixture() {
+            manager->stop_monitoring();
+        }
+
+        // 在delay之后执行action
+        void at(milliseconds delay, std::function<void()> action) {
+            auto timer = std::make_shared<boost::asio::steady_timer>(io, delay);
+            timer->async_wait([timer, action](const boost::system::error_code& ec) {
+                if (!ec) {
+                    action();
+                }
+            });
+        }
+
+        // 运行事件循环直到duration之后
+        void run_for(milliseconds duration) {
+            io.restart();
+            io.run_for(duration);
+        }
+    };
+
+    // 窗口内的连续复制只报告最后一次，且在最后一次复制之后一个窗口报告
+    void test_debounce() {
+        Fixture f(milliseconds(100), false, milliseconds(0));
+        test_clock::time_point last_copy;
+        f.at(milliseconds(0), [&] { f.backend->copy(text_item("a")); });
+        f.at(milliseconds(20), [&] { f.backend->copy(text_item("b")); });
+        f.at(milliseconds(40), [&] {
+            f.backend->copy(text_item("c"));
+            last_copy = test_clock::now();
+        });
+        f.run_for(milliseconds(400));
+
+        CHECK(f.reports.size() == 1);
+        if (!f.reports.empty()) {
+            CHECK(f.reports[0].text == "c");
+            CHECK(f.reports[0].selection == ClipboardSelection::Clipboard);
+            CHECK(f.reports[0].time - last_copy >= milliseconds(100));
+        }
+    }
+
+    // 相同内容的再次复制不报告；远端写入的内容回传时不报告，也不再写入
+    void test_dedup() {
+        Fixture f(milliseconds(0), false, milliseconds(0));
+        f.backend->copy(text_item("same"));
+        f.backend->copy(text_item("same"));
+        CHECK(f.reports.size() == 1);
+
+        CHECK(f.manager->set_clipboard_item(text_item("remote")));
+        CHECK(text_of(f.backend->content()) == "remote");
+        CHECK(!f.manager->set_clipboard_item(text_item("remote")));
+        f.backend->copy(text_item("remote"));
+        CHECK(f.reports.size() == 1);
+
+        f.backend->copy(text_item("new"));
+        CHECK(f.reports.size() == 2);
+        if (f.reports.size() == 2) {
+            CHECK(f.reports[1].text == "new");
+        }
+    }
+
+    // 等待中的粘贴只触发一次获取，超时后都失败；下次粘贴重新获取，取回后粘贴成功
+    void test_lazy_fetch_timeout() {
+        Fixture f(milliseconds(0), false, milliseconds(0));
+        int fetches = 0;
+        f.manager->set_lazy_clipboard({TEXT_MIME_TYPE}, [&] { ++fetches; });
+
+        std::vector<std::string> pasted;
+        int failed = 0;
+        auto paste = [&] {
+            f.backend->paste([&](std::shared_ptr<const ClipboardItem> item) {
+                if (item) {
+                    pasted.push_back(text_of(item));
+                } else {
+                    ++failed;
+                }
+            });
+        };
+
+        paste();
+        paste();
+        CHECK(fetches == 1);
+        f.run_for(milliseconds(LAZY_FETCH_TIMEOUT_MS - 500));
+        CHECK(failed == 0);
+        f.run_for(milliseconds(1000));
+        CHECK(failed == 2);
+        CHECK(pasted.empty());
+
+        paste();
+        CHECK(fetches == 2);
+        f.manager->resolve_lazy_clipboard(std::make_shared<const ClipboardItem>(text_item("fetched")));
+        CHECK(pasted.size() == 1 && pasted[0] == "fetched");
+
+        // 取回的内容不作为本地变化报告，之后的粘贴不再获取
+        paste();
+        CHECK(fetches == 2);
+        CHECK(pasted.size() == 2);
+        CHECK(f.reports.empty());
+    }
+
+    // 远端通告取代本地复制后，再次复制之前的内容仍然报告
+    void test_lazy_offer_resets_dedup() {
+        Fixture f(milliseconds(0), false, milliseconds(0));
+        f.backend->copy(text_item("a"));
+        CHECK(f.reports.size() == 1);
+
+        f.manager->set_lazy_clipboard({TEXT_MIME_TYPE}, [] {});
+        f.backend->copy(text_item("a"));
+        CHECK(f.reports.size() == 2);
+        if (f.reports.size() == 2) {
+            CHECK(f.reports[1].text == "a");
+        }
+    }
+
+    // 未启用PRIMARY同步时选中文本不报告
+    void test_primary_disabled() {
+        Fixture f(milliseconds(0), false, milliseconds(0));
+        f.backend->select(text_item("selected"));
+        f.run_for(milliseconds(50));
+        CHECK(f.reports.empty());
+    }
+
+    // 启用后第一次选中立即报告，间隔内的后续选中合并为一次，在间隔结束时报告最后的值；
+    // CLIPBOARD不受PRIMARY限速影响
+    void test_primary_rate_limit() {
+        Fixture f(milliseconds(0), true, milliseconds(300));
+        test_clock::time_point first;
+        f.at(milliseconds(0), [&] {
+            first = test_clock::now();
+            f.backend->select(text_item("s1"));
+        });
+        for (int i = 2; i <= 5; ++i) {
+            f.at(milliseconds(20 * i), [&, i] { f.backend->select(text_item("s" + std::to_string(i))); });
+        }
+        f.at(milliseconds(120), [&] { f.backend->copy(text_item("copied")); });
+        f.run_for(milliseconds(600));
+
+        std::vector<Report> primary;
+        std::vector<Report> clipboard;
+        for (const auto& report : f.reports) {
+            (report.selection == ClipboardSelection::Primary ? primary : clipboard).push_back(report);
+        }
+        CHECK(primary.size() == 2);
+        if (primary.size() == 2) {
+            CHECK(primary[0].text == "s1");
+            CHECK(primary[1].text == "s5");
+            CHECK(primary[1].time - first >= milliseconds(300));
+        }
+        CHECK(clipboard.size() == 1);
+        if (!clipboard.empty()) {
+            CHECK(clipboard[0].time - first < milliseconds(300));
+        }
+    }
+}
+
+int main() {
+    return test_support::run_tests<>({
+        {"debounce", test_debounce},
+        {"dedup", test_dedup},
+        {"lazy_fetch_timeout", test_lazy_fetch_timeout},
+        {"lazy_offer_resets_dedup", test_lazy_offer_resets_dedup},
+        {"primary_disabled", test_primary_disabled},
+        {"primary_rate_limit", test_primary_rate_limit},
+    });
+}
@@ -0,0 +1,185 @@
+// 协议消息解析和分片重组的测试
+//
+// 检查：
+//   - 解析：信封和纯文本消息的头部和消息体，只解析头部时消息体指向原始数据
+//   - 取出条目：只有一种表示时消息体移入条目，多种表示按parts切分
+//   - 分片重组：头部在第一个分片内、头部跨越分片、纯文本消息，偏移不连续时丢弃流，
+//     服务器放弃直通转发时(abort分片)丢弃已收到的部分
+//
+// 用法: protocol_test，全部通过时退出码为0
+#include "protocol.h"
+#include "test_support.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+    using test_support::make_text;
+
+    // 服务器发送的分片
+    ProtocolMessage chunk_header(const std::string& stream, size_t offset, size_t total) {
+        ProtocolMessage chunk;
+        chunk.set("type", "chunk");
+        chunk.set("stream", stream);
+        chunk.set("offset", std::to_string(offset));
+        chunk.set("total", std::to_string(total));
+        return chunk;
+    }
+
+    // 把原始消息按size切成分片依次交给重组器，返回最后一片的结果
+    bool feed_all(ChunkAssembler& assembler, const std::string& stream, const std::string& raw,
+                  size_t size, ProtocolMessage& complete) {
+        bool done = false;
+        for (size_t offset = 0; offset < raw.size(); offset += size) {
+            std::string_view data = std::string_view(raw).substr(offset, size);
+            done = assembler.feed(chunk_header(stream, offset, raw.size()), data, complete);
+            if (done != (offset + data.size() == raw.size())) {
+                return false;
+            }
+        }
+        return done;
+    }
+
+    // 带信封的消息和纯文本消息
+    void test_parse() {
+        ProtocolMessage message;
+        message.set("type", "clip");
+        message.set("seq", "7");
+        message.body = "hello";
+        std::string raw = message.serialize();
+
+        ProtocolMessage parsed;
+        CHECK(ProtocolMessage::parse(raw, parsed));
+        CHECK(parsed.get("type") == "clip");
+        CHECK(parsed.get("seq") == "7");
+        CHECK(parsed.body == "hello");
+
+        ProtocolMessage head;
+        std::string_view body;
+        CHECK(ProtocolMessage::parse_head(raw, head, body));
+        CHECK(head.get("seq") == "7");
+        CHECK(head.body.empty());
+        CHECK(body == "hello");
+        CHECK(body.data() == raw.data() + raw.size() - 5);
+
+        CHECK(ProtocolMessage::parse("plain text", parsed));
+        CHECK(parsed.get("type") == "clip");
+        CHECK(parsed.body == "plain text");
+
+        CHECK(!ProtocolMessage::parse(std::string(ENVELOPE_MAGIC) + "type: clip\n", parsed));
+    }
+
+    // 只有一种表示时消息体的存储直接移入条目
+    void test_take_item() {
+        ProtocolMessage message;
+        message.set("mime", "text/html");
+        message.body = make_text(1000);
+        const char* storage = message.body.data();
+
+        ClipboardItem item;
+        CHECK(message.take_item(item));
+        CHECK(message.body.empty());
+        CHECK(item.size() == 1);
+        if (item.size() == 1) {
+            CHECK(item[0].mime == "text/html");
+            CHECK(item[0].data.view().data() == storage);
+            CHECK(item[0].data.str() == make_text(1000));
+        }
+
+        ProtocolMessage multi;
+        multi.set_item(ClipboardItem{ClipboardPart{TEXT_MIME_TYPE, ClipboardData("text")},
+                                     ClipboardPart{"text/html", ClipboardData("<b>text</b>")}});
+        CHECK(multi.take_item(item));
+        CHECK(item.size() == 2);
+        if (item.size() == 2) {
+            CHECK(item[0].data.str() == "text");
+            CHECK(item[1].mime == "text/html");
+            CHECK(item[1].data.str() == "<b>text</b>");
+        }
+    }
+
+    // 头部在第一个分片内，之后的分片直接追加到消息体
+    void test_chunks() {
+        ProtocolMessage message;
+        message.set("type", "clip");
+        message.set("seq", "3");
+        message.body = make_text(100000);
+        std::string raw = message.serialize();
+
+        ChunkAssembler assembler;
+        ProtocolMessage complete;
+        CHECK(feed_all(assembler, "1", raw, 16384, complete));
+        CHECK(complete.get("seq") == "3");
+        CHECK(complete.body == message.body);
+    }
+
+    // 头部跨越分片时先暂存，纯文本消息整条都是消息体
+    void test_chunked_head_and_plain_text() {
+        ProtocolMessage message;
+        message.set("type", "clip");
+        message.set("trace", make_text(200));
+        message.body = make_text(5000);
+        std::string raw = message.serialize();
+
+        ChunkAssembler assembler;
+        ProtocolMessage complete;
+        CHECK(feed_all(assembler, "1", raw, 64, complete));
+        CHECK(complete.get("trace") == make_text(200));
+        CHECK(complete.body == message.body);
+
+        std::string text = make_text(40000);
+        CHECK(feed_all(assembler, "2", text, 16384, complete));
+        CHECK(complete.get("type") == "clip");
+        CHECK(complete.body == text);
+    }
+
+    // 偏移不连续时丢弃流，之后同一编号的新流从头重组
+    void test_chunk_gap() {
+        ProtocolMessage message;
+        message.body = make_text(50000);
+        std::string raw = message.serialize();
+        std::string_view view(raw);
+
+        ChunkAssembler assembler;
+        ProtocolMessage complete;
+        CHECK(!assembler.feed(chunk_header("1", 0, raw.size()), view.substr(0, 16384), complete));
+        CHECK(!assembler.feed(chunk_header("1", 32768, raw.size()), view.substr(32768), complete));
+        CHECK(feed_all(assembler, "1", raw, 16384, complete));
+        CHECK(complete.body == message.body);
+    }
+
+    // 服务器放弃直通转发：已收到的部分被丢弃，之后的分片不能接着拼上，同一编号的新流从头重组
+    void test_chunk_abort() {
+        ProtocolMessage message;
+        message.set("type", "clip");
+        message.body = make_text(30000);
+        std::string raw = message.serialize();
+        std::string_view view(raw);
+
+        ChunkAssembler assembler;
+        ProtocolMessage complete;
+        CHECK(!assembler.feed(chunk_header("5", 0, raw.size()), view.substr(0, 16384), complete));
+
+        ProtocolMessage abort;
+        abort.set("type", "chunk");
+        abort.set("stream", "5");
+        abort.set("abort", "1");
+        CHECK(!assembler.feed(abort, "", complete));
+        CHECK(!assembler.feed(chunk_header("5", 16384, raw.size()), view.substr(16384), complete));
+
+        CHECK(feed_all(assembler, "5", raw, 16384, complete));
+        CHECK(complete.body == message.body);
+    }
+}
+
+int main() {
+    return test_support::run_tests<>({
+        {"parse", test_parse},
+        {"take_item", test_take_item},
+        {"chunks", test_chunks},
+        {"chunked_head_and_plain_text", test_chunked_head_and_plain_text},
+        {"chunk_gap", test_chunk_gap},
+        {"chunk_abort", test_chunk_abort},
+    });
+}
@@ -0,0 +1,51 @@
+#!/usr/bin/env bash
+# 在临时的无头sway中运行测试程序
+#
+# 用法: run_headless_sway.sh <测试程序> [参数...]
+# sway的无头后端提供wlr数据控制协议(weston不提供)，合成器使用临时的XDG_RUNTIME_DIR，
+# 不影响当前桌面。sway没能启动时退出码为77(跳过)，否则为测试程序的退出码。
+set -euo pipefail
+
+if [ $# -lt 1 ]; then
+    echo "用法: $0 <测试程序> [参数...]" >&2
+    exit 2
+fi
+
+runtime_dir=$(mktemp -d)
+sway_pid=
+cleanup() {
+    if [ -n "$sway_pid" ]; then
+        kill "$sway_pid" 2>/dev/null || true
+        wait "$sway_pid" 2>/dev/null || true
+    fi
+    rm -rf "$runtime_dir"
+}
+trap cleanup EXIT
+
+unset WAYLAND_DISPLAY DISPLAY SWAYSOCK
+export XDG_RUNTIME_DIR=$runtime_dir
+WLR_BACKENDS=headless WLR_LIBINPUT_NO_DEVICES=1 WLR_RENDERER=pixman \
+    sway -c /dev/null >"$runtime_dir/sway.log" 2>&1 &
+sway_pid=$!
+
+# 等待合成器创建套接字，最多5秒
+for _ in $(seq 50); do
+    socket=$(find "$runtime_dir" -maxdepth 1 -name 'wayland-*' -type s -print -quit)
+    if [ -n "$socket" ]; then
+        break
+    fi
+    if ! kill -0 "$sway_pid" 2>/dev/null; then
+        break
+    fi
+    sleep 0.1
+done
+if [ -z "${socket:-}" ]; then
+    echo "无头sway没有启动，跳过" >&2
+    cat "$runtime_dir/sway.log" >&2
+    exit 77
+fi
+
+export WAYLAND_DISPLAY=$(basename "$socket")
+status=0
+"$@" || status=$?
+exit $status
@@ -0,0 +1,142 @@
+#ifndef TEST_SUPPORT_H
+#define TEST_SUPPORT_H
+
+// 客户端测试共用的检查宏、事件循环线程和后端事件记录
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "clipboard_backend.h"
+
+// 失败的检查数，main按它决定退出码
+inline int test_failures = 0;
+
+// 条件不成立时输出位置并记为失败，继续执行后面的检查
+#define CHECK(condition)                                                             \
+    do {                                                                             \
+        if (!(condition)) {                                                          \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": 检查失败: " #condition "\n"; \
+            ++test_failures;                                                         \
+        }                                                                            \
+    } while (0)
+
+namespace test_support {
+    using test_clock = std::chrono::steady_clock;
+    using std::chrono::milliseconds;
+
+    // 由可打印字符组成的文本，每个位置的字符不同周期重复，错位或丢段都会被发现
+    inline std::string make_text(size_t size) {
+        std::string text(size, ' ');
+        for (size_t i = 0; i < size; ++i) {
+            text[i] = static_cast<char>('!' + (i * 7 + i / 4093) % 94);
+        }
+        return text;
+    }
+
+    // 记录后端报告的事件，可以在其他线程上等待
+    class RecordingListener : public ClipboardBackend::Listener {
+    public:
+        void on_local_change(ClipboardSelection selection, ClipboardItem item) override {
+            const ClipboardPart* part = find_part(item, TEXT_MIME_TYPE);
+            std::lock_guard<std::mutex> lock(mutex_);
+            changes_.push_back({selection, part ? part->data.str() : ""});
+            changed_.notify_all();
+        }
+
+        void on_data_requested() override {
+            std::function<void()> action;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                ++data_requests_;
+                action = on_request_;
+            }
+            if (action) {
+                action();
+            }
+        }
+
+        void on_ownership_lost() override {}
+
+        // 按需获取的请求到达时在事件循环线程上执行action
+        void set_on_request(std::function<void()> action) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            on_request_ = std::move(action);
+        }
+
+        // 等待第count次报告，超时返回false
+        bool wait_for(size_t count, milliseconds timeout) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            return changed_.wait_for(lock, timeout, [&] { return changes_.size() >= count; });
+        }
+
+        std::vector<std::pair<ClipboardSelection, std::string>> changes() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return changes_;
+        }
+
+        int data_requests() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return data_requests_;
+        }
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable changed_;
+        std::vector<std::pair<ClipboardSelection, std::string>> changes_;
+        int data_requests_ = 0;
+        std::function<void()> on_request_;
+    };
+
+    // 在后台线程上运行的事件循环
+    class EventLoop {
+    public:
+        EventLoop() : work_(boost::asio::make_work_guard(io_)), thread_([this] { io_.run(); }) {}
+
+        ~EventLoop() {
+            work_.reset();
+            io_.stop();
+            thread_.join();
+        }
+
+        boost::asio::io_context& io() { return io_; }
+
+        // 在事件循环线程上执行action并等待完成
+        template <typename Action>
+        void call(Action action) {
+            std::promise<void> done;
+            boost::asio::post(io_, [&] {
+                action();
+                done.set_value();
+            });
+            done.get_future().wait();
+        }
+
+    private:
+        boost::asio::io_context io_;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_;
+        std::thread thread_;
+    };
+
+    // 依次运行各项测试并输出结果，返回main的退出码
+    template <typename... Args>
+    int run_tests(const std::vector<std::pair<const char*, void (*)(Args...)>>& tests, Args... args) {
+        for (const auto& test : tests) {
+            int before = test_failures;
+            test.second(args...);
+            std::cout << (test_failures == before ? "通过 " : "失败 ") << test.first << std::endl;
+        }
+        return test_failures == 0 ? 0 : 1;
+    }
+}
+
+#endif // TEST_SUPPORT_H
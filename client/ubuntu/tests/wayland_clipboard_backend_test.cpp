@@ -0,0 +1,444 @@
+// WaylandClipboardBackend的测试，在无头合成器中运行
+//
+// 事件循环在后台线程上驱动后端，主线程用独立的Wayland连接通过wlr数据控制协议扮演其他应用，检查：
+//   - 变化检测：其他应用设置CLIPBOARD后，后端在毫秒级报告新内容；
+//     超过管道缓冲区的内容分多次非阻塞读取，完整报告
+//   - 发送：后端提供几MB的文本，其他应用可以多次完整读取同一份数据；PRIMARY与CLIPBOARD分别提供
+//   - 按需获取：读取按通告持有的选择时后端请求数据，提供后读取方收到内容
+//   - 空闲：没有剪贴板变化时事件循环不执行任何处理器
+//
+// 核心数据设备只在获得键盘焦点时工作，无头环境中无法测试，因此需要支持wlr数据控制协议的合成器
+// (如sway的无头后端，weston不支持该协议)。
+//
+// 用法: run_headless_sway.sh wayland_clipboard_backend_test
+// 没有可用的合成器或合成器不支持wlr数据控制协议时退出码为77(跳过)，全部通过时为0
+#include "config.h"
+#include "test_support.h"
+#include "wayland_clipboard_backend.h"
+#include "wlr-data-control-unstable-v1-client-protocol.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace {
+    using namespace test_support;
+
+    std::shared_ptr<const ClipboardItem> text_item(const std::string& text) {
+        return std::make_shared<const ClipboardItem>(ClipboardItem{ClipboardPart{TEXT_MIME_TYPE, ClipboardData(text)}});
+    }
+
+    // 通过wlr数据控制协议扮演其他应用的Wayland客户端，所有方法在主线程上调用
+    class RawClient {
+    public:
+        // 连接合成器，不支持wlr数据控制协议时supported()为false
+        RawClient() {
+            display_ = wl_display_connect(nullptr);
+            if (!display_) {
+                return;
+            }
+            registry_ = wl_display_get_registry(display_);
+            wl_registry_add_listener(registry_, &registry_listener_, this);
+            wl_display_roundtrip(display_);
+            if (seat_ && manager_) {
+                device_ = zwlr_data_control_manager_v1_get_data_device(manager_, seat_);
+                zwlr_data_control_device_v1_add_listener(device_, &device_listener_, this);
+                wl_display_roundtrip(display_);
+            }
+        }
+
+        ~RawClient() {
+            for (auto* source : {clipboard_source_, primary_source_}) {
+                if (source) {
+                    zwlr_data_control_source_v1_destroy(source);
+                }
+            }
+            for (auto& offer : mime_types_) {
+                zwlr_data_control_offer_v1_destroy(offer.first);
+            }
+            if (device_) {
+                zwlr_data_control_device_v1_destroy(device_);
+            }
+            if (registry_) {
+                wl_registry_destroy(registry_);
+            }
+            if (display_) {
+                wl_display_disconnect(display_);
+            }
+        }
+
+        bool connected() const { return display_ != nullptr; }
+
+        bool supported() const { return device_ != nullptr; }
+
+        // 数据控制协议版本2起支持PRIMARY
+        bool supports_primary() const { return manager_version_ >= 2; }
+
+        // 设置选择并以纯文本提供text，读取请求在dispatch中回复
+        void own(ClipboardSelection selection, const std::string& text) {
+            auto* source = zwlr_data_control_manager_v1_create_data_source(manager_);
+            zwlr_data_control_source_v1_add_listener(source, &source_listener_, this);
+            zwlr_data_control_source_v1_offer(source, TEXT_MIME_TYPE);
+            zwlr_data_control_source_v1_offer(source, "UTF8_STRING");
+            if (selection == ClipboardSelection::Primary) {
+                replace_source(primary_source_, source);
+                zwlr_data_control_device_v1_set_primary_selection(device_, source);
+            } else {
+                replace_source(clipboard_source_, source);
+                zwlr_data_control_device_v1_set_selection(device_, source);
+            }
+            texts_[source] = text;
+            wl_display_flush(display_);
+        }
+
+        // 清空自己设置的选择
+        void clear(ClipboardSelection selection) {
+            if (selection == ClipboardSelection::Primary) {
+                zwlr_data_control_device_v1_set_primary_selection(device_, nullptr);
+                replace_source(primary_source_, nullptr);
+            } else {
+                zwlr_data_control_device_v1_set_selection(device_, nullptr);
+                replace_source(clipboard_source_, nullptr);
+            }
+            wl_display_roundtrip(display_);
+        }
+
+        // 分发事件，没有事件时最多等待timeout
+        void dispatch(milliseconds timeout) {
+            while (wl_display_prepare_read(display_) != 0) {
+                wl_display_dispatch_pending(display_);
+            }
+            wl_display_flush(display_);
+            struct pollfd pfd = {wl_display_get_fd(display_), POLLIN, 0};
+            if (poll(&pfd, 1, static_cast<int>(timeout.count())) > 0) {
+                wl_display_read_events(display_);
+            } else {
+                wl_display_cancel_read(display_);
+            }
+            wl_display_dispatch_pending(display_);
+        }
+
+        // 等待选择变为声明了marker类型的数据提供，即由后端设置的选择
+        bool wait_offer_with(ClipboardSelection selection, const std::string& marker, milliseconds timeout) {
+            auto deadline = test_clock::now() + timeout;
+            for (;;) {
+                auto* offer = current(selection);
+                if (offer) {
+                    const auto& types = mime_types_[offer];
+                    if (std::find(types.begin(), types.end(), marker) != types.end()) {
+                        return true;
+                    }
+                }
+                if (test_clock::now() >= deadline) {
+                    return false;
+                }
+                dispatch(milliseconds(10));
+            }
+        }
+
+        // 读取当前选择的纯文本，读完或超时后返回，超时时ok为false
+        std::string receive(ClipboardSelection selection, milliseconds timeout, bool& ok) {
+            ok = false;
+            std::string data;
+            auto* offer = current(selection);
+            int fds[2];
+            if (!offer || pipe2(fds, O_CLOEXEC) != 0) {
+                return data;
+            }
+            zwlr_data_control_offer_v1_receive(offer, TEXT_MIME_TYPE, fds[1]);
+            close(fds[1]);
+            wl_display_flush(display_);
+
+            auto deadline = test_clock::now() + timeout;
+            char buffer[64 * 1024];
+            for (;;) {
+                auto remaining = std::chrono::duration_cast<milliseconds>(deadline - test_clock::now());
+                struct pollfd pfd = {fds[0], POLLIN, 0};
+                if (remaining.count() <= 0 || poll(&pfd, 1, static_cast<int>(remaining.count())) <= 0) {
+                    break;
+                }
+                ssize_t n = read(fds[0], buffer, sizeof(buffer));
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    ok = n == 0;
+                    break;
+                }
+                data.append(buffer, static_cast<size_t>(n));
+            }
+            close(fds[0]);
+            return data;
+        }
+
+    private:
+        zwlr_data_control_offer_v1* current(ClipboardSelection selection) const {
+            return selection == ClipboardSelection::Primary ? primary_offer_ : clipboard_offer_;
+        }
+
+        void replace_source(zwlr_data_control_source_v1*& slot, zwlr_data_control_source_v1* source) {
+            if (slot) {
+                texts_.erase(slot);
+                zwlr_data_control_source_v1_destroy(slot);
+            }
+            slot = source;
+        }
+
+        // 选择变化，旧的数据提供不再使用
+        void set_offer(zwlr_data_control_offer_v1*& slot, zwlr_data_control_offer_v1* offer) {
+            if (slot && slot != offer) {
+                mime_types_.erase(slot);
+                zwlr_data_control_offer_v1_destroy(slot);
+            }
+            slot = offer;
+        }
+
+        // 阻塞写入提供的文本，读取方在后端的事件循环线程上读取
+        void send(zwlr_data_control_source_v1* source, int32_t fd) {
+            auto it = texts_.find(source);
+            if (it != texts_.end()) {
+                const std::string& text = it->second;
+                size_t written = 0;
+                while (written < text.size()) {
+                    ssize_t n = write(fd, text.data() + written, text.size() - written);
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n <= 0) {
+                        break;
+                    }
+                    written += static_cast<size_t>(n);
+                }
+            }
+            close(fd);
+        }
+
+        static void handle_global(void* data, wl_registry* registry, uint32_t name, const char* interface,
+                                  uint32_t version) {
+            auto* self = static_cast<RawClient*>(data);
+            if (strcmp(interface, "wl_seat") == 0 && !self->seat_) {
+                self->seat_ = static_cast<wl_seat*>(wl_registry_bind(registry, name, &wl_seat_interface, 1));
+            } else if (strcmp(interface, "zwlr_data_control_manager_v1") == 0) {
+                self->manager_version_ = std::min(version, 2u);
+                self->manager_ = static_cast<zwlr_data_control_manager_v1*>(
+                    wl_registry_bind(registry, name, &zwlr_data_control_manager_v1_interface, self->manager_version_));
+            }
+        }
+
+        static void handle_data_offer(void* data, zwlr_data_control_device_v1*, zwlr_data_control_offer_v1* offer) {
+            auto* self = static_cast<RawClient*>(data);
+            self->mime_types_[offer];
+            zwlr_data_control_offer_v1_add_listener(offer, &offer_listener_, data);
+        }
+
+        static void handle_selection(void* data, zwlr_data_control_device_v1*, zwlr_data_control_offer_v1* offer) {
+            auto* self = static_cast<RawClient*>(data);
+            self->set_offer(self->clipboard_offer_, offer);
+        }
+
+        static void handle_finished(void*, zwlr_data_control_device_v1*) {}
+
+        static void handle_primary_selection(void* data, zwlr_data_control_device_v1*,
+                                             zwlr_data_control_offer_v1* offer) {
+            auto* self = static_cast<RawClient*>(data);
+            self->set_offer(self->primary_offer_, offer);
+        }
+
+        static void handle_offer(void* data, zwlr_data_control_offer_v1* offer, const char* mime_type) {
+            static_cast<RawClient*>(data)->mime_types_[offer].push_back(mime_type);
+        }
+
+        static void handle_send(void* data, zwlr_data_control_source_v1* source, const char*, int32_t fd) {
+            static_cast<RawClient*>(data)->send(source, fd);
+        }
+
+        static void handle_cancelled(void* data, zwlr_data_control_source_v1* source) {
+            auto* self = static_cast<RawClient*>(data);
+            for (auto* slot : {&self->clipboard_source_, &self->primary_source_}) {
+                if (*slot == source) {
+                    *slot = nullptr;
+                }
+            }
+            self->texts_.erase(source);
+            zwlr_data_control_source_v1_destroy(source);
+        }
+
+        static const wl_registry_listener registry_listener_;
+        static const zwlr_data_control_device_v1_listener device_listener_;
+        static const zwlr_data_control_offer_v1_listener offer_listener_;
+        static const zwlr_data_control_source_v1_listener source_listener_;
+
+        wl_display* display_ = nullptr;
+        wl_registry* registry_ = nullptr;
+        wl_seat* seat_ = nullptr;
+        zwlr_data_control_manager_v1* manager_ = nullptr;
+        uint32_t manager_version_ = 0;
+        zwlr_data_control_device_v1* device_ = nullptr;
+        zwlr_data_control_offer_v1* clipboard_offer_ = nullptr;
+        zwlr_data_control_offer_v1* primary_offer_ = nullptr;
+        std::map<zwlr_data_control_offer_v1*, std::vector<std::string>> mime_types_;
+        zwlr_data_control_source_v1* clipboard_source_ = nullptr;
+        zwlr_data_control_source_v1* primary_source_ = nullptr;
+        std::map<zwlr_data_control_source_v1*, std::string> texts_;
+    };
+
+    const wl_registry_listener RawClient::registry_listener_ = {handle_global, nullptr};
+    const zwlr_data_control_device_v1_listener RawClient::device_listener_ = {
+        handle_data_offer, handle_selection, handle_finished, handle_primary_selection};
+    const zwlr_data_control_offer_v1_listener RawClient::offer_listener_ = {handle_offer};
+    const zwlr_data_control_source_v1_listener RawClient::source_listener_ = {handle_send, handle_cancelled};
+
+    // 后端为自己的数据源额外声明的类型
+    const char* const SOURCE_MARKER = "application/x-p2pboard-source";
+
+    // 由app分发事件，直到listener收到第count次报告，返回等待的时间；超时返回timeout
+    milliseconds dispatch_until(RawClient& app, RecordingListener& listener, size_t count, milliseconds timeout) {
+        auto started = test_clock::now();
+        while (listener.changes().size() < count) {
+            auto elapsed = std::chrono::duration_cast<milliseconds>(test_clock::now() - started);
+            if (elapsed >= timeout) {
+                return timeout;
+            }
+            app.dispatch(milliseconds(5));
+        }
+        return std::chrono::duration_cast<milliseconds>(test_clock::now() - started);
+    }
+
+    // 其他应用复制后很快报告；超过管道缓冲区的内容完整报告
+    void test_change_detection(RawClient& app) {
+        EventLoop loop;
+        RecordingListener listener;
+        WaylandClipboardBackend backend;
+        backend.initialize();
+        loop.call([&] { backend.start(loop.io(), listener); });
+        std::this_thread::sleep_for(milliseconds(200));
+        size_t before = listener.changes().size();
+
+        app.own(ClipboardSelection::Clipboard, "first copy");
+        CHECK(dispatch_until(app, listener, before + 1, milliseconds(2000)) < milliseconds(200));
+
+        const std::string text = make_text(MAX_MESSAGE_SIZE - 1024);
+        app.own(ClipboardSelection::Clipboard, text);
+        dispatch_until(app, listener, before + 2, milliseconds(5000));
+
+        auto changes = listener.changes();
+        CHECK(changes.size() == before + 2);
+        if (changes.size() == before + 2) {
+            CHECK(changes[before].first == ClipboardSelection::Clipboard);
+            CHECK(changes[before].second == "first copy");
+            CHECK(changes[before + 1].second.size() == text.size());
+            CHECK(changes[before + 1].second == text);
+        }
+        loop.call([&] { backend.stop(); });
+        // 之后的测试从空的剪贴板开始
+        app.clear(ClipboardSelection::Clipboard);
+    }
+
+    // 后端提供的几MB文本可以多次完整读取，PRIMARY单独提供
+    void test_send(RawClient& app) {
+        EventLoop loop;
+        RecordingListener listener;
+        WaylandClipboardBackend backend;
+        backend.initialize();
+        loop.call([&] { backend.start(loop.io(), listener); });
+
+        const std::string text = make_text(4 * 1024 * 1024 + 123);
+        loop.call([&] { backend.offer(ClipboardSelection::Clipboard, text_item(text)); });
+        CHECK(app.wait_offer_with(ClipboardSelection::Clipboard, SOURCE_MARKER, milliseconds(2000)));
+        for (int i = 0; i < 2; ++i) {
+            bool ok = false;
+            std::string received = app.receive(ClipboardSelection::Clipboard, milliseconds(10000), ok);
+            CHECK(ok);
+            CHECK(received.size() == text.size());
+            CHECK(received == text);
+        }
+
+        if (app.supports_primary()) {
+            loop.call([&] { backend.offer(ClipboardSelection::Primary, text_item("selected")); });
+            CHECK(app.wait_offer_with(ClipboardSelection::Primary, SOURCE_MARKER, milliseconds(2000)));
+            bool ok = false;
+            CHECK(app.receive(ClipboardSelection::Primary, milliseconds(2000), ok) == "selected" && ok);
+            // 设置PRIMARY不影响CLIPBOARD
+            CHECK(app.receive(ClipboardSelection::Clipboard, milliseconds(10000), ok).size() == text.size() && ok);
+        } else {
+            std::cout << "合成器的wlr数据控制协议版本低于2，跳过PRIMARY检查" << std::endl;
+        }
+
+        // 自己提供的内容不作为本地变化报告
+        CHECK(listener.changes().empty());
+        loop.call([&] { backend.stop(); });
+    }
+
+    // 读取按通告持有的选择时后端请求数据，提供后读取方收到内容
+    void test_lazy(RawClient& app) {
+        EventLoop loop;
+        RecordingListener listener;
+        WaylandClipboardBackend backend;
+        backend.initialize();
+        loop.call([&] { backend.start(loop.io(), listener); });
+
+        const std::string text = make_text(256 * 1024);
+        // 回调在事件循环线程上，延后到当前事件处理完再提供
+        listener.set_on_request([&] {
+            boost::asio::post(loop.io(), [&] { backend.provide(text_item(text)); });
+        });
+        loop.call([&] { backend.offer_lazy({TEXT_MIME_TYPE}); });
+        CHECK(app.wait_offer_with(ClipboardSelection::Clipboard, SOURCE_MARKER, milliseconds(2000)));
+
+        bool ok = false;
+        std::string received = app.receive(ClipboardSelection::Clipboard, milliseconds(5000), ok);
+        CHECK(ok);
+        CHECK(received == text);
+        CHECK(listener.data_requests() == 1);
+
+        // 取回后再次读取直接提供
+        received = app.receive(ClipboardSelection::Clipboard, milliseconds(5000), ok);
+        CHECK(ok && received == text);
+        CHECK(listener.data_requests() == 1);
+        loop.call([&] { backend.stop(); });
+    }
+
+    // 没有剪贴板变化时事件循环不执行任何处理器，即没有轮询
+    void test_idle_without_wakeups(RawClient&) {
+        boost::asio::io_context io;
+        RecordingListener listener;
+        WaylandClipboardBackend backend;
+        backend.initialize();
+        backend.start(io, listener);
+        // 启动时读取当前内容
+        io.run_for(milliseconds(300));
+        io.restart();
+        size_t handlers = io.run_for(milliseconds(1000));
+        CHECK(handlers == 0);
+        backend.stop();
+    }
+}
+
+int main() {
+    RawClient app;
+    if (!app.connected()) {
+        std::cerr << "没有可用的Wayland合成器，跳过" << std::endl;
+        return 77;
+    }
+    if (!app.supported()) {
+        std::cerr << "合成器不支持wlr数据控制协议，跳过" << std::endl;
+        return 77;
+    }
+
+    return run_tests<RawClient&>({
+        {"change_detection", test_change_detection},
+        {"send", test_send},
+        {"lazy", test_lazy},
+        {"idle_without_wakeups", test_idle_without_wakeups},
+    }, app);
+}
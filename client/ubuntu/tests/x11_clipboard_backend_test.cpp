@@ -0,0 +1,364 @@
+// X11ClipboardBackend的测试，在Xvfb中运行
+//
+// 事件循环在后台线程上驱动后端，主线程用独立的Xlib连接扮演其他应用，检查：
+//   - 变化检测：其他应用取得CLIPBOARD后，后端通过XFixes在毫秒级报告新内容，
+//     不回复转换请求的所有者不会阻塞之后的读取；没有变化时事件循环不被唤醒
+//   - 发送：后端提供几MB的文本，原始Xlib请求方转换CLIPBOARD，收到INCR头部和多段数据，
+//     拼接后与提供的内容一致
+//   - 接收：一个后端提供超过单次属性上限、不超过MAX_MESSAGE_SIZE的文本，
+//     另一个后端通过XFixes发现变化并以INCR读取，报告的内容与提供的一致
+//
+// 用法: xvfb-run -a x11_clipboard_backend_test
+// 没有可用的X显示时退出码为77(跳过)，全部通过时为0
+#include "config.h"
+#include "test_support.h"
+#include "x11_clipboard_backend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+
+namespace {
+    using namespace test_support;
+
+    std::shared_ptr<const ClipboardItem> text_item(const std::string& text) {
+        return std::make_shared<const ClipboardItem>(ClipboardItem{ClipboardPart{TEXT_MIME_TYPE, ClipboardData(text)}});
+    }
+
+    // 扮演其他应用的原始Xlib客户端
+    class RawClient {
+    public:
+        explicit RawClient(Display* display) : display_(display) {
+            window_ = XCreateSimpleWindow(display_, DefaultRootWindow(display_), 0, 0, 1, 1, 0, 0, 0);
+            XSelectInput(display_, window_, PropertyChangeMask);
+            property_ = XInternAtom(display_, "P2PBOARD_TEST", False);
+            incr_ = XInternAtom(display_, "INCR", False);
+            targets_ = XInternAtom(display_, "TARGETS", False);
+            utf8_string_ = XInternAtom(display_, "UTF8_STRING", False);
+        }
+
+        ~RawClient() {
+            XDestroyWindow(display_, window_);
+        }
+
+        // 转换的结果
+        struct Conversion {
+            bool ok = false;
+            Atom type = None;
+            std::string data;
+            // 使用了INCR时头部声明的长度、数据段数和最大的段
+            bool incr = false;
+            long declared = 0;
+            size_t chunks = 0;
+            size_t largest_chunk = 0;
+        };
+
+        // 按ICCCM转换选择，支持INCR
+        Conversion convert(Atom selection, Atom target, milliseconds timeout) {
+            Conversion result;
+            auto deadline = test_clock::now() + timeout;
+            XConvertSelection(display_, selection, target, property_, window_, CurrentTime);
+            XFlush(display_);
+
+            XEvent event;
+            if (!wait_event(SelectionNotify, event, deadline) || event.xselection.property == None) {
+                return result;
+            }
+            std::string header;
+            if (!take_property(result.type, header)) {
+                return result;
+            }
+            if (result.type != incr_) {
+                result.data = std::move(header);
+                result.ok = true;
+                return result;
+            }
+
+            // 删除属性(已在读取时完成)后所有者写入下一段，长度为0的段表示结束。
+            // 头部写入时的NewValue事件在SelectionNotify之前到达，那时属性已被删除，跳过
+            result.incr = true;
+            if (header.size() >= sizeof(long)) {
+                memcpy(&result.declared, header.data(), sizeof(long));
+            }
+            for (;;) {
+                if (!wait_event(PropertyNotify, event, deadline)) {
+                    return result;
+                }
+                if (event.xproperty.atom != property_ || event.xproperty.state != PropertyNewValue) {
+                    continue;
+                }
+                std::string chunk;
+                if (!take_property(result.type, chunk)) {
+                    return result;
+                }
+                if (result.type == None) {
+                    continue;
+                }
+                if (chunk.empty()) {
+                    result.ok = true;
+                    return result;
+                }
+                result.chunks++;
+                result.largest_chunk = std::max(result.largest_chunk, chunk.size());
+                result.data += chunk;
+            }
+        }
+
+        // 取得选择所有权并以UTF8_STRING提供text，转换请求由serve回复
+        void own(Atom selection, const std::string& text) {
+            text_ = text;
+            XSetSelectionOwner(display_, selection, window_, CurrentTime);
+            XFlush(display_);
+        }
+
+        // 回复已到达的转换请求，没有请求时最多等待timeout；answer为false时不回复，模拟无响应的应用
+        void serve(milliseconds timeout, bool answer = true) {
+            XEvent event;
+            if (!XCheckTypedWindowEvent(display_, window_, SelectionRequest, &event)) {
+                struct pollfd pfd = {ConnectionNumber(display_), POLLIN, 0};
+                poll(&pfd, 1, static_cast<int>(timeout.count()));
+                if (!XCheckTypedWindowEvent(display_, window_, SelectionRequest, &event)) {
+                    return;
+                }
+            }
+            do {
+                if (answer) {
+                    answer_request(event.xselectionrequest);
+                }
+            } while (XCheckTypedWindowEvent(display_, window_, SelectionRequest, &event));
+            XFlush(display_);
+        }
+
+    private:
+        // 提供TARGETS和UTF8_STRING，其他目标拒绝
+        void answer_request(const XSelectionRequestEvent& request) {
+            Atom property = request.property == None ? request.target : request.property;
+            if (request.target == targets_) {
+                Atom targets[] = {targets_, utf8_string_};
+                XChangeProperty(display_, request.requestor, property, XA_ATOM, 32, PropModeReplace,
+                                reinterpret_cast<unsigned char*>(targets), 2);
+            } else if (request.target == utf8_string_) {
+                XChangeProperty(display_, request.requestor, property, utf8_string_, 8, PropModeReplace,
+                                reinterpret_cast<const unsigned char*>(text_.data()), static_cast<int>(text_.size()));
+            } else {
+                property = None;
+            }
+
+            XEvent reply;
+            memset(&reply, 0, sizeof(reply));
+            reply.type = SelectionNotify;
+            reply.xselection.requestor = request.requestor;
+            reply.xselection.selection = request.selection;
+            reply.xselection.target = request.target;
+            reply.xselection.property = property;
+            reply.xselection.time = request.time;
+            XSendEvent(display_, request.requestor, False, NoEventMask, &reply);
+        }
+
+        // 等待本窗口的某类事件，超时返回false
+        bool wait_event(int type, XEvent& event, test_clock::time_point deadline) {
+            for (;;) {
+                if (XCheckTypedWindowEvent(display_, window_, type, &event)) {
+                    return true;
+                }
+                auto remaining = std::chrono::duration_cast<milliseconds>(deadline - test_clock::now());
+                if (remaining.count() <= 0) {
+                    return false;
+                }
+                struct pollfd pfd = {ConnectionNumber(display_), POLLIN, 0};
+                poll(&pfd, 1, static_cast<int>(remaining.count()));
+            }
+        }
+
+        // 读取并删除窗口上的属性，只处理8位数据和INCR头部
+        bool take_property(Atom& type, std::string& data) {
+            int format = 0;
+            unsigned long nitems = 0;
+            unsigned long bytes_after = 0;
+            unsigned char* value = nullptr;
+            if (XGetWindowProperty(display_, window_, property_, 0, LONG_MAX / 4, True, AnyPropertyType,
+                                   &type, &format, &nitems, &bytes_after, &value) != Success) {
+                return false;
+            }
+            if (value) {
+                size_t unit = format == 32 ? sizeof(long) : static_cast<size_t>(format / 8);
+                data.assign(reinterpret_cast<char*>(value), nitems * unit);
+                XFree(value);
+            }
+            return true;
+        }
+
+        Display* display_;
+        Window window_;
+        Atom property_;
+        Atom incr_;
+        Atom targets_;
+        Atom utf8_string_;
+        std::string text_;
+    };
+
+    // 由owner回复转换请求，直到listener收到第count次报告，返回等待的时间；超时返回timeout
+    milliseconds serve_until(RawClient& owner, RecordingListener& listener, size_t count, milliseconds timeout) {
+        auto started = test_clock::now();
+        while (listener.changes().size() < count) {
+            auto elapsed = std::chrono::duration_cast<milliseconds>(test_clock::now() - started);
+            if (elapsed >= timeout) {
+                return timeout;
+            }
+            owner.serve(milliseconds(5));
+        }
+        return std::chrono::duration_cast<milliseconds>(test_clock::now() - started);
+    }
+
+    // 其他应用复制后很快报告，不回复的所有者不影响之后的读取
+    void test_change_detection(Display* display) {
+        EventLoop loop;
+        RecordingListener listener;
+        X11ClipboardBackend backend;
+        backend.initialize();
+        loop.call([&] { backend.start(loop.io(), listener); });
+        std::this_thread::sleep_for(milliseconds(200));
+        size_t before = listener.changes().size();
+
+        Atom clipboard = XInternAtom(display, "CLIPBOARD", False);
+        RawClient first(display);
+        first.own(clipboard, "first copy");
+        milliseconds latency = serve_until(first, listener, before + 1, milliseconds(2000));
+        CHECK(latency < milliseconds(200));
+
+        // 取得所有权后不回复任何请求的应用，之后另一个应用复制的内容仍然很快报告
+        RawClient silent(display);
+        silent.own(clipboard, "never sent");
+        silent.serve(milliseconds(100), false);
+        RawClient second(display);
+        second.own(clipboard, "second copy");
+        latency = serve_until(second, listener, before + 2, milliseconds(2000));
+        CHECK(latency < milliseconds(200));
+
+        auto changes = listener.changes();
+        CHECK(changes.size() == before + 2);
+        if (changes.size() == before + 2) {
+            CHECK(changes[before].second == "first copy");
+            CHECK(changes[before + 1].second == "second copy");
+            CHECK(changes[before + 1].first == ClipboardSelection::Clipboard);
+        }
+        loop.call([&] { backend.stop(); });
+    }
+
+    // 没有剪贴板变化时事件循环不执行任何处理器，即没有轮询
+    void test_idle_without_wakeups(Display*) {
+        boost::asio::io_context io;
+        RecordingListener listener;
+        X11ClipboardBackend backend;
+        backend.initialize();
+        backend.start(io, listener);
+        // 启动时读取当前内容的往返
+        io.run_for(milliseconds(300));
+        io.restart();
+        size_t handlers = io.run_for(milliseconds(1000));
+        CHECK(handlers == 0);
+        backend.stop();
+    }
+
+    // 后端提供几MB文本，原始请求方以INCR分段读取
+    void test_incr_send(Display* display) {
+        EventLoop loop;
+        RecordingListener listener;
+        X11ClipboardBackend backend;
+        backend.initialize();
+        loop.call([&] { backend.start(loop.io(), listener); });
+
+        const std::string text = make_text(4 * 1024 * 1024 + 123);
+        loop.call([&] { backend.offer(ClipboardSelection::Clipboard, text_item(text)); });
+
+        Atom clipboard = XInternAtom(display, "CLIPBOARD", False);
+        Atom utf8_string = XInternAtom(display, "UTF8_STRING", False);
+        RawClient requestor(display);
+        RawClient::Conversion result = requestor.convert(clipboard, utf8_string, milliseconds(10000));
+
+        // 单段数据受请求长度限制，4MB必然分成多段
+        size_t max_property_bytes = static_cast<size_t>(XMaxRequestSize(display)) * 4;
+        CHECK(result.ok);
+        CHECK(result.incr);
+        CHECK(result.declared == static_cast<long>(text.size()));
+        CHECK(result.type == utf8_string);
+        CHECK(result.chunks > 1);
+        CHECK(result.largest_chunk <= max_property_bytes);
+        CHECK(result.data.size() == text.size());
+        CHECK(result.data == text);
+
+        // 同一份数据可以再次完整读取，较小的PRIMARY不使用INCR
+        RawClient::Conversion again = requestor.convert(clipboard, utf8_string, milliseconds(10000));
+        CHECK(again.ok && again.data == text);
+        Atom primary = XInternAtom(display, "PRIMARY", False);
+        loop.call([&] { backend.offer(ClipboardSelection::Primary, text_item("selected")); });
+        RawClient::Conversion small = requestor.convert(primary, utf8_string, milliseconds(2000));
+        CHECK(small.ok && !small.incr && small.data == "selected");
+
+        // 自己提供的内容不作为本地变化报告
+        CHECK(listener.changes().empty());
+        loop.call([&] { backend.stop(); });
+    }
+
+    // 一个后端提供的大文本由另一个后端以INCR读取
+    void test_incr_receive(Display* display) {
+        EventLoop loop;
+        RecordingListener owner_listener;
+        RecordingListener reader_listener;
+        X11ClipboardBackend owner;
+        X11ClipboardBackend reader;
+        owner.initialize();
+        reader.initialize();
+        loop.call([&] {
+            owner.start(loop.io(), owner_listener);
+            reader.start(loop.io(), reader_listener);
+        });
+        // 等启动时对当前CLIPBOARD的读取结束
+        std::this_thread::sleep_for(milliseconds(200));
+        size_t before = reader_listener.changes().size();
+
+        // 超过单次属性上限，且不超过接收上限
+        size_t max_property_bytes = static_cast<size_t>(XMaxRequestSize(display)) * 4;
+        const std::string text = make_text(std::min<size_t>(MAX_MESSAGE_SIZE - 1024, max_property_bytes * 3));
+        CHECK(text.size() > max_property_bytes);
+        loop.call([&] { owner.offer(ClipboardSelection::Clipboard, text_item(text)); });
+
+        CHECK(reader_listener.wait_for(before + 1, milliseconds(10000)));
+        auto changes = reader_listener.changes();
+        if (changes.size() > before) {
+            CHECK(changes[before].first == ClipboardSelection::Clipboard);
+            CHECK(changes[before].second.size() == text.size());
+            CHECK(changes[before].second == text);
+        }
+        CHECK(owner_listener.changes().empty());
+        loop.call([&] {
+            reader.stop();
+            owner.stop();
+        });
+    }
+}
+
+int main() {
+    XInitThreads();
+    Display* display = XOpenDisplay(nullptr);
+    if (!display) {
+        std::cerr << "没有可用的X显示，跳过" << std::endl;
+        return 77;
+    }
+
+    int status = run_tests<Display*>({
+        {"change_detection", test_change_detection},
+        {"idle_without_wakeups", test_idle_without_wakeups},
+        {"incr_send", test_incr_send},
+        {"incr_receive", test_incr_receive},
+    }, display);
+    XCloseDisplay(display);
+    return status;
+}
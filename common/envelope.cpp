@@ -0,0 +1,88 @@
+#include "envelope.h"
+#include <cstdlib>
+#include <cstring>
+
+// 原始数据是否带有协议信封
+bool is_envelope(std::string_view raw)
+{
+    const size_t magic_len = std::strlen(ENVELOPE_MAGIC);
+    return raw.size() >= magic_len && raw.compare(0, magic_len, ENVELOPE_MAGIC) == 0;
+}
+
+// 解析信封头部
+bool parse_envelope_head(std::string_view raw, envelope_headers &headers, size_t &body_offset)
+{
+    headers.clear();
+    if (!is_envelope(raw))
+        return false;
+
+    size_t pos = std::strlen(ENVELOPE_MAGIC);
+    while (pos < raw.size())
+    {
+        size_t eol = raw.find('\n', pos);
+        if (eol == std::string_view::npos)
+            return false; // 头部未结束
+        // 空行表示头部结束
+        if (eol == pos)
+        {
+            body_offset = eol + 1;
+            return true;
+        }
+        size_t colon = raw.find(": ", pos);
+        if (colon == std::string_view::npos || colon > eol)
+            return false; // 头部格式错误
+        headers[std::string(raw.substr(pos, colon - pos))] = std::string(raw.substr(colon + 2, eol - colon - 2));
+        pos = eol + 1;
+    }
+    return false;
+}
+
+// 序列化魔数首行和头部
+std::string serialize_envelope_head(const envelope_headers &headers)
+{
+    std::string out = ENVELOPE_MAGIC;
+    for (const auto &h : headers)
+    {
+        out += h.first;
+        out += ": ";
+        out += h.second;
+        out += '\n';
+    }
+    out += '\n';
+    return out;
+}
+
+// 解析parts头部
+bool parse_parts(const std::string &spec, size_t body_size, std::vector<envelope_part> &out)
+{
+    out.clear();
+    size_t offset = 0;
+    size_t pos = 0;
+    while (pos < spec.size())
+    {
+        size_t end = spec.find(',', pos);
+        if (end == std::string::npos)
+            end = spec.size();
+        size_t space = spec.rfind(' ', end);
+        if (space == std::string::npos || space < pos)
+            return false;
+        char *parsed_end = nullptr;
+        size_t length = std::strtoull(spec.c_str() + space + 1, &parsed_end, 10);
+        if (parsed_end != spec.c_str() + end || length > body_size - offset)
+            return false;
+        out.push_back(envelope_part{spec.substr(pos, space - pos), offset, length});
+        offset += length;
+        pos = end + 1;
+    }
+    return offset == body_size;
+}
+
+// 在parts头部末尾追加一种表示
+void append_part_spec(std::string &spec, const std::string &mime, size_t length)
+{
+    if (!spec.empty())
+        spec += ',';
+    spec += mime;
+    spec += ' ';
+    spec += std::to_string(length);
+}
@@ -0,0 +1,53 @@
+#ifndef CLIPBOARD_ENVELOPE_H
+#define CLIPBOARD_ENVELOPE_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 服务器和客户端共用的P2PB/1信封格式，两边的构建都编译这一份源文件
+//
+// 线上格式类似HTTP头部：
+//   P2PB/1\n
+//   key: value\n
+//   ...
+//   \n
+//   <body>
+// 没有魔数首行的消息视为纯文本剪贴板内容。头部按键的字典序序列化。
+//
+// 同一剪贴板条目的多种表示放在一条消息中时，parts头部按顺序列出每种表示的类型和长度：
+//   parts: text/plain;charset=utf-8 12,text/html 40
+// 消息体按顺序拼接各表示的数据。
+
+// 协议信封的魔数首行
+#define ENVELOPE_MAGIC "P2PB/1\n"
+
+// 信封的头部字段
+using envelope_headers = std::map<std::string, std::string>;
+
+// 多格式消息中一种表示在消息体中的位置
+struct envelope_part
+{
+    std::string mime;
+    size_t offset;
+    size_t length;
+};
+
+// 原始数据是否带有协议信封
+bool is_envelope(std::string_view raw);
+
+// 解析信封头部，body_offset输出消息体在raw中的起始位置；不是信封或头部格式错误时返回false
+bool parse_envelope_head(std::string_view raw, envelope_headers &headers, size_t &body_offset);
+
+// 序列化魔数首行和头部，以空行结束
+std::string serialize_envelope_head(const envelope_headers &headers);
+
+// 解析parts头部，各表示的长度之和必须等于body_size，否则返回false
+bool parse_parts(const std::string &spec, size_t body_size, std::vector<envelope_part> &out);
+
+// 在parts头部末尾追加一种表示
+void append_part_spec(std::string &spec, const std::string &mime, size_t length);
+
+#endif
@@ -0,0 +1,27 @@
+#include "fingerprint.h"
+#include <cstdio>
+
+// 把数据混入指纹
+uint64_t fingerprint_update(uint64_t hash, const char *data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= FINGERPRINT_PRIME;
+    }
+    return hash;
+}
+
+// 指纹的十六进制表示
+std::string fingerprint_hex(uint64_t hash)
+{
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+    return hex;
+}
+
+// 数据的指纹
+std::string payload_fingerprint(std::string_view data)
+{
+    return fingerprint_hex(fingerprint_update(FINGERPRINT_BASIS, data.data(), data.size()));
+}
@@ -0,0 +1,29 @@
+#ifndef CLIPBOARD_FINGERPRINT_H
+#define CLIPBOARD_FINGERPRINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// 服务器和客户端共用的内容指纹(64位FNV-1a)，两边的构建都编译这一份源文件
+//
+// 服务器在type=announce的fingerprint头部中给出消息体的指纹，客户端用同一算法
+// 识别自己发送过的内容，两边必须完全一致。
+
+// 指纹的初始值。最初的实现少写了标准FNV-1a初始值14695981039346656037的最后一位，
+// 改用标准值会使新旧版本之间的指纹不一致，因此保留
+const uint64_t FINGERPRINT_BASIS = 1469598103934665603ULL;
+// 每混入一个字节乘上的素数
+const uint64_t FINGERPRINT_PRIME = 1099511628211ULL;
+
+// 把数据混入指纹；依次混入几段数据与一次混入拼接后的数据结果相同
+uint64_t fingerprint_update(uint64_t hash, const char *data, size_t size);
+
+// 指纹的16位十六进制表示
+std::string fingerprint_hex(uint64_t hash);
+
+// 数据的指纹，以16位十六进制表示
+std::string payload_fingerprint(std::string_view data);
+
+#endif
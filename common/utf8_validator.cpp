@@ -0,0 +1,323 @@
+#include "utf8_validator.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define UTF8_VALIDATOR_X86 1
+#endif
+
+namespace
+{
+    // 查表法中每个字节对可能出现的错误，一个位表示一类
+    // 11______ 0_______ 或 11______ 11______：多字节序列被截断
+    const uint8_t TOO_SHORT = 1 << 0;
+    // 0_______ 10______：多余的后续字节
+    const uint8_t TOO_LONG = 1 << 1;
+    // 11100000 100_____：三字节的过长编码
+    const uint8_t OVERLONG_3 = 1 << 2;
+    // 11110100 1001____ 等：超出U+10FFFF
+    const uint8_t TOO_LARGE = 1 << 3;
+    // 11101101 101_____：UTF-16代理项
+    const uint8_t SURROGATE = 1 << 4;
+    // 1100000_ 10______：两字节的过长编码
+    const uint8_t OVERLONG_2 = 1 << 5;
+    // 11110101 1000____ 等：超出U+10FFFF，与OVERLONG_4共用一位
+    const uint8_t TOO_LARGE_1000 = 1 << 6;
+    // 11110000 1000____：四字节的过长编码
+    const uint8_t OVERLONG_4 = 1 << 6;
+    // 10______ 10______：两个相邻的后续字节，是否合法取决于更前面的字节
+    const uint8_t TWO_CONTS = 1 << 7;
+    // 只由前一字节的高4位决定的错误
+    const uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+    // 按前一字节的高4位查表
+    alignas(16) const uint8_t BYTE_1_HIGH[16] = {
+        // 0_______ ________：ASCII
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        // 10______ ________：后续字节
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        // 1100____ ________：两字节序列的首字节
+        TOO_SHORT | OVERLONG_2,
+        // 1101____ ________
+        TOO_SHORT,
+        // 1110____ ________：三字节序列的首字节
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        // 1111____ ________：四字节序列的首字节
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4};
+
+    // 按前一字节的低4位查表
+    alignas(16) const uint8_t BYTE_1_LOW[16] = {
+        // ____0000 ________
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        // ____0001 ________
+        CARRY | OVERLONG_2,
+        // ____001_ ________
+        CARRY,
+        CARRY,
+        // ____0100 ________
+        CARRY | TOO_LARGE,
+        // ____0101 ________ 到 ____1100 ________
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        // ____1101 ________
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        // ____111_ ________
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000};
+
+    // 按当前字节的高4位查表
+    alignas(16) const uint8_t BYTE_2_HIGH[16] = {
+        // ________ 0_______：ASCII
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        // ________ 1000____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        // ________ 1001____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        // ________ 101_____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        // ________ 11______：首字节
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT};
+
+    // 从s[i]开始的有效UTF-8字符的字节数，无效时返回0
+    size_t sequence_length(const unsigned char *s, size_t i, size_t size)
+    {
+        unsigned char c = s[i];
+        if (c < 0x80)
+            return 1;
+
+        // 第二个字节的范围排除过长编码、代理项和超出U+10FFFF的码点
+        size_t length;
+        unsigned char low = 0x80;
+        unsigned char high = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF)
+            length = 2;
+        else if (c >= 0xE0 && c <= 0xEF)
+        {
+            length = 3;
+            if (c == 0xE0)
+                low = 0xA0;
+            else if (c == 0xED)
+                high = 0x9F;
+        }
+        else if (c >= 0xF0 && c <= 0xF4)
+        {
+            length = 4;
+            if (c == 0xF0)
+                low = 0x90;
+            else if (c == 0xF4)
+                high = 0x8F;
+        }
+        else
+            return 0;
+
+        if (size - i < length || s[i + 1] < low || s[i + 1] > high)
+            return 0;
+        for (size_t k = 2; k < length; ++k)
+            if ((s[i + k] & 0xC0) != 0x80)
+                return 0;
+        return length;
+    }
+
+    // 标量实现，ASCII按8字节一组跳过
+    bool validate_scalar(const unsigned char *s, size_t size)
+    {
+        size_t i = 0;
+        while (i < size)
+        {
+            if (size - i >= 8)
+            {
+                uint64_t word;
+                std::memcpy(&word, s + i, sizeof(word));
+                if ((word & 0x8080808080808080ULL) == 0)
+                {
+                    i += 8;
+                    continue;
+                }
+            }
+            size_t length = sequence_length(s, i, size);
+            if (length == 0)
+                return false;
+            i += length;
+        }
+        return true;
+    }
+
+#ifdef UTF8_VALIDATOR_X86
+    // 16字节块中每个字节与前面1到3个字节组合后的错误位，非零表示无效
+    __attribute__((target("sse4.1")))
+    inline __m128i sse_block_errors(__m128i input, __m128i prev_input)
+    {
+        const __m128i low_nibble = _mm_set1_epi8(0x0F);
+        __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+        __m128i byte_1_high = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i *>(BYTE_1_HIGH)),
+                                               _mm_and_si128(_mm_srli_epi16(prev1, 4), low_nibble));
+        __m128i byte_1_low = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i *>(BYTE_1_LOW)),
+                                              _mm_and_si128(prev1, low_nibble));
+        __m128i byte_2_high = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i *>(BYTE_2_HIGH)),
+                                               _mm_and_si128(_mm_srli_epi16(input, 4), low_nibble));
+        __m128i special = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+        // 三字节和四字节序列的第3、4个字节必须是后续字节，正好抵消TWO_CONTS
+        __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+        __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+        __m128i third = _mm_subs_epu8(prev2, _mm_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+        __m128i fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+        __m128i must_continue = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(static_cast<char>(0x80)));
+        return _mm_xor_si128(must_continue, special);
+    }
+
+    // SSE4.1实现，每次处理16字节
+    __attribute__((target("sse4.1")))
+    bool validate_sse41(const unsigned char *s, size_t size)
+    {
+        // 块末尾的这些字节需要下一块中的后续字节
+        const __m128i incomplete_above = _mm_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+        __m128i error = _mm_setzero_si128();
+        __m128i prev_input = _mm_setzero_si128();
+        __m128i prev_incomplete = _mm_setzero_si128();
+
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16)
+        {
+            __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+            if (_mm_movemask_epi8(input) == 0)
+            {
+                // 纯ASCII块只需确认上一块没有未完成的序列
+                error = _mm_or_si128(error, prev_incomplete);
+            }
+            else
+            {
+                error = _mm_or_si128(error, sse_block_errors(input, prev_input));
+                prev_incomplete = _mm_subs_epu8(input, incomplete_above);
+            }
+            prev_input = input;
+        }
+
+        // 剩余字节补0后作为最后一块，末尾被截断的序列遇到0时报错
+        alignas(16) unsigned char tail[16] = {};
+        std::memcpy(tail, s + i, size - i);
+        error = _mm_or_si128(error, sse_block_errors(_mm_load_si128(reinterpret_cast<const __m128i *>(tail)),
+                                                     prev_input));
+        return _mm_testz_si128(error, error);
+    }
+
+    // 32字节块中每个字节的错误位，跨128位通道取前面的字节
+    __attribute__((target("avx2")))
+    inline __m256i avx2_block_errors(__m256i input, __m256i prev_input)
+    {
+        const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+        const __m256i table_1_high = _mm256_broadcastsi128_si256(
+            _mm_load_si128(reinterpret_cast<const __m128i *>(BYTE_1_HIGH)));
+        const __m256i table_1_low = _mm256_broadcastsi128_si256(
+            _mm_load_si128(reinterpret_cast<const __m128i *>(BYTE_1_LOW)));
+        const __m256i table_2_high = _mm256_broadcastsi128_si256(
+            _mm_load_si128(reinterpret_cast<const __m128i *>(BYTE_2_HIGH)));
+
+        // 上一块的高128位和这一块的低128位，供alignr取前面的字节
+        __m256i shifted = _mm256_permute2x128_si256(prev_input, input, 0x21);
+        __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+        __m256i byte_1_high = _mm256_shuffle_epi8(table_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble));
+        __m256i byte_1_low = _mm256_shuffle_epi8(table_1_low, _mm256_and_si256(prev1, low_nibble));
+        __m256i byte_2_high = _mm256_shuffle_epi8(table_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble));
+        __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+        __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+        __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+        __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+        __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+        __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth),
+                                                 _mm256_set1_epi8(static_cast<char>(0x80)));
+        return _mm256_xor_si256(must_continue, special);
+    }
+
+    // AVX2实现，每次处理32字节
+    __attribute__((target("avx2")))
+    bool validate_avx2(const unsigned char *s, size_t size)
+    {
+        const __m256i incomplete_above = _mm256_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+        __m256i error = _mm256_setzero_si256();
+        __m256i prev_input = _mm256_setzero_si256();
+        __m256i prev_incomplete = _mm256_setzero_si256();
+
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32)
+        {
+            __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+            if (_mm256_movemask_epi8(input) == 0)
+                error = _mm256_or_si256(error, prev_incomplete);
+            else
+            {
+                error = _mm256_or_si256(error, avx2_block_errors(input, prev_input));
+                prev_incomplete = _mm256_subs_epu8(input, incomplete_above);
+            }
+            prev_input = input;
+        }
+
+        alignas(32) unsigned char tail[32] = {};
+        std::memcpy(tail, s + i, size - i);
+        error = _mm256_or_si256(error, avx2_block_errors(_mm256_load_si256(reinterpret_cast<const __m256i *>(tail)),
+                                                         prev_input));
+        return _mm256_testz_si256(error, error);
+    }
+#endif
+
+    // 运行时选择的校验实现
+    struct utf8_validator
+    {
+        const char *name;
+        bool (*validate)(const unsigned char *, size_t);
+    };
+
+    utf8_validator select_validator()
+    {
+#ifdef UTF8_VALIDATOR_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return {"avx2", validate_avx2};
+        if (__builtin_cpu_supports("sse4.1"))
+            return {"sse4.1", validate_sse41};
+#endif
+        return {"scalar", validate_scalar};
+    }
+
+    const utf8_validator VALIDATOR = select_validator();
+}
+
+// 数据是否是有效的UTF-8
+bool is_valid_utf8(const char *data, size_t size)
+{
+    return VALIDATOR.validate(reinterpret_cast<const unsigned char *>(data), size);
+}
+
+// 运行时选择的实现
+const char *utf8_validator_name()
+{
+    return VALIDATOR.name;
+}
+
+// 从data[i]开始的有效UTF-8字符的字节数
+size_t utf8_sequence_length(const char *data, size_t i, size_t size)
+{
+    return sequence_length(reinterpret_cast<const unsigned char *>(data), i, size);
+}
+
+// 标量实现
+bool is_valid_utf8_scalar(const char *data, size_t size)
+{
+    return validate_scalar(reinterpret_cast<const unsigned char *>(data), size);
+}
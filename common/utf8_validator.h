@@ -0,0 +1,31 @@
+#ifndef CLIPBOARD_UTF8_VALIDATOR_H
+#define CLIPBOARD_UTF8_VALIDATOR_H
+
+#include <cstddef>
+#include <string>
+
+// 服务器和客户端共用的UTF-8校验，两边的构建都编译这一份源文件
+
+// 数据是否是有效的UTF-8，空数据也有效
+//
+// 按CPU能力在运行时选择实现：AVX2每次处理32字节，SSE4.1每次处理16字节，
+// 都用查表法(Keiser-Lemire)同时检查截断、过长编码、代理项和超出U+10FFFF的码点，
+// 纯ASCII的块只检查最高位；其他CPU使用逐字符的标量实现。
+bool is_valid_utf8(const char *data, size_t size);
+
+// 文本是否是有效的UTF-8
+inline bool is_valid_utf8(const std::string &text)
+{
+    return is_valid_utf8(text.data(), text.size());
+}
+
+// 运行时选择的实现，"avx2"、"sse4.1"或"scalar"
+const char *utf8_validator_name();
+
+// 逐字符的标量实现，ASCII按8字节一组跳过；用于对照测试和基准测试
+bool is_valid_utf8_scalar(const char *data, size_t size);
+
+// 从data[i]开始的有效UTF-8字符的字节数，无效或被截断时返回0，i必须小于size
+size_t utf8_sequence_length(const char *data, size_t i, size_t size);
+
+#endif
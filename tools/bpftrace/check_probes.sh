@@ -0,0 +1,67 @@
+#!/usr/bin/env bash
+# 检查bpftrace脚本挂载的USDT探针在二进制文件中存在，且参数个数不少于脚本用到的argN
+#
+# 用法: check_probes.sh <clipboard-server路径> <p2pboard_client路径>
+# 二进制文件必须在有<sys/sdt.h>的环境中构建，否则其中没有探针，检查失败。
+# 脚本中写的安装路径按文件名对应到参数给出的路径，不需要先安装。
+set -euo pipefail
+
+if [ $# -ne 2 ]; then
+    echo "用法: $0 <clipboard-server路径> <p2pboard_client路径>" >&2
+    exit 2
+fi
+
+declare -A binaries=([clipboard-server]="$1" [p2pboard_client]="$2")
+script_dir=$(dirname "$0")
+
+# 二进制文件中的探针："提供者:名称 参数个数"
+declare -A available
+for binary in "${binaries[@]}"; do
+    while read -r probe count; do
+        available[$probe]=$count
+    done < <(readelf -n "$binary" | awk '
+        /Provider:/ { provider = $2 }
+        /Name:/ { name = $2 }
+        /Arguments:/ { sub(/^.*Arguments: */, ""); print provider ":" name, NF }')
+done
+
+# 脚本中每个usdt探针块用到的最大参数编号："文件名 提供者:名称 参数个数"
+status=0
+for script in "$script_dir"/*.bt; do
+    while read -r file probe needed; do
+        have=${available[$probe]:-}
+        if [ -z "$have" ]; then
+            echo "$(basename "$script"): $file 中没有探针 $probe" >&2
+            status=1
+        elif [ "$have" -lt "$needed" ]; then
+            echo "$(basename "$script"): 探针 $probe 只有 $have 个参数，脚本用到 $needed 个" >&2
+            status=1
+        fi
+    done < <(awk '
+        function flush() { if (probe != "") print file, probe, max; probe = "" }
+        /^[A-Za-z]+:|^(BEGIN|END)/ {
+            flush()
+            if ($0 ~ /^usdt:/) {
+                split($1, parts, ":")
+                n = split(parts[2], path, "/")
+                file = path[n]
+                probe = parts[3] ":" parts[4]
+                max = 0
+            }
+            next
+        }
+        probe != "" {
+            line = $0
+            while (match(line, /arg[0-9]+/)) {
+                k = substr(line, RSTART + 3, RLENGTH - 3) + 1
+                if (k > max) max = k
+                line = substr(line, RSTART + RLENGTH)
+            }
+        }
+        END { flush() }' "$script")
+done
+
+if [ $status -eq 0 ]; then
+    echo "所有脚本的探针和参数个数都与二进制文件一致"
+fi
+exit $status